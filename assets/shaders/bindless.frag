@@ -0,0 +1,31 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_EXT_nonuniform_qualifier : require
+
+struct Material
+{
+	uint texture_count;
+	uint textures[7];
+};
+
+// All textures of bindless materials
+layout(binding = 0, set = 1) uniform sampler2D textures[];
+
+layout(std430, binding = 1, set = 1) readonly buffer Materials
+{
+	Material materials[];
+}
+materials;
+
+layout(location = 0) out vec4 out_color;
+layout(location = 1) in vec2 frag_uv;
+// Passed by the vertex shader so that regular and indirect draws share the fragment shader
+layout(location = 2) flat in vec4 frag_color;
+layout(location = 3) flat in uint frag_material;
+
+void main()
+{
+	Material material = materials.materials[frag_material];
+	// Entities of an instanced draw may use different materials
+	out_color = texture(textures[nonuniformEXT(material.textures[0])], frag_uv) * frag_color;
+}
@@ -0,0 +1,54 @@
+#version 450
+
+struct Camera
+{
+	vec4 position;
+	mat4 view;
+	mat4 proj;
+};
+
+struct Entity
+{
+	mat4 model;
+	vec4 color;
+	uint material;
+};
+
+layout(binding = 0) uniform UniformBufferObject
+{
+	vec4 background_color;
+	Camera cameras[8];
+	int camera_count;
+}
+scene;
+
+layout(std430, binding = 0, set = 2) readonly buffer Entities
+{
+	Entity entities[];
+}
+entities;
+
+layout(location = 0) in vec3 in_position;
+layout(location = 1) in vec2 in_uv;
+
+layout(location = 1) out vec2 frag_uv;
+layout(location = 2) flat out vec4 frag_color;
+layout(location = 3) flat out uint frag_material;
+
+// The index of the first entity, instanced draws add the instance index
+layout(push_constant) uniform ModelMatrix
+{
+	int index;
+}
+entity;
+
+void main()
+{
+	int index = entity.index + gl_InstanceIndex;
+	Entity entity = entities.entities[index];
+	Camera camera = scene.cameras[0];
+	gl_Position = camera.proj * camera.view * entity.model * vec4(in_position, 1.0);
+	frag_uv = in_uv;
+	frag_color = entity.color;
+	frag_material = entity.material;
+}
@@ -1,3 +1,7 @@
-C:/VulkanSDK/1.1.126.0/Bin/glslc.exe standard.vert -o standard.vert.spv
-C:/VulkanSDK/1.1.126.0/Bin/glslc.exe standard.frag -o standard.frag.spv
+C:/VulkanSDK/1.1.126.0/Bin/glslc.exe default.vert -o default.vert.spv
+C:/VulkanSDK/1.1.126.0/Bin/glslc.exe default.frag -o default.frag.spv
+C:/VulkanSDK/1.1.126.0/Bin/glslc.exe bindless.vert -o bindless.vert.spv
+C:/VulkanSDK/1.1.126.0/Bin/glslc.exe bindless.frag -o bindless.frag.spv
+C:/VulkanSDK/1.1.126.0/Bin/glslc.exe indirect.vert -o indirect.vert.spv
+C:/VulkanSDK/1.1.126.0/Bin/glslc.exe cull.comp -o cull.comp.spv
 echo "Compiling shaders"
\ No newline at end of file
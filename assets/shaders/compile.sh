@@ -1,3 +1,7 @@
-glslc standard.vert -o standard.vert.spv
-glslc standard.frag -o standard.frag.spv
+glslc default.vert -o default.vert.spv
+glslc default.frag -o default.frag.spv
+glslc bindless.vert -o bindless.vert.spv
+glslc bindless.frag -o bindless.frag.spv
+glslc indirect.vert -o indirect.vert.spv
+glslc cull.comp -o cull.comp.spv
 echo "Compiling shaders"
\ No newline at end of file
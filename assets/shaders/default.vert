@@ -12,6 +12,7 @@ struct Entity
 {
 	mat4 model;
 	vec4 color;
+	uint material;
 };
 
 layout(binding = 0) uniform UniformBufferObject
@@ -22,9 +23,9 @@ layout(binding = 0) uniform UniformBufferObject
 }
 scene;
 
-layout(binding = 0, set = 2) uniform Entities
+layout(std430, binding = 0, set = 2) readonly buffer Entities
 {
-	Entity entities[64];
+	Entity entities[];
 }
 entities;
 
@@ -0,0 +1,57 @@
+#version 450
+
+struct Camera
+{
+	vec4 position;
+	mat4 view;
+	mat4 proj;
+};
+
+struct Entity
+{
+	mat4 model;
+	vec4 color;
+	vec4 bounds;
+	uint material;
+	uint batch;
+};
+
+layout(binding = 0) uniform UniformBufferObject
+{
+	vec4 background_color;
+	Camera cameras[8];
+	int camera_count;
+}
+scene;
+
+// All resident entities, culled by cull.comp
+layout(std430, binding = 0, set = 2) readonly buffer Entities
+{
+	Entity entities[];
+}
+entities;
+
+// The indices of the visible entities, grouped by batch
+layout(std430, binding = 1, set = 2) readonly buffer Visible
+{
+	uint indices[];
+}
+visible;
+
+layout(location = 0) in vec3 in_position;
+layout(location = 1) in vec2 in_uv;
+
+layout(location = 1) out vec2 frag_uv;
+layout(location = 2) flat out vec4 frag_color;
+layout(location = 3) flat out uint frag_material;
+
+void main()
+{
+	// The first instance of each draw is the offset of its batch in the visible indices
+	Entity entity = entities.entities[visible.indices[gl_InstanceIndex]];
+	Camera camera = scene.cameras[0];
+	gl_Position = camera.proj * camera.view * entity.model * vec4(in_position, 1.0);
+	frag_uv = in_uv;
+	frag_color = entity.color;
+	frag_material = entity.material;
+}
@@ -0,0 +1,83 @@
+#ifndef BROADPHASE_H
+#define BROADPHASE_H
+#include "math/vec.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// Finds the pairs of overlapping bounding spheres each frame before exact collision tests
+// Uses sweep and prune, the spheres are sorted by their lower bound along the axis with the largest spread
+// and each sphere is only tested against the following spheres starting before its upper bound
+// To not test all spheres overlapping along the sweep axis, the other two axes are divided into a grid of columns
+// which are swept separately, a sphere is in every column its bounds overlap
+// The bounds are stored as separate arrays so that the sweep reads them linearly
+// The sweep is split into ranges of BROADPHASE_BATCH_SIZE spheres running as parallel jobs
+// Pairs are returned in the same order regardless of the thread count
+
+// The number of sorted spheres swept by a single job
+#define BROADPHASE_BATCH_SIZE 1024
+// The average number of spheres in a column
+#define BROADPHASE_COLUMN_SIZE 256
+// The maximum number of columns along each axis
+#define BROADPHASE_MAX_COLUMNS 64
+
+typedef struct Broadphase Broadphase;
+
+// Two overlapping spheres, a < b
+typedef struct BroadphasePair
+{
+	uint32_t a;
+	uint32_t b;
+} BroadphasePair;
+
+// The sphere first hit by a ray
+typedef struct BroadphaseHit
+{
+	uint32_t index;
+	// Along the normalized direction of the ray
+	float distance;
+	vec3 point;
+	// The surface normal of the sphere at point
+	vec3 normal;
+} BroadphaseHit;
+
+Broadphase* broadphase_create();
+
+// Sets the number of spheres
+// New spheres have a negative radius and are ignored until set
+void broadphase_set_count(Broadphase* broadphase, uint32_t count);
+uint32_t broadphase_get_count(Broadphase* broadphase);
+
+// Sets the bounding sphere at index, which needs to be less than the count
+// Spheres with a negative radius are ignored
+void broadphase_set(Broadphase* broadphase, uint32_t index, vec3 center, float radius);
+
+// Finds all pairs of overlapping spheres
+// Needs to be called from the main thread or from a job
+// Returns the number of pairs
+uint32_t broadphase_update(Broadphase* broadphase);
+
+// Prepares the spheres for queries without finding the pairs
+// The pairs of the last update are kept
+void broadphase_build(Broadphase* broadphase);
+
+// Returns the pairs found by the last update
+const BroadphasePair* broadphase_get_pairs(Broadphase* broadphase, uint32_t* count);
+
+// Queries test the spheres as of the last update or build and only search the columns they cross
+// Can be called from several threads at once, but not during an update or build
+// The overlap queries write up to max_results indices to results and return the total number found
+
+// Finds the spheres overlapping an axis aligned box
+uint32_t broadphase_query_box(const Broadphase* broadphase, vec3 box_min, vec3 box_max, uint32_t* results, uint32_t max_results);
+
+// Finds the spheres overlapping a sphere
+uint32_t broadphase_query_sphere(const Broadphase* broadphase, vec3 center, float radius, uint32_t* results, uint32_t max_results);
+
+// Finds the first sphere hit by a ray within max_distance
+// The ray walks through the columns it crosses and stops at the first column containing a hit
+// Spheres containing the origin are not hit
+// Returns false if nothing was hit
+bool broadphase_raycast(const Broadphase* broadphase, vec3 origin, vec3 direction, float max_distance, BroadphaseHit* hit);
+
+void broadphase_destroy(Broadphase* broadphase);
+#endif
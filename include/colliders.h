@@ -2,8 +2,24 @@
 #define COLLIDERS_H
 #include "math/vec.h"
 #include "transform.h"
+#include "broadphase.h"
+#include "graphics/model.h"
 #include <stdbool.h>
 
+// The maximum number of iterations of the intersection test and of the penetration depth search
+#define COLLIDER_GJK_ITERATIONS 64
+#define COLLIDER_EPA_ITERATIONS 64
+// The penetration depth is refined until it changes less than this
+#define COLLIDER_EPA_TOLERANCE 1e-4f
+// The most points describing the area of a contact
+#define COLLIDER_MAX_CONTACT_POINTS 4
+// The number of directions a collider is tilted in to find the corners of a contact
+#define COLLIDER_CONTACT_TILTS 4
+// The angle in radians colliders are tilted by
+#define COLLIDER_CONTACT_TILT_ANGLE 0.05f
+// Contact points closer than this are merged
+#define COLLIDER_CONTACT_MERGE_DISTANCE 0.01f
+
 // A 'virtual' struct working as a base for colliders
 // Contains function to assign for the different colliders to get points on the surface
 // A collider is bound to a transform
@@ -11,6 +27,9 @@
 typedef struct BaseCollider
 {
 	float (*get_distance)(struct BaseCollider*, vec3 direction);
+	// Returns the point on the surface furthest in direction in world space
+	// Used by the intersection tests, the direction does not need to be normalized
+	vec3 (*get_support)(const struct BaseCollider*, vec3 direction);
 	vec3 origin;
 	// The attached transform
 	const Transform* transform;
@@ -23,12 +42,87 @@ typedef struct SphereCollider
 
 } SphereCollider;
 
+// The colliders below are rotated and scaled with their transform, origin is the center in local space
+
+// A box with half the size along each local axis
+typedef struct BoxCollider
+{
+	struct BaseCollider base;
+	vec3 halfwidth;
+} BoxCollider;
+
+// A line segment along the local y axis swept by a sphere
+typedef struct CapsuleCollider
+{
+	struct BaseCollider base;
+	float radius;
+	// The length of the segment between the centers of the caps
+	float height;
+} CapsuleCollider;
+
+// The convex hull of a set of points
+typedef struct HullCollider
+{
+	struct BaseCollider base;
+	vec3* points;
+	uint32_t point_count;
+} HullCollider;
+
+// The result of an intersection between two colliders
+typedef struct Contact
+{
+	// The indices of the colliders, set by collider_intersect_pairs
+	uint32_t a;
+	uint32_t b;
+	// The direction to move b to separate it from a
+	vec3 normal;
+	// The distance b needs to be moved along normal
+	float depth;
+	// A point halfway between the deepest points of the colliders in world space
+	vec3 point;
+} Contact;
+
 SphereCollider spherecollider_create(float radius, vec3 origin, Transform* transform);
 
 // Returns true if two spheres collider_intersect
 // Faster than generic collision detection and useful for pruning
 bool spherecollider_intersect(const SphereCollider* a, const SphereCollider* b);
 
+BoxCollider boxcollider_create(vec3 halfwidth, vec3 origin, Transform* transform);
+
+CapsuleCollider capsulecollider_create(float radius, float height, vec3 origin, Transform* transform);
+
+// Creates a hull around points in local space
+// The points are copied and need to be freed with hullcollider_destroy
+HullCollider hullcollider_create(const vec3* points, uint32_t count, vec3 origin, Transform* transform);
+
+// Creates a hull around the vertices of the coarsest level of detail of a mesh
+HullCollider hullcollider_create_mesh(Mesh* mesh, Transform* transform);
+
+void hullcollider_destroy(HullCollider* hull);
+
 // Returns true if two colliders intersect
+// Uses the Gilbert-Johnson-Keerthi algorithm on the support functions of the colliders
+// Colliders touching without overlapping do not intersect
 bool collider_intersect(const BaseCollider* a, const BaseCollider* b);
-#endif
\ No newline at end of file
+
+// Returns true if two colliders intersect and finds the smallest translation separating them
+// The penetration is found by expanding the simplex of the intersection test into a polytope (EPA)
+// The indices of the contact are not set
+bool collider_penetration(const BaseCollider* a, const BaseCollider* b, Contact* contact);
+
+// Finds up to COLLIDER_MAX_CONTACT_POINTS points spanning the area where two colliders touch
+// A single point can not keep resting bodies from tipping over
+// The smaller collider is tilted slightly in several directions and the penetration found again
+// contact is the penetration found by collider_penetration
+// points and depths need to hold COLLIDER_MAX_CONTACT_POINTS, the depths are along the normal of the contact
+// Returns the number of points, the first is the point of contact
+uint32_t collider_contact_points(const BaseCollider* a, const BaseCollider* b, const Contact* contact, vec3* points, float* depths);
+
+// Finds the penetration of each pair of colliders in parallel on the job system
+// colliders is indexed by the indices of the pairs, for example the broadphase indices
+// contacts needs to hold count contacts, the intersecting pairs are written in order
+// Thread safe as long as the colliders and their transforms are not modified
+// Returns the number of contacts
+uint32_t collider_intersect_pairs(const BaseCollider* const* colliders, const BroadphasePair* pairs, uint32_t count, Contact* contacts);
+#endif
@@ -3,12 +3,19 @@
 
 // The maximum threads the renderer can use when building command buffers
 #define RENDERER_MAX_THREADS 4
-// The limit of entities in a tree before it splits
+// The default limit of entities in a tree node before it splits, see rendertree_set_limit
 #define RENDER_TREE_LIM 512
 
 #define MAX_FRAMES_IN_FLIGHT 3
 
 #define LENOF(l) (sizeof l / sizeof *l)
 
+// Declares a variable with one instance per thread
+#if PL_LINUX
+#define THREAD_LOCAL __thread
+#elif PL_WINDOWS
+#define THREAD_LOCAL __declspec(thread)
+#endif
+
 
 #endif
\ No newline at end of file
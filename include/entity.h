@@ -8,10 +8,20 @@
 #include "colliders.h"
 
 typedef struct Entity Entity;
+typedef struct Scene Scene;
+struct RenderTreeNode;
 
 // Creates an entity and adds it to the scene
 Entity* entity_create(const char* name, const char* material_name, const char* mesh_name, Transform transform, Rigidbody rigidbody);
 
+// Creates count entities sharing a name, material and mesh and adds them to the current scene at once
+// Unlike entity_create, the material and mesh are not looked up by name
+// rigidbodies can be NULL for stationary entities
+// mesh can be NULL for entities which are never rendered, such as in headless tools, their bounds are then a point
+// Writes the created entities to entities, which needs to hold count entities
+void entity_create_batch(const char* name, Material material, Mesh* mesh, const Transform* transforms, const Rigidbody* rigidbodies, uint32_t count,
+						 Entity** entities);
+
 const char* entity_get_name(Entity* entity);
 
 Transform* entity_get_transform(Entity* entity);
@@ -19,11 +29,38 @@ Rigidbody* entity_get_rigidbody(Entity* entity);
 Material entity_get_material(Entity* entity);
 Mesh* entity_get_mesh(Entity* entity);
 const SphereCollider* entity_get_boundingsphere(Entity* entity);
+
+// The collider used by physics, defaults to the bounding sphere
+// The collider is not copied or freed and needs to be bound to the transform of the entity
+const BaseCollider* entity_get_collider(Entity* entity);
+void entity_set_collider(Entity* entity, const BaseCollider* collider);
+
 vec4 entity_get_color(Entity* entity);
 
 void entity_set_color(Entity* entity, vec4 color);
 
+// The level of detail of the mesh drawn, selected by the render tree
+// Command buffers drawing the entity need to be re-recorded when it changes
+uint32_t entity_get_lod(Entity* entity);
+void entity_set_lod(Entity* entity, uint32_t lod);
+
+// Handled by scene
+// The slot of the entity in the entity list of its scene
+uint32_t entity_get_scene_index(Entity* entity);
+void entity_set_scene_index(Entity* entity, uint32_t index);
+
+// Handled by the render tree
+// The node holding the entity, NULL if it is not in the tree
+struct RenderTreeNode* entity_get_rendertree_node(Entity* entity);
+void entity_set_rendertree_node(Entity* entity, struct RenderTreeNode* node);
+
+// Handled by indirect
+// The slot of the entity in the resident GPU culling data, UINT32_MAX if it has none
+uint32_t entity_get_indirect_slot(Entity* entity);
+void entity_set_indirect_slot(Entity* entity, uint32_t slot);
+
 // Is called once a frame
+// The entity is moved by the physics of the scene
 void entity_update(Entity* entity);
 
 // Updates shader uniform for the entity from a mapped uniform buffer
@@ -33,6 +70,10 @@ void entity_update_shaderdata(Entity* entity, void* data_write, uint32_t index);
 // Index refers to the index of the entity in the uniform  buffer
 void entity_render(Entity* entity, Commandbuffer commandbuffer, uint32_t index, VkDescriptorSet data_descriptors);
 
+// Draws count entities sharing the mesh and a bindless pipeline with one instanced draw
+// The entities are expected to be consecutive in the uniform buffer starting at index
+void entity_render_instanced(Entity* entity, Commandbuffer commandbuffer, uint32_t index, uint32_t count, VkDescriptorSet data_descriptors);
+
 // Destroys and entity and removes it from the scene
 void entity_destroy(Entity* entity);
 #endif
\ No newline at end of file
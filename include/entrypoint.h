@@ -4,6 +4,7 @@
 #include <stdio.h>
 #include "magpie.h"
 #include "log.h"
+#include "jobs.h"
 #include <string.h>
 #include "application.h"
 #include "utils.h"
@@ -20,6 +21,7 @@ int main(int argc, char** argv)
 	}
 
 	log_init();
+	jobs_init(0);
 
 #ifdef DEBUG
 	LOG_S("Running in debug mode");
@@ -27,6 +29,8 @@ int main(int argc, char** argv)
 
 	application_start(argc, argv);
 
+	jobs_terminate();
+
 // Include allocation information on debug builds
 #ifdef DEBUG
 	//mp_print_locations();
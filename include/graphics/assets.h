@@ -0,0 +1,54 @@
+#ifndef ASSETS_H
+#define ASSETS_H
+#include <stdint.h>
+#include "graphics/material.h"
+
+// Loads assets in bulk using the job system
+// Textures are decoded and models are parsed on worker threads
+// The GPU uploads are batched and done on the main thread by assets_update
+
+// The maximum number of files loaded by a single assets_load_dir call
+#define ASSETS_DIR_MAX 512
+
+// Assets can be watched for changes and are then reloaded in place
+// Shaders, materials, textures and models keep their handles so nothing referencing them needs to be updated
+// Only the render tree nodes drawing affected materials or models are re-recorded
+// Watching uses inotify and is only supported on linux
+
+// The maximum number of directories watched
+#define ASSETS_MAX_WATCHES 256
+// The maximum number of distinct files reloaded per poll
+#define ASSETS_MAX_CHANGES 64
+// The maximum number of materials affected by a single changed file
+#define ASSETS_MAX_DEPENDENTS 256
+
+// Recursively starts loading all textures (.png, .jpg, .tga, .bmp) and models (.dae) in a directory
+// Returns immediately; the assets are pending until uploaded
+// Materials are not included since they depend on pipelines and should be loaded after with material_load
+// Returns the number of assets started
+uint32_t assets_load_dir(const char* dir);
+
+// Uploads all textures and models which have finished loading and reloads changed files if watching
+// Streams in requested texture levels
+// Called by renderer_begin every frame
+void assets_update();
+
+// Starts watching dir and all sub directories for modified assets
+// Changed shader binaries recreate the pipelines using them, changed shader sources are recompiled with glslc on the job system
+// Returns 0 on success
+int assets_watch(const char* dir);
+
+// Stops watching for changes
+void assets_unwatch();
+
+// Reloads all watched assets which have been written since the last poll
+// Returns the number of files reloaded
+uint32_t assets_poll_changes();
+
+// Re-records only the render tree nodes of the current scene drawing any of the materials
+void assets_mark_materials(Material* materials, uint32_t count);
+
+// Waits for all pending assets and shader compiles and uploads the assets
+void assets_wait();
+
+#endif
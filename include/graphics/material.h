@@ -1,6 +1,7 @@
 #ifndef MATERIAL_H
 #define MATERIAL_H
 #include <stdint.h>
+#include <stdbool.h>
 #include "graphics/commandbuffer.h"
 #include "graphics/uniforms.h"
 #include <vulkan/vulkan.h>
@@ -20,10 +21,55 @@ Material material_load(const char* file);
 // Returns a material that has been previosuly loaded into memory
 Material material_get(const char* name);
 
+// Returns the name the material is found by with material_get
+// Returns an empty string for invalid materials
+const char* material_get_name(Material mat);
+
 // Gets a default white material that can be used for whiteboxing
 // If default already exists, it is only returned (variable lookup)
 Material material_get_default();
 
+// Reloads a material from the file it was loaded from
+// The material is updated in place and keeps its handle
+// If the new version fails to load the previous one is kept
+// Returns 0 on success
+int material_reload(Material mat);
+
+// Finds all materials loaded from the file, or using a shader or texture from it
+// Writes at most size materials into result
+// Returns the number of materials found
+uint32_t material_find_dependents(const char* path, Material* result, uint32_t size);
+
+// Rewrites the descriptors of frame for materials whose texture views have been recreated
+// The descriptor sets of frame must not be in use by the GPU
+// Writes the updated materials into result, whose command buffers need to be re-recorded
+// At most size materials are updated, the rest are updated by the next call
+// Returns the number of materials updated
+uint32_t material_update_descriptors(uint32_t frame, Material* result, uint32_t size);
+
+// Requests the texture levels needed to draw the material over size pixels on screen
+void material_request_textures(Material mat, float size);
+
+// Returns the index of the material in the bindless material buffer
+// Materials opt into the bindless path with a "bindless" object specifying the bindless shaders
+// Returns 0 for materials using their own descriptors
+uint32_t material_get_bindless_index(Material mat);
+
+// Returns a key which is equal for materials sharing a pipeline, used to sort draws
+uintptr_t material_get_sort_key(Material mat);
+
+// Returns true if entities of both materials with the same mesh can be drawn in a single instanced draw
+// This is the case when both materials are bindless and share a pipeline
+bool material_can_batch(Material a, Material b);
+
+// Returns a key which is equal for materials sharing an indirect pipeline
+// Bindless materials get an indirect pipeline from the "indirectvertexshader" of their bindless object
+// Returns 0 if the material can not be drawn indirectly
+uintptr_t material_get_indirect_key(Material mat);
+
+// Binds the indirect pipeline with the global, bindless, and indirect_set descriptors
+void material_bind_indirect(Material mat, Commandbuffer commandbuffer, VkDescriptorSet indirect_set);
+
 // Bind the material's pipeline
 // Binds a material's descriptors for the specified frame
 // If frame is -1, the current frame to render will be used (result of renderer_get_frame)
@@ -5,6 +5,13 @@
 #include "graphics/commandbuffer.h"
 #include "graphics/vertexbuffer.h"
 
+// The maximum number of levels of detail of a mesh including the full mesh
+#define MESH_MAX_LODS 4
+// The error in pixels on screen a level of detail may have before a finer level is drawn
+#define MESH_LOD_PIXEL_ERROR 1.0f
+// Levels only change once their error crosses the threshold by this fraction to avoid popping back and forth
+#define MESH_LOD_HYSTERESIS 0.25f
+
 // A model contains several meshes loaded from collada
 typedef struct Model Model;
 // Represents a vertex and index buffer
@@ -14,9 +21,38 @@ typedef struct Mesh Mesh;
 // Can be accessed later by name
 void model_load_collada(const char* filepath);
 
+// Loads a model from a collada file without blocking
+// The model is inserted immediately but has no meshes until the file is parsed on a worker thread and uploaded by model_upload_pending
+// Returns NULL if a model with the same name exists
+Model* model_load_collada_async(const char* filepath);
+
+// Creates the meshes of all models which have finished parsing
+// Needs to be called from the main thread
+// Returns the number of models that were completed
+uint32_t model_upload_pending();
+
+// Waits for all pending models to be parsed and creates their meshes
+void model_wait_pending();
+
+// Returns true if the model is still being loaded
+int model_is_pending(Model* model);
+
+// Reloads all meshes of a model from the file it was loaded from
+// Existing meshes are updated in place and keep their pointers, new meshes are added
+// If the file fails to parse the previous meshes are kept
+// Returns 0 on success
+int model_reload(Model* model);
+
+// Finds a loaded model by the file it was loaded from
+// Returns NULL if no model was loaded from the file
+Model* model_find_file(const char* path);
+
 // Retrieves a model by name
 Model* model_get(const char* name);
 
+// Returns the name the model is retrieved by, the filename without extension for loaded models
+const char* model_get_name(Model* model);
+
 // Gets a mesh by index
 // Returns NULL if out of range
 Mesh* model_get_mesh(Model* model, uint32_t index);
@@ -35,17 +71,37 @@ void model_destroy(Model* model);
 void model_destroy_all();
 
 // @Meshes@
-// Binds a mesh
-void mesh_bind(Mesh* mesh, Commandbuffer commandbuffer);
+// Meshes share one vertex and index buffer which is bound once per command buffer with geometry_bind
 void mesh_draw(Mesh* mesh, Commandbuffer commandbuffer);
+// Draws count instances of a level of detail of a mesh, the shader offsets the entity index by gl_InstanceIndex
+void mesh_draw_instanced(Mesh* mesh, Commandbuffer commandbuffer, uint32_t lod, uint32_t count);
+// Selects the level of detail of a mesh covering size pixels on screen
+// Coarser levels are simplified when the mesh is created and are used while their error stays below MESH_LOD_PIXEL_ERROR
+// current is the level drawn previously, which is kept until the error crosses the threshold by MESH_LOD_HYSTERESIS
+uint32_t mesh_select_lod(Mesh* mesh, float size, uint32_t current);
+// Returns the model owning the mesh or NULL
+Model* mesh_get_model(Mesh* mesh);
+// Returns the name of the mesh within its model
+const char* mesh_get_name(Mesh* mesh);
 // Returns the furthest dimenstion of the mesh
 // Useful for bound generation
 float mesh_max_distance(Mesh* mesh);
 uint32_t mesh_get_index_count(Mesh* mesh);
 uint32_t mesh_get_vertex_count(Mesh* mesh);
+uint32_t mesh_get_lod_count(Mesh* mesh);
+// Returns the offset of a level's indices in the shared index buffer, used as firstIndex of draws
+uint32_t mesh_get_lod_first_index(Mesh* mesh, uint32_t lod);
+uint32_t mesh_get_lod_index_count(Mesh* mesh, uint32_t lod);
+// Returns the offset of the mesh's vertices in the shared vertex buffer, used as vertexOffset of draws
+uint32_t mesh_get_first_vertex(Mesh* mesh);
+// Gets the triangles of the full detail level, kept on the CPU for occlusion culling
+// The indices reference the returned positions in object space
+// Returns the index count
+uint32_t mesh_get_occluder(Mesh* mesh, const vec3** positions, const uint32_t** indices);
 
 // Gets a mesh by 'modelname:meshname' if only modelname is supplied, the first mesh of the model is returned
 Mesh* mesh_find(const char* name);
+// Generates the levels of detail of the mesh by quadric simplification
 Mesh* mesh_create(const char* name, Vertex* vertices, uint32_t vertex_count, uint32_t* indices, uint32_t index_count);
 // Destroys a mesh
 // Note: mesh should not be owned by a model when calling destroy
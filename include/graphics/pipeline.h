@@ -2,12 +2,20 @@
 #define PIPELINE_H
 #include "graphics/vertexbuffer.h"
 #include <vulkan/vulkan.h>
+#include <stdbool.h>
+
+// The maximum length of a shader path
+#define PIPELINE_PATH_MAX 256
+// The maximum number of descriptor set layouts of a pipeline
+#define PIPELINE_MAX_DESCRIPTOR_LAYOUTS 4
+// Where the pipeline cache is saved between runs
+#define PIPELINE_CACHE_PATH "./cache/pipelines.bin"
 
 struct PipelineInfo
 {
-	char vertexshader[4096];
-	char fragmentshader[4096];
-	char geometryshader[4096];
+	char vertexshader[PIPELINE_PATH_MAX];
+	char fragmentshader[PIPELINE_PATH_MAX];
+	char geometryshader[PIPELINE_PATH_MAX];
 
 	VkDescriptorSetLayout* descriptor_layouts;
 	uint32_t descriptor_layout_count;
@@ -22,11 +30,24 @@ typedef struct Pipeline Pipeline;
 
 // Creates a pipeline from info
 // If a pipeline using that info already exists, it is returned instead
+// Pipelines are identified by the full info, including descriptor layouts and vertex description
+// Descriptor layouts are compared by handle, layouts from descriptorlayout_get are the same for the same bindings
+// The pipeline is compiled on a worker thread and the first bind waits for it
+// Returns NULL if the layout could not be created
 Pipeline* pipeline_get(struct PipelineInfo* info);
+
+// Waits for the pipeline to finish compiling
+void pipeline_wait(Pipeline* pipeline);
+
+// Waits for all pipelines to finish compiling
+// Needs to be called before destroying the render pass
+void pipeline_wait_all();
 void pipeline_destroy(Pipeline* pipeline);
 // Destroys all loaded pipelines
 void pipeline_destroy_all();
 
+// Binds the pipeline, waiting for it to compile if necessary
+// Nothing is bound if compilation failed
 void pipeline_bind(Pipeline* pipeline, VkCommandBuffer command_buffer);
 // Returns the internal pipeline layout
 VkPipelineLayout pipeline_get_layout(Pipeline* pipeline);
@@ -34,7 +55,24 @@ VkPipelineLayout pipeline_get_layout(Pipeline* pipeline);
 // Recreates a pipeline from the same info as creation but with updated swapchain data
 void pipeline_recreate(Pipeline* pipeline);
 
-// Recreates all pipelines
+// Recreates all pipelines in parallel
 void pipeline_recreate_all();
 
+// Creates the pipeline cache used by all pipeline compilations
+// The cache is loaded from PIPELINE_CACHE_PATH if it was saved by the same driver and device
+// Called by graphics_init
+void pipeline_cache_init();
+
+// Saves the pipeline cache to PIPELINE_CACHE_PATH and destroys it
+// Called by graphics_terminate
+void pipeline_cache_terminate();
+
+// Recreates all pipelines using the compiled shader file
+// Waits for the device to be idle if any pipeline is affected
+// Returns the number of pipelines recreated
+uint32_t pipeline_reload_shader(const char* path);
+
+// Returns true if any stage of the pipeline is loaded from path
+bool pipeline_uses_shader(Pipeline* pipeline, const char* path);
+
 #endif
\ No newline at end of file
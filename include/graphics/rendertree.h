@@ -24,21 +24,27 @@ typedef struct RenderTreeNode
 	struct RenderTreeNode* parent;
 
 	// Entity data
+	// Grows with the entities and is freed when the node is empty
 	uint32_t entity_count;
-	Entity* entities[RENDER_TREE_LIM];
+	uint32_t entity_capacity;
+	Entity** entities;
 
 	// The framebuffer it is currently rendering to
 	Framebuffer framebuffers[3];
 
-	// Contains all RENDER_TREE_LIM entities data
+	// Contains the data of entity_data_capacity entities
+	// Created when the node first renders and given to other nodes when it becomes empty
 	Commandbuffer commandbuffers[3];
 	UniformBuffer* entity_data;
+	uint32_t entity_data_capacity;
 	// Set 2
 	DescriptorPack* entity_data_descriptors;
 
 	// A bit field of which frames should be rebuilt
 	int changed : 3;
 	uint8_t thread_idx;
+	// The number of updates in a row the subtree has been small enough to merge
+	uint8_t merge_delay;
 } RenderTreeNode;
 
 // Returns the single binding for the descriptor set
@@ -49,6 +55,13 @@ uint32_t rendertree_get_descriptor_binding_count(void);
 // Returns a descriptor layout
 VkDescriptorSetLayout rendertree_get_descriptor_layout(void);
 
+// Sets the number of entities a node holds before it splits, defaults to RENDER_TREE_LIM
+// Nodes at the deepest level hold more instead
+// The entity data of a node is a storage buffer, so its size is not bound by maxUniformBufferRange
+// Existing nodes follow the limit as entities move
+void rendertree_set_limit(uint32_t limit);
+uint32_t rendertree_get_limit(void);
+
 // Creates a rendertree root node for a thread
 // Note, only the render thread with the correct index should use this
 // All children inherit the thread index
@@ -61,6 +74,7 @@ void rendertree_destroy(RenderTreeNode* node);
 
 // Updates the tree recursively from node(root)
 // Re-places entities
+// Merges subtrees which held fewer than half of the limit of entities for several updates
 // Queues swapchain recreation
 void rendertree_update(RenderTreeNode* node, uint32_t frame);
 
@@ -68,13 +82,19 @@ void rendertree_update(RenderTreeNode* node, uint32_t frame);
 // Records secondary into primary command buffers
 void rendertree_render(RenderTreeNode* node, Commandbuffer primary, Camera* camera, uint32_t frame);
 
+// Marks all nodes from node containing an entity for which func returns true as changed
+// The secondary command buffers of those nodes are re-recorded for every frame
+// Returns the number of nodes marked
+uint32_t rendertree_mark_changed(RenderTreeNode* node, bool (*func)(Entity* entity, void* arg), void* arg);
+
 // Splits the node into 8 children
 // If the node is root, the children are assigned separate threads
 void rendertree_subdivide(RenderTreeNode* node);
-// Joins all children
+// Joins all children and their descendants into node
 void rendertree_merge(RenderTreeNode* node);
 
-// Returns true if an enitty is fully contained given node
+// Returns true if the center of the bounding sphere of an entity is inside node
+// Entities are placed by their centers, the bounds culled are gathered from the entities of each node
 // Entity cannot exist in any node when performing calling this function
 bool rendertree_fits(RenderTreeNode* node, Entity* entity);
 
@@ -97,4 +117,24 @@ bool rendertree_place_down(RenderTreeNode* node, Entity* entity);
 // Loops up until it fits, and then down with rendertree_place_down
 bool rendertree_place_up(RenderTreeNode* node, Entity* entity);
 
+// Places a batch of entities into the tree below root at once
+// The batch is split between the children recursively, so nodes are subdivided once instead of for each entity
+// Entities not fitting root are skipped
+// Note: the entities cannot exist in the tree when running this function
+// Returns the number of entities placed
+uint32_t rendertree_place_batch(RenderTreeNode* root, Entity* const* entities, uint32_t count);
+
+// Builds the tree below root from scratch for all entities of the tree
+// The entities are sorted by the Morton codes of their centers in parallel jobs, and each node takes a consecutive range
+// Nodes are subdivided until they hold at most the limit of entities, nodes no longer needed are destroyed
+// Nodes whose entities did not change are kept as they are and not re-recorded
+// Cheaper than re-placing the entities one by one when most of them move
+// Entities not fitting root are skipped
+// Returns the number of entities placed
+uint32_t rendertree_build(RenderTreeNode* root, Entity* const* entities, uint32_t count);
+
+// Removes an entity from the node holding it
+// Does nothing if the entity is not in the tree
+void rendertree_remove(Entity* entity);
+
 #endif
\ No newline at end of file
@@ -7,8 +7,6 @@
 
 // Defines the maximum amount of cameras in a scene
 #define CAMERA_MAX 8
-// Defines the maximum amount of entities rendering in a scene
-#define ENTITY_MAX 64
 
 //@Shader Types@ Defines several structs to match shader uniform structs
 
@@ -28,10 +26,63 @@ struct CameraData
 	mat4 proj;
 };
 
+// Defines the maximum amount of textures of a bindless material
+#define MATERIAL_TEXTURE_MAX 7
+
 struct EntityData
 {
 	mat4 model_matrix;
 	vec4 color;
+	// The index of the material in the bindless material buffer
+	uint32_t material_index;
+	uint32_t padding[3];
+};
+
+// Defines a material in the bindless material buffer
+// Textures are indices into the bindless texture array
+struct MaterialData
+{
+	uint32_t texture_count;
+	uint32_t textures[MATERIAL_TEXTURE_MAX];
+};
+
+// Defines an entity culled and drawn on the GPU
+struct IndirectEntityData
+{
+	mat4 model_matrix;
+	vec4 color;
+	// The world space center and radius of the bounding sphere
+	vec4 bounds;
+	uint32_t material_index;
+	// The indirect draw the entity belongs to
+	uint32_t batch;
+	uint32_t padding[2];
+};
+
+// Defines an indirect draw in the cull shader
+struct IndirectBatchData
+{
+	// The index of the first visible entity of the draw, passed as its first instance
+	uint32_t offset;
+	// The number of visible entities, counted by the cull shader and reset when the draw is written
+	uint32_t count;
+	// The pipeline group of the batch, UINT32_MAX for unused batches
+	uint32_t group;
+	// The draw command of the batch if the draws of a group are not compacted
+	uint32_t command;
+	uint32_t index_count;
+	uint32_t first_index;
+	int32_t vertex_offset;
+	uint32_t padding;
+};
+
+// Defines the draws of the batches sharing an indirect pipeline
+struct IndirectGroupData
+{
+	// The first draw command of the group
+	uint32_t first;
+	// The number of draws with visible entities, counted by the cull shader
+	uint32_t draw_count;
 };
 
 // Defines scene data in the shader
@@ -24,21 +24,95 @@ typedef enum
 
 #include "vulkan/vulkan.h"
 
+// Upper bound for maxLod that does not clamp the mip chain
+#define SAMPLER_LOD_MAX 1000.0f
+
+// The maximum number of mip levels generated for loaded textures
+#define TEXTURE_MAX_MIP_LEVELS 16
+
 // Returns a sampler with the specified options
 // If a sampler with options doesn't exist it is created and stored
-Sampler sampler_get(SamplerFilterMode filterMode, SamplerWrapMode wrapMode, int maxAnisotropy);
+// Samplers are shared and reference counted, each call needs to be matched by sampler_destroy
+// Linear filtering also blends between mip levels
+// minLod and maxLod clamp the sampled mip levels, lodBias is added to the computed level
+Sampler sampler_get(SamplerFilterMode filterMode, SamplerWrapMode wrapMode, int maxAnisotropy, float minLod, float maxLod, float lodBias);
 
 VkSampler sampler_get_vksampler(Sampler sampler);
 
+// Releases a reference to the sampler
+// The sampler is destroyed when the last reference is released
 void sampler_destroy(Sampler sampler);
 
-// Destroys all samplers
+// Destroys all samplers regardless of references
 void sampler_destroy_all();
 
 DEFINE_HANDLE(Texture);
+
+typedef enum
+{
+	// The texture is uploaded and can be used
+	TEXTURE_STATE_READY,
+	// The texture is being decoded or waiting for upload
+	TEXTURE_STATE_PENDING,
+	// The texture failed to load and has no image
+	TEXTURE_STATE_FAILED
+} TextureState;
+
+// The directory cooked textures are stored in
+#define TEXTURE_CACHE_DIR "./cache/textures/"
+
+// Textures loaded from files with a mip chain are streamed if the texture budget setting is not 0
+// Levels up to TEXTURE_STREAM_MIN_SIZE are always resident, finer levels are uploaded when requested by the renderer
+// When the budget is exceeded, levels of the least recently used textures are evicted
+// The budget only covers the levels of streamed textures, render targets are not included
+
+// Levels with no side larger than this are always resident
+#define TEXTURE_STREAM_MIN_SIZE 64
+// The maximum number of textures changing resident levels each frame
+#define TEXTURE_STREAM_MAX_UPDATES 8
+
+typedef struct TextureStreamStats
+{
+	VkDeviceSize budget;
+	// The size of all resident levels of streamed textures
+	VkDeviceSize resident_bytes;
+	// The size needed to hold all levels requested last frame
+	VkDeviceSize requested_bytes;
+	uint32_t texture_count;
+	// Textures resident at a coarser level than requested
+	uint32_t starved_count;
+	// Totals since startup
+	uint64_t loads;
+	uint64_t evictions;
+	uint64_t uploaded_bytes;
+} TextureStreamStats;
+
 // Loads a texture from a file
 // The textures name is the full file path
+// If texture compression is enabled the cooked file in TEXTURE_CACHE_DIR is mapped and uploaded directly
+// The texture is cooked first if the cooked file is missing or was cooked from a different version of the source
 Texture texture_load(const char* file);
+
+// Loads a texture from a file without blocking
+// The returned handle is pending until the file is decoded on a worker thread and uploaded by texture_upload_pending
+// Requesting the image view of a pending texture waits for it to be uploaded
+Texture texture_load_async(const char* file);
+
+// Uploads all textures which have finished decoding in a single batch
+// Needs to be called from the main thread
+// Returns the number of textures that were uploaded
+uint32_t texture_upload_pending();
+
+// Waits for all pending textures to be decoded and uploads them
+void texture_wait_pending();
+
+TextureState texture_get_state(Texture tex);
+
+// Compresses a texture file with its mip chain into TEXTURE_CACHE_DIR
+// The block format is chosen by the texture compression setting and whether the texture has alpha
+// Can be used to cook textures ahead of time
+// Returns -1 on failure or if compression is disabled or unsupported
+int texture_cook(const char* file);
 // Creates a texture from low level arguments
 // The contents of the texture is undefined until texture_update is called
 // If name is not NULL it shall be a unique name to get the texture by name later
@@ -55,6 +129,8 @@ Texture texture_create(const char* name, int width, int height, VkFormat format,
 Texture texture_create_existing(const char* name, int width, int height, VkFormat format, VkSampleCountFlagBits samples, VkImageLayout layout, VkImage image, VkImageAspectFlags imageAspect);
 
 // Updates the texture data from host memory
+// pixeldata holds the base level in RGBA8, from which the mip levels and any block compression are built
+// Textures in other formats are not updated
 void texture_update(Texture tex, uint8_t* pixeldata);
 
 // Resizes a texture
@@ -72,6 +148,15 @@ bool texture_owns_image(Texture tex);
 // Attempts to find a texture by name
 Texture texture_get(const char* name);
 
+// Finds a loaded texture by the file it was loaded from
+// Returns INVALID(Texture) if no texture was loaded from the file
+Texture texture_find_file(const char* path);
+
+// Reloads the pixels of a texture from its file, keeping the same handle
+// Returns 1 if the image view was recreated due to a size change and descriptors using it need to be rewritten
+// Returns 0 if only the contents were updated and -1 on failure
+int texture_reload(Texture tex);
+
 // This will remove the texture if it exists from the internal texture table
 // The resource needs to be freed explicitely
 
@@ -81,4 +166,23 @@ void texture_destroy(Texture tex);
 void texture_destroy_all();
 
 void* texture_get_image_view(Texture tex);
+
+// Returns a number which changes every time the image view of the texture is recreated
+// Descriptors written with an older version need to be rewritten
+uint32_t texture_get_view_version(Texture tex);
+
+// Returns true if the texture budget setting enables streaming
+bool texture_stream_enabled();
+
+// Requests the levels needed to draw the texture over size pixels on screen for the next texture_stream_update
+// The largest request of the frame is used
+// Does nothing for textures that are not streamed
+void texture_stream_request(Texture tex, float size);
+
+// Uploads requested levels and evicts the least recently used ones to stay within budget
+// Old images are destroyed when no frame in flight can reference them
+// Called by assets_update every frame
+void texture_stream_update();
+
+void texture_stream_get_stats(TextureStreamStats* stats);
 #endif
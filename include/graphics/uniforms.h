@@ -4,23 +4,26 @@
 #include "math/mat4.h"
 #include <vulkan/vulkan.h>
 #include "graphics/texture.h"
+#include "defines.h"
 #include <stdint.h>
 
 #define CS_WHOLE_SIZE  (uint32_t)-1
 
-typedef struct DescriptorPool DescriptorPool;
+// Descriptor sets are pooled by their bindings and recycled when destroyed
+// The maximum number of bindings in one set
+#define DESCRIPTOR_CLASS_MAX_BINDINGS 16
+// The number of sets in the first pool of each binding layout, later pools double up to the maximum
+#define DESCRIPTOR_POOL_MIN_SETS 32
+#define DESCRIPTOR_POOL_MAX_SETS 1024
+// The number of frames before a destroyed set is reused
+#define DESCRIPTOR_RETIRE_FRAMES (MAX_FRAMES_IN_FLIGHT + 1)
 
 // A struct containing an entire descriptor set and data of where it is from
 // Contains descriptor sets for all possible frames in flight
 typedef struct
 {
-	// Handle to the pool it allocated from
-	uint32_t pool_index;
-	// The sum of uniform_count and sampler_count describes the 'size' of the pool it takes
-	// Represents how many uniform types is allocated
-	uint32_t uniform_count;
-	// Represents how many sampler types is allocated
-	uint32_t sampler_count;
+	// The binding layout class it was allocated from
+	uint32_t class_index;
 
 	// How many descriptor set it holds
 	uint32_t count;
@@ -33,7 +36,14 @@ typedef struct UniformBuffer UniformBuffer;
 // Used when creating descriptors and during pipeline creation
 int descriptorlayout_create(VkDescriptorSetLayoutBinding* bindings, uint32_t binding_count, VkDescriptorSetLayout* dst_layout);
 
+// Returns the layout of the descriptor class for the bindings, which is the same for all callers with the same bindings
+// Pipelines created with it are shared by identical bindings
+// The layout is owned by the descriptor pools and must not be destroyed
+// Returns VK_NULL_HANDLE on failure
+VkDescriptorSetLayout descriptorlayout_get(VkDescriptorSetLayoutBinding* bindings, uint32_t binding_count);
+
 // Creates multiple descriptors, one for each frame in flight (swapchain_image_count)
+// The sets are compatible with any layout created from the same bindings
 DescriptorPack* descriptorpack_create(VkDescriptorSetLayout layout, VkDescriptorSetLayoutBinding* bindings, uint32_t binding_count);
 
 // Writes the buffers and samplers to each frame's descriptor as specified in bindings
@@ -44,9 +54,23 @@ DescriptorPack* descriptorpack_create(VkDescriptorSetLayout layout, VkDescriptor
 void descriptorpack_write(DescriptorPack* pack, VkDescriptorSetLayoutBinding* bindings, uint32_t binding_count, UniformBuffer** uniformbuffers,
 						  Texture* textures, Sampler* samplers);
 
-// Destroys a descriptor pack, and if necessary, destroy the pool
+// Same as descriptorpack_write but only writes the descriptor set of a single frame
+// The set must not be in use by a command buffer pending execution
+void descriptorpack_write_frame(DescriptorPack* pack, VkDescriptorSetLayoutBinding* bindings, uint32_t binding_count, UniformBuffer** uniformbuffers,
+								Texture* textures, Sampler* samplers, uint32_t frame);
+
+// Destroys a descriptor pack
+// The sets are reused by later packs with the same bindings once no frame in flight can use them
 void descriptorpack_destroy(DescriptorPack* pack);
 
+// Recycles the sets of packs destroyed DESCRIPTOR_RETIRE_FRAMES ago
+// Called by renderer_begin every frame
+void descriptorpool_update();
+
+// Destroys all descriptor pools and the sets in them
+// The device needs to be idle
+void descriptorpool_destroy_all();
+
 // Creates and allocates memory for a uniform buffer
 // Internally holds one buffer per frame in flight to avoid simultaneous read and writes
 // Uniform buffer is completely agnostic to the shader layout and binding
@@ -54,6 +78,11 @@ void descriptorpack_destroy(DescriptorPack* pack);
 // As the buffer memory is pooled, you cannot map two buffers simultaneously as they might share the same memory, just at different offsets. thread_idx fixes making sure two buffers with a different thread index don't share the same memory
 UniformBuffer* ub_create(uint32_t size, uint8_t thread_idx);
 
+// Creates a buffer like ub_create, but as a storage buffer
+// Storage buffers are not limited to maxUniformBufferRange and are bound to VK_DESCRIPTOR_TYPE_STORAGE_BUFFER bindings
+// Mapped, updated, and destroyed with the ub functions
+UniformBuffer* sb_create(uint32_t size, uint8_t thread_idx);
+
 // Maps the uniform buffer data for specified frame and returns a pointer to it
 // Note: you can not map the same frame simulataneously
 void* ub_map(UniformBuffer* ub, uint32_t offset, uint32_t size, uint32_t frame);
@@ -0,0 +1,68 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <stdint.h>
+
+// The job system runs small functions on a fixed pool of worker threads
+// Each thread, including the main thread, owns a work stealing deque
+// Idle threads steal jobs from the other deques
+// Jobs may only be submitted from the main thread or from inside other jobs
+
+// The maximum number of threads, including the main thread
+#define JOBS_MAX_THREADS 64
+// The number of jobs that can be queued on a single thread
+// If the queue is full the job is executed immediately instead
+// Needs to be a power of two
+#define JOBS_QUEUE_SIZE 4096
+
+// A counter tracks the number of unfinished jobs submitted with it
+// Needs to be zero initialized
+// Can be waited for or used as a dependency for other jobs
+typedef struct
+{
+	volatile int32_t value;
+} JobCounter;
+
+// A single job
+typedef void (*JobFunc)(void* arg);
+
+// A job executing a range [begin, end) of a parallel for
+typedef void (*JobRangeFunc)(void* arg, uint32_t begin, uint32_t end);
+
+// Starts the worker threads
+// If thread_count is 0, one worker per core except the calling thread will be created
+// Needs to be called from the main thread
+// Multiple calls are safe as they are ignored
+int jobs_init(uint32_t thread_count);
+
+// Waits for all queued jobs and stops the worker threads
+void jobs_terminate();
+
+// Returns the number of threads executing jobs, including the main thread
+uint32_t jobs_thread_count();
+
+// Returns the index of the calling thread
+// The main thread has index 0 and workers 1 to jobs_thread_count() - 1
+uint32_t jobs_thread_idx();
+
+// Queues a job on the calling thread
+// counter, if not NULL, is incremented and decremented when the job completes
+void job_submit(JobFunc func, void* arg, JobCounter* counter);
+
+// Queues a job that will not start until dependency has reached zero
+// The job is parked without blocking the calling thread and queued by the job bringing dependency to zero
+// dependency needs to stay valid until the job has started
+void job_submit_after(JobCounter* dependency, JobFunc func, void* arg, JobCounter* counter);
+
+// Executes other jobs until counter reaches zero
+void job_wait(JobCounter* counter);
+
+// Splits [0, count) into batches of batch_size and queues a job for each
+// If batch_size is 0, the batch size is chosen from the thread count
+// counter, if not NULL, is incremented for each batch
+void job_parallel_for_async(uint32_t count, uint32_t batch_size, JobRangeFunc func, void* arg, JobCounter* counter);
+
+// Same as job_parallel_for_async but waits for all batches to complete
+void job_parallel_for(uint32_t count, uint32_t batch_size, JobRangeFunc func, void* arg);
+
+#endif
@@ -1,6 +1,7 @@
 #ifndef LOG_H
 #define LOG_H
 
+#include <stdio.h>
 #include <string.h>
 
 #if PL_LINUX
@@ -30,6 +31,19 @@
 // Multiple calls are safe as they are ignored
 int log_init();
 
+// Log file modes
+// -> text : every message is formatted and written to stdout and ./logs/*.log
+// -> binary : normal and status messages only record the format string id and raw arguments to ./logs/*.blog
+//    Warnings and above are still formatted and printed to stdout
+//    The format strings of normal and status messages need to be string literals since they are identified by address
+//    Use log_decode or tools/logdecode to convert the file to text
+#define LOG_MODE_TEXT	0
+#define LOG_MODE_BINARY 1
+
+// Sets the log file mode
+// Needs to be called before log_init to take effect
+void log_set_mode(int mode);
+
 // Should be called at the end of the program
 // Flushes and closes the log file correctly
 // Multiple calls are safe as they are ignored
@@ -61,6 +75,11 @@ int log_get_count(int severity);
 
 int log_call(int severity, const char* name, const char* fmt, ...);
 
+// Decodes a binary log file into text in the same format as the text mode
+// The file needs to be decoded on a machine with the same endianness as it was written
+// Returns 0 on success and -1 if the file is not a binary log or is truncated
+int log_decode(FILE* in, FILE* out);
+
 // Continues the previous log call
 #define LOG_CONT(fmt, ...) log_call(-1, NULL, fmt, ##__VA_ARGS__)
 
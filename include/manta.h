@@ -6,14 +6,17 @@
 #include "event.h"
 #include "cr_time.h"
 #include "timer.h"
+#include "jobs.h"
 #include "window.h"
 #include "settings.h"
 #include "input.h"
 #include "log.h"
 #include "scene.h"
+#include "scenefile.h"
 
 #include "graphics/graphics.h"
 #include "graphics/material.h"
 #include "graphics/model.h"
+#include "graphics/assets.h"
 #include "graphics/renderer.h"
 #endif
\ No newline at end of file
@@ -0,0 +1,83 @@
+#ifndef PHYSICS_H
+#define PHYSICS_H
+#include "broadphase.h"
+#include "colliders.h"
+#include "rigidbody.h"
+
+// Simulates rigidbodies at a fixed timestep independent of the framerate
+// Each step adds gravity and forces to the velocities, finds contacts with the broadphase and the colliders,
+// solves the contacts and moves the bodies by their velocities
+// Contacts are solved with sequential impulses, each contact is solved in turn for several iterations
+// while the total impulse of a contact is clamped to only push the bodies apart
+// Contacts start with the impulses of the last step, which lets stacks come to rest with few iterations
+// Dynamic bodies touching each other form islands which don't share any dynamic body and are solved in parallel jobs
+// Kinematic bodies don't join islands since contacts don't change their velocity
+// Islands which stay still for PHYSICS_SLEEP_TIME fall asleep and are not moved until touched by an awake body
+
+// The duration of a step in seconds
+#define PHYSICS_TIMESTEP (1 / 60.0f)
+// The most steps taken by an update, the simulation slows down instead of falling further behind
+#define PHYSICS_MAX_STEPS 4
+// The number of times the contacts of an island are solved each step
+#define PHYSICS_ITERATIONS 10
+// Contact points closer than this to a point of the last step start with its impulses
+#define PHYSICS_MATCH_DISTANCE 0.05f
+// The part of the penetration corrected each step
+#define PHYSICS_BAUMGARTE 0.2f
+// The penetration allowed without correction, keeps resting contacts from jittering
+#define PHYSICS_SLOP 0.01f
+// Contacts approaching slower than this don't bounce
+#define PHYSICS_RESTITUTION_VELOCITY 1.0f
+// Bodies moving slower than this, in units or radians per second, are resting
+#define PHYSICS_SLEEP_VELOCITY 0.05f
+#define PHYSICS_SLEEP_TIME 0.5f
+
+// A body simulated by the physics
+typedef struct PhysicsBody
+{
+	Rigidbody* rigidbody;
+	Transform* transform;
+	// The shape tested for contacts
+	const BaseCollider* collider;
+	// Encloses the collider, used by the broadphase
+	const SphereCollider* bounds;
+} PhysicsBody;
+
+typedef struct Physics Physics;
+
+Physics* physics_create();
+
+// Defaults to 9.81 downwards
+void physics_set_gravity(Physics* physics, vec3 gravity);
+vec3 physics_get_gravity(Physics* physics);
+
+// Advances the simulation by delta seconds in fixed steps
+// The time left over is carried to the next update
+// The bodies are indexed the same way by the overlaps and contacts and need to stay in the same order between updates
+// Needs to be called from the main thread
+// Returns the number of steps taken
+uint32_t physics_update(Physics* physics, const PhysicsBody* bodies, uint32_t count, float delta);
+
+// Advances the simulation by a single step of dt seconds
+void physics_step(Physics* physics, const PhysicsBody* bodies, uint32_t count, float dt);
+
+// Keeps the contacts of the last step, which the next step starts from, in line with the bodies
+// Call when the body at index is removed from count bodies by moving the last body into its place
+// The contacts of the removed body are dropped
+void physics_remove_body(Physics* physics, uint32_t index, uint32_t count);
+
+// Returns the pairs of bodies whose bounds overlapped at the last step
+const BroadphasePair* physics_get_overlaps(Physics* physics, uint32_t* count);
+
+// Returns the contacts solved at the last step
+// Contacts between kinematic or sleeping bodies are not searched for
+const Contact* physics_get_contacts(Physics* physics, uint32_t* count);
+
+// Returns the broadphase holding the bounds of the bodies as of the last step, for spatial queries
+const Broadphase* physics_get_broadphase(Physics* physics);
+
+// Returns the number of islands solved at the last step
+uint32_t physics_get_island_count(Physics* physics);
+
+void physics_destroy(Physics* physics);
+#endif
@@ -2,14 +2,68 @@
 #define RIGIDBODY_H
 #include "math/vec.h"
 #include "transform.h"
+#include <stdbool.h>
 
+// A rigidbody is either dynamic, moved by forces and contacts, or kinematic
+// Kinematic bodies have no mass and are only moved by their velocity, stationary bodies are kinematic without velocity
+// Bodies are simulated at a fixed timestep by the physics of the scene
 typedef struct Rigidbody
 {
 	vec3 velocity;
-	/* data */
+	// The rotation per second around each world axis in radians
+	vec3 angular_velocity;
+	// Zero for kinematic bodies
+	float inverse_mass;
+	// The inverse of the principal moments of inertia along the local axes
+	vec3 inverse_inertia;
+	// Applied and cleared at the next step
+	vec3 force;
+	vec3 torque;
+	// The part of the velocity kept when bouncing
+	float restitution;
+	float friction;
+	// The time the body has been nearly still
+	float rest_time;
+	// Sleeping bodies are not moved until something touches them
+	bool asleep;
 } Rigidbody;
 
 static const Rigidbody rigidbody_stationary = {.velocity = (vec3){0, 0, 0}};
 
-void rigidbody_update(Rigidbody* rigidbody, Transform* transform);
-#endif
\ No newline at end of file
+// Creates a dynamic body
+// inertia are the principal moments of inertia along the local axes, see rigidbody_inertia_box and rigidbody_inertia_sphere
+// A mass of zero creates a kinematic body
+Rigidbody rigidbody_create(float mass, vec3 inertia, float restitution, float friction);
+
+// Returns the moments of inertia of a solid box with halfwidth
+vec3 rigidbody_inertia_box(float mass, vec3 halfwidth);
+
+// Returns the moments of inertia of a solid sphere
+vec3 rigidbody_inertia_sphere(float mass, float radius);
+
+static inline bool rigidbody_is_dynamic(const Rigidbody* rigidbody)
+{
+	return rigidbody->inverse_mass > 0;
+}
+
+// Applies a force at the center of mass during the next step
+void rigidbody_add_force(Rigidbody* rigidbody, vec3 force);
+
+// Applies a force at a point in world space during the next step
+void rigidbody_add_force_at(Rigidbody* rigidbody, const Transform* transform, vec3 force, vec3 point);
+
+// Changes the velocity immediately by an impulse at a point in world space
+void rigidbody_add_impulse(Rigidbody* rigidbody, const Transform* transform, vec3 impulse, vec3 point);
+
+// Wakes up a sleeping body
+void rigidbody_wake(Rigidbody* rigidbody);
+
+// Multiplies a world space vector with the inverse inertia tensor of the body rotated by transform
+vec3 rigidbody_apply_inverse_inertia(const Rigidbody* rigidbody, const Transform* transform, vec3 v);
+
+// Adds gravity and the accumulated forces to the velocity of dynamic bodies and clears the forces
+void rigidbody_integrate_forces(Rigidbody* rigidbody, const Transform* transform, vec3 gravity, float dt);
+
+// Moves and rotates transform by the velocities
+void rigidbody_update(Rigidbody* rigidbody, Transform* transform, float dt);
+#endif
@@ -3,10 +3,28 @@
 #include "entity.h"
 #include "graphics/camera.h"
 #include "graphics/rendertree.h"
+#include "physics.h"
 // A scene contains all entities
 // The scene makes sure to render and update all entities
 typedef struct Scene Scene;
 
+typedef struct Ray
+{
+	vec3 origin;
+	vec3 direction;
+	float max_distance;
+} Ray;
+
+// The entity first hit by a ray
+typedef struct RaycastHit
+{
+	// NULL if nothing was hit
+	Entity* entity;
+	float distance;
+	vec3 point;
+	vec3 normal;
+} RaycastHit;
+
 // Creates an empty scene
 // If no scene is set as current, the newly created scene will be set as current
 Scene* scene_create(const char* name);
@@ -21,12 +39,18 @@ Scene* scene_get_current();
 // Handled automatically by entity
 void scene_add_entity(Scene* scene, Entity* entity);
 
+// Handled automatically by entity_create_batch
+// Adds count entities with a single allocation and places them into the render tree at once
+void scene_add_entities(Scene* scene, Entity* const* entities, uint32_t count);
+
 // Handled automatically by entity
-// Removes an entity from the scene
+// Removes an entity from the scene and the render tree in constant time
+// The last entity takes the index of the removed one
 // Note: this does not destroy the entity
 void scene_remove_entity(Scene* scene, Entity* entity);
 
-// Finds an entity in the scene by name
+// Finds an entity in the scene by name with a hash lookup
+// If several entities share the name, the first one added is returned while it is in the scene
 // Returns NULL if it doesn't exist
 Entity* scene_find_entity(Scene* scene, const char* name);
 
@@ -34,6 +58,9 @@ Entity* scene_find_entity(Scene* scene, const char* name);
 // Returns NULL if out of bounds
 Entity* scene_get_entity(Scene* scene, uint32_t index);
 
+// Returns the number of entities in the scene, the entities are at indices below it
+uint32_t scene_get_entity_count(Scene* scene);
+
 // Adds a camera to the scene
 // Note: there cannot be more than CAMERA_MAX cameras in a scene due to shaderdata constraints
 void scene_add_camera(Scene* scene, Camera* camera);
@@ -44,9 +71,52 @@ Camera* scene_get_camera(Scene* scene, uint32_t index);
 
 RenderTreeNode* scene_get_rendertree(Scene* scene);
 
+// Rebuilds the render tree from scratch each update instead of re-placing the entities that moved
+// Faster for scenes where most entities move each frame, defaults to false
+void scene_set_rendertree_rebuild(Scene* scene, bool rebuild);
+
+// Returns the physics simulating the rigidbodies of the entities
+Physics* scene_get_physics(Scene* scene);
+
 // Updates all entities and cameras in the scene
+// Advances the physics by the time of the last frame in fixed steps
 void scene_update(Scene* scene);
 
+// Returns the pairs of entities whose bounding spheres overlapped at the last physics step
+// The pairs hold the indices of the entities for scene_get_entity
+// Valid until the next update or until entities are added or removed
+const BroadphasePair* scene_get_overlaps(Scene* scene, uint32_t* count);
+
+// Returns the contacts between the colliders of entities found at the last physics step
+// Contacts between kinematic or sleeping entities are not searched for
+// Valid until the next update or until entities are added or removed
+const Contact* scene_get_contacts(Scene* scene, uint32_t* count);
+
+// Spatial queries test the bounding spheres of the entities with a broadphase of their own
+// It is rebuilt by the first query after entities were added or removed or the scene was updated,
+// so entities moved by hand in between are found where they were at that query
+// Entity indices returned are valid until entities are added or removed
+// The queries can be issued from several threads, but not while the scene is updated or entities are added or removed
+
+// Finds the first entity whose bounding sphere is hit by a ray within max_distance
+// Entities whose bounding sphere contains the origin are not hit
+// Returns false if nothing was hit
+bool scene_raycast(Scene* scene, vec3 origin, vec3 direction, float max_distance, RaycastHit* hit);
+
+// Casts count rays split across the job system, hits[i] is the result of rays[i]
+// Blocks until all rays are cast
+void scene_raycast_batch(Scene* scene, const Ray* rays, uint32_t count, RaycastHit* hits);
+
+// Finds the entities whose bounding sphere overlaps a sphere
+// Writes up to max_results entity indices for scene_get_entity to results
+// Returns the total number of entities found, which can be more than max_results
+uint32_t scene_overlap_sphere(Scene* scene, vec3 center, float radius, uint32_t* results, uint32_t max_results);
+
+// Finds the entities whose bounding sphere overlaps an axis aligned box
+// Writes up to max_results entity indices for scene_get_entity to results
+// Returns the total number of entities found, which can be more than max_results
+uint32_t scene_overlap_aabb(Scene* scene, vec3 box_min, vec3 box_max, uint32_t* results, uint32_t max_results);
+
 // Will destroy all entities in the scene
 void scene_destroy_entities(Scene* scene);
 
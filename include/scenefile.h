@@ -0,0 +1,34 @@
+#ifndef SCENEFILE_H
+#define SCENEFILE_H
+#include "scene.h"
+
+// Scenes are saved as chunked binary snapshots which are loaded straight from the mapped file
+// A file starts with a header holding the magic "MSCN", the format version and the number of chunks and entities
+// Each chunk starts with an id, its own version and its size, and is padded to SCENEFILE_ALIGN bytes
+// Unknown chunks are skipped, so chunks can be added without breaking older readers
+// Chunks with a newer version than SCENEFILE_VERSION are skipped as well, the file fails to load if a required one is skipped
+// The entities are stored as a structure of arrays, one array per member holding an element for each entity
+// Materials and meshes are referenced by name through a string table and looked up when loading
+// Cameras and colliders set with entity_set_collider are not saved
+// The data is written in the byte order of the machine, which is little endian on all supported platforms
+
+// The version written, files with a newer version are not loaded
+#define SCENEFILE_VERSION 1
+#define SCENEFILE_ALIGN	  16
+
+// Saves the entities of a scene to a binary file
+// Returns 0 on success
+int scene_save(Scene* scene, const char* path);
+
+// Adds the entities of a file written by scene_save to scene
+// The entity data is decoded from the mapped file in parallel jobs
+// Consecutive entities sharing a name, material and mesh are created as one batch
+// Entities whose mesh is not loaded are skipped
+// Returns 0 on success
+int scene_load(Scene* scene, const char* path);
+
+// Writes the entities of a scene as readable XML for debugging
+// Much larger and slower than scene_save, and can not be loaded
+// Returns 0 on success
+int scene_export_xml(Scene* scene, const char* path);
+#endif
@@ -9,6 +9,16 @@ enum VsyncMode
 	VSYNC_TRIPLE
 };
 
+enum TextureCompression
+{
+	// Textures are uploaded uncompressed as RGBA8
+	TEXTURE_COMPRESSION_NONE,
+	// BC1 for opaque textures and BC3 for textures with alpha
+	TEXTURE_COMPRESSION_BC1_BC3,
+	// BC7 for all textures, higher quality but twice the size of BC1 for opaque textures
+	TEXTURE_COMPRESSION_BC7
+};
+
 void settings_load();
 void settings_save();
 
@@ -16,9 +26,23 @@ ivec2 settings_get_resolution();
 int settings_get_window_style();
 enum VsyncMode settings_get_vsync();
 int settings_get_msaa();
+enum TextureCompression settings_get_texture_compression();
+// The budget for streamed textures in MB, 0 disables streaming
+int settings_get_texture_budget();
+// Nonzero to cull and draw entities with bindless materials on the GPU with indirect draws
+int settings_get_gpu_culling();
+// Nonzero to skip entities hidden behind large entities drawn the previous frame
+int settings_get_occlusion_culling();
+// The number of entities a render tree node holds before it splits
+int settings_get_rendertree_limit();
 
 void settings_set_resolution(ivec2 res);
 void settings_set_window_style(int ws);
 void settings_set_vsync(enum VsyncMode mode);
 void settings_set_msaa(int samples);
+void settings_set_texture_compression(enum TextureCompression compression);
+void settings_set_texture_budget(int megabytes);
+void settings_set_gpu_culling(int enabled);
+void settings_set_occlusion_culling(int enabled);
+void settings_set_rendertree_limit(int limit);
 #endif
\ No newline at end of file
@@ -2,6 +2,7 @@
 #define UTILS_H
 #include "magpie.h"
 #include <stdarg.h>
+#include <stdint.h>
 
 // Contains utility functions used by the engine
 
@@ -48,6 +49,26 @@ size_t read_fileb(const char* path, char* buf);
 // Changes the working directory
 void set_workingdir(const char* dir);
 
+// Returns 1 if both paths refer to the same file
+// Resolves relative paths and separators
+int path_equal(const char* path1, const char* path2);
+
+// Returns the last modification time of a file in seconds
+// Returns -1 if the file doesn't exist
+int64_t file_mtime(const char* path);
+
+// Identifies a version of a file by its modification time and size
+// The time has the finest resolution of the platform, nanoseconds on Linux and 100ns intervals on Windows
+// Returns -1 if the file doesn't exist
+int file_stamp(const char* path, uint64_t* mtime, uint64_t* size);
+
+// Maps a file read only into memory and writes its length to size
+// Returns NULL if the file doesn't exist or is empty
+// Needs to be unmapped with unmap_file
+void* map_file(const char* path, size_t* size);
+
+void unmap_file(void* data, size_t size);
+
 // Goes back or up one directory in the file tree
 // Does not include the last dir delimeter
 void dir_up(const char* path, char* result, size_t size, size_t steps);
@@ -32,27 +32,45 @@ int application_start(int argc, char** argv)
 	time_init();
 
 	Scene* scene = scene_create("main");
-	model_load_collada("./assets/models/cube.dae");
-	model_load_collada("./assets/models/multiple.dae");
+	// Parse the models in the background while the materials load
+	model_load_collada_async("./assets/models/cube.dae");
+	model_load_collada_async("./assets/models/multiple.dae");
 	material_load("./assets/materials/concrete.json");
 	material_load("./assets/materials/grid.json");
+	assets_wait();
+
+#ifdef DEBUG
+	// Reload assets in place when they are modified
+	assets_watch("./assets");
+#endif
 
 	Camera* camera = camera_create_perspective("main", (Transform){(vec3){0, 0, 10}}, window_get_aspect(window), 1.5, 0.1, 100);
 
 	Entity* entity1 = entity_create("entity1", "grid", "cube", (Transform){(vec3){0, 0, -10}, quat_identity, vec3_one}, rigidbody_stationary);
 
-	(void)entity_create("entity2", "concrete", "cube", (Transform){(vec3){4, 0, -10}, quat_identity, vec3_one}, (Rigidbody){.velocity = (vec3){-5, 0, 0}});
+	Entity* entity2 = entity_create("entity2", "concrete", "cube", (Transform){(vec3){4, 0, -10}, quat_identity, vec3_one}, (Rigidbody){.velocity = (vec3){-5, 0, 0}});
 
 	Entity* entity3 = entity_create("suzanne", "concrete", "multiple:Suzanne", (Transform){(vec3){0, 0, 3}, quat_identity, vec3_one}, rigidbody_stationary);
 
+	// Spawn the cubes in one batch
+	Transform* transforms = malloc(10000 * sizeof *transforms);
+	Rigidbody* rigidbodies = malloc(10000 * sizeof *rigidbodies);
+	Entity** entities = malloc(10000 * sizeof *entities);
 	for (int i = 0; i < 10000; i++)
 	{
-		Entity* e = entity_create("multiple", "concrete", "cube", (Transform){vec3_add(vec3_random_sphere_even(10, 200), (vec3){0, -0, 0}), quat_identity, (vec3){0.5f, 0.5f, 0.5f}},
-								  (Rigidbody){.velocity = vec3_random_sphere(0, 1)});
+		transforms[i] = (Transform){vec3_add(vec3_random_sphere_even(10, 200), (vec3){0, -0, 0}), quat_identity, (vec3){0.5f, 0.5f, 0.5f}};
+		rigidbodies[i] = (Rigidbody){.velocity = vec3_random_sphere(0, 1)};
+	}
+	entity_create_batch("multiple", material_get("concrete"), mesh_find("cube"), transforms, rigidbodies, 10000, entities);
 
+	for (int i = 0; i < 10000; i++)
+	{
 		// Assign a random color
-		entity_set_color(e, vec4_hsv(rand() / (float)RAND_MAX * 2 * M_PI, rand() / (float)RAND_MAX, rand() / (float)RAND_MAX));
+		entity_set_color(entities[i], vec4_hsv(rand() / (float)RAND_MAX * 2 * M_PI, rand() / (float)RAND_MAX, rand() / (float)RAND_MAX));
 	}
+	free(transforms);
+	free(rigidbodies);
+	free(entities);
 
 	while (!window_get_close(window))
 	{
@@ -106,17 +124,23 @@ int application_start(int argc, char** argv)
 
 		time_update();
 
-		//const SphereCollider* bound1 = entity_get_boundingsphere(entity1);
-		//const SphereCollider* bound2 = entity_get_boundingsphere(entity2);
-
-		/*if (spherecollider_intersect(bound1, bound2))
+		// Log when entity2 passes through entity1
+		static bool colliding = false;
+		bool collision = false;
+		uint32_t overlap_count = 0;
+		const BroadphasePair* overlaps = scene_get_overlaps(scene, &overlap_count);
+		for (uint32_t i = 0; i < overlap_count; i++)
 		{
-			LOG("Colliding");
+			Entity* a = scene_get_entity(scene, overlaps[i].a);
+			Entity* b = scene_get_entity(scene, overlaps[i].b);
+			if ((a == entity1 && b == entity2) || (a == entity2 && b == entity1))
+				collision = true;
 		}
-		else
+		if (collision != colliding)
 		{
-			LOG("Not Colliding");
-		}*/
+			colliding = collision;
+			LOG(colliding ? "Colliding" : "Not Colliding");
+		}
 
 		renderer_submit(scene);
 
@@ -0,0 +1,597 @@
+#include "broadphase.h"
+#include "jobs.h"
+#include "log.h"
+#include "magpie.h"
+#include <string.h>
+#include <math.h>
+
+// The pairs found by one batch of the sweep
+struct BroadphaseBatch
+{
+	BroadphasePair* pairs;
+	uint32_t count;
+	uint32_t size;
+};
+
+struct Broadphase
+{
+	uint32_t count;
+	uint32_t size;
+	// The spheres by index
+	float* x;
+	float* y;
+	float* z;
+	float* radius;
+
+	// The grid of columns across the two axes other than the sweep axis
+	uint32_t axis;
+	float column_origin[2];
+	float column_width[2];
+	uint32_t column_count[2];
+	// The first entry of each column, and the largest radius in it to bound searches by lower bound
+	uint32_t column_start[BROADPHASE_MAX_COLUMNS * BROADPHASE_MAX_COLUMNS + 1];
+	float column_radius[BROADPHASE_MAX_COLUMNS * BROADPHASE_MAX_COLUMNS];
+
+	// The entries of the spheres in each column they overlap, sorted by column and then by lower bound
+	// min and max are the bounds along the sweep axis, u and v the center along the other axes
+	uint32_t entry_count;
+	uint32_t entry_size;
+	uint32_t* entry_column;
+	uint32_t* entry_index;
+	float* entry_min;
+	float* entry_max;
+	float* entry_u;
+	float* entry_v;
+	float* entry_radius;
+	// Scratch space for sorting
+	uint64_t* keys;
+	uint64_t* keys_tmp;
+	uint32_t* index_tmp;
+
+	struct BroadphaseBatch* batches;
+	uint32_t batch_count;
+
+	BroadphasePair* pairs;
+	uint32_t pair_count;
+	uint32_t pair_size;
+};
+
+Broadphase* broadphase_create()
+{
+	Broadphase* broadphase = calloc(1, sizeof(Broadphase));
+	return broadphase;
+}
+
+void broadphase_set_count(Broadphase* broadphase, uint32_t count)
+{
+	if (count > broadphase->size)
+	{
+		uint32_t size = broadphase->size ? broadphase->size : 64;
+		while (size < count)
+			size *= 2;
+
+		broadphase->x = realloc(broadphase->x, size * sizeof *broadphase->x);
+		broadphase->y = realloc(broadphase->y, size * sizeof *broadphase->y);
+		broadphase->z = realloc(broadphase->z, size * sizeof *broadphase->z);
+		broadphase->radius = realloc(broadphase->radius, size * sizeof *broadphase->radius);
+		broadphase->size = size;
+	}
+
+	for (uint32_t i = broadphase->count; i < count; i++)
+		broadphase->radius[i] = -1.0f;
+	broadphase->count = count;
+}
+
+uint32_t broadphase_get_count(Broadphase* broadphase)
+{
+	return broadphase->count;
+}
+
+void broadphase_set(Broadphase* broadphase, uint32_t index, vec3 center, float radius)
+{
+	if (index >= broadphase->count)
+	{
+		LOG_E("Broadphase index %d out of range of %d spheres", index, broadphase->count);
+		return;
+	}
+	broadphase->x[index] = center.x;
+	broadphase->y[index] = center.y;
+	broadphase->z[index] = center.z;
+	broadphase->radius[index] = radius;
+}
+
+static void broadphase_reserve_entries(Broadphase* broadphase, uint32_t count)
+{
+	if (count <= broadphase->entry_size)
+		return;
+
+	uint32_t size = broadphase->entry_size ? broadphase->entry_size : 64;
+	while (size < count)
+		size *= 2;
+
+	broadphase->entry_column = realloc(broadphase->entry_column, size * sizeof *broadphase->entry_column);
+	broadphase->entry_index = realloc(broadphase->entry_index, size * sizeof *broadphase->entry_index);
+	broadphase->entry_min = realloc(broadphase->entry_min, size * sizeof *broadphase->entry_min);
+	broadphase->entry_max = realloc(broadphase->entry_max, size * sizeof *broadphase->entry_max);
+	broadphase->entry_u = realloc(broadphase->entry_u, size * sizeof *broadphase->entry_u);
+	broadphase->entry_v = realloc(broadphase->entry_v, size * sizeof *broadphase->entry_v);
+	broadphase->entry_radius = realloc(broadphase->entry_radius, size * sizeof *broadphase->entry_radius);
+	broadphase->keys = realloc(broadphase->keys, size * sizeof *broadphase->keys);
+	broadphase->keys_tmp = realloc(broadphase->keys_tmp, size * sizeof *broadphase->keys_tmp);
+	broadphase->index_tmp = realloc(broadphase->index_tmp, size * sizeof *broadphase->index_tmp);
+	broadphase->entry_size = size;
+}
+
+// Maps a float to an unsigned integer with the same order
+static uint32_t broadphase_float_key(float f)
+{
+	uint32_t u;
+	memcpy(&u, &f, sizeof u);
+	return u & 0x80000000 ? ~u : u | 0x80000000;
+}
+
+// Sorts the indices by their keys with a least significant digit radix sort
+// The result is in keys and index
+static void broadphase_radix_sort(uint64_t* keys, uint32_t* index, uint64_t* keys_tmp, uint32_t* index_tmp, uint32_t count)
+{
+	for (uint32_t shift = 0; shift < 64 && count; shift += 8)
+	{
+		uint32_t offsets[256] = {0};
+		for (uint32_t i = 0; i < count; i++)
+			offsets[(keys[i] >> shift) & 0xff]++;
+
+		// All keys share the digit
+		if (offsets[(keys[0] >> shift) & 0xff] == count)
+			continue;
+
+		uint32_t sum = 0;
+		for (uint32_t i = 0; i < 256; i++)
+		{
+			uint32_t digit_count = offsets[i];
+			offsets[i] = sum;
+			sum += digit_count;
+		}
+
+		for (uint32_t i = 0; i < count; i++)
+		{
+			uint32_t dst = offsets[(keys[i] >> shift) & 0xff]++;
+			keys_tmp[dst] = keys[i];
+			index_tmp[dst] = index[i];
+		}
+
+		memcpy(keys, keys_tmp, count * sizeof *keys);
+		memcpy(index, index_tmp, count * sizeof *index);
+	}
+}
+
+// Returns the column along grid axis 0 or 1 containing value
+static uint32_t broadphase_column(const Broadphase* broadphase, uint32_t axis, float value)
+{
+	float column = (value - broadphase->column_origin[axis]) / broadphase->column_width[axis];
+	if (column < 1.0f)
+		return 0;
+	if (column >= broadphase->column_count[axis])
+		return broadphase->column_count[axis] - 1;
+	return (uint32_t)column;
+}
+
+// Picks the sweep axis and fits the grid of columns to the spheres
+// Returns the sweep axis
+static uint32_t broadphase_fit_grid(Broadphase* broadphase)
+{
+	float* axes[3] = {broadphase->x, broadphase->y, broadphase->z};
+
+	// Sweep along the axis with the largest variance, which separates the most spheres
+	double sum[3] = {0}, sqr_sum[3] = {0};
+	float lower[3] = {0}, upper[3] = {0};
+	uint32_t count = 0;
+	for (uint32_t i = 0; i < broadphase->count; i++)
+	{
+		if (broadphase->radius[i] < 0.0f)
+			continue;
+		for (uint32_t a = 0; a < 3; a++)
+		{
+			float value = axes[a][i];
+			sum[a] += value;
+			sqr_sum[a] += (double)value * value;
+			lower[a] = count == 0 || value < lower[a] ? value : lower[a];
+			upper[a] = count == 0 || value > upper[a] ? value : upper[a];
+		}
+		count++;
+	}
+
+	uint32_t axis = 0;
+	double best = -1.0;
+	for (uint32_t a = 0; a < 3 && count; a++)
+	{
+		double variance = sqr_sum[a] / count - (sum[a] / count) * (sum[a] / count);
+		if (variance > best)
+		{
+			best = variance;
+			axis = a;
+		}
+	}
+
+	// Split the centers of the other axes evenly
+	uint32_t columns = (uint32_t)sqrtf((float)count / BROADPHASE_COLUMN_SIZE);
+	columns = columns < 1 ? 1 : columns > BROADPHASE_MAX_COLUMNS ? BROADPHASE_MAX_COLUMNS : columns;
+	for (uint32_t i = 0; i < 2; i++)
+	{
+		uint32_t a = (axis + 1 + i) % 3;
+		float width = (upper[a] - lower[a]) / columns;
+		broadphase->column_origin[i] = lower[a];
+		broadphase->column_width[i] = width > 0.0f ? width : 1.0f;
+		broadphase->column_count[i] = width > 0.0f ? columns : 1;
+	}
+
+	return axis;
+}
+
+// Inserts the spheres into the columns they overlap and sorts them in sweep order
+static void broadphase_sort(Broadphase* broadphase)
+{
+	uint32_t axis = broadphase_fit_grid(broadphase);
+	broadphase->axis = axis;
+	const float* axes[3] = {broadphase->x, broadphase->y, broadphase->z};
+	const float* sweep = axes[axis];
+	const float* u = axes[(axis + 1) % 3];
+	const float* v = axes[(axis + 2) % 3];
+	const float* radius = broadphase->radius;
+
+	uint32_t count = 0;
+	for (uint32_t i = 0; i < broadphase->count; i++)
+	{
+		if (radius[i] < 0.0f)
+			continue;
+		uint32_t u_count = broadphase_column(broadphase, 0, u[i] + radius[i]) - broadphase_column(broadphase, 0, u[i] - radius[i]) + 1;
+		uint32_t v_count = broadphase_column(broadphase, 1, v[i] + radius[i]) - broadphase_column(broadphase, 1, v[i] - radius[i]) + 1;
+		count += u_count * v_count;
+	}
+	broadphase_reserve_entries(broadphase, count);
+
+	count = 0;
+	for (uint32_t i = 0; i < broadphase->count; i++)
+	{
+		if (radius[i] < 0.0f)
+			continue;
+
+		uint64_t key = broadphase_float_key(sweep[i] - radius[i]);
+		uint32_t u0 = broadphase_column(broadphase, 0, u[i] - radius[i]);
+		uint32_t u1 = broadphase_column(broadphase, 0, u[i] + radius[i]);
+		uint32_t v0 = broadphase_column(broadphase, 1, v[i] - radius[i]);
+		uint32_t v1 = broadphase_column(broadphase, 1, v[i] + radius[i]);
+		for (uint32_t cv = v0; cv <= v1; cv++)
+		{
+			for (uint32_t cu = u0; cu <= u1; cu++)
+			{
+				uint64_t column = cv * broadphase->column_count[0] + cu;
+				broadphase->keys[count] = column << 32 | key;
+				broadphase->entry_index[count] = i;
+				count++;
+			}
+		}
+	}
+
+	broadphase_radix_sort(broadphase->keys, broadphase->entry_index, broadphase->keys_tmp, broadphase->index_tmp, count);
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		uint32_t index = broadphase->entry_index[i];
+		broadphase->entry_column[i] = broadphase->keys[i] >> 32;
+		broadphase->entry_min[i] = sweep[index] - radius[index];
+		broadphase->entry_max[i] = sweep[index] + radius[index];
+		broadphase->entry_u[i] = u[index];
+		broadphase->entry_v[i] = v[index];
+		broadphase->entry_radius[i] = radius[index];
+	}
+	broadphase->entry_count = count;
+
+	uint32_t column_count = broadphase->column_count[0] * broadphase->column_count[1];
+	memset(broadphase->column_start, 0, (column_count + 1) * sizeof *broadphase->column_start);
+	memset(broadphase->column_radius, 0, column_count * sizeof *broadphase->column_radius);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		uint32_t column = broadphase->entry_column[i];
+		broadphase->column_start[column + 1]++;
+		if (broadphase->entry_radius[i] > broadphase->column_radius[column])
+			broadphase->column_radius[column] = broadphase->entry_radius[i];
+	}
+	for (uint32_t i = 0; i < column_count; i++)
+		broadphase->column_start[i + 1] += broadphase->column_start[i];
+}
+
+// Tests the entries [begin, end) against the following entries of the same column overlapping on the sweep axis
+static void broadphase_sweep(void* arg, uint32_t begin, uint32_t end)
+{
+	Broadphase* broadphase = arg;
+	struct BroadphaseBatch* batch = &broadphase->batches[begin / BROADPHASE_BATCH_SIZE];
+	batch->count = 0;
+
+	const uint32_t* column = broadphase->entry_column;
+	const float* min = broadphase->entry_min;
+	const float* max = broadphase->entry_max;
+	const float* u = broadphase->entry_u;
+	const float* v = broadphase->entry_v;
+	const float* radius = broadphase->entry_radius;
+	for (uint32_t i = begin; i < end; i++)
+	{
+		for (uint32_t j = i + 1; j < broadphase->entry_count && column[j] == column[i] && min[j] <= max[i]; j++)
+		{
+			float d0 = (min[j] + radius[j]) - (min[i] + radius[i]);
+			float d1 = u[j] - u[i];
+			float d2 = v[j] - v[i];
+			float radii = radius[i] + radius[j];
+			if (d0 * d0 + d1 * d1 + d2 * d2 >= radii * radii)
+				continue;
+
+			// Spheres sharing several columns are reported by the column containing the lower corner of the overlap of their bounds
+			float overlap_u = u[i] - radius[i] > u[j] - radius[j] ? u[i] - radius[i] : u[j] - radius[j];
+			float overlap_v = v[i] - radius[i] > v[j] - radius[j] ? v[i] - radius[i] : v[j] - radius[j];
+			if (broadphase_column(broadphase, 1, overlap_v) * broadphase->column_count[0] + broadphase_column(broadphase, 0, overlap_u) != column[i])
+				continue;
+
+			if (batch->count >= batch->size)
+			{
+				batch->size = batch->size ? batch->size * 2 : 64;
+				batch->pairs = realloc(batch->pairs, batch->size * sizeof *batch->pairs);
+			}
+
+			uint32_t a = broadphase->entry_index[i];
+			uint32_t b = broadphase->entry_index[j];
+			batch->pairs[batch->count++] = a < b ? (BroadphasePair){a, b} : (BroadphasePair){b, a};
+		}
+	}
+}
+
+void broadphase_build(Broadphase* broadphase)
+{
+	broadphase_sort(broadphase);
+}
+
+uint32_t broadphase_update(Broadphase* broadphase)
+{
+	broadphase_sort(broadphase);
+
+	uint32_t batch_count = (broadphase->entry_count + BROADPHASE_BATCH_SIZE - 1) / BROADPHASE_BATCH_SIZE;
+	if (batch_count > broadphase->batch_count)
+	{
+		broadphase->batches = realloc(broadphase->batches, batch_count * sizeof *broadphase->batches);
+		memset(broadphase->batches + broadphase->batch_count, 0, (batch_count - broadphase->batch_count) * sizeof *broadphase->batches);
+		broadphase->batch_count = batch_count;
+	}
+
+	job_parallel_for(broadphase->entry_count, BROADPHASE_BATCH_SIZE, broadphase_sweep, broadphase);
+
+	// Concatenate the batches in sweep order
+	uint32_t pair_count = 0;
+	for (uint32_t i = 0; i < batch_count; i++)
+		pair_count += broadphase->batches[i].count;
+
+	if (pair_count > broadphase->pair_size)
+	{
+		broadphase->pair_size = pair_count;
+		broadphase->pairs = realloc(broadphase->pairs, broadphase->pair_size * sizeof *broadphase->pairs);
+	}
+
+	broadphase->pair_count = 0;
+	for (uint32_t i = 0; i < batch_count; i++)
+	{
+		memcpy(broadphase->pairs + broadphase->pair_count, broadphase->batches[i].pairs, broadphase->batches[i].count * sizeof *broadphase->pairs);
+		broadphase->pair_count += broadphase->batches[i].count;
+	}
+
+	return broadphase->pair_count;
+}
+
+const BroadphasePair* broadphase_get_pairs(Broadphase* broadphase, uint32_t* count)
+{
+	*count = broadphase->pair_count;
+	return broadphase->pairs;
+}
+
+// Returns the first entry of column whose lower bound is not below value
+static uint32_t broadphase_lower_bound(const Broadphase* broadphase, uint32_t column, float value)
+{
+	uint32_t begin = broadphase->column_start[column];
+	uint32_t end = broadphase->column_start[column + 1];
+	while (begin < end)
+	{
+		uint32_t middle = begin + (end - begin) / 2;
+		if (broadphase->entry_min[middle] < value)
+			begin = middle + 1;
+		else
+			end = middle;
+	}
+	return begin;
+}
+
+static float broadphase_axis(vec3 v, uint32_t axis)
+{
+	return axis == 0 ? v.x : axis == 1 ? v.y : v.z;
+}
+
+// Finds the spheres overlapping a box, and the sphere at center if radius is not negative
+static uint32_t broadphase_query(const Broadphase* broadphase, vec3 box_min, vec3 box_max, vec3 center, float radius, uint32_t* results,
+								 uint32_t max_results)
+{
+	if (broadphase->entry_count == 0)
+		return 0;
+
+	uint32_t axis = broadphase->axis;
+	float min[3] = {broadphase_axis(box_min, axis), broadphase_axis(box_min, (axis + 1) % 3), broadphase_axis(box_min, (axis + 2) % 3)};
+	float max[3] = {broadphase_axis(box_max, axis), broadphase_axis(box_max, (axis + 1) % 3), broadphase_axis(box_max, (axis + 2) % 3)};
+	float mid[3] = {broadphase_axis(center, axis), broadphase_axis(center, (axis + 1) % 3), broadphase_axis(center, (axis + 2) % 3)};
+
+	uint32_t count = 0;
+	uint32_t u0 = broadphase_column(broadphase, 0, min[1]);
+	uint32_t u1 = broadphase_column(broadphase, 0, max[1]);
+	uint32_t v0 = broadphase_column(broadphase, 1, min[2]);
+	uint32_t v1 = broadphase_column(broadphase, 1, max[2]);
+	for (uint32_t cv = v0; cv <= v1; cv++)
+	{
+		for (uint32_t cu = u0; cu <= u1; cu++)
+		{
+			uint32_t column = cv * broadphase->column_count[0] + cu;
+			// Spheres overlapping the box start at most their diameter before it
+			uint32_t end = broadphase->column_start[column + 1];
+			for (uint32_t i = broadphase_lower_bound(broadphase, column, min[0] - 2 * broadphase->column_radius[column]);
+				 i < end && broadphase->entry_min[i] <= max[0]; i++)
+			{
+				float r = broadphase->entry_radius[i];
+				float p[3] = {broadphase->entry_min[i] + r, broadphase->entry_u[i], broadphase->entry_v[i]};
+
+				// The distance from the center of the sphere to the box
+				float distance = 0.0f;
+				for (uint32_t a = 0; a < 3; a++)
+				{
+					float d = p[a] < min[a] ? min[a] - p[a] : p[a] > max[a] ? p[a] - max[a] : 0.0f;
+					distance += d * d;
+				}
+				if (distance > r * r)
+					continue;
+
+				if (radius >= 0.0f)
+				{
+					float d0 = p[0] - mid[0], d1 = p[1] - mid[1], d2 = p[2] - mid[2];
+					if (d0 * d0 + d1 * d1 + d2 * d2 > (r + radius) * (r + radius))
+						continue;
+				}
+
+				// Spheres in several columns are reported by the column containing the lower corner of their overlap with the box
+				float overlap_u = p[1] - r > min[1] ? p[1] - r : min[1];
+				float overlap_v = p[2] - r > min[2] ? p[2] - r : min[2];
+				if (broadphase_column(broadphase, 1, overlap_v) * broadphase->column_count[0] + broadphase_column(broadphase, 0, overlap_u) != column)
+					continue;
+
+				if (count < max_results)
+					results[count] = broadphase->entry_index[i];
+				count++;
+			}
+		}
+	}
+	return count;
+}
+
+uint32_t broadphase_query_box(const Broadphase* broadphase, vec3 box_min, vec3 box_max, uint32_t* results, uint32_t max_results)
+{
+	return broadphase_query(broadphase, box_min, box_max, vec3_zero, -1.0f, results, max_results);
+}
+
+uint32_t broadphase_query_sphere(const Broadphase* broadphase, vec3 center, float radius, uint32_t* results, uint32_t max_results)
+{
+	vec3 box_min = {center.x - radius, center.y - radius, center.z - radius};
+	vec3 box_max = {center.x + radius, center.y + radius, center.z + radius};
+	return broadphase_query(broadphase, box_min, box_max, center, radius, results, max_results);
+}
+
+// Returns the distance along the ray to the column boundary it crosses next along grid axis
+static float broadphase_next_boundary(const Broadphase* broadphase, uint32_t axis, uint32_t column, float origin, float direction)
+{
+	// The outer columns reach to infinity
+	if (direction > 0.0f && column + 1 < broadphase->column_count[axis])
+		return (broadphase->column_origin[axis] + (column + 1) * broadphase->column_width[axis] - origin) / direction;
+	if (direction < 0.0f && column > 0)
+		return (broadphase->column_origin[axis] + column * broadphase->column_width[axis] - origin) / direction;
+	return INFINITY;
+}
+
+bool broadphase_raycast(const Broadphase* broadphase, vec3 origin, vec3 direction, float max_distance, BroadphaseHit* hit)
+{
+	float length = vec3_mag(direction);
+	if (broadphase->entry_count == 0 || length == 0.0f)
+		return false;
+	direction = vec3_scale(direction, 1.0f / length);
+
+	uint32_t axis = broadphase->axis;
+	float o[3] = {broadphase_axis(origin, axis), broadphase_axis(origin, (axis + 1) % 3), broadphase_axis(origin, (axis + 2) % 3)};
+	float d[3] = {broadphase_axis(direction, axis), broadphase_axis(direction, (axis + 1) % 3), broadphase_axis(direction, (axis + 2) % 3)};
+
+	// Walk the columns along the ray
+	uint32_t cu = broadphase_column(broadphase, 0, o[1]);
+	uint32_t cv = broadphase_column(broadphase, 1, o[2]);
+	float next_u = broadphase_next_boundary(broadphase, 0, cu, o[1], d[1]);
+	float next_v = broadphase_next_boundary(broadphase, 1, cv, o[2], d[2]);
+
+	float closest = max_distance;
+	uint32_t closest_index = UINT32_MAX;
+	float enter = 0.0f;
+	while (enter <= closest)
+	{
+		float exit = next_u < next_v ? next_u : next_v;
+		exit = exit < closest ? exit : closest;
+
+		// The entries overlapping the part of the ray in the column along the sweep axis
+		uint32_t column = cv * broadphase->column_count[0] + cu;
+		float s0 = o[0] + d[0] * enter;
+		float s1 = o[0] + d[0] * exit;
+		float s_min = s0 < s1 ? s0 : s1;
+		float s_max = s0 < s1 ? s1 : s0;
+		uint32_t end = broadphase->column_start[column + 1];
+		for (uint32_t i = broadphase_lower_bound(broadphase, column, s_min - 2 * broadphase->column_radius[column]);
+			 i < end && broadphase->entry_min[i] <= s_max; i++)
+		{
+			float r = broadphase->entry_radius[i];
+			float oc[3] = {o[0] - (broadphase->entry_min[i] + r), o[1] - broadphase->entry_u[i], o[2] - broadphase->entry_v[i]};
+			float b = oc[0] * d[0] + oc[1] * d[1] + oc[2] * d[2];
+			float c = oc[0] * oc[0] + oc[1] * oc[1] + oc[2] * oc[2] - r * r;
+			// Spheres containing the origin or behind it are not hit
+			if (c <= 0.0f || b > 0.0f || b * b < c)
+				continue;
+
+			float t = -b - sqrtf(b * b - c);
+			if (t < closest)
+			{
+				closest = t;
+				closest_index = broadphase->entry_index[i];
+			}
+		}
+
+		// A hit inside this column is closer than anything in the following columns
+		if (exit >= closest)
+			break;
+
+		enter = exit;
+		if (next_u < next_v)
+		{
+			cu = d[1] > 0.0f ? cu + 1 : cu - 1;
+			next_u = broadphase_next_boundary(broadphase, 0, cu, o[1], d[1]);
+		}
+		else
+		{
+			cv = d[2] > 0.0f ? cv + 1 : cv - 1;
+			next_v = broadphase_next_boundary(broadphase, 1, cv, o[2], d[2]);
+		}
+	}
+
+	if (closest_index == UINT32_MAX)
+		return false;
+
+	vec3 point = vec3_add(origin, vec3_scale(direction, closest));
+	vec3 center = {broadphase->x[closest_index], broadphase->y[closest_index], broadphase->z[closest_index]};
+	*hit = (BroadphaseHit){closest_index, closest, point, vec3_norm(vec3_sub(point, center))};
+	return true;
+}
+
+void broadphase_destroy(Broadphase* broadphase)
+{
+	free(broadphase->x);
+	free(broadphase->y);
+	free(broadphase->z);
+	free(broadphase->radius);
+	free(broadphase->entry_column);
+	free(broadphase->entry_index);
+	free(broadphase->entry_min);
+	free(broadphase->entry_max);
+	free(broadphase->entry_u);
+	free(broadphase->entry_v);
+	free(broadphase->entry_radius);
+	free(broadphase->keys);
+	free(broadphase->keys_tmp);
+	free(broadphase->index_tmp);
+
+	for (uint32_t i = 0; i < broadphase->batch_count; i++)
+		free(broadphase->batches[i].pairs);
+	free(broadphase->batches);
+	free(broadphase->pairs);
+	free(broadphase);
+}
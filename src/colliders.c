@@ -1,4 +1,10 @@
 #include "colliders.h"
+#include "jobs.h"
+#include "log.h"
+#include "magpie.h"
+#include "math/math.h"
+#include <float.h>
+#include <string.h>
 
 // Distance functions
 // Returns the distance to the surface in a gives direction of a sphere
@@ -10,10 +16,27 @@ float spherecollider_distance(struct BaseCollider* sphere, vec3 direction)
 	return vec3_dot(pos, direction) + ((SphereCollider*)sphere)->radius * vec3_largest(sphere->transform->scale);
 }
 
+// Returns the point on the surface of a sphere furthest in direction
+static vec3 spherecollider_support(const struct BaseCollider* sphere, vec3 direction)
+{
+	vec3 pos = sphere->origin;
+	float radius = ((const SphereCollider*)sphere)->radius;
+	if (sphere->transform)
+	{
+		pos = vec3_add(sphere->transform->position, pos);
+		radius *= vec3_largest(sphere->transform->scale);
+	}
+
+	float mag = vec3_mag(direction);
+	if (mag < 1e-12f)
+		return pos;
+	return vec3_add(pos, vec3_scale(direction, radius / mag));
+}
+
 SphereCollider spherecollider_create(float radius, vec3 origin, Transform* transform)
 {
 	SphereCollider sphere;
-	sphere.base			  = (BaseCollider){.get_distance = spherecollider_distance};
+	sphere.base			  = (BaseCollider){.get_distance = spherecollider_distance, .get_support = spherecollider_support};
 	sphere.base.origin	  = origin;
 	sphere.base.transform = transform;
 	sphere.radius		  = radius;
@@ -36,5 +59,660 @@ bool spherecollider_intersect(const SphereCollider* a, const SphereCollider* b)
 	return (vec3_sqrdistance(mid_a, mid_b) < radii * radii);
 }
 
-// Returns true if two colliders intersect
-bool collider_intersect(const BaseCollider* a, const BaseCollider* b);
+// The support of a linearly transformed shape M K in direction d is M times the support of K in direction M^T d
+// Transforms a direction into the local space of a collider for the support of its local shape
+static vec3 collider_local_direction(const BaseCollider* collider, vec3 direction)
+{
+	if (collider->transform == NULL)
+		return direction;
+	vec3 local = quat_transform_vec3(quat_conjugate(collider->transform->rotation), direction);
+	return vec3_prod(local, collider->transform->scale);
+}
+
+// Transforms a support point of the local shape into world space
+static vec3 collider_world_point(const BaseCollider* collider, vec3 point)
+{
+	point = vec3_add(point, collider->origin);
+	if (collider->transform == NULL)
+		return point;
+	point = vec3_prod(point, collider->transform->scale);
+	return vec3_add(quat_transform_vec3(collider->transform->rotation, point), collider->transform->position);
+}
+
+// The distance to the surface in a direction for colliders defined by their support
+static float collider_distance(struct BaseCollider* collider, vec3 direction)
+{
+	return vec3_dot(collider->get_support(collider, direction), direction);
+}
+
+static vec3 boxcollider_support(const struct BaseCollider* box, vec3 direction)
+{
+	vec3 d = collider_local_direction(box, direction);
+	vec3 halfwidth = ((const BoxCollider*)box)->halfwidth;
+	vec3 point = {d.x < 0 ? -halfwidth.x : halfwidth.x, d.y < 0 ? -halfwidth.y : halfwidth.y, d.z < 0 ? -halfwidth.z : halfwidth.z};
+	return collider_world_point(box, point);
+}
+
+BoxCollider boxcollider_create(vec3 halfwidth, vec3 origin, Transform* transform)
+{
+	BoxCollider box;
+	box.base = (BaseCollider){.get_distance = collider_distance, .get_support = boxcollider_support, .origin = origin, .transform = transform};
+	box.halfwidth = halfwidth;
+	return box;
+}
+
+static vec3 capsulecollider_support(const struct BaseCollider* capsule, vec3 direction)
+{
+	const CapsuleCollider* c = (const CapsuleCollider*)capsule;
+	vec3 d = collider_local_direction(capsule, direction);
+	vec3 point = {0, d.y < 0 ? -c->height / 2 : c->height / 2, 0};
+
+	float mag = vec3_mag(d);
+	if (mag > 1e-12f)
+		point = vec3_add(point, vec3_scale(d, c->radius / mag));
+	return collider_world_point(capsule, point);
+}
+
+CapsuleCollider capsulecollider_create(float radius, float height, vec3 origin, Transform* transform)
+{
+	CapsuleCollider capsule;
+	capsule.base = (BaseCollider){.get_distance = collider_distance, .get_support = capsulecollider_support, .origin = origin, .transform = transform};
+	capsule.radius = radius;
+	capsule.height = height;
+	return capsule;
+}
+
+static vec3 hullcollider_support(const struct BaseCollider* hull, vec3 direction)
+{
+	const HullCollider* h = (const HullCollider*)hull;
+	vec3 d = collider_local_direction(hull, direction);
+
+	uint32_t best = 0;
+	float best_distance = -INFINITY;
+	for (uint32_t i = 0; i < h->point_count; i++)
+	{
+		float distance = vec3_dot(h->points[i], d);
+		if (distance > best_distance)
+		{
+			best_distance = distance;
+			best = i;
+		}
+	}
+	return collider_world_point(hull, h->point_count ? h->points[best] : vec3_zero);
+}
+
+HullCollider hullcollider_create(const vec3* points, uint32_t count, vec3 origin, Transform* transform)
+{
+	HullCollider hull;
+	hull.base = (BaseCollider){.get_distance = collider_distance, .get_support = hullcollider_support, .origin = origin, .transform = transform};
+	hull.points = malloc((count ? count : 1) * sizeof *hull.points);
+	hull.point_count = count;
+	memcpy(hull.points, points, count * sizeof *hull.points);
+	return hull;
+}
+
+HullCollider hullcollider_create_mesh(Mesh* mesh, Transform* transform)
+{
+	const vec3* positions = NULL;
+	const uint32_t* indices = NULL;
+	uint32_t index_count = mesh_get_occluder(mesh, &positions, &indices);
+
+	// The positions of the coarsest level are only the referenced vertices
+	uint32_t count = 0;
+	for (uint32_t i = 0; i < index_count; i++)
+		count = indices[i] + 1 > count ? indices[i] + 1 : count;
+
+	return hullcollider_create(positions, count, vec3_zero, transform);
+}
+
+void hullcollider_destroy(HullCollider* hull)
+{
+	free(hull->points);
+	hull->points = NULL;
+	hull->point_count = 0;
+}
+
+// A point of the Minkowski difference a - b and the points of the colliders it was found from
+struct SupportPoint
+{
+	vec3 p;
+	vec3 a;
+	vec3 b;
+};
+
+// The simplex of the intersection test, the newest point first
+struct Simplex
+{
+	struct SupportPoint points[4];
+	uint32_t count;
+};
+
+static struct SupportPoint collider_support(const BaseCollider* a, const BaseCollider* b, vec3 direction)
+{
+	vec3 support_a = a->get_support(a, direction);
+	vec3 support_b = b->get_support(b, vec3_scale(direction, -1));
+	return (struct SupportPoint){vec3_sub(support_a, support_b), support_a, support_b};
+}
+
+static vec3 collider_center(const BaseCollider* collider)
+{
+	return collider->transform ? vec3_add(collider->transform->position, collider->origin) : collider->origin;
+}
+
+// The simplex cases reduce the simplex to the feature closest to the origin and point the direction towards the origin
+static bool simplex_line(struct Simplex* simplex, vec3* direction)
+{
+	struct SupportPoint a = simplex->points[0], b = simplex->points[1];
+	vec3 ab = vec3_sub(b.p, a.p);
+	vec3 ao = vec3_scale(a.p, -1);
+
+	if (vec3_dot(ab, ao) > 0)
+		*direction = vec3_cross(vec3_cross(ab, ao), ab);
+	else
+	{
+		simplex->count = 1;
+		*direction = ao;
+	}
+	return false;
+}
+
+static bool simplex_triangle(struct Simplex* simplex, vec3* direction)
+{
+	struct SupportPoint a = simplex->points[0], b = simplex->points[1], c = simplex->points[2];
+	vec3 ab = vec3_sub(b.p, a.p);
+	vec3 ac = vec3_sub(c.p, a.p);
+	vec3 ao = vec3_scale(a.p, -1);
+	vec3 abc = vec3_cross(ab, ac);
+
+	if (vec3_dot(vec3_cross(abc, ac), ao) > 0)
+	{
+		if (vec3_dot(ac, ao) > 0)
+		{
+			*simplex = (struct Simplex){{a, c}, 2};
+			*direction = vec3_cross(vec3_cross(ac, ao), ac);
+			return false;
+		}
+		*simplex = (struct Simplex){{a, b}, 2};
+		return simplex_line(simplex, direction);
+	}
+
+	if (vec3_dot(vec3_cross(ab, abc), ao) > 0)
+	{
+		*simplex = (struct Simplex){{a, b}, 2};
+		return simplex_line(simplex, direction);
+	}
+
+	// The origin is above or below the triangle, the winding is kept so that abc faces the origin
+	if (vec3_dot(abc, ao) > 0)
+		*direction = abc;
+	else
+	{
+		*simplex = (struct Simplex){{a, c, b}, 3};
+		*direction = vec3_scale(abc, -1);
+	}
+	return false;
+}
+
+static bool simplex_tetrahedron(struct Simplex* simplex, vec3* direction)
+{
+	struct SupportPoint a = simplex->points[0], b = simplex->points[1], c = simplex->points[2], d = simplex->points[3];
+	vec3 ab = vec3_sub(b.p, a.p);
+	vec3 ac = vec3_sub(c.p, a.p);
+	vec3 ad = vec3_sub(d.p, a.p);
+	vec3 ao = vec3_scale(a.p, -1);
+
+	if (vec3_dot(vec3_cross(ab, ac), ao) > 0)
+	{
+		*simplex = (struct Simplex){{a, b, c}, 3};
+		return simplex_triangle(simplex, direction);
+	}
+	if (vec3_dot(vec3_cross(ac, ad), ao) > 0)
+	{
+		*simplex = (struct Simplex){{a, c, d}, 3};
+		return simplex_triangle(simplex, direction);
+	}
+	if (vec3_dot(vec3_cross(ad, ab), ao) > 0)
+	{
+		*simplex = (struct Simplex){{a, d, b}, 3};
+		return simplex_triangle(simplex, direction);
+	}
+
+	// The origin is inside the tetrahedron
+	return true;
+}
+
+// Runs the intersection test and leaves the final simplex
+// The simplex is a tetrahedron containing the origin unless the colliders are only touching
+static bool collider_gjk(const BaseCollider* a, const BaseCollider* b, struct Simplex* simplex)
+{
+	vec3 direction = vec3_sub(collider_center(b), collider_center(a));
+	if (vec3_sqrmag(direction) < 1e-12f)
+		direction = (vec3){1, 0, 0};
+
+	simplex->points[0] = collider_support(a, b, direction);
+	simplex->count = 1;
+	direction = vec3_scale(simplex->points[0].p, -1);
+
+	for (uint32_t i = 0; i < COLLIDER_GJK_ITERATIONS; i++)
+	{
+		// The origin is on the simplex
+		if (vec3_sqrmag(direction) < 1e-12f)
+			return true;
+
+		struct SupportPoint support = collider_support(a, b, direction);
+		// The furthest point towards the origin does not pass it
+		if (vec3_dot(support.p, direction) <= 0)
+			return false;
+
+		memmove(simplex->points + 1, simplex->points, simplex->count * sizeof *simplex->points);
+		simplex->points[0] = support;
+		simplex->count++;
+
+		bool contains = false;
+		switch (simplex->count)
+		{
+		case 2:
+			contains = simplex_line(simplex, &direction);
+			break;
+		case 3:
+			contains = simplex_triangle(simplex, &direction);
+			break;
+		case 4:
+			contains = simplex_tetrahedron(simplex, &direction);
+			break;
+		}
+
+		if (contains)
+			return true;
+	}
+
+	// Did not converge, which happens for shapes barely touching
+	return false;
+}
+
+bool collider_intersect(const BaseCollider* a, const BaseCollider* b)
+{
+	struct Simplex simplex;
+	return collider_gjk(a, b, &simplex);
+}
+
+#define EPA_MAX_POINTS (COLLIDER_EPA_ITERATIONS + 4)
+#define EPA_MAX_FACES  (EPA_MAX_POINTS * 2)
+
+// A triangle of the polytope, wound so that its normal points away from the origin
+struct PolytopeFace
+{
+	uint32_t indices[3];
+	vec3 normal;
+	float distance;
+};
+
+struct Polytope
+{
+	struct SupportPoint points[EPA_MAX_POINTS];
+	uint32_t point_count;
+	struct PolytopeFace faces[EPA_MAX_FACES];
+	uint32_t face_count;
+};
+
+// A closed polytope has at most 2 * point_count - 4 faces, which always fit
+// Degenerate faces are kept to close the polytope but are never the closest
+static void polytope_add_face(struct Polytope* polytope, uint32_t i0, uint32_t i1, uint32_t i2)
+{
+	if (polytope->face_count >= EPA_MAX_FACES)
+		return;
+
+	vec3 p0 = polytope->points[i0].p;
+	vec3 e1 = vec3_sub(polytope->points[i1].p, p0), e2 = vec3_sub(polytope->points[i2].p, p0);
+	vec3 normal = vec3_cross(e1, e2);
+	float mag = vec3_mag(normal);
+	// Compared to the edges since a sliver has a normal of any direction
+	if (mag <= 1e-6f * sqrtf(vec3_sqrmag(e1) * vec3_sqrmag(e2)) || mag < 1e-12f)
+	{
+		polytope->faces[polytope->face_count++] = (struct PolytopeFace){{i0, i1, i2}, (vec3){0, 0, 0}, FLT_MAX};
+		return;
+	}
+	normal = vec3_scale(normal, 1 / mag);
+	polytope->faces[polytope->face_count++] = (struct PolytopeFace){{i0, i1, i2}, normal, vec3_dot(normal, p0)};
+}
+
+// Adds a face of the initial tetrahedron wound away from the opposite point
+static void polytope_add_tetrahedron_face(struct Polytope* polytope, uint32_t i0, uint32_t i1, uint32_t i2, uint32_t opposite)
+{
+	vec3 p0 = polytope->points[i0].p;
+	vec3 normal = vec3_cross(vec3_sub(polytope->points[i1].p, p0), vec3_sub(polytope->points[i2].p, p0));
+	if (vec3_dot(normal, vec3_sub(polytope->points[opposite].p, p0)) > 0)
+		polytope_add_face(polytope, i0, i2, i1);
+	else
+		polytope_add_face(polytope, i0, i1, i2);
+}
+
+// Adds an edge of a removed face to the horizon, or removes it if the opposite face was removed as well
+static void polytope_add_edge(uint32_t (*edges)[2], uint32_t* edge_count, uint32_t a, uint32_t b)
+{
+	for (uint32_t i = 0; i < *edge_count; i++)
+	{
+		if (edges[i][0] == b && edges[i][1] == a)
+		{
+			edges[i][0] = edges[*edge_count - 1][0];
+			edges[i][1] = edges[*edge_count - 1][1];
+			(*edge_count)--;
+			return;
+		}
+	}
+	edges[*edge_count][0] = a;
+	edges[*edge_count][1] = b;
+	(*edge_count)++;
+}
+
+// Returns true if the origin is inside a tetrahedron or within COLLIDER_EPA_TOLERANCE of its faces
+static bool simplex_contains_origin(const struct Simplex* simplex)
+{
+	static const uint32_t faces[4][4] = {{0, 1, 2, 3}, {0, 3, 1, 2}, {0, 2, 3, 1}, {1, 3, 2, 0}};
+	for (uint32_t i = 0; i < 4; i++)
+	{
+		vec3 p0 = simplex->points[faces[i][0]].p;
+		vec3 normal = vec3_cross(vec3_sub(simplex->points[faces[i][1]].p, p0), vec3_sub(simplex->points[faces[i][2]].p, p0));
+		float mag = vec3_mag(normal);
+		if (mag < 1e-12f)
+			return false;
+
+		// Signed towards the opposite point
+		float side = vec3_dot(normal, vec3_sub(simplex->points[faces[i][3]].p, p0)) > 0 ? 1.0f : -1.0f;
+		if (side * vec3_dot(normal, vec3_scale(p0, -1)) / mag < -COLLIDER_EPA_TOLERANCE)
+			return false;
+	}
+	return true;
+}
+
+// Returns false if a simplex touching the origin can not be expanded into a tetrahedron containing it
+static bool collider_expand_simplex(const BaseCollider* a, const BaseCollider* b, struct Simplex* simplex)
+{
+	static const vec3 axes[6] = {{1, 0, 0}, {-1, 0, 0}, {0, 1, 0}, {0, -1, 0}, {0, 0, 1}, {0, 0, -1}};
+	for (uint32_t i = 0; i < 6 && simplex->count < 4; i++)
+	{
+		struct SupportPoint support = collider_support(a, b, axes[i]);
+
+		// Only keep points extending the simplex into a new dimension
+		// Compared by the angle to the line or plane, since the extent of the simplex is not known
+		vec3 offset = vec3_sub(support.p, simplex->points[0].p);
+		bool degenerate = false;
+		if (simplex->count == 1)
+			degenerate = vec3_sqrmag(offset) < 1e-10f;
+		else if (simplex->count == 2)
+		{
+			vec3 edge = vec3_sub(simplex->points[1].p, simplex->points[0].p);
+			degenerate = vec3_sqrmag(vec3_cross(edge, offset)) <= 1e-6f * vec3_sqrmag(edge) * vec3_sqrmag(offset);
+		}
+		else
+		{
+			vec3 normal = vec3_cross(vec3_sub(simplex->points[1].p, simplex->points[0].p), vec3_sub(simplex->points[2].p, simplex->points[0].p));
+			float distance = vec3_dot(normal, offset);
+			degenerate = distance * distance <= 1e-6f * vec3_sqrmag(normal) * vec3_sqrmag(offset);
+		}
+
+		if (!degenerate)
+			simplex->points[simplex->count++] = support;
+	}
+	return simplex->count == 4 && simplex_contains_origin(simplex);
+}
+
+// The contact of colliders only touching, pushed apart along the line between their centers
+static void collider_touching_contact(const BaseCollider* a, const BaseCollider* b, const struct SupportPoint* point, Contact* contact)
+{
+	vec3 normal = vec3_sub(collider_center(b), collider_center(a));
+	contact->normal = vec3_sqrmag(normal) > 1e-12f ? vec3_norm(normal) : (vec3){0, 1, 0};
+	contact->depth = 0;
+	contact->point = vec3_scale(vec3_add(point->a, point->b), 0.5f);
+}
+
+bool collider_penetration(const BaseCollider* a, const BaseCollider* b, Contact* contact)
+{
+	struct Simplex simplex;
+	if (!collider_gjk(a, b, &simplex))
+		return false;
+
+	// The origin is on the boundary of a lower dimensional simplex when the colliders barely overlap
+	if (simplex.count < 4 && !collider_expand_simplex(a, b, &simplex))
+	{
+		collider_touching_contact(a, b, &simplex.points[0], contact);
+		return true;
+	}
+
+	struct Polytope polytope;
+	memcpy(polytope.points, simplex.points, sizeof simplex.points);
+	polytope.point_count = 4;
+	polytope.face_count = 0;
+	polytope_add_tetrahedron_face(&polytope, 0, 1, 2, 3);
+	polytope_add_tetrahedron_face(&polytope, 0, 3, 1, 2);
+	polytope_add_tetrahedron_face(&polytope, 0, 2, 3, 1);
+	polytope_add_tetrahedron_face(&polytope, 1, 3, 2, 0);
+
+	uint32_t closest = 0;
+	for (uint32_t iteration = 0; iteration < COLLIDER_EPA_ITERATIONS; iteration++)
+	{
+		closest = 0;
+		for (uint32_t i = 1; i < polytope.face_count; i++)
+		{
+			if (polytope.faces[i].distance < polytope.faces[closest].distance)
+				closest = i;
+		}
+
+		vec3 normal = polytope.faces[closest].normal;
+		struct SupportPoint support = collider_support(a, b, normal);
+		// The closest face is on the surface of the Minkowski difference
+		if (vec3_dot(support.p, normal) - polytope.faces[closest].distance < COLLIDER_EPA_TOLERANCE)
+			break;
+
+		if (polytope.point_count >= EPA_MAX_POINTS)
+			break;
+
+		// Remove the faces seen from the support point and close the hole with faces to it
+		uint32_t edges[EPA_MAX_FACES * 3][2];
+		uint32_t edge_count = 0;
+		for (uint32_t i = 0; i < polytope.face_count;)
+		{
+			struct PolytopeFace* face = &polytope.faces[i];
+			if (vec3_dot(face->normal, vec3_sub(support.p, polytope.points[face->indices[0]].p)) > 0)
+			{
+				polytope_add_edge(edges, &edge_count, face->indices[0], face->indices[1]);
+				polytope_add_edge(edges, &edge_count, face->indices[1], face->indices[2]);
+				polytope_add_edge(edges, &edge_count, face->indices[2], face->indices[0]);
+				*face = polytope.faces[--polytope.face_count];
+			}
+			else
+				i++;
+		}
+
+		uint32_t index = polytope.point_count++;
+		polytope.points[index] = support;
+		for (uint32_t i = 0; i < edge_count; i++)
+			polytope_add_face(&polytope, edges[i][0], edges[i][1], index);
+
+		closest = 0;
+		for (uint32_t i = 1; i < polytope.face_count; i++)
+		{
+			if (polytope.faces[i].distance < polytope.faces[closest].distance)
+				closest = i;
+		}
+	}
+
+	struct PolytopeFace* face = &polytope.faces[closest];
+	// Only degenerate faces are left when the polytope is flat
+	if (face->distance == FLT_MAX)
+	{
+		collider_touching_contact(a, b, &polytope.points[0], contact);
+		return true;
+	}
+	contact->normal = face->normal;
+	contact->depth = face->distance;
+
+	// The barycentric coordinates of the origin projected onto the closest face give the deepest points on both colliders
+	struct SupportPoint* p0 = &polytope.points[face->indices[0]];
+	struct SupportPoint* p1 = &polytope.points[face->indices[1]];
+	struct SupportPoint* p2 = &polytope.points[face->indices[2]];
+	vec3 projected = vec3_scale(face->normal, face->distance);
+	vec3 v0 = vec3_sub(p1->p, p0->p), v1 = vec3_sub(p2->p, p0->p), v2 = vec3_sub(projected, p0->p);
+	float d00 = vec3_dot(v0, v0), d01 = vec3_dot(v0, v1), d11 = vec3_dot(v1, v1);
+	float d20 = vec3_dot(v2, v0), d21 = vec3_dot(v2, v1);
+	float denom = d00 * d11 - d01 * d01;
+	float u = 1.0f / 3, v = 1.0f / 3, w = 1.0f / 3;
+	if (fabsf(denom) > 1e-12f)
+	{
+		v = (d11 * d20 - d01 * d21) / denom;
+		w = (d00 * d21 - d01 * d20) / denom;
+		u = 1.0f - v - w;
+	}
+
+	vec3 point_a = vec3_add(vec3_add(vec3_scale(p0->a, u), vec3_scale(p1->a, v)), vec3_scale(p2->a, w));
+	vec3 point_b = vec3_add(vec3_add(vec3_scale(p0->b, u), vec3_scale(p1->b, v)), vec3_scale(p2->b, w));
+	contact->point = vec3_scale(vec3_add(point_a, point_b), 0.5f);
+	return true;
+}
+
+// A collider rotated around a pivot, used to tilt colliders without touching their transforms
+struct TiltedCollider
+{
+	BaseCollider base;
+	const BaseCollider* collider;
+	quaternion rotation;
+	vec3 pivot;
+};
+
+static vec3 tiltedcollider_support(const struct BaseCollider* collider, vec3 direction)
+{
+	const struct TiltedCollider* tilted = (const struct TiltedCollider*)collider;
+	vec3 d = quat_transform_vec3(quat_conjugate(tilted->rotation), direction);
+	vec3 point = vec3_sub(tilted->collider->get_support(tilted->collider, d), tilted->pivot);
+	return vec3_add(quat_transform_vec3(tilted->rotation, point), tilted->pivot);
+}
+
+// Returns the width of a collider along direction
+static float collider_width(const BaseCollider* collider, vec3 direction)
+{
+	vec3 front = collider->get_support(collider, direction);
+	vec3 back = collider->get_support(collider, vec3_scale(direction, -1));
+	return vec3_dot(vec3_sub(front, back), direction);
+}
+
+uint32_t collider_contact_points(const BaseCollider* a, const BaseCollider* b, const Contact* contact, vec3* points, float* depths)
+{
+	vec3 normal = contact->normal;
+	// The contact and a point for each tilt
+	vec3 candidates[COLLIDER_CONTACT_TILTS + 1] = {contact->point};
+	float candidate_depths[COLLIDER_CONTACT_TILTS + 1] = {contact->depth};
+	uint32_t count = 1;
+
+	vec3 tangent = vec3_norm(fabsf(normal.x) >= 0.57735f ? (vec3){normal.y, -normal.x, 0} : (vec3){0, normal.z, -normal.y});
+	vec3 bitangent = vec3_cross(normal, tangent);
+
+	// Tilting the larger collider would move its surface too far away from its center
+	bool tilt_a = collider_width(a, tangent) + collider_width(a, bitangent) < collider_width(b, tangent) + collider_width(b, bitangent);
+	const BaseCollider* tilted_collider = tilt_a ? a : b;
+	struct TiltedCollider tilted = {.base.get_support = tiltedcollider_support, .collider = tilted_collider, .pivot = collider_center(tilted_collider)};
+
+	// The deepest point of the collider which is not tilted is kept, its depth is measured from the surface of the other collider
+	// at the original contact, which is approximated by a plane
+	vec3 surface = vec3_add(contact->point, vec3_scale(normal, tilt_a ? contact->depth / 2 : -contact->depth / 2));
+
+	for (uint32_t i = 0; i < COLLIDER_CONTACT_TILTS; i++)
+	{
+		// The axes are offset from the tangents so that they are not aligned with the faces of boxes
+		float angle = (i + 0.125f) * DEG_360 / COLLIDER_CONTACT_TILTS;
+		vec3 axis = vec3_add(vec3_scale(tangent, cosf(angle)), vec3_scale(bitangent, sinf(angle)));
+		tilted.rotation = quat_axis_angle(axis, COLLIDER_CONTACT_TILT_ANGLE);
+
+		Contact tilted_contact;
+		if (!(tilt_a ? collider_penetration(&tilted.base, b, &tilted_contact) : collider_penetration(a, &tilted.base, &tilted_contact)))
+			continue;
+
+		// The point on b lies half the depth behind the contact point, the point on a half the depth in front
+		vec3 point;
+		float depth;
+		if (tilt_a)
+		{
+			point = vec3_sub(tilted_contact.point, vec3_scale(tilted_contact.normal, tilted_contact.depth / 2));
+			depth = vec3_dot(vec3_sub(surface, point), normal);
+		}
+		else
+		{
+			point = vec3_add(tilted_contact.point, vec3_scale(tilted_contact.normal, tilted_contact.depth / 2));
+			depth = vec3_dot(vec3_sub(point, surface), normal);
+		}
+
+		if (depth < 0)
+			continue;
+		point = vec3_add(point, vec3_scale(normal, tilt_a ? depth / 2 : -depth / 2));
+
+		bool duplicate = false;
+		for (uint32_t j = 0; j < count && !duplicate; j++)
+			duplicate = vec3_sqrdistance(candidates[j], point) < COLLIDER_CONTACT_MERGE_DISTANCE * COLLIDER_CONTACT_MERGE_DISTANCE;
+		if (duplicate)
+			continue;
+
+		candidates[count] = point;
+		candidate_depths[count] = depth;
+		count++;
+	}
+
+	// Drop the points closest to the center of the area until few enough are left
+	while (count > COLLIDER_MAX_CONTACT_POINTS)
+	{
+		vec3 center = vec3_zero;
+		for (uint32_t i = 0; i < count; i++)
+			center = vec3_add(center, candidates[i]);
+		center = vec3_scale(center, 1.0f / count);
+
+		uint32_t inner = 0;
+		for (uint32_t i = 1; i < count; i++)
+		{
+			if (vec3_sqrdistance(candidates[i], center) < vec3_sqrdistance(candidates[inner], center))
+				inner = i;
+		}
+		candidates[inner] = candidates[--count];
+		candidate_depths[inner] = candidate_depths[count];
+	}
+
+	memcpy(points, candidates, count * sizeof *points);
+	memcpy(depths, candidate_depths, count * sizeof *depths);
+	return count;
+}
+
+struct ColliderPairs
+{
+	const BaseCollider* const* colliders;
+	const BroadphasePair* pairs;
+	Contact* contacts;
+};
+
+static void collider_intersect_range(void* arg, uint32_t begin, uint32_t end)
+{
+	struct ColliderPairs* data = arg;
+	for (uint32_t i = begin; i < end; i++)
+	{
+		const BroadphasePair* pair = &data->pairs[i];
+		Contact* contact = &data->contacts[i];
+		if (collider_penetration(data->colliders[pair->a], data->colliders[pair->b], contact))
+		{
+			contact->a = pair->a;
+			contact->b = pair->b;
+		}
+		// Marked as a miss and removed when compacting
+		else
+			contact->depth = -1;
+	}
+}
+
+uint32_t collider_intersect_pairs(const BaseCollider* const* colliders, const BroadphasePair* pairs, uint32_t count, Contact* contacts)
+{
+	struct ColliderPairs data = {colliders, pairs, contacts};
+	job_parallel_for(count, 0, collider_intersect_range, &data);
+
+	uint32_t contact_count = 0;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		if (contacts[i].depth >= 0)
+			contacts[contact_count++] = contacts[i];
+	}
+	return contact_count;
+}
@@ -16,7 +16,17 @@ struct Entity
 	Material material;
 	vec4 color;
 	Mesh* mesh;
+	// The level of detail of the mesh drawn
+	uint32_t lod;
 	SphereCollider boundingsphere;
+	// The shape used by physics, NULL to use the bounding sphere
+	const BaseCollider* collider;
+	// The scene the entity was added to and its slot there
+	Scene* scene;
+	uint32_t scene_index;
+	struct RenderTreeNode* rendertree_node;
+	// The slot of the entity in the resident GPU culling data
+	uint32_t indirect_slot;
 };
 
 // Pool entity creation to allow for faster allocations and reduce memory fragmentation
@@ -46,13 +56,48 @@ Entity* entity_create(const char* name, const char* material_name, const char* m
 	// Create bounding sphere from model and bind the transform to it
 	entity->boundingsphere = spherecollider_create(mesh_max_distance(entity->mesh), vec3_zero, &entity->transform);
 
+	entity->collider = NULL;
 	entity->color = vec4_white;
+	entity->lod = 0;
+	entity->rendertree_node = NULL;
+	entity->indirect_slot = UINT32_MAX;
 
 	// Add to scene
-	scene_add_entity(scene_get_current(), entity);
+	entity->scene = scene_get_current();
+	scene_add_entity(entity->scene, entity);
 	return entity;
 }
 
+void entity_create_batch(const char* name, Material material, Mesh* mesh, const Transform* transforms, const Rigidbody* rigidbodies, uint32_t count,
+						 Entity** entities)
+{
+	// Entities without a mesh are never drawn and need no material
+	if (mesh && !HANDLE_VALID(material))
+		material = material_get_default();
+
+	Scene* scene = scene_get_current();
+	float radius = mesh ? mesh_max_distance(mesh) : 0;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		Entity* entity = mempool_alloc(&entity_pool);
+		snprintf(entity->name, sizeof entity->name, "%s", name);
+		entity->transform = transforms[i];
+		entity->rigidbody = rigidbodies ? rigidbodies[i] : rigidbody_stationary;
+		entity->material = material;
+		entity->mesh = mesh;
+		entity->boundingsphere = spherecollider_create(radius, vec3_zero, &entity->transform);
+		entity->collider = NULL;
+		entity->color = vec4_white;
+		entity->lod = 0;
+		entity->scene = scene;
+		entity->rendertree_node = NULL;
+		entity->indirect_slot = UINT32_MAX;
+		entities[i] = entity;
+	}
+
+	scene_add_entities(scene, entities, count);
+}
+
 const char* entity_get_name(Entity* entity)
 {
 	return entity->name;
@@ -79,6 +124,16 @@ const SphereCollider* entity_get_boundingsphere(Entity* entity)
 	return &entity->boundingsphere;
 }
 
+const BaseCollider* entity_get_collider(Entity* entity)
+{
+	return entity->collider ? entity->collider : &entity->boundingsphere.base;
+}
+
+void entity_set_collider(Entity* entity, const BaseCollider* collider)
+{
+	entity->collider = collider;
+}
+
 vec4 entity_get_color(Entity* entity)
 {
 	return entity->color;
@@ -89,9 +144,48 @@ void entity_set_color(Entity* entity, vec4 color)
 	entity->color = color;
 }
 
+uint32_t entity_get_lod(Entity* entity)
+{
+	return entity->lod;
+}
+
+void entity_set_lod(Entity* entity, uint32_t lod)
+{
+	entity->lod = lod;
+}
+
+uint32_t entity_get_scene_index(Entity* entity)
+{
+	return entity->scene_index;
+}
+
+void entity_set_scene_index(Entity* entity, uint32_t index)
+{
+	entity->scene_index = index;
+}
+
+struct RenderTreeNode* entity_get_rendertree_node(Entity* entity)
+{
+	return entity->rendertree_node;
+}
+
+void entity_set_rendertree_node(Entity* entity, struct RenderTreeNode* node)
+{
+	entity->rendertree_node = node;
+}
+
+uint32_t entity_get_indirect_slot(Entity* entity)
+{
+	return entity->indirect_slot;
+}
+
+void entity_set_indirect_slot(Entity* entity, uint32_t slot)
+{
+	entity->indirect_slot = slot;
+}
+
 void entity_update(Entity* entity)
 {
-	rigidbody_update(&entity->rigidbody, &entity->transform);
 	transform_update(&entity->transform);
 }
 
@@ -100,6 +194,7 @@ void entity_update_shaderdata(Entity* entity, void* data_write, uint32_t index)
 	struct EntityData data = {0};
 	data.model_matrix = entity->transform.model_matrix;
 	data.color = entity->color;
+	data.material_index = material_get_bindless_index(entity->material);
 
 	memcpy((struct EntityData*)data_write + index, &data, sizeof(struct EntityData));
 }
@@ -109,15 +204,23 @@ void entity_render(Entity* entity, Commandbuffer commandbuffer, uint32_t index,
 {
 	// Binding is done by renderer
 	material_bind(entity->material, commandbuffer, data_descriptors);
-	mesh_bind(entity->mesh, commandbuffer);
 
 	// Set push constant for model matrix
 	material_push_constants(entity->material, commandbuffer, 0, &index);
-	mesh_draw(entity->mesh, commandbuffer);
+	mesh_draw_instanced(entity->mesh, commandbuffer, entity->lod, 1);
+}
+
+void entity_render_instanced(Entity* entity, Commandbuffer commandbuffer, uint32_t index, uint32_t count, VkDescriptorSet data_descriptors)
+{
+	material_bind(entity->material, commandbuffer, data_descriptors);
+
+	// The push constant holds the index of the first instance
+	material_push_constants(entity->material, commandbuffer, 0, &index);
+	mesh_draw_instanced(entity->mesh, commandbuffer, entity->lod, count);
 }
 
 void entity_destroy(Entity* entity)
 {
+	scene_remove_entity(entity->scene, entity);
 	mempool_free(&entity_pool, entity);
-	//scene_remove_entity(scene_get_current(), entity);
 }
\ No newline at end of file
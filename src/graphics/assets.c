@@ -0,0 +1,405 @@
+#include "graphics/assets.h"
+#include "graphics/texture.h"
+#include "graphics/model.h"
+#include "graphics/material.h"
+#include "graphics/pipeline.h"
+#include "graphics/rendertree.h"
+#include "scene.h"
+#include "jobs.h"
+#include "utils.h"
+#include "log.h"
+#include "magpie.h"
+#include "defines.h"
+#include <limits.h>
+#include <string.h>
+#include <stdio.h>
+
+#if PL_LINUX
+#include <unistd.h>
+#include <errno.h>
+#include <dirent.h>
+#include <sys/inotify.h>
+#endif
+
+static const char* texture_extensions[] = {".png", ".jpg", ".jpeg", ".tga", ".bmp"};
+static const char* model_extensions[] = {".dae"};
+static const char* material_extensions[] = {".json"};
+static const char* shader_extensions[] = {".spv"};
+static const char* shader_source_extensions[] = {".vert", ".frag", ".geom"};
+
+// Returns true if path ends with any of the given extensions
+static int has_extension(const char* path, const char** extensions, size_t count)
+{
+	const char* ext = strrchr(path, '.');
+	if (ext == NULL)
+		return 0;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		if (strcmp(ext, extensions[i]) == 0)
+			return 1;
+	}
+	return 0;
+}
+
+uint32_t assets_load_dir(const char* dir)
+{
+	// listdir returns 0 both when the directory can't be opened and when the paths are full
+	if (!is_dir(dir))
+	{
+		LOG_E("Failed to load assets from %s - not a directory", dir);
+		return 0;
+	}
+
+	// listdir writes full paths into preallocated strings
+	// The strings start empty so entries not written by a failing subdirectory are skipped
+	char** paths = malloc(ASSETS_DIR_MAX * sizeof *paths);
+	char* path_data = malloc(ASSETS_DIR_MAX * PATH_MAX);
+	for (uint32_t i = 0; i < ASSETS_DIR_MAX; i++)
+	{
+		paths[i] = path_data + i * PATH_MAX;
+		paths[i][0] = '\0';
+	}
+
+	size_t count = ASSETS_DIR_MAX - listdir(dir, paths, ASSETS_DIR_MAX, 0);
+
+	uint32_t started = 0;
+	for (size_t i = 0; i < count && paths[i][0]; i++)
+	{
+		if (has_extension(paths[i], texture_extensions, LENOF(texture_extensions)))
+		{
+			texture_load_async(paths[i]);
+			started++;
+		}
+		else if (has_extension(paths[i], model_extensions, LENOF(model_extensions)))
+		{
+			if (model_load_collada_async(paths[i]))
+				started++;
+		}
+	}
+
+	free(path_data);
+	free(paths);
+
+	LOG_S("Loading %d assets from %s", started, dir);
+	return started;
+}
+
+// Set of materials for marking render tree nodes
+struct MaterialSet
+{
+	Material* materials;
+	uint32_t count;
+};
+
+static bool entity_uses_materials(Entity* entity, void* arg)
+{
+	struct MaterialSet* set = arg;
+	Material mat = entity_get_material(entity);
+	for (uint32_t i = 0; i < set->count; i++)
+	{
+		if (HANDLE_COMPARE(mat, set->materials[i]))
+			return true;
+	}
+	return false;
+}
+
+static bool entity_uses_model(Entity* entity, void* arg)
+{
+	Mesh* mesh = entity_get_mesh(entity);
+	return mesh && mesh_get_model(mesh) == arg;
+}
+
+void assets_mark_materials(Material* materials, uint32_t count)
+{
+	Scene* scene = scene_get_current();
+	if (scene == NULL || count == 0)
+		return;
+
+	struct MaterialSet set = {materials, count};
+	uint32_t nodes = rendertree_mark_changed(scene_get_rendertree(scene), entity_uses_materials, &set);
+	LOG("Re-recording %d render tree nodes", nodes);
+}
+
+// Shader sources being compiled by glslc on the job system
+typedef struct ShaderCompile
+{
+	char source[PATH_MAX];
+	char binary[PATH_MAX];
+} ShaderCompile;
+
+static JobCounter shader_jobs;
+
+// Runs glslc on a worker thread
+// The written binary triggers the pipeline reload on a later poll
+static void assets_compile_job(void* arg)
+{
+	ShaderCompile* compile = arg;
+
+	char command[PATH_MAX * 2 + 32];
+	snprintf(command, sizeof command, "glslc \"%s\" -o \"%s\"", compile->source, compile->binary);
+	if (system(command) != 0)
+		LOG_E("Failed to compile shader %s", compile->source);
+
+	free(compile);
+}
+
+// Reloads a single changed file and everything depending on it
+// Returns 1 if anything was reloaded
+static int assets_reload_file(const char* path)
+{
+	Material dependents[ASSETS_MAX_DEPENDENTS];
+
+	if (has_extension(path, shader_extensions, LENOF(shader_extensions)))
+	{
+		uint32_t count = material_find_dependents(path, dependents, ASSETS_MAX_DEPENDENTS);
+		if (count == 0)
+			return 0;
+
+		pipeline_reload_shader(path);
+		assets_mark_materials(dependents, count);
+		return 1;
+	}
+
+	if (has_extension(path, shader_source_extensions, LENOF(shader_source_extensions)))
+	{
+		// Compile sources of loaded shaders, the written binary triggers the pipeline reload
+		char binary[PATH_MAX];
+		snprintf(binary, sizeof binary, "%s.spv", path);
+		if (material_find_dependents(binary, dependents, ASSETS_MAX_DEPENDENTS) == 0)
+			return 0;
+
+		ShaderCompile* compile = malloc(sizeof *compile);
+		snprintf(compile->source, sizeof compile->source, "%s", path);
+		snprintf(compile->binary, sizeof compile->binary, "%s", binary);
+		LOG_S("Compiling shader %s", path);
+		job_submit(assets_compile_job, compile, &shader_jobs);
+		return 1;
+	}
+
+	if (has_extension(path, material_extensions, LENOF(material_extensions)))
+	{
+		uint32_t count = material_find_dependents(path, dependents, ASSETS_MAX_DEPENDENTS);
+		uint32_t reloaded = 0;
+		for (uint32_t i = 0; i < count; i++)
+		{
+			if (material_reload(dependents[i]) == 0)
+				dependents[reloaded++] = dependents[i];
+		}
+		assets_mark_materials(dependents, reloaded);
+		return reloaded != 0;
+	}
+
+	if (has_extension(path, texture_extensions, LENOF(texture_extensions)))
+	{
+		Texture tex = texture_find_file(path);
+		if (!HANDLE_VALID(tex))
+			return 0;
+
+		int result = texture_reload(tex);
+		// The descriptors still reference the old image view
+		if (result == 1)
+		{
+			uint32_t count = material_find_dependents(path, dependents, ASSETS_MAX_DEPENDENTS);
+			uint32_t reloaded = 0;
+			for (uint32_t i = 0; i < count; i++)
+			{
+				if (material_reload(dependents[i]) == 0)
+					dependents[reloaded++] = dependents[i];
+			}
+			assets_mark_materials(dependents, reloaded);
+		}
+		return result >= 0;
+	}
+
+	if (has_extension(path, model_extensions, LENOF(model_extensions)))
+	{
+		Model* model = model_find_file(path);
+		if (model == NULL || model_reload(model) != 0)
+			return 0;
+
+		Scene* scene = scene_get_current();
+		if (scene)
+			rendertree_mark_changed(scene_get_rendertree(scene), entity_uses_model, model);
+		return 1;
+	}
+
+	return 0;
+}
+
+#if PL_LINUX
+struct AssetWatch
+{
+	int wd;
+	char dir[256];
+};
+
+static int watch_fd = -1;
+static struct AssetWatch watches[ASSETS_MAX_WATCHES];
+static uint32_t watch_count = 0;
+
+// Adds an inotify watch for dir and all sub directories
+static void assets_watch_dir(const char* dir)
+{
+	if (watch_count >= ASSETS_MAX_WATCHES)
+	{
+		LOG_W("Too many directories to watch, ignoring %s", dir);
+		return;
+	}
+
+	int wd = inotify_add_watch(watch_fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+	if (wd < 0)
+	{
+		LOG_W("Failed to watch directory %s - %s", dir, strerror(errno));
+		return;
+	}
+	watches[watch_count].wd = wd;
+	snprintf(watches[watch_count].dir, sizeof watches[watch_count].dir, "%s", dir);
+	watch_count++;
+
+	DIR* dp = opendir(dir);
+	if (dp == NULL)
+		return;
+
+	struct dirent* ep;
+	while ((ep = readdir(dp)))
+	{
+		if (!strcmp(ep->d_name, ".") || !strcmp(ep->d_name, ".."))
+			continue;
+
+		char full_path[PATH_MAX];
+		snprintf(full_path, sizeof full_path, "%s/%s", dir, ep->d_name);
+		if (is_dir(full_path))
+			assets_watch_dir(full_path);
+	}
+	closedir(dp);
+}
+
+int assets_watch(const char* dir)
+{
+	if (watch_fd >= 0)
+		assets_unwatch();
+
+	watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (watch_fd < 0)
+	{
+		LOG_E("Failed to initialize inotify - %s", strerror(errno));
+		return -1;
+	}
+
+	assets_watch_dir(dir);
+	LOG_S("Watching %d directories in %s for changes", watch_count, dir);
+	return 0;
+}
+
+void assets_unwatch()
+{
+	if (watch_fd < 0)
+		return;
+
+	close(watch_fd);
+	watch_fd = -1;
+	watch_count = 0;
+}
+
+uint32_t assets_poll_changes()
+{
+	if (watch_fd < 0)
+		return 0;
+
+	// Editors often write a file several times, only reload each file once per poll
+	// Allocated on the first change since most polls see none
+	char** changed = NULL;
+	uint32_t changed_count = 0;
+
+	// Aligned for the event structs
+	char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	ssize_t len;
+	while ((len = read(watch_fd, buf, sizeof buf)) > 0)
+	{
+		for (char* p = buf; p < buf + len; p += sizeof(struct inotify_event) + ((struct inotify_event*)p)->len)
+		{
+			const struct inotify_event* event = (const struct inotify_event*)p;
+			if (event->len == 0)
+				continue;
+
+			const char* dir = NULL;
+			for (uint32_t i = 0; i < watch_count; i++)
+			{
+				if (watches[i].wd == event->wd)
+				{
+					dir = watches[i].dir;
+					break;
+				}
+			}
+			if (dir == NULL)
+				continue;
+
+			char path[PATH_MAX];
+			snprintf(path, sizeof path, "%s/%s", dir, event->name);
+
+			// Watch new sub directories
+			if (event->mask & IN_ISDIR)
+			{
+				if (event->mask & (IN_CREATE | IN_MOVED_TO))
+					assets_watch_dir(path);
+				continue;
+			}
+
+			// Only react on completed writes
+			if ((event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) == 0)
+				continue;
+
+			uint32_t i = 0;
+			while (i < changed_count && strcmp(changed[i], path) != 0)
+				i++;
+			if (i != changed_count || changed_count >= ASSETS_MAX_CHANGES)
+				continue;
+
+			if (changed == NULL)
+				changed = malloc(ASSETS_MAX_CHANGES * sizeof *changed);
+			changed[changed_count++] = stringdup(path);
+		}
+	}
+
+	uint32_t reloaded = 0;
+	for (uint32_t i = 0; i < changed_count; i++)
+	{
+		reloaded += assets_reload_file(changed[i]);
+		free(changed[i]);
+	}
+	if (changed)
+		free(changed);
+	return reloaded;
+}
+#else
+int assets_watch(const char* dir)
+{
+	LOG_W("Asset hot reloading is not supported on this platform, not watching %s", dir);
+	return -1;
+}
+
+void assets_unwatch()
+{
+}
+
+uint32_t assets_poll_changes()
+{
+	return 0;
+}
+#endif
+
+void assets_update()
+{
+	texture_upload_pending();
+	model_upload_pending();
+	assets_poll_changes();
+	texture_stream_update();
+}
+
+void assets_wait()
+{
+	texture_wait_pending();
+	model_wait_pending();
+	job_wait(&shader_jobs);
+}
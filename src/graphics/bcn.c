@@ -0,0 +1,473 @@
+#include "bcn.h"
+#include "jobs.h"
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+// Interpolation weights of the 4 bit indices in BC7, out of 64
+static const int bc7_weights[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+size_t bcn_block_size(VkFormat format)
+{
+	switch (format)
+	{
+	case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+	case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+		return 8;
+	case VK_FORMAT_BC3_UNORM_BLOCK:
+	case VK_FORMAT_BC3_SRGB_BLOCK:
+	case VK_FORMAT_BC7_UNORM_BLOCK:
+	case VK_FORMAT_BC7_SRGB_BLOCK:
+		return 16;
+	default:
+		return 0;
+	}
+}
+
+size_t bcn_image_size(VkFormat format, int width, int height)
+{
+	return bcn_block_size(format) * ((width + 3) / 4) * ((height + 3) / 4);
+}
+
+bool bcn_has_alpha(const uint8_t* pixels, int width, int height)
+{
+	size_t count = (size_t)width * height;
+	for (size_t i = 0; i < count; i++)
+	{
+		if (pixels[4 * i + 3] != 255)
+			return true;
+	}
+	return false;
+}
+
+static float bcn_clamp(float v)
+{
+	return v < 0.0f ? 0.0f : v > 255.0f ? 255.0f : v;
+}
+
+// Finds two endpoints spanning the texels along their principal axis
+// Only the first channels are considered
+static void bcn_fit_axis(const float block[16][4], int channels, float e0[4], float e1[4])
+{
+	float mean[4] = {0};
+	for (int i = 0; i < 16; i++)
+		for (int c = 0; c < channels; c++)
+			mean[c] += block[i][c] / 16.0f;
+
+	float cov[4][4] = {0};
+	for (int i = 0; i < 16; i++)
+		for (int a = 0; a < channels; a++)
+			for (int b = 0; b < channels; b++)
+				cov[a][b] += (block[i][a] - mean[a]) * (block[i][b] - mean[b]);
+
+	// Power iteration converges to the axis with the largest variance
+	float axis[4] = {0};
+	for (int c = 0; c < channels; c++)
+		axis[c] = 1.0f;
+
+	for (int iter = 0; iter < 8; iter++)
+	{
+		float next[4] = {0};
+		float len = 0.0f;
+		for (int a = 0; a < channels; a++)
+		{
+			for (int b = 0; b < channels; b++)
+				next[a] += cov[a][b] * axis[b];
+			len += next[a] * next[a];
+		}
+
+		// Flat block
+		if (len < 1e-12f)
+			break;
+
+		len = sqrtf(len);
+		for (int c = 0; c < channels; c++)
+			axis[c] = next[c] / len;
+	}
+
+	float lo = FLT_MAX, hi = -FLT_MAX;
+	for (int i = 0; i < 16; i++)
+	{
+		float t = 0.0f;
+		for (int c = 0; c < channels; c++)
+			t += (block[i][c] - mean[c]) * axis[c];
+		lo = t < lo ? t : lo;
+		hi = t > hi ? t : hi;
+	}
+
+	for (int c = 0; c < 4; c++)
+	{
+		e0[c] = bcn_clamp(mean[c] + axis[c] * lo);
+		e1[c] = bcn_clamp(mean[c] + axis[c] * hi);
+	}
+}
+
+// Solves the endpoints with the least squared error for the texels interpolated by weights
+// Returns false if the system is singular, I.e; all texels use the same weight
+static bool bcn_refine(const float block[16][4], int channels, const float weights[16], float e0[4], float e1[4])
+{
+	float a = 0.0f, b = 0.0f, c = 0.0f;
+	float x0[4] = {0}, x1[4] = {0};
+	for (int i = 0; i < 16; i++)
+	{
+		float w = weights[i];
+		a += (1.0f - w) * (1.0f - w);
+		b += (1.0f - w) * w;
+		c += w * w;
+		for (int k = 0; k < channels; k++)
+		{
+			x0[k] += (1.0f - w) * block[i][k];
+			x1[k] += w * block[i][k];
+		}
+	}
+
+	float det = a * c - b * b;
+	if (fabsf(det) < 1e-6f)
+		return false;
+
+	for (int k = 0; k < channels; k++)
+	{
+		e0[k] = bcn_clamp((c * x0[k] - b * x1[k]) / det);
+		e1[k] = bcn_clamp((a * x1[k] - b * x0[k]) / det);
+	}
+	return true;
+}
+
+static uint16_t bcn_pack565(const float c[4])
+{
+	uint16_t r = (uint16_t)(c[0] * 31.0f / 255.0f + 0.5f);
+	uint16_t g = (uint16_t)(c[1] * 63.0f / 255.0f + 0.5f);
+	uint16_t b = (uint16_t)(c[2] * 31.0f / 255.0f + 0.5f);
+	return (r << 11) | (g << 5) | b;
+}
+
+static void bcn_unpack565(uint16_t v, float c[4])
+{
+	int r = v >> 11, g = (v >> 5) & 63, b = v & 31;
+	c[0] = (r << 3) | (r >> 2);
+	c[1] = (g << 2) | (g >> 4);
+	c[2] = (b << 3) | (b >> 2);
+}
+
+// Picks the closest of the four colors for each texel
+// Writes the weight of c1 for each texel and returns the squared error
+static float bcn_bc1_indices(const float block[16][4], uint16_t c0, uint16_t c1, uint32_t* indices, float weights[16])
+{
+	static const float palette_weights[4] = {0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f};
+
+	float palette[4][4];
+	bcn_unpack565(c0, palette[0]);
+	bcn_unpack565(c1, palette[1]);
+	for (int c = 0; c < 3; c++)
+	{
+		palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+		palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+	}
+
+	// Equal endpoints select the three color mode where index 3 is black
+	int count = c0 == c1 ? 1 : 4;
+
+	float error = 0.0f;
+	*indices = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		int best = 0;
+		float best_dist = FLT_MAX;
+		for (int k = 0; k < count; k++)
+		{
+			float dist = 0.0f;
+			for (int c = 0; c < 3; c++)
+				dist += (block[i][c] - palette[k][c]) * (block[i][c] - palette[k][c]);
+			if (dist < best_dist)
+			{
+				best_dist = dist;
+				best = k;
+			}
+		}
+		*indices |= (uint32_t)best << (2 * i);
+		weights[i] = palette_weights[best];
+		error += best_dist;
+	}
+	return error;
+}
+
+static void bcn_encode_bc1(const float block[16][4], uint8_t* dst)
+{
+	float e0[4], e1[4];
+	bcn_fit_axis(block, 3, e0, e1);
+
+	// Inset the endpoints as the extremes are rarely the best fit
+	for (int c = 0; c < 3; c++)
+	{
+		float inset = (e1[c] - e0[c]) / 16.0f;
+		e0[c] += inset;
+		e1[c] -= inset;
+	}
+
+	uint16_t best0 = 0, best1 = 0;
+	uint32_t best_indices = 0;
+	float best_error = FLT_MAX;
+	for (int iter = 0; iter < 2; iter++)
+	{
+		// c0 > c1 selects the four color mode
+		uint16_t a = bcn_pack565(e0), b = bcn_pack565(e1);
+		uint16_t c0 = a > b ? a : b;
+		uint16_t c1 = a > b ? b : a;
+
+		uint32_t indices;
+		float weights[16];
+		float error = bcn_bc1_indices(block, c0, c1, &indices, weights);
+		if (error < best_error)
+		{
+			best_error = error;
+			best0 = c0;
+			best1 = c1;
+			best_indices = indices;
+		}
+
+		bcn_unpack565(c0, e0);
+		bcn_unpack565(c1, e1);
+		if (!bcn_refine(block, 3, weights, e0, e1))
+			break;
+	}
+
+	dst[0] = best0 & 0xFF;
+	dst[1] = best0 >> 8;
+	dst[2] = best1 & 0xFF;
+	dst[3] = best1 >> 8;
+	for (int i = 0; i < 4; i++)
+		dst[4 + i] = (best_indices >> (8 * i)) & 0xFF;
+}
+
+// Encodes the alpha block of BC3 with eight interpolated values between the extremes
+static void bcn_encode_alpha(const float block[16][4], uint8_t* dst)
+{
+	float lo = 255.0f, hi = 0.0f;
+	for (int i = 0; i < 16; i++)
+	{
+		lo = block[i][3] < lo ? block[i][3] : lo;
+		hi = block[i][3] > hi ? block[i][3] : hi;
+	}
+
+	uint8_t a0 = (uint8_t)(hi + 0.5f);
+	uint8_t a1 = (uint8_t)(lo + 0.5f);
+	dst[0] = a0;
+	dst[1] = a1;
+
+	uint64_t bits = 0;
+	if (a0 > a1)
+	{
+		for (int i = 0; i < 16; i++)
+		{
+			// Steps from a0 towards a1
+			int step = (int)((a0 - block[i][3]) * 7.0f / (a0 - a1) + 0.5f);
+			step = step < 0 ? 0 : step > 7 ? 7 : step;
+			uint64_t code = step == 0 ? 0 : step == 7 ? 1 : step + 1;
+			bits |= code << (3 * i);
+		}
+	}
+
+	for (int i = 0; i < 6; i++)
+		dst[2 + i] = (bits >> (8 * i)) & 0xFF;
+}
+
+// Quantizes an endpoint to 7 bits per channel and a shared p-bit
+static void bcn_bc7_quantize(const float e[4], uint8_t q[4], int* pbit)
+{
+	float best_error = FLT_MAX;
+	for (int p = 0; p < 2; p++)
+	{
+		uint8_t v[4];
+		float error = 0.0f;
+		for (int c = 0; c < 4; c++)
+		{
+			int x = (int)((e[c] - p) / 2.0f + 0.5f);
+			v[c] = x < 0 ? 0 : x > 127 ? 127 : x;
+			float r = (v[c] << 1) | p;
+			error += (r - e[c]) * (r - e[c]);
+		}
+		if (error < best_error)
+		{
+			best_error = error;
+			memcpy(q, v, sizeof v);
+			*pbit = p;
+		}
+	}
+}
+
+// Picks the closest of the sixteen interpolated values for each texel
+// Writes the weight of e1 for each texel and returns the squared error
+static float bcn_bc7_indices(const float block[16][4], const int e0[4], const int e1[4], uint8_t indices[16], float weights[16])
+{
+	float palette[16][4];
+	for (int k = 0; k < 16; k++)
+		for (int c = 0; c < 4; c++)
+			palette[k][c] = ((64 - bc7_weights[k]) * e0[c] + bc7_weights[k] * e1[c] + 32) >> 6;
+
+	float error = 0.0f;
+	for (int i = 0; i < 16; i++)
+	{
+		int best = 0;
+		float best_dist = FLT_MAX;
+		for (int k = 0; k < 16; k++)
+		{
+			float dist = 0.0f;
+			for (int c = 0; c < 4; c++)
+				dist += (block[i][c] - palette[k][c]) * (block[i][c] - palette[k][c]);
+			if (dist < best_dist)
+			{
+				best_dist = dist;
+				best = k;
+			}
+		}
+		indices[i] = best;
+		weights[i] = bc7_weights[best] / 64.0f;
+		error += best_dist;
+	}
+	return error;
+}
+
+static void bcn_put_bits(uint8_t* dst, uint32_t* pos, uint32_t value, uint32_t count)
+{
+	for (uint32_t i = 0; i < count; i++, (*pos)++)
+	{
+		if (value & (1u << i))
+			dst[*pos / 8] |= 1u << (*pos % 8);
+	}
+}
+
+// Encodes a block with mode 6 of BC7
+// A single subset of RGBA endpoints with 7 bits and a p-bit each, and 4 bit indices
+static void bcn_encode_bc7(const float block[16][4], uint8_t* dst)
+{
+	float e0[4], e1[4];
+	bcn_fit_axis(block, 4, e0, e1);
+
+	uint8_t best_q[2][4] = {{0}};
+	int best_p[2] = {0};
+	uint8_t best_indices[16] = {0};
+	float best_error = FLT_MAX;
+	for (int iter = 0; iter < 2; iter++)
+	{
+		uint8_t q[2][4];
+		int p[2];
+		bcn_bc7_quantize(e0, q[0], &p[0]);
+		bcn_bc7_quantize(e1, q[1], &p[1]);
+
+		int full0[4], full1[4];
+		for (int c = 0; c < 4; c++)
+		{
+			full0[c] = (q[0][c] << 1) | p[0];
+			full1[c] = (q[1][c] << 1) | p[1];
+		}
+
+		uint8_t indices[16];
+		float weights[16];
+		float error = bcn_bc7_indices(block, full0, full1, indices, weights);
+		if (error < best_error)
+		{
+			best_error = error;
+			memcpy(best_q, q, sizeof q);
+			memcpy(best_p, p, sizeof p);
+			memcpy(best_indices, indices, sizeof indices);
+		}
+
+		for (int c = 0; c < 4; c++)
+		{
+			e0[c] = full0[c];
+			e1[c] = full1[c];
+		}
+		if (!bcn_refine(block, 4, weights, e0, e1))
+			break;
+	}
+
+	// The high bit of the first index is implicitly zero
+	if (best_indices[0] & 8)
+	{
+		for (int c = 0; c < 4; c++)
+		{
+			uint8_t tmp = best_q[0][c];
+			best_q[0][c] = best_q[1][c];
+			best_q[1][c] = tmp;
+		}
+		int tmp = best_p[0];
+		best_p[0] = best_p[1];
+		best_p[1] = tmp;
+		for (int i = 0; i < 16; i++)
+			best_indices[i] = 15 - best_indices[i];
+	}
+
+	memset(dst, 0, 16);
+	uint32_t pos = 0;
+	// Mode 6 is six zero bits followed by a one
+	bcn_put_bits(dst, &pos, 1 << 6, 7);
+	for (int c = 0; c < 4; c++)
+	{
+		bcn_put_bits(dst, &pos, best_q[0][c], 7);
+		bcn_put_bits(dst, &pos, best_q[1][c], 7);
+	}
+	bcn_put_bits(dst, &pos, best_p[0], 1);
+	bcn_put_bits(dst, &pos, best_p[1], 1);
+	bcn_put_bits(dst, &pos, best_indices[0], 3);
+	for (int i = 1; i < 16; i++)
+		bcn_put_bits(dst, &pos, best_indices[i], 4);
+}
+
+struct BcnJob
+{
+	VkFormat format;
+	const uint8_t* pixels;
+	int width;
+	int height;
+	uint8_t* dst;
+};
+
+// Compresses the rows of blocks [begin, end)
+static void bcn_compress_rows(void* arg, uint32_t begin, uint32_t end)
+{
+	const struct BcnJob* job = arg;
+	int blocks_x = (job->width + 3) / 4;
+	size_t block_size = bcn_block_size(job->format);
+
+	for (uint32_t by = begin; by < end; by++)
+	{
+		for (int bx = 0; bx < blocks_x; bx++)
+		{
+			float block[16][4];
+			for (int y = 0; y < 4; y++)
+			{
+				int sy = by * 4 + y < (uint32_t)job->height ? (int)by * 4 + y : job->height - 1;
+				for (int x = 0; x < 4; x++)
+				{
+					int sx = bx * 4 + x < job->width ? bx * 4 + x : job->width - 1;
+					const uint8_t* texel = job->pixels + 4 * ((size_t)sy * job->width + sx);
+					for (int c = 0; c < 4; c++)
+						block[y * 4 + x][c] = texel[c];
+				}
+			}
+
+			uint8_t* out = job->dst + (by * blocks_x + bx) * block_size;
+			switch (job->format)
+			{
+			case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+			case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+				bcn_encode_bc1(block, out);
+				break;
+			case VK_FORMAT_BC3_UNORM_BLOCK:
+			case VK_FORMAT_BC3_SRGB_BLOCK:
+				bcn_encode_alpha(block, out);
+				bcn_encode_bc1(block, out + 8);
+				break;
+			default:
+				bcn_encode_bc7(block, out);
+				break;
+			}
+		}
+	}
+}
+
+void bcn_compress(VkFormat format, const uint8_t* pixels, int width, int height, uint8_t* dst)
+{
+	struct BcnJob job = {format, pixels, width, height, dst};
+	job_parallel_for((height + 3) / 4, 4, bcn_compress_rows, &job);
+}
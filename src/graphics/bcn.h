@@ -0,0 +1,25 @@
+#ifndef BCN_H
+#define BCN_H
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "vulkan/vulkan.h"
+
+// Block compression of RGBA8 images into BC1, BC3 and BC7
+// Images are split into blocks of 4x4 texels, partial blocks at the edges are padded by repeating the last texel
+// Colors are encoded as they are, sRGB textures are compressed in gamma space
+
+// Returns the size in bytes of a 4x4 block
+// Returns 0 if the format is not a supported block compressed format
+size_t bcn_block_size(VkFormat format);
+
+// Returns the size in bytes of a compressed image
+size_t bcn_image_size(VkFormat format, int width, int height);
+
+// Returns true if any texel in the RGBA8 image is not fully opaque
+bool bcn_has_alpha(const uint8_t* pixels, int width, int height);
+
+// Compresses an RGBA8 image into dst which needs to be at least bcn_image_size bytes
+// Rows of blocks are split over the job system
+void bcn_compress(VkFormat format, const uint8_t* pixels, int width, int height, uint8_t* dst);
+#endif
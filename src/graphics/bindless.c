@@ -0,0 +1,370 @@
+#include "bindless.h"
+#include "buffer.h"
+#include "vulkan_members.h"
+#include "log.h"
+#include "magpie.h"
+#include <string.h>
+
+// The number of descriptor writes submitted at once
+#define BINDLESS_WRITE_BATCH 64
+
+#define TEXTURE_BINDING	 0
+#define MATERIAL_BINDING 1
+
+struct BindlessTexture
+{
+	Texture tex;
+	Sampler sampler;
+	bool used;
+};
+
+static VkDescriptorSetLayout bindless_layout = VK_NULL_HANDLE;
+
+// A descriptor set and material buffer region for each swapchain image
+static uint32_t frame_count = 0;
+static VkDescriptorPool bindless_pool = VK_NULL_HANDLE;
+static VkDescriptorSet* bindless_sets = NULL;
+
+static struct BindlessTexture* textures = NULL;
+static uint32_t texture_capacity = 0;
+// One past the highest index in use
+static uint32_t texture_end = 0;
+static uint32_t* free_textures = NULL;
+static uint32_t free_texture_count = 0;
+// The texture view version the descriptor of each frame was written with, texture_capacity for each frame
+// BINDLESS_INVALID if the descriptor needs to be written
+static uint32_t* texture_versions = NULL;
+
+// Host copy of the material buffer, copied into the region of each frame when changed
+static struct MaterialData* materials = NULL;
+static bool* materials_used = NULL;
+static uint32_t material_end = 0;
+static uint32_t* free_materials = NULL;
+static uint32_t free_material_count = 0;
+// Incremented when a material is added, each frame copies the materials when its version differs
+static uint32_t material_version = 0;
+static uint32_t* material_versions = NULL;
+
+// Holds the material buffer of every frame after each other
+static VkBuffer material_buffer = VK_NULL_HANDLE;
+static VkDeviceMemory material_memory = VK_NULL_HANDLE;
+static VkDeviceSize material_region_size = 0;
+static uint8_t* material_mapped = NULL;
+
+// Creates the descriptor sets and material buffer regions for each swapchain image
+// All textures and materials are written to the new sets by bindless_update
+// Returns 0 on success
+static int bindless_create_frames()
+{
+	frame_count = swapchain_image_count;
+
+	VkDescriptorPoolSize pool_sizes[2] = {
+		{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, texture_capacity * frame_count},
+		{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, frame_count},
+	};
+	VkDescriptorPoolCreateInfo pool_info = {0};
+	pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	pool_info.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT;
+	pool_info.poolSizeCount = 2;
+	pool_info.pPoolSizes = pool_sizes;
+	pool_info.maxSets = frame_count;
+
+	VkResult result = vkCreateDescriptorPool(device, &pool_info, NULL, &bindless_pool);
+	if (result != VK_SUCCESS)
+	{
+		LOG_E("Failed to create bindless descriptor pool - code %d", result);
+		return -2;
+	}
+
+	VkDescriptorSetLayout* layouts = malloc(frame_count * sizeof *layouts);
+	for (uint32_t i = 0; i < frame_count; i++)
+		layouts[i] = bindless_layout;
+	VkDescriptorSetAllocateInfo alloc_info = {0};
+	alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	alloc_info.descriptorPool = bindless_pool;
+	alloc_info.descriptorSetCount = frame_count;
+	alloc_info.pSetLayouts = layouts;
+
+	bindless_sets = calloc(frame_count, sizeof *bindless_sets);
+	result = vkAllocateDescriptorSets(device, &alloc_info, bindless_sets);
+	free(layouts);
+	if (result != VK_SUCCESS)
+	{
+		LOG_E("Failed to allocate bindless descriptor sets - code %d", result);
+		return -3;
+	}
+
+	// Each frame reads its own region of the buffer
+	material_region_size = BINDLESS_MAX_MATERIALS * sizeof(struct MaterialData);
+	material_region_size = (material_region_size + memory_limits.minStorageBufferOffsetAlignment - 1) & ~(memory_limits.minStorageBufferOffsetAlignment - 1);
+	if (buffer_create(material_region_size * frame_count, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+					  &material_buffer, &material_memory, NULL, NULL))
+	{
+		LOG_E("Failed to create bindless material buffer");
+		return -4;
+	}
+	vkMapMemory(device, material_memory, 0, material_region_size * frame_count, 0, (void**)&material_mapped);
+
+	VkDescriptorBufferInfo* buffer_infos = malloc(frame_count * sizeof *buffer_infos);
+	VkWriteDescriptorSet* writes = calloc(frame_count, sizeof *writes);
+	for (uint32_t i = 0; i < frame_count; i++)
+	{
+		buffer_infos[i].buffer = material_buffer;
+		buffer_infos[i].offset = material_region_size * i;
+		buffer_infos[i].range = BINDLESS_MAX_MATERIALS * sizeof(struct MaterialData);
+
+		writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writes[i].dstSet = bindless_sets[i];
+		writes[i].dstBinding = MATERIAL_BINDING;
+		writes[i].descriptorCount = 1;
+		writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		writes[i].pBufferInfo = &buffer_infos[i];
+	}
+	vkUpdateDescriptorSets(device, frame_count, writes, 0, NULL);
+	free(buffer_infos);
+	free(writes);
+
+	texture_versions = malloc(texture_capacity * frame_count * sizeof *texture_versions);
+	memset(texture_versions, 0xFF, texture_capacity * frame_count * sizeof *texture_versions);
+	material_versions = malloc(frame_count * sizeof *material_versions);
+	memset(material_versions, 0xFF, frame_count * sizeof *material_versions);
+	return 0;
+}
+
+static void bindless_destroy_frames()
+{
+	if (material_mapped)
+		vkUnmapMemory(device, material_memory);
+	vkDestroyBuffer(device, material_buffer, NULL);
+	vkFreeMemory(device, material_memory, NULL);
+	vkDestroyDescriptorPool(device, bindless_pool, NULL);
+
+	free(bindless_sets);
+	free(texture_versions);
+	free(material_versions);
+
+	bindless_pool = VK_NULL_HANDLE;
+	material_buffer = VK_NULL_HANDLE;
+	material_memory = VK_NULL_HANDLE;
+	material_mapped = NULL;
+	bindless_sets = NULL;
+	texture_versions = NULL;
+	material_versions = NULL;
+	frame_count = 0;
+}
+
+int bindless_init()
+{
+	if (bindless_texture_limit == 0)
+		return 0;
+
+	texture_capacity = bindless_texture_limit < BINDLESS_MAX_TEXTURES ? bindless_texture_limit : BINDLESS_MAX_TEXTURES;
+
+	VkDescriptorSetLayoutBinding bindings[2] = {0};
+	bindings[TEXTURE_BINDING].binding = TEXTURE_BINDING;
+	bindings[TEXTURE_BINDING].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	bindings[TEXTURE_BINDING].descriptorCount = texture_capacity;
+	bindings[TEXTURE_BINDING].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+	bindings[MATERIAL_BINDING].binding = MATERIAL_BINDING;
+	bindings[MATERIAL_BINDING].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	bindings[MATERIAL_BINDING].descriptorCount = 1;
+	bindings[MATERIAL_BINDING].stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+
+	// Unused texture slots are left unwritten and slots are written while command buffers using the set are recorded
+	VkDescriptorBindingFlags binding_flags[2] = {VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT, 0};
+	VkDescriptorSetLayoutBindingFlagsCreateInfoEXT flags_info = {0};
+	flags_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+	flags_info.bindingCount = 2;
+	flags_info.pBindingFlags = binding_flags;
+
+	VkDescriptorSetLayoutCreateInfo layout_info = {0};
+	layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layout_info.pNext = &flags_info;
+	layout_info.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT;
+	layout_info.bindingCount = 2;
+	layout_info.pBindings = bindings;
+
+	VkResult result = vkCreateDescriptorSetLayout(device, &layout_info, NULL, &bindless_layout);
+	if (result != VK_SUCCESS)
+	{
+		LOG_E("Failed to create bindless descriptor set layout - code %d", result);
+		return -1;
+	}
+
+	// Bindless stays unsupported if the frames can't be created
+	int frames_result = bindless_create_frames();
+	if (frames_result != 0)
+	{
+		bindless_destroy_frames();
+		vkDestroyDescriptorSetLayout(device, bindless_layout, NULL);
+		bindless_layout = VK_NULL_HANDLE;
+		return frames_result;
+	}
+
+	textures = calloc(texture_capacity, sizeof *textures);
+	free_textures = malloc(texture_capacity * sizeof *free_textures);
+	materials = calloc(BINDLESS_MAX_MATERIALS, sizeof *materials);
+	materials_used = calloc(BINDLESS_MAX_MATERIALS, sizeof *materials_used);
+	free_materials = malloc(BINDLESS_MAX_MATERIALS * sizeof *free_materials);
+
+	LOG_S("Created bindless descriptors with %d textures and %d materials", texture_capacity, BINDLESS_MAX_MATERIALS);
+	return 0;
+}
+
+int bindless_recreate()
+{
+	if (!bindless_supported() || frame_count == swapchain_image_count)
+		return 0;
+
+	bindless_destroy_frames();
+	return bindless_create_frames();
+}
+
+bool bindless_supported()
+{
+	return bindless_layout != VK_NULL_HANDLE;
+}
+
+VkDescriptorSetLayout bindless_get_layout()
+{
+	return bindless_layout;
+}
+
+VkDescriptorSet bindless_get_set(uint32_t frame)
+{
+	return frame < frame_count ? bindless_sets[frame] : VK_NULL_HANDLE;
+}
+
+uint32_t bindless_texture_add(Texture tex, Sampler sampler)
+{
+	uint32_t index = BINDLESS_INVALID;
+	if (free_texture_count)
+		index = free_textures[--free_texture_count];
+	else if (texture_end < texture_capacity)
+		index = texture_end++;
+	else
+	{
+		LOG_E("Bindless texture array is full with %d textures", texture_capacity);
+		return BINDLESS_INVALID;
+	}
+
+	textures[index] = (struct BindlessTexture){.tex = tex, .sampler = sampler, .used = true};
+	for (uint32_t i = 0; i < frame_count; i++)
+		texture_versions[i * texture_capacity + index] = BINDLESS_INVALID;
+	return index;
+}
+
+void bindless_texture_remove(uint32_t index)
+{
+	if (index >= texture_end || !textures[index].used)
+		return;
+
+	// The descriptor is left as is, no material references it anymore
+	textures[index].used = false;
+	free_textures[free_texture_count++] = index;
+}
+
+uint32_t bindless_material_add(const struct MaterialData* data)
+{
+	uint32_t index = BINDLESS_INVALID;
+	if (free_material_count)
+		index = free_materials[--free_material_count];
+	else if (material_end < BINDLESS_MAX_MATERIALS)
+		index = material_end++;
+	else
+	{
+		LOG_E("Bindless material buffer is full with %d materials", BINDLESS_MAX_MATERIALS);
+		return BINDLESS_INVALID;
+	}
+
+	materials[index] = *data;
+	materials_used[index] = true;
+	material_version++;
+	return index;
+}
+
+void bindless_material_remove(uint32_t index)
+{
+	if (index >= material_end || !materials_used[index])
+		return;
+
+	materials_used[index] = false;
+	free_materials[free_material_count++] = index;
+}
+
+void bindless_update(uint32_t frame)
+{
+	if (!bindless_supported() || frame >= frame_count)
+		return;
+
+	if (material_versions[frame] != material_version)
+	{
+		memcpy(material_mapped + material_region_size * frame, materials, material_end * sizeof(struct MaterialData));
+		material_versions[frame] = material_version;
+	}
+
+	uint32_t* versions = texture_versions + frame * texture_capacity;
+	VkDescriptorImageInfo image_infos[BINDLESS_WRITE_BATCH];
+	VkWriteDescriptorSet writes[BINDLESS_WRITE_BATCH];
+	uint32_t write_count = 0;
+	for (uint32_t i = 0; i < texture_end; i++)
+	{
+		struct BindlessTexture* slot = &textures[i];
+		if (!slot->used)
+			continue;
+
+		uint32_t version = texture_get_view_version(slot->tex);
+		if (versions[i] == version)
+			continue;
+
+		versions[i] = version;
+
+		image_infos[write_count].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		image_infos[write_count].imageView = texture_get_image_view(slot->tex);
+		image_infos[write_count].sampler = sampler_get_vksampler(slot->sampler);
+
+		writes[write_count] = (VkWriteDescriptorSet){0};
+		writes[write_count].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writes[write_count].dstSet = bindless_sets[frame];
+		writes[write_count].dstBinding = TEXTURE_BINDING;
+		writes[write_count].dstArrayElement = i;
+		writes[write_count].descriptorCount = 1;
+		writes[write_count].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		writes[write_count].pImageInfo = &image_infos[write_count];
+
+		if (++write_count == BINDLESS_WRITE_BATCH)
+		{
+			vkUpdateDescriptorSets(device, write_count, writes, 0, NULL);
+			write_count = 0;
+		}
+	}
+
+	if (write_count)
+		vkUpdateDescriptorSets(device, write_count, writes, 0, NULL);
+}
+
+void bindless_destroy()
+{
+	if (!bindless_supported())
+		return;
+
+	bindless_destroy_frames();
+	vkDestroyDescriptorSetLayout(device, bindless_layout, NULL);
+
+	free(textures);
+	free(free_textures);
+	free(materials);
+	free(materials_used);
+	free(free_materials);
+
+	bindless_layout = VK_NULL_HANDLE;
+	textures = NULL;
+	free_textures = NULL;
+	materials = NULL;
+	materials_used = NULL;
+	free_materials = NULL;
+	texture_end = 0;
+	free_texture_count = 0;
+	material_end = 0;
+	free_material_count = 0;
+}
@@ -0,0 +1,59 @@
+#ifndef BINDLESS_H
+#define BINDLESS_H
+#include <stdint.h>
+#include <stdbool.h>
+#include "graphics/shadertypes.h"
+#include "graphics/texture.h"
+
+// Bindless materials share one descriptor set per swapchain image instead of a set per material
+// Binding 0 is an array of all registered textures, binding 1 a storage buffer of MaterialData
+// Materials are identified by their index in the buffer, which entities pass to the shaders in EntityData
+// Entities with different bindless materials but the same pipeline and mesh can be drawn instanced
+// Only available if the device supports descriptor indexing
+
+// The maximum number of textures in the bindless texture array, the device limit may be lower
+#define BINDLESS_MAX_TEXTURES 4096
+// The maximum number of materials in the bindless material buffer
+#define BINDLESS_MAX_MATERIALS 1024
+
+#define BINDLESS_INVALID ((uint32_t)-1)
+
+// Creates the bindless descriptor layout, sets and material buffer
+// Does nothing if descriptor indexing is not supported
+// Returns 0 on success
+int bindless_init();
+
+// Recreates the descriptor sets and material buffer if the number of swapchain images changed
+// Called when the swapchain is recreated, the previous sets must no longer be in use
+// Returns 0 on success
+int bindless_recreate();
+
+// Returns true if bindless materials can be used
+bool bindless_supported();
+
+// Returns the layout of the bindless set, used in place of the per material layout
+VkDescriptorSetLayout bindless_get_layout();
+
+VkDescriptorSet bindless_get_set(uint32_t frame);
+
+// Adds a texture to the bindless texture array
+// Returns the index of the texture in the array or BINDLESS_INVALID if the array is full
+uint32_t bindless_texture_add(Texture tex, Sampler sampler);
+
+// Frees a texture index, the texture and sampler are not destroyed
+void bindless_texture_remove(uint32_t index);
+
+// Adds a material to the bindless material buffer
+// Returns the index of the material or BINDLESS_INVALID if the buffer is full
+uint32_t bindless_material_add(const struct MaterialData* data);
+
+void bindless_material_remove(uint32_t index);
+
+// Writes the textures and materials changed since the frame was last updated
+// Textures whose image views were recreated are rewritten as well
+// Recorded command buffers stay valid since the texture array is updated after bind
+// The material buffer of the frame must not be in use by the GPU
+void bindless_update(uint32_t frame);
+
+void bindless_destroy();
+#endif
@@ -23,9 +23,17 @@ void buffer_pool_add(BufferPool* pool, uint32_t size)
 	{
 		size = memory_limits.maxUniformBufferRange;
 	}
+	// Storage buffers allocate at least as much to be shared by several buffers
+	else if (pool->usage == VK_BUFFER_USAGE_STORAGE_BUFFER_BIT && size < memory_limits.maxUniformBufferRange)
+	{
+		size = memory_limits.maxUniformBufferRange;
+	}
 
 	// Create the buffer and memory for vulkan
 	buffer_create(size, pool->usage, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &new_block->buffer, &new_block->memory, &pool->alignment, NULL);
+	// Storage buffers are bound at their offset in the block
+	if (pool->usage == VK_BUFFER_USAGE_STORAGE_BUFFER_BIT && pool->alignment < memory_limits.minStorageBufferOffsetAlignment)
+		pool->alignment = memory_limits.minStorageBufferOffsetAlignment;
 
 	// No blocks have been allocated nor freed, so initialize to 0
 	new_block->free_pool = (mempool_t){0};
@@ -310,7 +318,7 @@ void single_use_commands_end(Commandbuffer commandbuffer)
 	commandbuffer_destroy(commandbuffer);
 }
 
-VkDeviceSize image_create(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage* image,
+VkDeviceSize image_create(uint32_t width, uint32_t height, uint32_t mip_levels, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage* image,
 						  VkDeviceMemory* memory, VkSampleCountFlagBits num_samples)
 {
 	// Create the VKImage
@@ -320,7 +328,7 @@ VkDeviceSize image_create(uint32_t width, uint32_t height, VkFormat format, VkIm
 	imageInfo.extent.width = width;
 	imageInfo.extent.height = height;
 	imageInfo.extent.depth = 1;
-	imageInfo.mipLevels = 1;
+	imageInfo.mipLevels = mip_levels;
 	imageInfo.arrayLayers = 1;
 
 	imageInfo.format = format;
@@ -363,7 +371,7 @@ VkDeviceSize image_create(uint32_t width, uint32_t height, VkFormat format, VkIm
 	return memRequirements.size;
 }
 
-VkImageView image_view_create(VkImage image, VkFormat format, VkImageAspectFlags aspect_flags)
+VkImageView image_view_create(VkImage image, VkFormat format, VkImageAspectFlags aspect_flags, uint32_t mip_levels)
 {
 	VkImageViewCreateInfo viewInfo = {0};
 	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -372,7 +380,7 @@ VkImageView image_view_create(VkImage image, VkFormat format, VkImageAspectFlags
 	viewInfo.format = format;
 	viewInfo.subresourceRange.aspectMask = aspect_flags;
 	viewInfo.subresourceRange.baseMipLevel = 0;
-	viewInfo.subresourceRange.levelCount = 1;
+	viewInfo.subresourceRange.levelCount = mip_levels;
 	viewInfo.subresourceRange.baseArrayLayer = 0;
 	viewInfo.subresourceRange.layerCount = 1;
 	VkImageView view;
@@ -385,7 +393,7 @@ VkImageView image_view_create(VkImage image, VkFormat format, VkImageAspectFlags
 	return view;
 }
 
-void transition_image_layout(VkImage image, VkFormat format, VkImageLayout old_layout, VkImageLayout new_layout)
+void transition_image_layout(VkImage image, VkFormat format, VkImageLayout old_layout, VkImageLayout new_layout, uint32_t mip_levels)
 {
 	Commandbuffer commandbuffer = single_use_commands_begin();
 
@@ -414,7 +422,7 @@ void transition_image_layout(VkImage image, VkFormat format, VkImageLayout old_l
 		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 	}
 	barrier.subresourceRange.baseMipLevel = 0;
-	barrier.subresourceRange.levelCount = 1;
+	barrier.subresourceRange.levelCount = mip_levels;
 	barrier.subresourceRange.baseArrayLayer = 0;
 	barrier.subresourceRange.layerCount = 1;
 
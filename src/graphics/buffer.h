@@ -83,14 +83,16 @@ Commandbuffer single_use_commands_begin();
 // Ends and frees a single time command buffer
 void single_use_commands_end(Commandbuffer command_buffer);
 
-// Creates and allocates a vulkan image
+// Creates and allocates a vulkan image with mip_levels levels
 // Returns the allocated size
-VkDeviceSize image_create(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage* image,
+VkDeviceSize image_create(uint32_t width, uint32_t height, uint32_t mip_levels, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage* image,
 						  VkDeviceMemory* memory, VkSampleCountFlagBits num_samples);
 
-VkImageView image_view_create(VkImage image, VkFormat format, VkImageAspectFlags aspect_flags);
+// Creates a view of all mip levels of an image
+VkImageView image_view_create(VkImage image, VkFormat format, VkImageAspectFlags aspect_flags, uint32_t mip_levels);
 
 void copy_buffer_to_image(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height);
 
-void transition_image_layout(VkImage image, VkFormat format, VkImageLayout old_layout, VkImageLayout new_layout);
+// Transitions all mip levels of an image
+void transition_image_layout(VkImage image, VkFormat format, VkImageLayout old_layout, VkImageLayout new_layout, uint32_t mip_levels);
 #endif
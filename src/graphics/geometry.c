@@ -0,0 +1,243 @@
+#include "geometry.h"
+#include "buffer.h"
+#include "vulkan_members.h"
+#include "log.h"
+#include "magpie.h"
+#include <string.h>
+#include <stdbool.h>
+
+// A free range of elements in an arena
+struct GeometryRange
+{
+	uint32_t first;
+	uint32_t count;
+};
+
+// A device local buffer suballocated by element
+struct GeometryArena
+{
+	VkBuffer buffer;
+	VkDeviceMemory memory;
+	VkBufferUsageFlags usage;
+	// The size of each element in bytes
+	uint32_t stride;
+	// The number of elements the buffer holds
+	uint32_t capacity;
+	uint32_t min_capacity;
+
+	// Free ranges sorted by first element
+	struct GeometryRange* free_ranges;
+	uint32_t free_count;
+	uint32_t free_size;
+};
+
+static struct GeometryArena vertex_arena = {.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, .stride = sizeof(Vertex), .min_capacity = GEOMETRY_MIN_VERTICES};
+static struct GeometryArena index_arena = {.usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT, .stride = sizeof(uint32_t), .min_capacity = GEOMETRY_MIN_INDICES};
+
+static uint32_t geometry_version = 0;
+
+// Inserts a free range at position index of the free list
+static void geometry_insert_range(struct GeometryArena* arena, uint32_t index, uint32_t first, uint32_t count)
+{
+	if (arena->free_count >= arena->free_size)
+	{
+		arena->free_size = arena->free_size ? arena->free_size * 2 : 16;
+		arena->free_ranges = realloc(arena->free_ranges, arena->free_size * sizeof *arena->free_ranges);
+	}
+	memmove(arena->free_ranges + index + 1, arena->free_ranges + index, (arena->free_count - index) * sizeof *arena->free_ranges);
+	arena->free_ranges[index] = (struct GeometryRange){first, count};
+	arena->free_count++;
+}
+
+static void geometry_erase_range(struct GeometryArena* arena, uint32_t index)
+{
+	memmove(arena->free_ranges + index, arena->free_ranges + index + 1, (arena->free_count - index - 1) * sizeof *arena->free_ranges);
+	arena->free_count--;
+}
+
+// Returns a range to the free list, merging it with adjacent free ranges
+static void geometry_free_range(struct GeometryArena* arena, uint32_t first, uint32_t count)
+{
+	uint32_t index = 0;
+	while (index < arena->free_count && arena->free_ranges[index].first < first)
+		index++;
+
+	bool merge_prev = index > 0 && arena->free_ranges[index - 1].first + arena->free_ranges[index - 1].count == first;
+	bool merge_next = index < arena->free_count && first + count == arena->free_ranges[index].first;
+
+	if (merge_prev && merge_next)
+	{
+		arena->free_ranges[index - 1].count += count + arena->free_ranges[index].count;
+		geometry_erase_range(arena, index);
+	}
+	else if (merge_prev)
+		arena->free_ranges[index - 1].count += count;
+	else if (merge_next)
+	{
+		arena->free_ranges[index].first = first;
+		arena->free_ranges[index].count += count;
+	}
+	else
+		geometry_insert_range(arena, index, first, count);
+}
+
+// Recreates the buffer of an arena to hold at least capacity elements and copies the previous contents
+static int geometry_grow(struct GeometryArena* arena, uint32_t capacity)
+{
+	uint32_t new_capacity = arena->capacity ? arena->capacity : arena->min_capacity;
+	while (new_capacity < capacity)
+		new_capacity *= 2;
+
+	VkBuffer buffer;
+	VkDeviceMemory memory;
+	if (buffer_create((VkDeviceSize)new_capacity * arena->stride, arena->usage | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+					  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &buffer, &memory, NULL, NULL))
+	{
+		LOG_E("Failed to create geometry buffer of %d elements", new_capacity);
+		return -1;
+	}
+
+	if (arena->capacity)
+	{
+		LOG_S("Growing geometry buffer from %d to %d elements", arena->capacity, new_capacity);
+		buffer_copy(arena->buffer, buffer, (VkDeviceSize)arena->capacity * arena->stride, 0, 0);
+
+		// Command buffers in flight may still bind the previous buffer
+		vkDeviceWaitIdle(device);
+		vkDestroyBuffer(device, arena->buffer, NULL);
+		vkFreeMemory(device, arena->memory, NULL);
+	}
+
+	geometry_free_range(arena, arena->capacity, new_capacity - arena->capacity);
+	arena->buffer = buffer;
+	arena->memory = memory;
+	arena->capacity = new_capacity;
+	geometry_version++;
+	return 0;
+}
+
+// Allocates count elements from an arena with best fit, growing the buffer if needed
+// Returns the first element or GEOMETRY_INVALID
+static uint32_t geometry_alloc(struct GeometryArena* arena, uint32_t count)
+{
+	uint32_t best = GEOMETRY_INVALID;
+	for (uint32_t i = 0; i < arena->free_count; i++)
+	{
+		if (arena->free_ranges[i].count >= count && (best == GEOMETRY_INVALID || arena->free_ranges[i].count < arena->free_ranges[best].count))
+			best = i;
+	}
+
+	if (best == GEOMETRY_INVALID)
+	{
+		// Trailing free space is merged into the grown range
+		uint32_t tail = 0;
+		if (arena->free_count && arena->free_ranges[arena->free_count - 1].first + arena->free_ranges[arena->free_count - 1].count == arena->capacity)
+			tail = arena->free_ranges[arena->free_count - 1].count;
+
+		if (geometry_grow(arena, arena->capacity - tail + count) != 0)
+			return GEOMETRY_INVALID;
+		best = arena->free_count - 1;
+	}
+
+	struct GeometryRange* range = &arena->free_ranges[best];
+	uint32_t first = range->first;
+	range->first += count;
+	range->count -= count;
+	if (range->count == 0)
+		geometry_erase_range(arena, best);
+	return first;
+}
+
+// Uploads count elements to an arena through a staging buffer
+static uint32_t geometry_add(struct GeometryArena* arena, const void* data, uint32_t count)
+{
+	if (count == 0)
+		return 0;
+
+	uint32_t first = geometry_alloc(arena, count);
+	if (first == GEOMETRY_INVALID)
+		return GEOMETRY_INVALID;
+
+	VkDeviceSize size = (VkDeviceSize)count * arena->stride;
+	VkBuffer staging_buffer;
+	VkDeviceMemory staging_buffer_memory;
+	buffer_create(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &staging_buffer,
+				  &staging_buffer_memory, NULL, NULL);
+
+	void* mapped = NULL;
+	vkMapMemory(device, staging_buffer_memory, 0, size, 0, &mapped);
+	if (mapped == NULL)
+	{
+		LOG_E("Failed to map geometry staging memory");
+		vkDestroyBuffer(device, staging_buffer, NULL);
+		vkFreeMemory(device, staging_buffer_memory, NULL);
+		geometry_free_range(arena, first, count);
+		return GEOMETRY_INVALID;
+	}
+	memcpy(mapped, data, size);
+	vkUnmapMemory(device, staging_buffer_memory);
+
+	buffer_copy(staging_buffer, arena->buffer, size, 0, first * arena->stride);
+	vkDestroyBuffer(device, staging_buffer, NULL);
+	vkFreeMemory(device, staging_buffer_memory, NULL);
+	return first;
+}
+
+static void geometry_arena_destroy(struct GeometryArena* arena)
+{
+	if (arena->capacity)
+	{
+		vkDestroyBuffer(device, arena->buffer, NULL);
+		vkFreeMemory(device, arena->memory, NULL);
+	}
+	free(arena->free_ranges);
+	arena->buffer = VK_NULL_HANDLE;
+	arena->memory = VK_NULL_HANDLE;
+	arena->capacity = 0;
+	arena->free_ranges = NULL;
+	arena->free_count = 0;
+	arena->free_size = 0;
+}
+
+uint32_t geometry_add_vertices(const Vertex* vertices, uint32_t count)
+{
+	return geometry_add(&vertex_arena, vertices, count);
+}
+
+uint32_t geometry_add_indices(const uint32_t* indices, uint32_t count)
+{
+	return geometry_add(&index_arena, indices, count);
+}
+
+void geometry_remove_vertices(uint32_t first, uint32_t count)
+{
+	if (count)
+		geometry_free_range(&vertex_arena, first, count);
+}
+
+void geometry_remove_indices(uint32_t first, uint32_t count)
+{
+	if (count)
+		geometry_free_range(&index_arena, first, count);
+}
+
+void geometry_bind(Commandbuffer commandbuffer)
+{
+	if (vertex_arena.capacity == 0 || index_arena.capacity == 0)
+		return;
+
+	VkDeviceSize offset = 0;
+	vkCmdBindVertexBuffers(commandbuffer_vk(commandbuffer), 0, 1, &vertex_arena.buffer, &offset);
+	vkCmdBindIndexBuffer(commandbuffer_vk(commandbuffer), index_arena.buffer, 0, VK_INDEX_TYPE_UINT32);
+}
+
+uint32_t geometry_get_version()
+{
+	return geometry_version;
+}
+
+void geometry_destroy()
+{
+	geometry_arena_destroy(&vertex_arena);
+	geometry_arena_destroy(&index_arena);
+}
@@ -0,0 +1,45 @@
+#ifndef GEOMETRY_H
+#define GEOMETRY_H
+#include <stdint.h>
+#include "graphics/commandbuffer.h"
+#include "graphics/vertexbuffer.h"
+
+// All meshes share one vertex and one index buffer
+// A mesh is a range of indices and vertices in the shared buffers, drawn with firstIndex and vertexOffset
+// The buffers are bound once per command buffer, so draws of different meshes only differ in their offsets
+// The buffers grow when full, which invalidates recorded command buffers binding them
+
+// The initial number of vertices and indices the buffers hold
+#define GEOMETRY_MIN_VERTICES 65536
+#define GEOMETRY_MIN_INDICES  196608
+
+#define GEOMETRY_INVALID ((uint32_t)-1)
+
+// Uploads vertices to the shared vertex buffer
+// Returns the index of the first vertex or GEOMETRY_INVALID on failure
+uint32_t geometry_add_vertices(const Vertex* vertices, uint32_t count);
+
+// Uploads indices to the shared index buffer
+// The indices are relative to the first vertex of the mesh
+// Returns the index of the first index or GEOMETRY_INVALID on failure
+uint32_t geometry_add_indices(const uint32_t* indices, uint32_t count);
+
+// Frees a range returned by geometry_add_vertices
+// The vertices must not be in use by the GPU
+void geometry_remove_vertices(uint32_t first, uint32_t count);
+
+// Frees a range returned by geometry_add_indices
+// The indices must not be in use by the GPU
+void geometry_remove_indices(uint32_t first, uint32_t count);
+
+// Binds the shared vertex and index buffers
+void geometry_bind(Commandbuffer commandbuffer);
+
+// Returns a number which changes every time the buffers are recreated
+// Command buffers recorded with an earlier version need to be re-recorded
+uint32_t geometry_get_version();
+
+// Destroys the shared buffers
+// All meshes need to be destroyed before
+void geometry_destroy();
+#endif
@@ -0,0 +1,886 @@
+#include "indirect.h"
+#include "bindless.h"
+#include "geometry.h"
+#include "buffer.h"
+#include "vulkan_internal.h"
+#include "graphics/renderer.h"
+#include "graphics/shadertypes.h"
+#include "settings.h"
+#include "utils.h"
+#include "log.h"
+#include "magpie.h"
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+
+// The initial number of batches the buffers of each frame hold
+#define INDIRECT_MIN_BATCHES 16
+
+#define ENTITY_BINDING	   0
+#define VISIBLE_BINDING	   1
+#define COMMAND_BINDING	   2
+#define BATCH_BINDING	   3
+#define GROUP_BINDING	   4
+#define VISIBILITY_BINDING 5
+#define BINDING_COUNT	   6
+
+// Marks a free slot or unused batch
+#define INDIRECT_NONE UINT32_MAX
+
+struct IndirectBuffer
+{
+	VkBuffer buffer;
+	VkDeviceMemory memory;
+	// NULL if the buffer is not host visible
+	void* mapped;
+};
+
+struct IndirectFrame
+{
+	// struct IndirectEntityData for each slot, only changed entities are written by the host
+	struct IndirectBuffer entities;
+	// The indices of the visible entities grouped by batch, written by the cull shader
+	struct IndirectBuffer visible;
+	// A bit for each slot not occluded this frame, written by the host
+	struct IndirectBuffer visibility;
+	uint32_t entity_capacity;
+
+	// VkDrawIndexedIndirectCommand for each batch, written by the cull shader
+	struct IndirectBuffer commands;
+	// struct IndirectBatchData for each batch
+	struct IndirectBuffer batches;
+	// struct IndirectGroupData for each group, the draw counts are the count buffer of the draws
+	struct IndirectBuffer groups;
+	uint32_t batch_capacity;
+	// The batch version the batch and group buffers were written for
+	uint32_t batch_version;
+
+	// Set when the buffers are recreated and the descriptor set needs to be rewritten
+	bool dirty;
+	VkDescriptorSet set;
+
+	Commandbuffer cull_commands;
+	Commandbuffer draw_commands;
+};
+
+// The host copy of an entity resident in the entity buffers
+struct IndirectSlot
+{
+	// The batch is INDIRECT_NONE for free slots
+	struct IndirectEntityData data;
+	// A bit for each frame whose entity buffer does not hold data yet
+	uint32_t stale;
+};
+
+// The resident entities sharing an indirect pipeline, mesh, and level of detail
+struct IndirectBatch
+{
+	uintptr_t key;
+	Material material;
+	Mesh* mesh;
+	uint32_t lod;
+	// The number of resident entities in the batch, unused batches have none
+	uint32_t users;
+	// The range of the batch in the visible indices
+	uint32_t offset;
+	uint32_t group;
+	uint32_t command;
+};
+
+// The batches sharing an indirect pipeline, their draw commands are consecutive
+struct IndirectGroup
+{
+	Material material;
+	uint32_t first;
+	uint32_t count;
+};
+
+struct CullConstants
+{
+	// Frustum planes facing inwards
+	vec4 planes[6];
+	uint32_t entity_count;
+	uint32_t batch_count;
+	uint32_t group_count;
+	// 0 culls the entities, 1 writes the draw commands
+	uint32_t pass;
+	// Set if the draws of each group are compacted and drawn with a draw count
+	uint32_t compact;
+};
+
+static VkDescriptorSetLayout indirect_layout = VK_NULL_HANDLE;
+static VkDescriptorPool indirect_pool = VK_NULL_HANDLE;
+static VkPipelineLayout cull_layout = VK_NULL_HANDLE;
+static VkPipeline cull_pipeline = VK_NULL_HANDLE;
+static PFN_vkCmdDrawIndexedIndirectCountKHR cmd_draw_indexed_indirect_count = NULL;
+
+// A frame for each swapchain image
+static struct IndirectFrame* frames = NULL;
+static uint32_t frame_count = 0;
+
+// The frame entities are gathered for
+static uint32_t gather_frame = 0;
+
+static struct IndirectSlot* slots = NULL;
+static uint32_t slot_count = 0;
+static uint32_t slot_size = 0;
+static uint32_t* free_slots = NULL;
+static uint32_t free_slot_count = 0;
+// A bit for each slot added this frame, copied to the visibility buffer of the frame
+static uint32_t* visibility = NULL;
+
+static struct IndirectBatch* batches = NULL;
+static uint32_t batch_count = 0;
+static uint32_t batch_size = 0;
+// Incremented when the batches or their entity counts change
+static uint32_t batch_version = 1;
+// The batch version the groups were laid out for
+static uint32_t layout_version = 0;
+
+// The used batches ordered by pipeline
+static uint32_t* batch_order = NULL;
+static struct IndirectGroup* groups = NULL;
+static uint32_t group_count = 0;
+
+static int indirect_buffer_create(VkDeviceSize size, VkBufferUsageFlags usage, bool host_visible, struct IndirectBuffer* buffer)
+{
+	VkMemoryPropertyFlags properties = host_visible ? VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT : VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+	if (buffer_create(size, usage, properties, &buffer->buffer, &buffer->memory, NULL, NULL))
+	{
+		LOG_E("Failed to create indirect draw buffer of %d bytes", (uint32_t)size);
+		return -1;
+	}
+
+	buffer->mapped = NULL;
+	if (host_visible)
+		vkMapMemory(device, buffer->memory, 0, size, 0, &buffer->mapped);
+	return 0;
+}
+
+static void indirect_buffer_destroy(struct IndirectBuffer* buffer)
+{
+	if (buffer->mapped)
+		vkUnmapMemory(device, buffer->memory);
+	vkDestroyBuffer(device, buffer->buffer, NULL);
+	vkFreeMemory(device, buffer->memory, NULL);
+	*buffer = (struct IndirectBuffer){0};
+}
+
+// Grows the entity buffers of a frame to hold at least count entities
+// The resident entities are copied to the new buffer
+// The buffers of the frame must not be in use by the GPU
+static int indirect_reserve_entities(struct IndirectFrame* frame, uint32_t count)
+{
+	if (count <= frame->entity_capacity)
+		return 0;
+
+	uint32_t capacity = frame->entity_capacity ? frame->entity_capacity : INDIRECT_MIN_ENTITIES;
+	while (capacity < count)
+		capacity *= 2;
+
+	struct IndirectBuffer entities, visible, visibility_bits;
+	if (indirect_buffer_create(capacity * sizeof(struct IndirectEntityData), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, true, &entities))
+		return -1;
+	if (indirect_buffer_create(capacity * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, false, &visible))
+	{
+		indirect_buffer_destroy(&entities);
+		return -1;
+	}
+	if (indirect_buffer_create(capacity / 32 * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, true, &visibility_bits))
+	{
+		indirect_buffer_destroy(&entities);
+		indirect_buffer_destroy(&visible);
+		return -1;
+	}
+
+	if (frame->entity_capacity)
+	{
+		memcpy(entities.mapped, frame->entities.mapped, frame->entity_capacity * sizeof(struct IndirectEntityData));
+		indirect_buffer_destroy(&frame->entities);
+		indirect_buffer_destroy(&frame->visible);
+		indirect_buffer_destroy(&frame->visibility);
+	}
+
+	frame->entities = entities;
+	frame->visible = visible;
+	frame->visibility = visibility_bits;
+	frame->entity_capacity = capacity;
+	frame->dirty = true;
+	return 0;
+}
+
+// Grows the batch buffers of a frame to hold at least count batches
+// The buffers of the frame must not be in use by the GPU
+static int indirect_reserve_batches(struct IndirectFrame* frame, uint32_t count)
+{
+	if (count <= frame->batch_capacity)
+		return 0;
+
+	uint32_t capacity = frame->batch_capacity ? frame->batch_capacity : INDIRECT_MIN_BATCHES;
+	while (capacity < count)
+		capacity *= 2;
+
+	struct IndirectBuffer commands, batch_data, group_data;
+	if (indirect_buffer_create(capacity * sizeof(VkDrawIndexedIndirectCommand), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, false, &commands))
+		return -1;
+	if (indirect_buffer_create(capacity * sizeof(struct IndirectBatchData), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, true, &batch_data))
+	{
+		indirect_buffer_destroy(&commands);
+		return -1;
+	}
+	// A group holds at least one batch
+	if (indirect_buffer_create(capacity * sizeof(struct IndirectGroupData), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, true, &group_data))
+	{
+		indirect_buffer_destroy(&commands);
+		indirect_buffer_destroy(&batch_data);
+		return -1;
+	}
+
+	if (frame->batch_capacity)
+	{
+		indirect_buffer_destroy(&frame->commands);
+		indirect_buffer_destroy(&frame->batches);
+		indirect_buffer_destroy(&frame->groups);
+	}
+
+	frame->commands = commands;
+	frame->batches = batch_data;
+	frame->groups = group_data;
+	frame->batch_capacity = capacity;
+	frame->batch_version = 0;
+	frame->dirty = true;
+	return 0;
+}
+
+static void indirect_write_set(struct IndirectFrame* frame)
+{
+	VkDescriptorBufferInfo buffer_infos[BINDING_COUNT] = {
+		{frame->entities.buffer, 0, VK_WHOLE_SIZE},
+		{frame->visible.buffer, 0, VK_WHOLE_SIZE},
+		{frame->commands.buffer, 0, VK_WHOLE_SIZE},
+		{frame->batches.buffer, 0, VK_WHOLE_SIZE},
+		{frame->groups.buffer, 0, VK_WHOLE_SIZE},
+		{frame->visibility.buffer, 0, VK_WHOLE_SIZE},
+	};
+
+	VkWriteDescriptorSet writes[BINDING_COUNT] = {0};
+	for (uint32_t i = 0; i < BINDING_COUNT; i++)
+	{
+		writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writes[i].dstSet = frame->set;
+		writes[i].dstBinding = i;
+		writes[i].descriptorCount = 1;
+		writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		writes[i].pBufferInfo = &buffer_infos[i];
+	}
+	vkUpdateDescriptorSets(device, BINDING_COUNT, writes, 0, NULL);
+	frame->dirty = false;
+}
+
+// Returns true if the graphics queue can also dispatch compute shaders
+static bool indirect_queue_supports_compute()
+{
+	QueueFamilies indices = get_queue_families(physical_device);
+	uint32_t family_count = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &family_count, NULL);
+	VkQueueFamilyProperties* families = malloc(family_count * sizeof *families);
+	vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &family_count, families);
+
+	bool supported = indices.graphics < family_count && (families[indices.graphics].queueFlags & VK_QUEUE_COMPUTE_BIT);
+	free(families);
+	return supported;
+}
+
+static int indirect_create_cull_pipeline()
+{
+	size_t code_size = read_fileb(INDIRECT_CULL_SHADER, NULL);
+	if (code_size == 0)
+	{
+		LOG_W("Failed to read cull shader %s", INDIRECT_CULL_SHADER);
+		return -1;
+	}
+	char* code = malloc(code_size);
+	read_fileb(INDIRECT_CULL_SHADER, code);
+	VkShaderModule module = create_shader_module(code, code_size);
+	free(code);
+
+	VkPushConstantRange push_constants = {0};
+	push_constants.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	push_constants.offset = 0;
+	push_constants.size = sizeof(struct CullConstants);
+
+	VkPipelineLayoutCreateInfo layout_info = {0};
+	layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	layout_info.setLayoutCount = 1;
+	layout_info.pSetLayouts = &indirect_layout;
+	layout_info.pushConstantRangeCount = 1;
+	layout_info.pPushConstantRanges = &push_constants;
+
+	VkResult result = vkCreatePipelineLayout(device, &layout_info, NULL, &cull_layout);
+	if (result != VK_SUCCESS)
+	{
+		LOG_E("Failed to create cull pipeline layout - code %d", result);
+		vkDestroyShaderModule(device, module, NULL);
+		return -2;
+	}
+
+	VkComputePipelineCreateInfo pipeline_info = {0};
+	pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipeline_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipeline_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipeline_info.stage.module = module;
+	pipeline_info.stage.pName = "main";
+	pipeline_info.layout = cull_layout;
+
+	result = vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipeline_info, NULL, &cull_pipeline);
+	vkDestroyShaderModule(device, module, NULL);
+	if (result != VK_SUCCESS)
+	{
+		LOG_E("Failed to create cull pipeline - code %d", result);
+		cull_pipeline = VK_NULL_HANDLE;
+		return -3;
+	}
+	return 0;
+}
+
+// Returns a stale bit for each frame
+static uint32_t indirect_all_frames()
+{
+	return frame_count >= 32 ? UINT32_MAX : (1u << frame_count) - 1;
+}
+
+// Creates the descriptor sets, buffers and command buffers of a frame for each swapchain image
+// Returns 0 on success
+static int indirect_create_frames()
+{
+	frame_count = swapchain_image_count;
+	frames = calloc(frame_count, sizeof *frames);
+	for (uint32_t i = 0; i < frame_count; i++)
+	{
+		frames[i].draw_commands = INVALID(Commandbuffer);
+		frames[i].cull_commands = INVALID(Commandbuffer);
+	}
+
+	VkDescriptorPoolSize pool_size = {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, BINDING_COUNT * frame_count};
+	VkDescriptorPoolCreateInfo pool_info = {0};
+	pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	pool_info.poolSizeCount = 1;
+	pool_info.pPoolSizes = &pool_size;
+	pool_info.maxSets = frame_count;
+
+	VkResult result = vkCreateDescriptorPool(device, &pool_info, NULL, &indirect_pool);
+	if (result != VK_SUCCESS)
+	{
+		LOG_E("Failed to create indirect descriptor pool - code %d", result);
+		return -2;
+	}
+
+	VkDescriptorSetLayout* layouts = malloc(frame_count * sizeof *layouts);
+	VkDescriptorSet* sets = malloc(frame_count * sizeof *sets);
+	for (uint32_t i = 0; i < frame_count; i++)
+		layouts[i] = indirect_layout;
+	VkDescriptorSetAllocateInfo alloc_info = {0};
+	alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	alloc_info.descriptorPool = indirect_pool;
+	alloc_info.descriptorSetCount = frame_count;
+	alloc_info.pSetLayouts = layouts;
+
+	result = vkAllocateDescriptorSets(device, &alloc_info, sets);
+	free(layouts);
+	if (result != VK_SUCCESS)
+	{
+		LOG_E("Failed to allocate indirect descriptor sets - code %d", result);
+		free(sets);
+		return -3;
+	}
+
+	for (uint32_t i = 0; i < frame_count; i++)
+	{
+		struct IndirectFrame* frame = &frames[i];
+		if (indirect_reserve_entities(frame, INDIRECT_MIN_ENTITIES) || indirect_reserve_batches(frame, INDIRECT_MIN_BATCHES))
+		{
+			free(sets);
+			return -4;
+		}
+		frame->set = sets[i];
+		indirect_write_set(frame);
+
+		// The primary and framebuffer of the draws are assigned when rendering
+		frame->cull_commands = commandbuffer_create_primary(0);
+		frame->draw_commands = commandbuffer_create_secondary(0, INVALID(Commandbuffer), renderPass, INVALID(Framebuffer));
+	}
+	free(sets);
+
+	// The resident entities are written again to the new buffers
+	for (uint32_t i = 0; i < slot_count; i++)
+		slots[i].stale = indirect_all_frames();
+	return 0;
+}
+
+static void indirect_destroy_frames()
+{
+	for (uint32_t i = 0; i < frame_count; i++)
+	{
+		struct IndirectFrame* frame = &frames[i];
+		if (HANDLE_VALID(frame->draw_commands))
+			commandbuffer_destroy(frame->draw_commands);
+		if (HANDLE_VALID(frame->cull_commands))
+			commandbuffer_destroy(frame->cull_commands);
+		if (frame->entity_capacity)
+		{
+			indirect_buffer_destroy(&frame->entities);
+			indirect_buffer_destroy(&frame->visible);
+			indirect_buffer_destroy(&frame->visibility);
+		}
+		if (frame->batch_capacity)
+		{
+			indirect_buffer_destroy(&frame->commands);
+			indirect_buffer_destroy(&frame->batches);
+			indirect_buffer_destroy(&frame->groups);
+		}
+	}
+	free(frames);
+	frames = NULL;
+	frame_count = 0;
+
+	if (indirect_pool)
+		vkDestroyDescriptorPool(device, indirect_pool, NULL);
+	indirect_pool = VK_NULL_HANDLE;
+}
+
+int indirect_init()
+{
+	if (!settings_get_gpu_culling())
+		return 0;
+
+	if (!bindless_supported() || !indirect_queue_supports_compute())
+	{
+		LOG_W("GPU culling requires bindless materials and compute support on the graphics queue, entities are drawn by the render tree");
+		return 0;
+	}
+
+	// The vertex shader finds the entities of a draw by its first instance
+	if (!draw_indirect_first_instance_supported)
+	{
+		LOG_W("GPU culling requires indirect draws with a first instance, entities are drawn by the render tree");
+		return 0;
+	}
+
+	VkDescriptorSetLayoutBinding bindings[BINDING_COUNT] = {0};
+	for (uint32_t i = 0; i < BINDING_COUNT; i++)
+	{
+		bindings[i].binding = i;
+		bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[i].descriptorCount = 1;
+		bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+	// The draws read the entities through the visible indices
+	bindings[ENTITY_BINDING].stageFlags |= VK_SHADER_STAGE_VERTEX_BIT;
+	bindings[VISIBLE_BINDING].stageFlags |= VK_SHADER_STAGE_VERTEX_BIT;
+
+	if (descriptorlayout_create(bindings, BINDING_COUNT, &indirect_layout) != 0)
+		return -1;
+
+	// GPU culling is disabled without the shader, the render tree draws all entities instead
+	if (indirect_create_cull_pipeline() != 0)
+	{
+		indirect_destroy();
+		return 0;
+	}
+
+	int result = indirect_create_frames();
+	if (result != 0)
+	{
+		indirect_destroy();
+		return result;
+	}
+
+	// Without the draw count the draws of a group are not compacted, empty batches are drawn with no instances
+	if (draw_indirect_count_supported)
+		cmd_draw_indexed_indirect_count = (PFN_vkCmdDrawIndexedIndirectCountKHR)vkGetDeviceProcAddr(device, "vkCmdDrawIndexedIndirectCountKHR");
+
+	LOG_S("Enabled GPU culling with indirect draws");
+	return 0;
+}
+
+int indirect_recreate()
+{
+	if (!indirect_enabled() || frame_count == swapchain_image_count)
+		return 0;
+
+	indirect_destroy_frames();
+	int result = indirect_create_frames();
+	if (result != 0)
+	{
+		LOG_E("Failed to recreate the GPU culling frames, entities are drawn by the render tree");
+		indirect_destroy();
+	}
+	return result;
+}
+
+bool indirect_enabled()
+{
+	return cull_pipeline != VK_NULL_HANDLE;
+}
+
+VkDescriptorSetLayout indirect_get_layout()
+{
+	return indirect_layout;
+}
+
+bool indirect_accepts(Material mat)
+{
+	return indirect_enabled() && material_get_indirect_key(mat) != 0;
+}
+
+void indirect_begin(uint32_t frame)
+{
+	gather_frame = frame;
+	memset(visibility, 0, (slot_count + 31) / 32 * sizeof *visibility);
+}
+
+// Gives entity a free slot in the resident entities
+static uint32_t indirect_alloc_slot(Entity* entity)
+{
+	uint32_t slot;
+	if (free_slot_count)
+		slot = free_slots[--free_slot_count];
+	else
+	{
+		if (slot_count >= slot_size)
+		{
+			uint32_t size = slot_size ? slot_size * 2 : INDIRECT_MIN_ENTITIES;
+			slots = realloc(slots, size * sizeof *slots);
+			free_slots = realloc(free_slots, size * sizeof *free_slots);
+			visibility = realloc(visibility, size / 32 * sizeof *visibility);
+			memset(visibility + slot_size / 32, 0, (size - slot_size) / 32 * sizeof *visibility);
+			slot_size = size;
+		}
+		slot = slot_count++;
+	}
+
+	slots[slot] = (struct IndirectSlot){.data = {.batch = INDIRECT_NONE}, .stale = 0};
+	entity_set_indirect_slot(entity, slot);
+	return slot;
+}
+
+// Returns the batch of the material, mesh, and level of detail with one more entity, adding it if it doesn't exist
+static uint32_t indirect_acquire_batch(Material mat, Mesh* mesh, uint32_t lod)
+{
+	batch_version++;
+	uintptr_t key = material_get_indirect_key(mat);
+	uint32_t unused = INDIRECT_NONE;
+	for (uint32_t i = 0; i < batch_count; i++)
+	{
+		if (batches[i].users && batches[i].key == key && batches[i].mesh == mesh && batches[i].lod == lod)
+		{
+			batches[i].users++;
+			return i;
+		}
+		if (batches[i].users == 0 && unused == INDIRECT_NONE)
+			unused = i;
+	}
+
+	if (unused == INDIRECT_NONE)
+	{
+		if (batch_count >= batch_size)
+		{
+			batch_size = batch_size ? batch_size * 2 : INDIRECT_MIN_BATCHES;
+			batches = realloc(batches, batch_size * sizeof *batches);
+			batch_order = realloc(batch_order, batch_size * sizeof *batch_order);
+			groups = realloc(groups, batch_size * sizeof *groups);
+		}
+		unused = batch_count++;
+	}
+
+	batches[unused] = (struct IndirectBatch){.key = key, .material = mat, .mesh = mesh, .lod = lod, .users = 1, .group = INDIRECT_NONE};
+	return unused;
+}
+
+static void indirect_release_batch(uint32_t batch)
+{
+	if (batch == INDIRECT_NONE)
+		return;
+	batches[batch].users--;
+	batch_version++;
+}
+
+void indirect_add(Entity* entity)
+{
+	uint32_t slot = entity_get_indirect_slot(entity);
+	if (slot == INDIRECT_NONE)
+		slot = indirect_alloc_slot(entity);
+	struct IndirectSlot* resident = &slots[slot];
+
+	Material mat = entity_get_material(entity);
+	Mesh* mesh = entity_get_mesh(entity);
+	uint32_t lod = entity_get_lod(entity);
+	uint32_t batch = resident->data.batch;
+	if (batch == INDIRECT_NONE || batches[batch].key != material_get_indirect_key(mat) || batches[batch].mesh != mesh || batches[batch].lod != lod)
+	{
+		indirect_release_batch(batch);
+		batch = indirect_acquire_batch(mat, mesh, lod);
+	}
+
+	const SphereCollider* sphere = entity_get_boundingsphere(entity);
+	float radius = sphere->radius * vec3_largest(sphere->base.transform->scale);
+
+	struct IndirectEntityData data = {0};
+	data.model_matrix = entity_get_transform(entity)->model_matrix;
+	data.color = entity_get_color(entity);
+	data.bounds = to_vec4(sphere->base.transform->position, radius);
+	data.material_index = material_get_bindless_index(mat);
+	data.batch = batch;
+
+	// Only entities that changed are written, once to the buffer of each frame
+	if (memcmp(&data, &resident->data, sizeof data) != 0)
+	{
+		resident->data = data;
+		resident->stale = indirect_all_frames();
+	}
+
+	struct IndirectFrame* frame = &frames[gather_frame];
+	if (resident->stale & (1u << gather_frame))
+	{
+		if (indirect_reserve_entities(frame, slot + 1) != 0)
+			return;
+		((struct IndirectEntityData*)frame->entities.mapped)[slot] = data;
+		resident->stale &= ~(1u << gather_frame);
+	}
+
+	visibility[slot / 32] |= 1u << (slot % 32);
+}
+
+void indirect_remove(Entity* entity)
+{
+	uint32_t slot = entity_get_indirect_slot(entity);
+	entity_set_indirect_slot(entity, INDIRECT_NONE);
+	if (slot >= slot_count)
+		return;
+
+	indirect_release_batch(slots[slot].data.batch);
+	slots[slot] = (struct IndirectSlot){.data = {.batch = INDIRECT_NONE}, .stale = 0};
+	visibility[slot / 32] &= ~(1u << (slot % 32));
+	free_slots[free_slot_count++] = slot;
+}
+
+// Orders the used batches by pipeline so that the draw commands of each pipeline are consecutive
+// Each batch gets a range of the visible indices large enough for all its entities
+static void indirect_layout_batches()
+{
+	uint32_t count = 0;
+	for (uint32_t i = 0; i < batch_count; i++)
+	{
+		batches[i].group = INDIRECT_NONE;
+		if (batches[i].users == 0)
+			continue;
+
+		// Insertion sort, batches are only laid out when they change
+		uint32_t j = count++;
+		while (j > 0 && batches[batch_order[j - 1]].key > batches[i].key)
+		{
+			batch_order[j] = batch_order[j - 1];
+			j--;
+		}
+		batch_order[j] = i;
+	}
+
+	group_count = 0;
+	uint32_t offset = 0;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		struct IndirectBatch* batch = &batches[batch_order[i]];
+		if (i == 0 || batches[batch_order[i - 1]].key != batch->key)
+			groups[group_count++] = (struct IndirectGroup){.material = batch->material, .first = i, .count = 0};
+
+		groups[group_count - 1].count++;
+		batch->group = group_count - 1;
+		batch->command = i;
+		batch->offset = offset;
+		offset += batch->users;
+	}
+	layout_version = batch_version;
+}
+
+// Writes the batches and groups to the buffers of a frame
+static void indirect_write_batches(struct IndirectFrame* frame)
+{
+	struct IndirectBatchData* batch_data = frame->batches.mapped;
+	for (uint32_t i = 0; i < batch_count; i++)
+	{
+		struct IndirectBatch* batch = &batches[i];
+		if (batch->group == INDIRECT_NONE)
+		{
+			batch_data[i] = (struct IndirectBatchData){.group = INDIRECT_NONE};
+			continue;
+		}
+
+		batch_data[i] = (struct IndirectBatchData){.offset = batch->offset,
+												   .count = 0,
+												   .group = batch->group,
+												   .command = batch->command,
+												   .index_count = mesh_get_lod_index_count(batch->mesh, batch->lod),
+												   .first_index = mesh_get_lod_first_index(batch->mesh, batch->lod),
+												   .vertex_offset = mesh_get_first_vertex(batch->mesh)};
+	}
+
+	struct IndirectGroupData* group_data = frame->groups.mapped;
+	for (uint32_t i = 0; i < group_count; i++)
+		group_data[i] = (struct IndirectGroupData){.first = groups[i].first, .draw_count = 0};
+
+	frame->batch_version = batch_version;
+}
+
+// Extracts the normalized frustum planes from the view projection matrix of the camera
+// Planes of a NULL camera accept everything
+static void indirect_get_frustum(Camera* camera, vec4* planes)
+{
+	if (camera == NULL)
+	{
+		for (uint32_t i = 0; i < 6; i++)
+			planes[i] = (vec4){0, 0, 0, 1};
+		return;
+	}
+
+	mat4 view = camera_get_view_matrix(camera);
+	mat4 proj = camera_get_projection_matrix(camera);
+	// Matrices are stored by column, a row of the clip space transform is raw[0..3][row]
+	mat4 m = mat4_mul(&view, &proj);
+	for (uint32_t i = 0; i < 3; i++)
+	{
+		for (uint32_t side = 0; side < 2; side++)
+		{
+			float sign = side ? -1.0f : 1.0f;
+			vec4 plane = {m.raw[0][3] + sign * m.raw[0][i], m.raw[1][3] + sign * m.raw[1][i], m.raw[2][3] + sign * m.raw[2][i], m.raw[3][3] + sign * m.raw[3][i]};
+			float length = sqrtf(plane.x * plane.x + plane.y * plane.y + plane.z * plane.z);
+			if (length > 0.0f)
+				plane = (vec4){plane.x / length, plane.y / length, plane.z / length, plane.w / length};
+			planes[i * 2 + side] = plane;
+		}
+	}
+}
+
+void indirect_render(Commandbuffer primary, Camera* camera, uint32_t frame_index)
+{
+	struct IndirectFrame* frame = &frames[frame_index];
+	if (layout_version != batch_version)
+		indirect_layout_batches();
+
+	// Nothing is drawn this frame if the buffers can't hold the entities and batches
+	bool ready = indirect_reserve_entities(frame, slot_count) == 0 && indirect_reserve_batches(frame, batch_count) == 0;
+	if (ready && frame->batch_version != batch_version)
+		indirect_write_batches(frame);
+	if (ready)
+		memcpy(frame->visibility.mapped, visibility, (slot_count + 31) / 32 * sizeof *visibility);
+
+	if (frame->dirty)
+		indirect_write_set(frame);
+
+	// Cull the entities into the visible indices, then write the draw commands of the batches
+	commandbuffer_begin(frame->cull_commands);
+	VkCommandBuffer cull = commandbuffer_vk(frame->cull_commands);
+	if (ready && slot_count)
+	{
+		struct CullConstants constants = {0};
+		indirect_get_frustum(camera, constants.planes);
+		constants.entity_count = slot_count;
+		constants.batch_count = batch_count;
+		constants.group_count = group_count;
+		constants.compact = cmd_draw_indexed_indirect_count != NULL;
+
+		vkCmdBindPipeline(cull, VK_PIPELINE_BIND_POINT_COMPUTE, cull_pipeline);
+		vkCmdBindDescriptorSets(cull, VK_PIPELINE_BIND_POINT_COMPUTE, cull_layout, 0, 1, &frame->set, 0, NULL);
+		// There are never more groups than entities
+		constants.pass = 0;
+		vkCmdPushConstants(cull, cull_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof constants, &constants);
+		vkCmdDispatch(cull, (slot_count + INDIRECT_CULL_GROUP_SIZE - 1) / INDIRECT_CULL_GROUP_SIZE, 1, 1);
+
+		VkMemoryBarrier counted = {0};
+		counted.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		counted.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		counted.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(cull, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &counted, 0, NULL, 0, NULL);
+
+		constants.pass = 1;
+		vkCmdPushConstants(cull, cull_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof constants, &constants);
+		vkCmdDispatch(cull, (batch_count + INDIRECT_CULL_GROUP_SIZE - 1) / INDIRECT_CULL_GROUP_SIZE, 1, 1);
+	}
+
+	// The draws of the primary command buffer submitted after read the culling results
+	VkMemoryBarrier barrier = {0};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+	vkCmdPipelineBarrier(cull, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, 0, 1, &barrier, 0, NULL, 0, NULL);
+	commandbuffer_end(frame->cull_commands);
+
+	// One bind and draw per pipeline
+	commandbuffer_set_info(frame->draw_commands, primary, renderPass, renderer_get_framebuffers()[frame_index]);
+	commandbuffer_begin(frame->draw_commands);
+	VkCommandBuffer draw = commandbuffer_vk(frame->draw_commands);
+	geometry_bind(frame->draw_commands);
+	for (uint32_t i = 0; ready && slot_count && i < group_count; i++)
+	{
+		struct IndirectGroup* group = &groups[i];
+		material_bind_indirect(group->material, frame->draw_commands, frame->set);
+
+		const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+		VkDeviceSize command_offset = group->first * stride;
+		if (cmd_draw_indexed_indirect_count)
+			cmd_draw_indexed_indirect_count(draw, frame->commands.buffer, command_offset, frame->groups.buffer,
+											i * sizeof(struct IndirectGroupData) + offsetof(struct IndirectGroupData, draw_count), group->count, stride);
+		else if (multi_draw_indirect_supported)
+			vkCmdDrawIndexedIndirect(draw, frame->commands.buffer, command_offset, group->count, stride);
+		else
+		{
+			for (uint32_t j = 0; j < group->count; j++)
+				vkCmdDrawIndexedIndirect(draw, frame->commands.buffer, command_offset + j * stride, 1, stride);
+		}
+	}
+	commandbuffer_end(frame->draw_commands);
+
+	vkCmdExecuteCommands(commandbuffer_vk(primary), 1, &draw);
+}
+
+VkCommandBuffer indirect_get_cull_commands(uint32_t frame)
+{
+	return commandbuffer_vk(frames[frame].cull_commands);
+}
+
+void indirect_destroy()
+{
+	indirect_destroy_frames();
+
+	if (cull_pipeline)
+		vkDestroyPipeline(device, cull_pipeline, NULL);
+	if (cull_layout)
+		vkDestroyPipelineLayout(device, cull_layout, NULL);
+	if (indirect_layout)
+		vkDestroyDescriptorSetLayout(device, indirect_layout, NULL);
+
+	cull_pipeline = VK_NULL_HANDLE;
+	cull_layout = VK_NULL_HANDLE;
+	indirect_layout = VK_NULL_HANDLE;
+	cmd_draw_indexed_indirect_count = NULL;
+
+	free(slots);
+	free(free_slots);
+	free(visibility);
+	slots = NULL;
+	free_slots = NULL;
+	visibility = NULL;
+	slot_count = 0;
+	slot_size = 0;
+	free_slot_count = 0;
+
+	free(batches);
+	free(batch_order);
+	free(groups);
+	batches = NULL;
+	batch_order = NULL;
+	groups = NULL;
+	batch_count = 0;
+	batch_size = 0;
+	group_count = 0;
+	layout_version = batch_version;
+}
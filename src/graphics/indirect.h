@@ -0,0 +1,65 @@
+#ifndef INDIRECT_H
+#define INDIRECT_H
+#include <stdint.h>
+#include <stdbool.h>
+#include "graphics/commandbuffer.h"
+#include "graphics/camera.h"
+#include "graphics/material.h"
+#include "entity.h"
+
+// GPU driven drawing of entities with bindless materials
+// Entities stay resident in a storage buffer, only the ones that changed are written again
+// The render tree marks the entities not occluded each frame
+// A compute shader culls them against the camera frustum and writes the commands of indirect draws
+// Batches of entities sharing a pipeline, mesh, and level of detail are drawn with one bind and draw per pipeline,
+// so recording cost does not depend on the entity or mesh count
+// Enabled by the gpu_culling setting if bindless materials and indirect draws with a first instance are supported
+
+// The compiled cull shader
+#define INDIRECT_CULL_SHADER "./assets/shaders/cull.comp.spv"
+// Needs to match local_size_x of the cull shader
+#define INDIRECT_CULL_GROUP_SIZE 64
+// The initial number of entities the buffers of each frame hold
+#define INDIRECT_MIN_ENTITIES 1024
+
+// Creates the descriptor layout and cull pipeline
+// Does nothing if GPU culling is disabled or unsupported
+// Returns 0 on success
+int indirect_init();
+
+// Recreates the buffers and descriptor sets of each frame if the number of swapchain images changed
+// GPU culling is disabled if they can't be recreated
+// Returns 0 on success
+int indirect_recreate();
+
+bool indirect_enabled();
+
+// Returns the layout of set 2 for indirect pipelines, holding the entity and visible index buffers
+// Returns VK_NULL_HANDLE if GPU culling is disabled
+VkDescriptorSetLayout indirect_get_layout();
+
+// Returns true if entities with the material are drawn indirectly instead of by the render tree
+bool indirect_accepts(Material mat);
+
+// Starts gathering the entities of frame
+// Called before rendertree_render
+void indirect_begin(uint32_t frame);
+
+// Marks an entity to be culled and drawn this frame, making it resident if it isn't
+// Its data is only written again if it changed since it was last written for the frame
+// The material of the entity needs to be accepted by indirect_accepts
+void indirect_add(Entity* entity);
+
+// Frees the resident slot of an entity, does nothing if it has none
+void indirect_remove(Entity* entity);
+
+// Records the culling of the gathered entities and executes their draws into primary
+// Primary needs to be inside the render pass
+void indirect_render(Commandbuffer primary, Camera* camera, uint32_t frame);
+
+// Returns the command buffer culling the entities of frame
+// Needs to be submitted before the primary command buffer of the frame
+VkCommandBuffer indirect_get_cull_commands(uint32_t frame);
+
+void indirect_destroy();
+#endif
@@ -0,0 +1,298 @@
+#include "ktx.h"
+#include "bcn.h"
+#include "log.h"
+#include "utils.h"
+#include <stdio.h>
+#include <string.h>
+
+static const uint8_t ktx_identifier[12] = {0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+
+// Size of the identifier, header and index
+#define KTX_HEADER_SIZE 80
+#define KTX_LEVEL_INDEX_SIZE 24
+// Level data is aligned to the largest block size
+#define KTX_LEVEL_ALIGNMENT 16
+
+// Data format descriptor values from the Khronos data format specification
+#define KHR_DF_MODEL_BC1A 128
+#define KHR_DF_MODEL_BC3 130
+#define KHR_DF_MODEL_BC7 133
+#define KHR_DF_PRIMARIES_BT709 1
+#define KHR_DF_TRANSFER_LINEAR 1
+#define KHR_DF_TRANSFER_SRGB 2
+#define KHR_DF_CHANNEL_COLOR 0
+#define KHR_DF_CHANNEL_BC3_ALPHA 15
+#define KHR_DF_SAMPLE_LINEAR 0x10
+
+static uint32_t ktx_read32(const uint8_t* data)
+{
+	uint32_t v;
+	memcpy(&v, data, sizeof v);
+	return v;
+}
+
+static uint64_t ktx_read64(const uint8_t* data)
+{
+	uint64_t v;
+	memcpy(&v, data, sizeof v);
+	return v;
+}
+
+int ktx_open(const char* path, KtxFile* ktx)
+{
+	memset(ktx, 0, sizeof *ktx);
+	ktx->mapping = map_file(path, &ktx->mapping_size);
+	if (ktx->mapping == NULL)
+		return -1;
+
+	const uint8_t* data = ktx->mapping;
+	size_t size = ktx->mapping_size;
+	if (size < KTX_HEADER_SIZE || memcmp(data, ktx_identifier, sizeof ktx_identifier) != 0)
+	{
+		LOG_W("File %s is not a KTX2 file", path);
+		ktx_close(ktx);
+		return -1;
+	}
+
+	ktx->format = ktx_read32(data + 12);
+	ktx->width = ktx_read32(data + 20);
+	ktx->height = ktx_read32(data + 24);
+	uint32_t depth = ktx_read32(data + 28);
+	uint32_t layers = ktx_read32(data + 32);
+	uint32_t faces = ktx_read32(data + 36);
+	ktx->mip_levels = ktx_read32(data + 40);
+	uint32_t supercompression = ktx_read32(data + 44);
+	uint32_t kvd_offset = ktx_read32(data + 56);
+	uint32_t kvd_size = ktx_read32(data + 60);
+
+	if (ktx->width == 0 || ktx->height == 0 || depth > 1 || layers > 1 || faces != 1 || supercompression != 0 || ktx->mip_levels == 0 ||
+		ktx->mip_levels > KTX_MAX_LEVELS || size < KTX_HEADER_SIZE + ktx->mip_levels * KTX_LEVEL_INDEX_SIZE || kvd_offset > size || kvd_size > size - kvd_offset)
+	{
+		LOG_W("KTX2 file %s is not a supported 2D texture", path);
+		ktx_close(ktx);
+		return -1;
+	}
+
+	for (uint32_t i = 0; i < ktx->mip_levels; i++)
+	{
+		const uint8_t* entry = data + KTX_HEADER_SIZE + i * KTX_LEVEL_INDEX_SIZE;
+		uint64_t offset = ktx_read64(entry);
+		uint64_t length = ktx_read64(entry + 8);
+		if (offset > size || length > size - offset)
+		{
+			LOG_W("KTX2 file %s is truncated", path);
+			ktx_close(ktx);
+			return -1;
+		}
+		ktx->levels[i] = data + offset;
+		ktx->level_sizes[i] = length;
+	}
+
+	ktx->key_values = kvd_size ? data + kvd_offset : NULL;
+	ktx->key_value_size = kvd_size;
+	return 0;
+}
+
+const void* ktx_find_value(const KtxFile* ktx, const char* key, uint32_t* size)
+{
+	size_t key_size = strlen(key) + 1;
+	uint32_t offset = 0;
+	// Each entry is its length, the null terminated key and the value, padded to 4 bytes
+	while (ktx->key_value_size - offset >= 4)
+	{
+		uint32_t length = ktx_read32(ktx->key_values + offset);
+		offset += 4;
+		if (length > ktx->key_value_size - offset)
+			return NULL;
+
+		const uint8_t* entry = ktx->key_values + offset;
+		if (length >= key_size && memcmp(entry, key, key_size) == 0)
+		{
+			*size = length - key_size;
+			return entry + key_size;
+		}
+		offset += (length + 3) & ~3u;
+		if (offset > ktx->key_value_size)
+			return NULL;
+	}
+	return NULL;
+}
+
+void ktx_close(KtxFile* ktx)
+{
+	if (ktx->mapping)
+		unmap_file(ktx->mapping, ktx->mapping_size);
+	ktx->mapping = NULL;
+	ktx->mapping_size = 0;
+}
+
+// Fills in the basic data format descriptor of a block compressed format
+// Returns the size in bytes
+static uint32_t ktx_write_dfd(VkFormat format, uint32_t* dfd)
+{
+	uint32_t model = 0;
+	uint32_t sample_count = 1;
+	bool srgb = false;
+	switch (format)
+	{
+	case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+		srgb = true;
+		// Fallthrough
+	case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+		model = KHR_DF_MODEL_BC1A;
+		break;
+	case VK_FORMAT_BC3_SRGB_BLOCK:
+		srgb = true;
+		// Fallthrough
+	case VK_FORMAT_BC3_UNORM_BLOCK:
+		model = KHR_DF_MODEL_BC3;
+		sample_count = 2;
+		break;
+	case VK_FORMAT_BC7_SRGB_BLOCK:
+		srgb = true;
+		// Fallthrough
+	case VK_FORMAT_BC7_UNORM_BLOCK:
+		model = KHR_DF_MODEL_BC7;
+		break;
+	default:
+		return 0;
+	}
+
+	uint32_t block_size = bcn_block_size(format);
+	uint32_t descriptor_size = 24 + 16 * sample_count;
+	dfd[0] = 4 + descriptor_size;
+	dfd[1] = 0;
+	dfd[2] = 2 | (descriptor_size << 16);
+	dfd[3] = model | (KHR_DF_PRIMARIES_BT709 << 8) | ((srgb ? KHR_DF_TRANSFER_SRGB : KHR_DF_TRANSFER_LINEAR) << 16);
+	// 4x4 texel blocks, stored minus one
+	dfd[4] = 3 | (3 << 8);
+	dfd[5] = block_size;
+	dfd[6] = 0;
+
+	uint32_t* sample = dfd + 7;
+	if (sample_count == 2)
+	{
+		// BC3 stores the linear alpha block before the color block
+		sample[0] = 0 | (63 << 16) | ((KHR_DF_CHANNEL_BC3_ALPHA | KHR_DF_SAMPLE_LINEAR) << 24);
+		sample[1] = 0;
+		sample[2] = 0;
+		sample[3] = 0xFFFFFFFF;
+		sample += 4;
+		sample[0] = 64 | (63 << 16) | (KHR_DF_CHANNEL_COLOR << 24);
+	}
+	else
+	{
+		sample[0] = 0 | ((block_size * 8 - 1) << 16) | (KHR_DF_CHANNEL_COLOR << 24);
+	}
+	sample[1] = 0;
+	sample[2] = 0;
+	sample[3] = 0xFFFFFFFF;
+
+	return dfd[0];
+}
+
+int ktx_write(const char* path, VkFormat format, uint32_t width, uint32_t height, uint32_t mip_levels, const uint8_t* const* levels, const size_t* level_sizes,
+			  const KtxKeyValue* key_values, uint32_t key_value_count)
+{
+	uint32_t dfd[15];
+	uint32_t dfd_size = ktx_write_dfd(format, dfd);
+	if (dfd_size == 0)
+	{
+		LOG_E("Cannot write %s, only block compressed formats are supported", path);
+		return -1;
+	}
+
+	if (mip_levels == 0 || mip_levels > KTX_MAX_LEVELS)
+	{
+		LOG_E("Cannot write %s with %d mip levels", path, mip_levels);
+		return -1;
+	}
+
+	char dir[256];
+	get_dir(path, dir, sizeof dir);
+	create_dirs(dir);
+
+	// Write to a temporary file so that readers never map a partial file
+	char tmp_path[512];
+	snprintf(tmp_path, sizeof tmp_path, "%s.tmp", path);
+	FILE* file = fopen(tmp_path, "wb");
+	if (file == NULL)
+	{
+		LOG_E("Failed to open %s for writing", tmp_path);
+		return -1;
+	}
+
+	uint32_t dfd_offset = KTX_HEADER_SIZE + mip_levels * KTX_LEVEL_INDEX_SIZE;
+	// The key/value data follows the descriptor
+	uint32_t kvd_offset = dfd_offset + dfd_size;
+	uint32_t kvd_size = 0;
+	for (uint32_t i = 0; i < key_value_count; i++)
+		kvd_size += 4 + ((strlen(key_values[i].key) + 1 + key_values[i].size + 3) & ~3u);
+	uint32_t header[9] = {format, 1, width, height, 0, 0, 1, mip_levels, 0};
+	// No supercompression data
+	uint32_t index[4] = {dfd_offset, dfd_size, kvd_size ? kvd_offset : 0, kvd_size};
+	uint64_t sgd[2] = {0, 0};
+
+	fwrite(ktx_identifier, 1, sizeof ktx_identifier, file);
+	fwrite(header, 1, sizeof header, file);
+	fwrite(index, 1, sizeof index, file);
+	fwrite(sgd, 1, sizeof sgd, file);
+
+	// The smallest level is stored first
+	uint64_t offsets[KTX_MAX_LEVELS];
+	uint64_t offset = kvd_offset + kvd_size;
+	for (uint32_t i = mip_levels; i-- > 0;)
+	{
+		offset = (offset + KTX_LEVEL_ALIGNMENT - 1) & ~(uint64_t)(KTX_LEVEL_ALIGNMENT - 1);
+		offsets[i] = offset;
+		offset += level_sizes[i];
+	}
+
+	for (uint32_t i = 0; i < mip_levels; i++)
+	{
+		// The uncompressed length is the same for block compressed formats
+		uint64_t entry[3] = {offsets[i], level_sizes[i], level_sizes[i]};
+		fwrite(entry, 1, sizeof entry, file);
+	}
+	fwrite(dfd, 1, dfd_size, file);
+
+	static const uint8_t padding[KTX_LEVEL_ALIGNMENT] = {0};
+	for (uint32_t i = 0; i < key_value_count; i++)
+	{
+		uint32_t key_size = strlen(key_values[i].key) + 1;
+		uint32_t length = key_size + key_values[i].size;
+		fwrite(&length, 1, sizeof length, file);
+		fwrite(key_values[i].key, 1, key_size, file);
+		fwrite(key_values[i].value, 1, key_values[i].size, file);
+		fwrite(padding, 1, ((length + 3) & ~3u) - length, file);
+	}
+
+	uint64_t written = kvd_offset + kvd_size;
+	for (uint32_t i = mip_levels; i-- > 0;)
+	{
+		fwrite(padding, 1, offsets[i] - written, file);
+		fwrite(levels[i], 1, level_sizes[i], file);
+		written = offsets[i] + level_sizes[i];
+	}
+
+	int failed = ferror(file);
+	fclose(file);
+	if (failed)
+	{
+		LOG_E("Failed to write %s", path);
+		remove(tmp_path);
+		return -1;
+	}
+
+#if PL_WINDOWS
+	// Windows does not replace existing files on rename
+	remove(path);
+#endif
+	if (rename(tmp_path, path) != 0)
+	{
+		LOG_E("Failed to move %s to %s", tmp_path, path);
+		remove(tmp_path);
+		return -1;
+	}
+	return 0;
+}
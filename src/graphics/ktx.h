@@ -0,0 +1,54 @@
+#ifndef KTX_H
+#define KTX_H
+#include <stdint.h>
+#include <stddef.h>
+#include "vulkan/vulkan.h"
+
+// Reads and writes 2D textures in the KTX2 container
+// Only single layer, non supercompressed files are supported
+// The level data is stored from the smallest to the largest level
+
+#define KTX_MAX_LEVELS 16
+
+typedef struct
+{
+	VkFormat format;
+	uint32_t width;
+	uint32_t height;
+	uint32_t mip_levels;
+	// Points into the mapped file, level 0 is the largest
+	const uint8_t* levels[KTX_MAX_LEVELS];
+	size_t level_sizes[KTX_MAX_LEVELS];
+	// The key/value data, points into the mapped file
+	const uint8_t* key_values;
+	uint32_t key_value_size;
+	void* mapping;
+	size_t mapping_size;
+} KtxFile;
+
+// An entry of the key/value data
+typedef struct
+{
+	const char* key;
+	const void* value;
+	uint32_t size;
+} KtxKeyValue;
+
+// Maps and validates a KTX2 file
+// Returns 0 on success and -1 if the file doesn't exist or is malformed
+int ktx_open(const char* path, KtxFile* ktx);
+
+// Finds the value of a key in the key/value data and writes its size to size
+// Returns NULL if the file has no such key
+const void* ktx_find_value(const KtxFile* ktx, const char* key, uint32_t* size);
+
+// Unmaps a file opened with ktx_open
+void ktx_close(KtxFile* ktx);
+
+// Writes the levels to path, creating the directories if necessary
+// Only the BC1, BC3 and BC7 formats can be written
+// key_values are written to the key/value data, they need to be sorted by key
+// Returns 0 on success
+int ktx_write(const char* path, VkFormat format, uint32_t width, uint32_t height, uint32_t mip_levels, const uint8_t* const* levels, const size_t* level_sizes,
+			  const KtxKeyValue* key_values, uint32_t key_value_count);
+#endif
@@ -11,6 +11,9 @@
 #include "magpie.h"
 #include "handlepool.h"
 #include "handletable.h"
+#include "graphics/bindless.h"
+#include "graphics/indirect.h"
+#include <stdbool.h>
 
 // A linked list tracking all loaded materials
 static handletable_t* material_table = NULL;
@@ -24,6 +27,8 @@ typedef struct Material_raw
 {
 	// Name should not be modified after creation
 	char name[256];
+	// The file the material was loaded from, empty if created in code
+	char file[256];
 
 	// An array to all descriptor layouts of the pipeline
 	// 0 : global descriptor layout
@@ -31,6 +36,9 @@ typedef struct Material_raw
 	// 2 : per rendertree node layout
 	VkDescriptorSetLayout descriptor_layouts[3];
 	DescriptorPack* material_descriptors;
+	// Kept to rewrite the descriptors when texture views change
+	VkDescriptorSetLayoutBinding* bindings;
+	uint32_t binding_count;
 	Pipeline* pipeline;
 
 	VkPushConstantRange push_constants[4];
@@ -41,6 +49,18 @@ typedef struct Material_raw
 	Texture textures[7];
 	uint32_t sampler_count;
 	Sampler samplers[7];
+	// The texture view versions the descriptors of each swapchain image were written with
+	// MATERIAL_TEXTURE_MAX entries per image, for as many images as the swapchain had at creation
+	uint32_t* texture_versions;
+	uint32_t texture_version_frames;
+
+	// Bindless materials use the shared bindless set in place of material_descriptors
+	bool bindless;
+	uint32_t bindless_index;
+	// The index of each texture in the bindless texture array
+	uint32_t texture_indices[7];
+	// Draws the entities culled on the GPU, NULL if the material is not drawn indirectly
+	Pipeline* indirect_pipeline;
 	// The resource management part, inaccessible for the use
 	struct Material *prev, *next;
 } Material_raw;
@@ -51,12 +71,80 @@ static const void* keyfunc_material(GenericHandle handle)
 {
 	return ((Material_raw*)handlepool_get_raw(&material_pool, handle))->name;
 }
-// Loads a material from a json struct
-Material material_load_internal(JSON* object)
+// Frees the descriptors owned by the material and releases its samplers
+// Textures and pipelines are shared and not freed
+static void material_release(Material_raw* raw)
 {
-	const struct handle_wrapper* wrapper = handlepool_alloc(&material_pool);
-	Material_raw* raw = (Material_raw*)wrapper->data;
-	Material handle = PUN_HANDLE(wrapper->handle, Material);
+	for (uint32_t i = 0; i < raw->sampler_count; i++)
+	{
+		if (HANDLE_VALID(raw->samplers[i]))
+			sampler_destroy(raw->samplers[i]);
+	}
+	raw->sampler_count = 0;
+
+	if (raw->material_descriptors)
+		descriptorpack_destroy(raw->material_descriptors);
+
+	// The layouts are shared
+	if (raw->bindless)
+	{
+		for (uint32_t i = 0; i < raw->texture_count; i++)
+			bindless_texture_remove(raw->texture_indices[i]);
+		bindless_material_remove(raw->bindless_index);
+		raw->bindless = false;
+	}
+	free(raw->bindings);
+	free(raw->texture_versions);
+	raw->material_descriptors = NULL;
+	raw->bindings = NULL;
+	raw->texture_versions = NULL;
+	raw->texture_version_frames = 0;
+	raw->descriptor_layouts[MATERIAL_DESCRIPTOR_INDEX] = VK_NULL_HANDLE;
+}
+
+// Adds the textures and parameters of a material to the bindless descriptors
+// The textures are stored in the order of the bindings
+// Returns 0 on success
+static int material_init_bindless(Material_raw* raw)
+{
+	raw->bindless_index = BINDLESS_INVALID;
+	for (uint32_t i = 0; i < MATERIAL_TEXTURE_MAX; i++)
+		raw->texture_indices[i] = BINDLESS_INVALID;
+
+	for (uint32_t i = 0; i < raw->binding_count; i++)
+	{
+		if (raw->bindings[i].descriptorType != VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER)
+		{
+			LOG_E("Failed to load material %s - bindless materials only support texture bindings", raw->name);
+			return -1;
+		}
+	}
+
+	struct MaterialData data = {0};
+	data.texture_count = raw->texture_count;
+	for (uint32_t i = 0; i < raw->texture_count; i++)
+	{
+		raw->texture_indices[i] = bindless_texture_add(raw->textures[i], raw->samplers[i]);
+		if (raw->texture_indices[i] == BINDLESS_INVALID)
+			return -1;
+		data.textures[i] = raw->texture_indices[i];
+	}
+
+	raw->bindless_index = bindless_material_add(&data);
+	if (raw->bindless_index == BINDLESS_INVALID)
+		return -1;
+
+	raw->descriptor_layouts[MATERIAL_DESCRIPTOR_INDEX] = bindless_get_layout();
+	return 0;
+}
+
+// Fills in a material from a json struct
+// Does not insert the material into the table
+// Returns 0 on success; on failure the material is partially filled and needs to be released
+static int material_init(Material_raw* raw, JSON* object, const char* file)
+{
+	memset(raw, 0, sizeof *raw);
+	snprintf(raw->file, sizeof raw->file, "%s", file ? file : "");
 
 	// Set name if it exists, if it doesn't, use the filename without extension
 	JSON* jname = json_get_member(object, "name");
@@ -91,23 +179,6 @@ Material material_load_internal(JSON* object)
 		raw->name[lname - 1] = '\0';
 	}
 
-	// Create table if it doesn't exist
-	if (material_table == NULL)
-	{
-		material_table = handletable_create(keyfunc_material, handletable_hashfunc_string, handletable_comp_string);
-	}
-
-	// Insert material into tracking table after name is acquired
-	if (HANDLE_VALID(handletable_find(material_table, raw->name)))
-	{
-		LOG_W("Duplicate material %s", raw->name);
-		material_destroy(handle);
-		return INVALID(Material);
-	}
-
-	// Insert into table
-	handletable_insert(material_table, PUN_HANDLE(handle, GenericHandle));
-
 	// Fill in global layout, assumes global descriptors exist and does not create them
 	raw->descriptor_layouts[GLOBAL_DESCRIPTOR_INDEX] = global_descriptor_layout;
 	raw->descriptor_layouts[ENTITY_DESCRIPTOR_INDEX] = rendertree_get_descriptor_layout();
@@ -116,14 +187,13 @@ Material material_load_internal(JSON* object)
 	if (json_type(jbindings) != JSON_TARRAY)
 	{
 		LOG_E("Failed to load material %s - bindings should be of type array", raw->name);
-		material_destroy(handle);
-		return INVALID(Material);
+		return -1;
 	}
 
 	// Since samplers and images take up two layout bindings allocate twice the amount of children
 	const int material_binding_count = json_get_count(jbindings);
 
-	// Freed on destruction of pipeline
+	// Freed on release of the material
 	VkDescriptorSetLayoutBinding* material_bindings = malloc(material_binding_count * sizeof(VkDescriptorSetLayoutBinding));
 	// Iterate and fill out the bindings
 	JSON* bindcur = json_get_elements(jbindings);
@@ -160,16 +230,14 @@ Material material_load_internal(JSON* object)
 			{
 				LOG_E("Failed to load material %s - missing value for \"texture\" in binding %d", raw->name, i);
 				free(material_bindings);
-				material_destroy(handle);
-				return INVALID(Material);
+				return -1;
 			}
 			const char* texture_path = json_get_member_string(object, texture_name);
 			if (texture_path == NULL)
 			{
 				LOG_E("Failed to load material %s - missing texture \"%s\", required by binding %d", raw->name, texture_name, i);
 				free(material_bindings);
-				material_destroy(handle);
-				return INVALID(Material);
+				return -1;
 			}
 			raw->textures[raw->texture_count++] = texture_get(texture_path);
 
@@ -214,14 +282,25 @@ Material material_load_internal(JSON* object)
 			if (j_aniso && json_type(j_aniso) == JSON_TNUMBER)
 				anisotropy = json_get_number(j_aniso);
 
-			raw->samplers[raw->sampler_count++] = sampler_get(filterMode, wrapMode, anisotropy);
+			// Optional mip level range and bias
+			float min_lod = 0.0f, max_lod = SAMPLER_LOD_MAX, lod_bias = 0.0f;
+			JSON* j_lod = json_get_member(bindcur, "minLod");
+			if (j_lod && json_type(j_lod) == JSON_TNUMBER)
+				min_lod = json_get_number(j_lod);
+			j_lod = json_get_member(bindcur, "maxLod");
+			if (j_lod && json_type(j_lod) == JSON_TNUMBER)
+				max_lod = json_get_number(j_lod);
+			j_lod = json_get_member(bindcur, "lodBias");
+			if (j_lod && json_type(j_lod) == JSON_TNUMBER)
+				lod_bias = json_get_number(j_lod);
+
+			raw->samplers[raw->sampler_count++] = sampler_get(filterMode, wrapMode, anisotropy, min_lod, max_lod, lod_bias);
 		}
 		else
 		{
 			LOG_E("Failed to load material %s - unknown binding type \"%s\"", raw->name, type);
 			free(material_bindings);
-			material_destroy(handle);
-			return INVALID(Material);
+			return -1;
 		}
 
 		// Read the shader stage of the resource
@@ -242,31 +321,53 @@ Material material_load_internal(JSON* object)
 		{
 			LOG_E("Failed to load material %s - unknown shader stage \"%s\"", raw->name, stage);
 			free(material_bindings);
-			material_destroy(handle);
-			return INVALID(Material);
+			return -1;
 		}
 
 		bindcur = json_next(bindcur);
 	}
 
-	descriptorlayout_create(material_bindings, material_binding_count, &raw->descriptor_layouts[MATERIAL_DESCRIPTOR_INDEX]);
+	raw->bindings = material_bindings;
+	raw->binding_count = material_binding_count;
+
+	// The optional bindless object specifies the shaders reading from the bindless set
+	// Without descriptor indexing the material falls back to its own descriptors and regular shaders
+	JSON* jbindless = json_get_member(object, "bindless");
+	raw->bindless = json_type(jbindless) == JSON_TOBJECT && bindless_supported();
+	if (raw->bindless)
+	{
+		if (material_init_bindless(raw) != 0)
+			return -1;
+	}
+	else
+	{
+		// Shared by materials with the same bindings so that they share pipelines as well
+		raw->descriptor_layouts[MATERIAL_DESCRIPTOR_INDEX] = descriptorlayout_get(material_bindings, material_binding_count);
 
-	// Create the material descriptors
-	raw->material_descriptors = descriptorpack_create(raw->descriptor_layouts[MATERIAL_DESCRIPTOR_INDEX], material_bindings, material_binding_count);
+		// Create the material descriptors
+		raw->material_descriptors = descriptorpack_create(raw->descriptor_layouts[MATERIAL_DESCRIPTOR_INDEX], material_bindings, material_binding_count);
 
-	// Write the descriptors
-	descriptorpack_write(raw->material_descriptors, material_bindings, material_binding_count, NULL, raw->textures, raw->samplers);
+		// Write the descriptors
+		descriptorpack_write(raw->material_descriptors, material_bindings, material_binding_count, NULL, raw->textures, raw->samplers);
+		raw->texture_version_frames = raw->material_descriptors->count;
+		raw->texture_versions = malloc(raw->texture_version_frames * MATERIAL_TEXTURE_MAX * sizeof *raw->texture_versions);
+		for (uint32_t i = 0; i < raw->texture_count; i++)
+		{
+			uint32_t version = texture_get_view_version(raw->textures[i]);
+			for (uint32_t frame = 0; frame < raw->texture_version_frames; frame++)
+				raw->texture_versions[frame * MATERIAL_TEXTURE_MAX + i] = version;
+		}
+	}
 
-	free(material_bindings);
 	// Load the shaders
 	// Get the shader names temporarily
-	const char* vertexshader = json_get_member_string(object, "vertexshader");
-	const char* fragmentshader = json_get_member_string(object, "fragmentshader");
+	JSON* jshaders = raw->bindless ? jbindless : object;
+	const char* vertexshader = json_get_member_string(jshaders, "vertexshader");
+	const char* fragmentshader = json_get_member_string(jshaders, "fragmentshader");
 	if (vertexshader == NULL || fragmentshader == NULL)
 	{
 		LOG_E("Failed to read shaders from material %s", raw->name);
-		material_destroy(handle);
-		return INVALID(Material);
+		return -1;
 	}
 
 	struct PipelineInfo pipeline_info = {0};
@@ -318,10 +419,60 @@ Material material_load_internal(JSON* object)
 	if (raw->pipeline == NULL)
 	{
 		LOG_E("Failed to create graphics pipeline for material %s", raw->name);
-		material_destroy(handle);
+		return -1;
+	}
+
+	// Bindless materials can be drawn indirectly with a vertex shader reading the culled entities
+	const char* indirectshader = raw->bindless ? json_get_member_string(jbindless, "indirectvertexshader") : NULL;
+	if (indirectshader && indirect_get_layout())
+	{
+		VkDescriptorSetLayout indirect_layouts[3] = {raw->descriptor_layouts[GLOBAL_DESCRIPTOR_INDEX], raw->descriptor_layouts[MATERIAL_DESCRIPTOR_INDEX], indirect_get_layout()};
+		pipeline_info.descriptor_layouts = indirect_layouts;
+		snprintf(pipeline_info.vertexshader, sizeof pipeline_info.vertexshader, "%s", indirectshader);
+		pipeline_info.push_constants = malloc(pipeline_info.push_constant_count * sizeof(VkPushConstantRange));
+		memcpy(pipeline_info.push_constants, raw->push_constants, raw->push_constant_count * sizeof(VkPushConstantRange));
+
+		// The entities are drawn by the render tree instead
+		raw->indirect_pipeline = pipeline_get(&pipeline_info);
+		if (raw->indirect_pipeline == NULL)
+			LOG_W("Failed to create indirect pipeline for material %s", raw->name);
+	}
+
+	return 0;
+}
+
+// Loads a material from a json struct
+// file is the file the json was loaded from, or NULL
+static Material material_load_internal(JSON* object, const char* file)
+{
+	const struct handle_wrapper* wrapper = handlepool_alloc(&material_pool);
+	Material_raw* raw = (Material_raw*)wrapper->data;
+	Material handle = PUN_HANDLE(wrapper->handle, Material);
+
+	if (material_init(raw, object, file) != 0)
+	{
+		material_release(raw);
+		handlepool_free(&material_pool, PUN_HANDLE(handle, GenericHandle));
 		return INVALID(Material);
 	}
 
+	// Create table if it doesn't exist
+	if (material_table == NULL)
+	{
+		material_table = handletable_create(keyfunc_material, handletable_hashfunc_string, handletable_comp_string);
+	}
+
+	// Insert material into tracking table after name is acquired
+	if (HANDLE_VALID(handletable_find(material_table, raw->name)))
+	{
+		LOG_W("Duplicate material %s", raw->name);
+		material_release(raw);
+		handlepool_free(&material_pool, PUN_HANDLE(handle, GenericHandle));
+		return INVALID(Material);
+	}
+
+	// Insert into table
+	handletable_insert(material_table, PUN_HANDLE(handle, GenericHandle));
 	return handle;
 }
 
@@ -340,7 +491,7 @@ Material material_load(const char* file)
 	// Load the one root material
 	if (jtype == JSON_TOBJECT)
 	{
-		mat = material_load_internal(root);
+		mat = material_load_internal(root, file);
 	}
 	// Load several materials in linked lists [TODO]
 	else if (jtype == JSON_TARRAY)
@@ -348,7 +499,7 @@ Material material_load(const char* file)
 		JSON* cur = json_get_elements(root);
 		while (cur)
 		{
-			material_load_internal(cur);
+			material_load_internal(cur, file);
 			cur = json_next(cur);
 		}
 	}
@@ -385,6 +536,11 @@ Material material_get_default()
 	json_add_member(root, "albedo", json_create_string("col:white"));
 	json_add_member(root, "vertexshader", json_create_string("./assets/shaders/default.vert.spv"));
 	json_add_member(root, "fragmentshader", json_create_string("./assets/shaders/default.frag.spv"));
+	JSON* bindless = json_create_object();
+	json_add_member(bindless, "vertexshader", json_create_string("./assets/shaders/bindless.vert.spv"));
+	json_add_member(bindless, "fragmentshader", json_create_string("./assets/shaders/bindless.frag.spv"));
+	json_add_member(bindless, "indirectvertexshader", json_create_string("./assets/shaders/indirect.vert.spv"));
+	json_add_member(root, "bindless", bindless);
 	JSON* bindings = json_create_array();
 	JSON* binding = json_create_object();
 	json_add_member(binding, "binding", json_create_number(0));
@@ -394,12 +550,202 @@ Material material_get_default()
 	json_add_element(bindings, binding);
 	json_add_member(root, "bindings", bindings);
 
-	material_default = material_load_internal(root);
+	material_default = material_load_internal(root, NULL);
 
 	json_destroy(root);
 	return material_default;
 }
 
+// Returns the number of materials using the pipeline
+static uint32_t material_count_pipeline_users(Pipeline* pipeline)
+{
+	uint32_t count = 0;
+	for (uint32_t i = 0; i < material_pool.size; i++)
+	{
+		if (HANDLEPOOL_INDEX((&material_pool), i)->next != NULL)
+			continue;
+
+		Material_raw* raw = (Material_raw*)HANDLEPOOL_INDEX((&material_pool), i)->data;
+		if (raw->pipeline == pipeline || raw->indirect_pipeline == pipeline)
+			count++;
+	}
+	return count;
+}
+
+// Returns the number of materials sampling the texture
+static uint32_t material_count_texture_users(Texture tex)
+{
+	uint32_t count = 0;
+	for (uint32_t i = 0; i < material_pool.size; i++)
+	{
+		if (HANDLEPOOL_INDEX((&material_pool), i)->next != NULL)
+			continue;
+
+		Material_raw* raw = (Material_raw*)HANDLEPOOL_INDEX((&material_pool), i)->data;
+		for (uint32_t j = 0; j < raw->texture_count; j++)
+		{
+			if (HANDLE_COMPARE(raw->textures[j], tex))
+			{
+				count++;
+				break;
+			}
+		}
+	}
+	return count;
+}
+
+// Finds the json object describing the named material in a material file
+static JSON* material_find_object(JSON* root, const char* name)
+{
+	if (json_type(root) == JSON_TOBJECT)
+		return root;
+
+	for (JSON* cur = json_get_elements(root); cur; cur = json_next(cur))
+	{
+		if (strcmp_s(json_get_member_string(cur, "name"), name) == 0)
+			return cur;
+	}
+	return NULL;
+}
+
+int material_reload(Material mat)
+{
+	Material_raw* raw = handlepool_get_raw(&material_pool, PUN_HANDLE(mat, GenericHandle));
+	if (raw->file[0] == '\0')
+	{
+		LOG_W("Material %s was not loaded from a file and cannot be reloaded", raw->name);
+		return -1;
+	}
+
+	// Keep the previous version in case the new one fails
+	Material_raw old = *raw;
+
+	JSON* root = json_loadfile(old.file);
+	if (root == NULL)
+	{
+		LOG_E("Failed to reload material %s from %s", old.name, old.file);
+		return -1;
+	}
+
+	JSON* object = material_find_object(root, old.name);
+	if (object == NULL)
+	{
+		LOG_E("Failed to reload material %s - it no longer exists in %s", old.name, old.file);
+		json_destroy(root);
+		return -1;
+	}
+
+	LOG_S("Reloading material %s", old.name);
+
+	// The descriptors may be in use by frames in flight
+	vkDeviceWaitIdle(device);
+
+	// The material is filled in place so the handle stays valid for all entities
+	handletable_remove(material_table, old.name);
+	int result = material_init(raw, object, old.file);
+	json_destroy(root);
+
+	if (result != 0)
+	{
+		LOG_E("Failed to reload material %s, keeping the previous version", old.name);
+		material_release(raw);
+		// Textures loaded for the new version are destroyed unless the previous version or another material uses them
+		Texture textures[MATERIAL_TEXTURE_MAX];
+		uint32_t texture_count = raw->texture_count;
+		memcpy(textures, raw->textures, texture_count * sizeof *textures);
+		*raw = old;
+		handletable_insert(material_table, PUN_HANDLE(mat, GenericHandle));
+
+		for (uint32_t i = 0; i < texture_count; i++)
+		{
+			if (HANDLE_VALID(textures[i]) && material_count_texture_users(textures[i]) == 0)
+			{
+				texture_destroy(textures[i]);
+				// A texture bound several times is only destroyed once
+				for (uint32_t j = i + 1; j < texture_count; j++)
+				{
+					if (HANDLE_COMPARE(textures[j], textures[i]))
+						textures[j] = INVALID(Texture);
+				}
+			}
+		}
+		return -1;
+	}
+
+	handletable_insert(material_table, PUN_HANDLE(mat, GenericHandle));
+	material_release(&old);
+
+	// The new descriptor layout gives a different pipeline, the old one is destroyed if unused
+	if (old.pipeline != raw->pipeline && material_count_pipeline_users(old.pipeline) == 0)
+		pipeline_destroy(old.pipeline);
+	if (old.indirect_pipeline && old.indirect_pipeline != raw->indirect_pipeline && material_count_pipeline_users(old.indirect_pipeline) == 0)
+		pipeline_destroy(old.indirect_pipeline);
+	return 0;
+}
+
+uint32_t material_find_dependents(const char* path, Material* result, uint32_t size)
+{
+	Texture tex = texture_find_file(path);
+	uint32_t count = 0;
+	for (uint32_t i = 0; i < material_pool.size && count < size; i++)
+	{
+		if (HANDLEPOOL_INDEX((&material_pool), i)->next != NULL)
+			continue;
+
+		Material_raw* raw = (Material_raw*)HANDLEPOOL_INDEX((&material_pool), i)->data;
+		bool uses = (raw->file[0] && path_equal(raw->file, path)) || pipeline_uses_shader(raw->pipeline, path) ||
+					(raw->indirect_pipeline && pipeline_uses_shader(raw->indirect_pipeline, path));
+
+		for (uint32_t j = 0; !uses && j < raw->texture_count; j++)
+		{
+			uses = HANDLE_VALID(tex) && HANDLE_COMPARE(raw->textures[j], tex);
+		}
+
+		if (uses)
+			result[count++] = PUN_HANDLE(HANDLEPOOL_INDEX((&material_pool), i)->handle, Material);
+	}
+	return count;
+}
+
+uint32_t material_update_descriptors(uint32_t frame, Material* result, uint32_t size)
+{
+	uint32_t count = 0;
+	for (uint32_t i = 0; i < material_pool.size && count < size; i++)
+	{
+		if (HANDLEPOOL_INDEX((&material_pool), i)->next != NULL)
+			continue;
+
+		Material_raw* raw = (Material_raw*)HANDLEPOOL_INDEX((&material_pool), i)->data;
+		// Bindless textures are rewritten by bindless_update without re-recording
+		// The descriptors only exist for the swapchain images at creation
+		if (raw->bindless || frame >= raw->texture_version_frames)
+			continue;
+
+		bool changed = false;
+		uint32_t* versions = raw->texture_versions + frame * MATERIAL_TEXTURE_MAX;
+		for (uint32_t j = 0; j < raw->texture_count; j++)
+		{
+			uint32_t version = texture_get_view_version(raw->textures[j]);
+			changed = changed || versions[j] != version;
+			versions[j] = version;
+		}
+
+		if (changed)
+		{
+			descriptorpack_write_frame(raw->material_descriptors, raw->bindings, raw->binding_count, NULL, raw->textures, raw->samplers, frame);
+			result[count++] = PUN_HANDLE(HANDLEPOOL_INDEX((&material_pool), i)->handle, Material);
+		}
+	}
+	return count;
+}
+
+void material_request_textures(Material mat, float size)
+{
+	Material_raw* raw = handlepool_get_raw(&material_pool, PUN_HANDLE(mat, GenericHandle));
+	for (uint32_t i = 0; i < raw->texture_count; i++)
+		texture_stream_request(raw->textures[i], size);
+}
+
 void material_bind(Material mat, Commandbuffer commandbuffer, VkDescriptorSet data_descriptors)
 {
 	Material_raw* raw = handlepool_get_raw(&material_pool, PUN_HANDLE(mat, GenericHandle));
@@ -412,13 +758,56 @@ void material_bind(Material mat, Commandbuffer commandbuffer, VkDescriptorSet da
 	vkCmdBindDescriptorSets(commandbuffer_vk(commandbuffer), VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout, GLOBAL_DESCRIPTOR_INDEX, 1, &global_descriptors->sets[renderer_get_frameindex()], 0,
 							NULL);
 	// Bind material set 1
-	vkCmdBindDescriptorSets(commandbuffer_vk(commandbuffer), VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout, MATERIAL_DESCRIPTOR_INDEX, 1,
-							&raw->material_descriptors->sets[renderer_get_frameindex()], 0, NULL);
+	VkDescriptorSet material_set = raw->bindless ? bindless_get_set(renderer_get_frameindex()) : raw->material_descriptors->sets[renderer_get_frameindex()];
+	vkCmdBindDescriptorSets(commandbuffer_vk(commandbuffer), VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout, MATERIAL_DESCRIPTOR_INDEX, 1, &material_set, 0, NULL);
 
 	// Per entity data set 2
 	vkCmdBindDescriptorSets(commandbuffer_vk(commandbuffer), VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout, ENTITY_DESCRIPTOR_INDEX, 1, &data_descriptors, 0, NULL);
 }
 
+const char* material_get_name(Material mat)
+{
+	if (!HANDLE_VALID(mat))
+		return "";
+	Material_raw* raw = handlepool_get_raw(&material_pool, PUN_HANDLE(mat, GenericHandle));
+	return raw ? raw->name : "";
+}
+
+uint32_t material_get_bindless_index(Material mat)
+{
+	Material_raw* raw = handlepool_get_raw(&material_pool, PUN_HANDLE(mat, GenericHandle));
+	return raw->bindless ? raw->bindless_index : 0;
+}
+
+uintptr_t material_get_sort_key(Material mat)
+{
+	Material_raw* raw = handlepool_get_raw(&material_pool, PUN_HANDLE(mat, GenericHandle));
+	return (uintptr_t)raw->pipeline;
+}
+
+bool material_can_batch(Material a, Material b)
+{
+	Material_raw* raw_a = handlepool_get_raw(&material_pool, PUN_HANDLE(a, GenericHandle));
+	Material_raw* raw_b = handlepool_get_raw(&material_pool, PUN_HANDLE(b, GenericHandle));
+	return raw_a->bindless && raw_b->bindless && raw_a->pipeline == raw_b->pipeline;
+}
+
+uintptr_t material_get_indirect_key(Material mat)
+{
+	Material_raw* raw = handlepool_get_raw(&material_pool, PUN_HANDLE(mat, GenericHandle));
+	return (uintptr_t)raw->indirect_pipeline;
+}
+
+void material_bind_indirect(Material mat, Commandbuffer commandbuffer, VkDescriptorSet indirect_set)
+{
+	Material_raw* raw = handlepool_get_raw(&material_pool, PUN_HANDLE(mat, GenericHandle));
+	pipeline_bind(raw->indirect_pipeline, commandbuffer_vk(commandbuffer));
+
+	VkPipelineLayout pipeline_layout = pipeline_get_layout(raw->indirect_pipeline);
+	VkDescriptorSet sets[3] = {global_descriptors->sets[renderer_get_frameindex()], bindless_get_set(renderer_get_frameindex()), indirect_set};
+	vkCmdBindDescriptorSets(commandbuffer_vk(commandbuffer), VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout, GLOBAL_DESCRIPTOR_INDEX, 3, sets, 0, NULL);
+}
+
 void material_push_constants(Material mat, Commandbuffer commandbuffer, uint32_t index, void* data)
 {
 	Material_raw* raw = handlepool_get_raw(&material_pool, PUN_HANDLE(mat, GenericHandle));
@@ -448,8 +837,7 @@ void material_destroy(Material mat)
 		texture_destroy(raw->textures[i]);
 	}
 
-	descriptorpack_destroy(raw->material_descriptors);
-	vkDestroyDescriptorSetLayout(device, raw->descriptor_layouts[MATERIAL_DESCRIPTOR_INDEX], NULL);
+	material_release(raw);
 
 	handlepool_free(&material_pool, PUN_HANDLE(mat, GenericHandle));
 }
@@ -1,22 +1,52 @@
 #include "graphics/model.h"
 #include "utils.h"
 #include "graphics/vertexbuffer.h"
-#include "graphics/indexbuffer.h"
+#include "geometry.h"
+#include "simplify.h"
 #include "xmlparser.h"
 #include "log.h"
 #include "utils.h"
 #include "hashtable.h"
+#include "jobs.h"
+#include "vulkan_members.h"
+
+// Meshes with fewer indices are not simplified further
+#define MESH_LOD_MIN_INDICES 384
+// A level is dropped if it keeps more than this fraction of the indices of the previous level
+#define MESH_LOD_MIN_REDUCTION 0.8f
+// The largest error of a level relative to the mesh radius
+#define MESH_LOD_MAX_ERROR 0.25f
 
 hashtable_t* model_table = NULL;
 
+// A level of detail in the shared index buffer
+struct MeshLod
+{
+	uint32_t first_index;
+	uint32_t index_count;
+	// The geometric error relative to the diameter of the mesh
+	float error;
+};
+
 struct Mesh
 {
 	// The mesh id
 	char name[256];
-	VertexBuffer* vb;
-	IndexBuffer* ib;
+	// The ranges of the mesh in the shared geometry buffers
+	// The index range holds all levels of detail
+	uint32_t first_index;
+	uint32_t first_vertex;
+	uint32_t total_index_count;
+	// The index count of the full mesh
 	uint32_t index_count;
 	uint32_t vertex_count;
+	// Level 0 is the full mesh, coarser levels reference the same vertices
+	struct MeshLod lods[MESH_MAX_LODS];
+	uint32_t lod_count;
+	// The coarsest level kept on the CPU for occlusion culling
+	vec3* occluder_positions;
+	uint32_t* occluder_indices;
+	uint32_t occluder_index_count;
 	float max_distance;
 	Model* model_parent;
 };
@@ -25,8 +55,12 @@ struct Model
 {
 	// The filename without extension
 	char name[256];
+	// The file the model was loaded from, empty if created in code
+	char filepath[256];
 	Mesh** meshes;
 	uint32_t mesh_count;
+	// Set while the meshes are being loaded on a worker thread
+	int pending;
 };
 
 struct Face
@@ -34,38 +68,102 @@ struct Face
 	uint32_t pos_index, normal_index, uv_index;
 };
 
-void model_load_collada(const char* filepath)
+// The index lists of the levels of detail of a mesh on the CPU
+// Level 0 is the full mesh
+struct MeshLods
 {
-	LOG("Loading model %s", filepath);
+	uint32_t* indices[MESH_MAX_LODS];
+	uint32_t index_counts[MESH_MAX_LODS];
+	// The geometric error relative to the diameter of the mesh
+	float errors[MESH_MAX_LODS];
+	uint32_t count;
+};
 
-	XMLNode* root = xml_loadfile(filepath);
-	if (root == NULL)
-	{
-		LOG_E("Failed to open COLLADA model file %s", filepath);
-		return;
-	}
+// CPU side mesh data parsed from a file
+struct MeshData
+{
+	char name[256];
+	Vertex* vertices;
+	uint32_t vertex_count;
+	struct MeshLods lods;
+};
 
-	Model* model = malloc(sizeof(Model));
-	model->meshes = NULL;
-	model->mesh_count = 0;
-	// Load the name from the filename
-	get_filename(filepath, model->name, sizeof model->name);
+// Generates the coarser levels of detail from level 0 by successive simplification
+// Stops when a level no longer removes enough triangles or its error grows too large
+// Can run on any thread
+static void mesh_generate_lods(struct MeshLods* lods, const Vertex* vertices, uint32_t vertex_count)
+{
+	float radius = 0.0f;
+	for (uint32_t i = 0; i < vertex_count; i++)
+		radius = fmaxf(radius, vec3_sqrmag(vertices[i].position));
+	radius = sqrtf(radius);
+	if (radius <= 0.0f)
+		return;
 
-	// Insert into table
-	// Create table if it doesn't exist
-	if (model_table == NULL)
+	while (lods->count < MESH_MAX_LODS)
 	{
-		model_table = hashtable_create_string();
+		uint32_t prev = lods->count - 1;
+		uint32_t prev_count = lods->index_counts[prev];
+		if (prev_count < MESH_LOD_MIN_INDICES)
+			break;
+
+		// Each level halves the triangles of the previous one
+		uint32_t* indices = malloc(prev_count * sizeof *indices);
+		float error = 0.0f;
+		uint32_t count = simplify_mesh(indices, lods->indices[prev], prev_count, vertices, vertex_count, prev_count / 6 * 3, radius * MESH_LOD_MAX_ERROR, &error);
+		if (count == 0 || count > prev_count * MESH_LOD_MIN_REDUCTION)
+		{
+			free(indices);
+			break;
+		}
+
+		// Errors of successive simplifications add up
+		lods->indices[lods->count] = indices;
+		lods->index_counts[lods->count] = count;
+		lods->errors[lods->count] = lods->errors[prev] + error / (2.0f * radius);
+		lods->count++;
 	}
-	// Insert material into tracking table after name is acquired
-	if (hashtable_find(model_table, model->name) != NULL)
+}
+
+static Mesh* mesh_create_lods(const char* name, Vertex* vertices, uint32_t vertex_count, const struct MeshLods* lods);
+
+// Frees the generated levels, level 0 is owned by the caller
+static void mesh_free_lods(struct MeshLods* lods)
+{
+	for (uint32_t i = 1; i < lods->count; i++)
+		free(lods->indices[i]);
+	lods->count = 1;
+}
+
+// A model file being parsed, possibly on a worker thread
+// Workers don't touch the model, the meshes are created from the parsed data on the main thread
+typedef struct ModelLoad
+{
+	Model* model;
+	char filepath[256];
+	// The filename without extension
+	char name[256];
+	struct MeshData* meshes;
+	uint32_t mesh_count;
+	// Set if the file could not be parsed
+	int failed;
+	struct ModelLoad* next;
+} ModelLoad;
+
+// Parsed models waiting for mesh creation, pushed by the workers
+static ModelLoad* volatile model_loads_done = NULL;
+static JobCounter model_jobs = {0};
+
+// Parses all meshes of a COLLADA file into load
+// Does not touch any graphics or model state and can run on any thread
+static int model_parse_collada(ModelLoad* load)
+{
+	XMLNode* root = xml_loadfile(load->filepath);
+	if (root == NULL)
 	{
-		LOG_W("Duplicate model %s", model->name);
-		model_destroy(model);
-		return;
+		LOG_E("Failed to open COLLADA model file %s", load->filepath);
+		return -1;
 	}
-	// Insert into table
-	hashtable_insert(model_table, model->name, model);
 
 	XMLNode* lib_geometries = xml_get_child(root, "library_geometries");
 	XMLNode* geometries = xml_get_children(lib_geometries);
@@ -172,15 +270,15 @@ void model_load_collada(const char* filepath)
 		// Check what got loaded
 		if (positions == NULL)
 		{
-			LOG_W("Mesh %s:%s contains no vertex position data", model->name, name);
+			LOG_W("Mesh %s:%s contains no vertex position data", load->name, name);
 		}
 		if (normals == NULL)
 		{
-			LOG_W("Mesh %s:%s contains no normal data", model->name, name);
+			LOG_W("Mesh %s:%s contains no normal data", load->name, name);
 		}
 		if (uvs == NULL)
 		{
-			LOG_W("Mesh %s:%s contains no uv data", model->name, name);
+			LOG_W("Mesh %s:%s contains no uv data", load->name, name);
 		}
 
 		// Triangles
@@ -242,26 +340,212 @@ void model_load_collada(const char* filepath)
 			vertices[i].uv = *(vec2*)&uvs[2 * sets[i].uv_index];
 		}
 
-		Mesh* mesh = mesh_create(name, vertices, set_count, indices, index_count);
-		model_add_mesh(model, mesh);
+		// Keep the vertices and indices for mesh creation on the main thread
+		load->meshes = realloc(load->meshes, ++load->mesh_count * sizeof *load->meshes);
+		struct MeshData* data = &load->meshes[load->mesh_count - 1];
+		snprintf(data->name, sizeof data->name, "%s", name);
+		data->vertices = vertices;
+		data->vertex_count = set_count;
+		data->lods = (struct MeshLods){.indices = {indices}, .index_counts = {index_count}, .errors = {0.0f}, .count = 1};
+		mesh_generate_lods(&data->lods, vertices, set_count);
 
 		free(positions);
 		free(uvs);
 		free(normals);
 		free(sets);
-		free(indices);
-		free(vertices);
 	}
 
 	xml_destroy(root);
+	return 0;
 }
 
-Mesh* mesh_create(const char* name, Vertex* vertices, uint32_t vertex_count, uint32_t* indices, uint32_t index_count)
+// Creates the meshes from the parsed data and frees it
+static void model_build(Model* model, ModelLoad* load)
 {
-	Mesh* mesh = malloc(sizeof(Mesh));
+	for (uint32_t i = 0; i < load->mesh_count; i++)
+	{
+		struct MeshData* data = &load->meshes[i];
+		Mesh* mesh = mesh_create_lods(data->name, data->vertices, data->vertex_count, &data->lods);
+		model_add_mesh(model, mesh);
 
-	snprintf(mesh->name, sizeof mesh->name, "%s", name);
+		free(data->vertices);
+		free(data->lods.indices[0]);
+		mesh_free_lods(&data->lods);
+	}
+
+	free(load->meshes);
+	load->meshes = NULL;
+	load->mesh_count = 0;
+	model->pending = 0;
+}
+
+// Creates an empty model and inserts it into the table
+// Returns NULL if a model with the same name exists
+static Model* model_create(const char* name)
+{
+	Model* model = malloc(sizeof(Model));
+	model->meshes = NULL;
+	model->mesh_count = 0;
+	model->pending = 0;
+	model->filepath[0] = '\0';
+	snprintf(model->name, sizeof model->name, "%s", name);
+
+	// Insert into table
+	// Create table if it doesn't exist
+	if (model_table == NULL)
+	{
+		model_table = hashtable_create_string();
+	}
+	// Insert material into tracking table after name is acquired
+	if (hashtable_find(model_table, model->name) != NULL)
+	{
+		LOG_W("Duplicate model %s", model->name);
+		free(model);
+		return NULL;
+	}
+	// Insert into table
+	hashtable_insert(model_table, model->name, model);
+	return model;
+}
+
+void model_load_collada(const char* filepath)
+{
+	LOG("Loading model %s", filepath);
+
+	ModelLoad load = {0};
+	snprintf(load.filepath, sizeof load.filepath, "%s", filepath);
+	// Load the name from the filename
+	get_filename(filepath, load.name, sizeof load.name);
+
+	if (model_get(load.name) != NULL)
+	{
+		LOG_W("Duplicate model %s", load.name);
+		return;
+	}
+
+	if (model_parse_collada(&load) != 0)
+		return;
+
+	Model* model = model_create(load.name);
+	snprintf(model->filepath, sizeof model->filepath, "%s", filepath);
+	model_build(model, &load);
+}
+
+static void model_parse_job(void* arg)
+{
+	ModelLoad* load = arg;
+	load->failed = model_parse_collada(load) != 0;
+
+	// Push onto the list of parsed models
+	ModelLoad* head = __atomic_load_n(&model_loads_done, __ATOMIC_RELAXED);
+	do
+	{
+		load->next = head;
+	} while (!__atomic_compare_exchange_n(&model_loads_done, &head, load, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+Model* model_load_collada_async(const char* filepath)
+{
+	LOG("Loading model %s", filepath);
+
+	ModelLoad* load = calloc(1, sizeof(ModelLoad));
+	snprintf(load->filepath, sizeof load->filepath, "%s", filepath);
+	get_filename(filepath, load->name, sizeof load->name);
+
+	load->model = model_create(load->name);
+	if (load->model == NULL)
+	{
+		free(load);
+		return NULL;
+	}
+
+	load->model->pending = 1;
+	snprintf(load->model->filepath, sizeof load->model->filepath, "%s", filepath);
+	job_submit(model_parse_job, load, &model_jobs);
+	return load->model;
+}
 
+uint32_t model_upload_pending()
+{
+	ModelLoad* loads = __atomic_exchange_n(&model_loads_done, NULL, __ATOMIC_ACQUIRE);
+	uint32_t count = 0;
+	while (loads)
+	{
+		ModelLoad* next = loads->next;
+		if (loads->failed)
+			loads->model->pending = 0;
+		else
+			model_build(loads->model, loads);
+		free(loads);
+		loads = next;
+		count++;
+	}
+	return count;
+}
+
+void model_wait_pending()
+{
+	job_wait(&model_jobs);
+	model_upload_pending();
+}
+
+int model_is_pending(Model* model)
+{
+	return model->pending;
+}
+
+// Frees the ranges of a mesh in the geometry buffers
+// The mesh is left empty and draws nothing
+static void mesh_release(Mesh* mesh)
+{
+	if (mesh->first_vertex != GEOMETRY_INVALID)
+		geometry_remove_vertices(mesh->first_vertex, mesh->vertex_count);
+	if (mesh->first_index != GEOMETRY_INVALID)
+		geometry_remove_indices(mesh->first_index, mesh->total_index_count);
+	mesh->first_vertex = 0;
+	mesh->first_index = 0;
+	mesh->vertex_count = 0;
+	mesh->index_count = 0;
+	mesh->total_index_count = 0;
+	mesh->lods[0] = (struct MeshLod){0, 0, 0.0f};
+	mesh->lod_count = 1;
+	free(mesh->occluder_positions);
+	free(mesh->occluder_indices);
+	mesh->occluder_positions = NULL;
+	mesh->occluder_indices = NULL;
+	mesh->occluder_index_count = 0;
+}
+
+// Copies the positions referenced by the full detail level of a mesh and remaps its indices to them
+// Simplified levels can bulge outside the mesh and would hide what is visible past its silhouette
+static void mesh_fill_occluder(Mesh* mesh, const Vertex* vertices, uint32_t vertex_count, const struct MeshLods* lods)
+{
+	const uint32_t* indices = lods->indices[0];
+	uint32_t index_count = lods->index_counts[0];
+
+	uint32_t* remap = malloc(vertex_count * sizeof *remap);
+	memset(remap, 0xff, vertex_count * sizeof *remap);
+
+	mesh->occluder_positions = malloc(vertex_count * sizeof *mesh->occluder_positions);
+	mesh->occluder_indices = malloc(index_count * sizeof *mesh->occluder_indices);
+	mesh->occluder_index_count = index_count;
+	uint32_t position_count = 0;
+	for (uint32_t i = 0; i < index_count; i++)
+	{
+		if (remap[indices[i]] == (uint32_t)-1)
+		{
+			remap[indices[i]] = position_count;
+			mesh->occluder_positions[position_count++] = vertices[indices[i]].position;
+		}
+		mesh->occluder_indices[i] = remap[indices[i]];
+	}
+	mesh->occluder_positions = realloc(mesh->occluder_positions, (position_count ? position_count : 1) * sizeof *mesh->occluder_positions);
+	free(remap);
+}
+
+// Uploads the vertices and the indices of all levels of a mesh to the shared geometry buffers
+static void mesh_fill(Mesh* mesh, Vertex* vertices, uint32_t vertex_count, const struct MeshLods* lods)
+{
 	mesh->max_distance = 0;
 	// Find max distance
 	for (uint32_t i = 0; i < vertex_count; i++)
@@ -272,15 +556,138 @@ Mesh* mesh_create(const char* name, Vertex* vertices, uint32_t vertex_count, uin
 		}
 	}
 
-	mesh->vb = vb_create(vertices, vertex_count);
-	mesh->ib = ib_create(indices, index_count);
-	mesh->index_count = index_count;
+	// All levels are stored consecutively in one index range
+	uint32_t total_index_count = 0;
+	for (uint32_t i = 0; i < lods->count; i++)
+		total_index_count += lods->index_counts[i];
+
+	uint32_t* indices = malloc(total_index_count * sizeof *indices);
+	uint32_t offset = 0;
+	for (uint32_t i = 0; i < lods->count; i++)
+	{
+		memcpy(indices + offset, lods->indices[i], lods->index_counts[i] * sizeof *indices);
+		offset += lods->index_counts[i];
+	}
+
+	mesh->first_vertex = geometry_add_vertices(vertices, vertex_count);
+	mesh->first_index = geometry_add_indices(indices, total_index_count);
+	mesh->total_index_count = total_index_count;
+	mesh->index_count = lods->index_counts[0];
 	mesh->vertex_count = vertex_count;
+	free(indices);
+
+	offset = mesh->first_index;
+	for (uint32_t i = 0; i < lods->count; i++)
+	{
+		mesh->lods[i] = (struct MeshLod){offset, lods->index_counts[i], lods->errors[i]};
+		offset += lods->index_counts[i];
+	}
+	mesh->lod_count = lods->count;
+	mesh_fill_occluder(mesh, vertices, vertex_count, lods);
+
+	if (mesh->first_vertex == GEOMETRY_INVALID || mesh->first_index == GEOMETRY_INVALID)
+	{
+		LOG_E("Failed to upload mesh %s", mesh->name);
+		mesh_release(mesh);
+	}
+}
+
+// Creates a mesh with precomputed levels of detail
+static Mesh* mesh_create_lods(const char* name, Vertex* vertices, uint32_t vertex_count, const struct MeshLods* lods)
+{
+	Mesh* mesh = malloc(sizeof(Mesh));
+
+	snprintf(mesh->name, sizeof mesh->name, "%s", name);
+	mesh->occluder_positions = NULL;
+	mesh->occluder_indices = NULL;
+	mesh_fill(mesh, vertices, vertex_count, lods);
 	mesh->model_parent = NULL;
 
 	return mesh;
 }
 
+Mesh* mesh_create(const char* name, Vertex* vertices, uint32_t vertex_count, uint32_t* indices, uint32_t index_count)
+{
+	struct MeshLods lods = {.indices = {indices}, .index_counts = {index_count}, .errors = {0.0f}, .count = 1};
+	mesh_generate_lods(&lods, vertices, vertex_count);
+
+	Mesh* mesh = mesh_create_lods(name, vertices, vertex_count, &lods);
+	mesh_free_lods(&lods);
+	return mesh;
+}
+
+int model_reload(Model* model)
+{
+	if (model->pending)
+		model_wait_pending();
+
+	if (model->filepath[0] == '\0')
+	{
+		LOG_W("Model %s was not loaded from a file and cannot be reloaded", model->name);
+		return -1;
+	}
+
+	ModelLoad load = {0};
+	load.model = model;
+	snprintf(load.filepath, sizeof load.filepath, "%s", model->filepath);
+	snprintf(load.name, sizeof load.name, "%s", model->name);
+
+	// Keep the previous meshes if the file is broken
+	if (model_parse_collada(&load) != 0)
+	{
+		LOG_E("Failed to reload model %s, keeping the previous version", model->name);
+		return -1;
+	}
+
+	LOG_S("Reloading model %s", model->name);
+
+	// The buffers may be in use by frames in flight
+	vkDeviceWaitIdle(device);
+
+	// Meshes are patched in place so that entities referencing them stay valid
+	// Meshes no longer in the file are kept
+	for (uint32_t i = 0; i < load.mesh_count; i++)
+	{
+		struct MeshData* data = &load.meshes[i];
+		Mesh* mesh = model_find_mesh(model, data->name);
+		if (mesh)
+		{
+			mesh_release(mesh);
+			mesh_fill(mesh, data->vertices, data->vertex_count, &data->lods);
+		}
+		else
+		{
+			model_add_mesh(model, mesh_create_lods(data->name, data->vertices, data->vertex_count, &data->lods));
+		}
+
+		free(data->vertices);
+		free(data->lods.indices[0]);
+		mesh_free_lods(&data->lods);
+	}
+	free(load.meshes);
+	return 0;
+}
+
+Model* model_find_file(const char* path)
+{
+	if (model_table == NULL)
+		return NULL;
+
+	Model* result = NULL;
+	hashtable_iterator* it = hashtable_iterator_begin(model_table);
+	Model* model = NULL;
+	while ((model = hashtable_iterator_next(it)))
+	{
+		if (model->filepath[0] && path_equal(model->filepath, path))
+		{
+			result = model;
+			break;
+		}
+	}
+	hashtable_iterator_end(it);
+	return result;
+}
+
 Model* model_get(const char* name)
 {
 	// No materials loaded
@@ -289,6 +696,11 @@ Model* model_get(const char* name)
 	return hashtable_find(model_table, name);
 }
 
+const char* model_get_name(Model* model)
+{
+	return model->name;
+}
+
 Mesh* model_get_mesh(Model* model, uint32_t index)
 {
 	if (index >= model->mesh_count)
@@ -320,6 +732,10 @@ void model_add_mesh(Model* model, Mesh* mesh)
 
 void model_destroy(Model* model)
 {
+	// The meshes are still being parsed
+	if (model->pending)
+		model_wait_pending();
+
 	// Remove from table if it exists
 	hashtable_remove(model_table, model->name);
 	// Last texture was removed
@@ -347,15 +763,40 @@ void model_destroy_all()
 	}
 }
 
-void mesh_bind(Mesh* mesh, Commandbuffer commandbuffer)
+void mesh_draw(Mesh* mesh, Commandbuffer commandbuffer)
 {
-	vb_bind(mesh->vb, commandbuffer);
-	ib_bind(mesh->ib, commandbuffer);
+	vkCmdDrawIndexed(commandbuffer_vk(commandbuffer), mesh->index_count, 1, mesh->first_index, mesh->first_vertex, 0);
 }
 
-void mesh_draw(Mesh* mesh, Commandbuffer commandbuffer)
+void mesh_draw_instanced(Mesh* mesh, Commandbuffer commandbuffer, uint32_t lod, uint32_t count)
+{
+	const struct MeshLod* level = &mesh->lods[lod < mesh->lod_count ? lod : mesh->lod_count - 1];
+	vkCmdDrawIndexed(commandbuffer_vk(commandbuffer), level->index_count, count, level->first_index, mesh->first_vertex, 0);
+}
+
+uint32_t mesh_select_lod(Mesh* mesh, float size, uint32_t current)
+{
+	// The error of each level grows with the level, the coarsest level within the threshold is used
+	uint32_t lod = 0;
+	for (uint32_t i = 1; i < mesh->lod_count; i++)
+	{
+		// Moving to a coarser level requires the error to be further below the threshold than staying
+		float threshold = MESH_LOD_PIXEL_ERROR * (i <= current ? 1.0f + MESH_LOD_HYSTERESIS : 1.0f - MESH_LOD_HYSTERESIS);
+		if (size * mesh->lods[i].error > threshold)
+			break;
+		lod = i;
+	}
+	return lod;
+}
+
+Model* mesh_get_model(Mesh* mesh)
 {
-	vkCmdDrawIndexed(commandbuffer_vk(commandbuffer), mesh->vertex_count, 1, 0, 0, 0);
+	return mesh->model_parent;
+}
+
+const char* mesh_get_name(Mesh* mesh)
+{
+	return mesh->name;
 }
 
 float mesh_max_distance(Mesh* mesh)
@@ -371,6 +812,29 @@ uint32_t mesh_get_vertex_count(Mesh* mesh)
 {
 	return mesh->vertex_count;
 }
+uint32_t mesh_get_lod_count(Mesh* mesh)
+{
+	return mesh->lod_count;
+}
+uint32_t mesh_get_lod_first_index(Mesh* mesh, uint32_t lod)
+{
+	return mesh->lods[lod < mesh->lod_count ? lod : mesh->lod_count - 1].first_index;
+}
+uint32_t mesh_get_lod_index_count(Mesh* mesh, uint32_t lod)
+{
+	return mesh->lods[lod < mesh->lod_count ? lod : mesh->lod_count - 1].index_count;
+}
+uint32_t mesh_get_first_vertex(Mesh* mesh)
+{
+	return mesh->first_vertex;
+}
+
+uint32_t mesh_get_occluder(Mesh* mesh, const vec3** positions, const uint32_t** indices)
+{
+	*positions = mesh->occluder_positions;
+	*indices = mesh->occluder_indices;
+	return mesh->occluder_index_count;
+}
 
 Mesh* mesh_find(const char* name)
 {
@@ -389,6 +853,11 @@ Mesh* mesh_find(const char* name)
 		LOG_E("Unknown model %s", modelname);
 		return NULL;
 	}
+	if (model->pending)
+	{
+		LOG_W("Model %s is still loading", modelname);
+		return NULL;
+	}
 	// Get first mesh
 	if (delimiter == NULL)
 	{
@@ -407,7 +876,6 @@ Mesh* mesh_find(const char* name)
 
 void mesh_destroy(Mesh* mesh)
 {
-	vb_destroy(mesh->vb);
-	ib_destroy(mesh->ib);
+	mesh_release(mesh);
 	free(mesh);
 }
\ No newline at end of file
@@ -0,0 +1,289 @@
+#include "occlusion.h"
+#include "settings.h"
+#include "log.h"
+#include "math/math.h"
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+// Vertices with a smaller clip space w are behind or too close to the camera to be projected
+#define OCCLUSION_MIN_W 1e-4f
+
+// An occluder offered during the frame
+struct Occluder
+{
+	Mesh* mesh;
+	Transform* transform;
+	float size;
+};
+
+static struct Occluder occluders[OCCLUSION_MAX_OCCLUDERS];
+static uint32_t occluder_count = 0;
+
+// The occluders of last frame, rasterized this frame
+static struct Occluder kept[OCCLUSION_MAX_OCCLUDERS];
+static uint32_t kept_count = 0;
+
+// All levels of the depth pyramid, level 0 is the rasterized depth
+// Depth is normalized device z, larger is further away
+static float pyramid[OCCLUSION_WIDTH * OCCLUSION_HEIGHT * 4 / 3];
+static float* levels[OCCLUSION_LEVELS];
+
+static mat4 view_proj;
+// Set if the pyramid is valid for this frame
+static bool active = false;
+
+bool occlusion_enabled()
+{
+	return settings_get_occlusion_culling();
+}
+
+// Projects a point into the pixel space of the depth buffer
+// Returns false if the point is behind the camera
+static bool occlusion_project(vec3 point, vec3* result)
+{
+	vec4 clip = mat4_transform_vec4(&view_proj, (vec4){point.x, point.y, point.z, 1.0f});
+	if (clip.w < OCCLUSION_MIN_W)
+		return false;
+
+	*result = (vec3){(clip.x / clip.w * 0.5f + 0.5f) * OCCLUSION_WIDTH, (clip.y / clip.w * 0.5f + 0.5f) * OCCLUSION_HEIGHT, clip.z / clip.w};
+	return true;
+}
+
+static float occlusion_edge(vec3 a, vec3 b, float x, float y)
+{
+	return (b.x - a.x) * (y - a.y) - (b.y - a.y) * (x - a.x);
+}
+
+// Rasterizes a triangle into level 0 keeping the nearest depth
+// Only pixels entirely inside the triangle are covered, and they get the furthest depth of the triangle within them,
+// so that the depth buffer never hides more than the occluders do
+static void occlusion_rasterize(vec3 a, vec3 b, vec3 c)
+{
+	float area = occlusion_edge(a, b, c.x, c.y);
+	if (fabsf(area) < FLT_EPSILON)
+		return;
+
+	// Both windings are rasterized, the edge functions are made positive inside
+	if (area < 0.0f)
+	{
+		vec3 tmp = b;
+		b = c;
+		c = tmp;
+		area = -area;
+	}
+
+	// The most an edge function decreases from the center to a corner of a pixel
+	float ea = 0.5f * (fabsf(c.x - b.x) + fabsf(c.y - b.y));
+	float eb = 0.5f * (fabsf(a.x - c.x) + fabsf(a.y - c.y));
+	float ec = 0.5f * (fabsf(b.x - a.x) + fabsf(b.y - a.y));
+	// The most depth increases from the center to a corner of a pixel
+	float dzdx = ((b.y - c.y) * a.z + (c.y - a.y) * b.z + (a.y - b.y) * c.z) / area;
+	float dzdy = ((c.x - b.x) * a.z + (a.x - c.x) * b.z + (b.x - a.x) * c.z) / area;
+	float dz = 0.5f * (fabsf(dzdx) + fabsf(dzdy));
+
+	// Clamped before converting since vertices close to the camera project far outside
+	int x0 = (int)ceilf(max(min(a.x, min(b.x, c.x)), 0.0f) - 0.5f);
+	int y0 = (int)ceilf(max(min(a.y, min(b.y, c.y)), 0.0f) - 0.5f);
+	int x1 = (int)floorf(min(max(a.x, max(b.x, c.x)), (float)OCCLUSION_WIDTH) - 0.5f);
+	int y1 = (int)floorf(min(max(a.y, max(b.y, c.y)), (float)OCCLUSION_HEIGHT) - 0.5f);
+
+	float* depth = levels[0];
+	for (int y = y0; y <= y1; y++)
+	{
+		for (int x = x0; x <= x1; x++)
+		{
+			float px = x + 0.5f;
+			float py = y + 0.5f;
+			float wa = occlusion_edge(b, c, px, py);
+			float wb = occlusion_edge(c, a, px, py);
+			float wc = occlusion_edge(a, b, px, py);
+			if (wa < ea || wb < eb || wc < ec)
+				continue;
+
+			// Normalized device depth is linear in screen space
+			float z = (wa * a.z + wb * b.z + wc * c.z) / area + dz;
+			if (z < depth[y * OCCLUSION_WIDTH + x])
+				depth[y * OCCLUSION_WIDTH + x] = z;
+		}
+	}
+}
+
+// Reduces each level into the next by keeping the furthest depth of each 2x2 block
+static void occlusion_build_pyramid()
+{
+	for (uint32_t l = 1; l < OCCLUSION_LEVELS; l++)
+	{
+		uint32_t width = OCCLUSION_WIDTH >> l;
+		uint32_t height = OCCLUSION_HEIGHT >> l;
+		uint32_t src_width = OCCLUSION_WIDTH >> (l - 1);
+		const float* src = levels[l - 1];
+		float* dst = levels[l];
+		for (uint32_t y = 0; y < height; y++)
+		{
+			for (uint32_t x = 0; x < width; x++)
+			{
+				const float* block = src + y * 2 * src_width + x * 2;
+				dst[y * width + x] = max(max(block[0], block[1]), max(block[src_width], block[src_width + 1]));
+			}
+		}
+	}
+}
+
+void occlusion_begin(Camera* camera)
+{
+	occluder_count = 0;
+	active = camera && occlusion_enabled();
+	if (!active)
+		return;
+
+	if (levels[0] == NULL)
+	{
+		float* level = pyramid;
+		for (uint32_t l = 0; l < OCCLUSION_LEVELS; l++)
+		{
+			levels[l] = level;
+			level += (OCCLUSION_WIDTH >> l) * (OCCLUSION_HEIGHT >> l);
+		}
+	}
+
+	mat4 view = camera_get_view_matrix(camera);
+	mat4 proj = camera_get_projection_matrix(camera);
+	view_proj = mat4_mul(&view, &proj);
+
+	for (uint32_t i = 0; i < OCCLUSION_WIDTH * OCCLUSION_HEIGHT; i++)
+		levels[0][i] = FLT_MAX;
+
+	for (uint32_t i = 0; i < kept_count; i++)
+	{
+		// The occluders may have moved since last frame
+		transform_update(kept[i].transform);
+		const mat4* model_matrix = &kept[i].transform->model_matrix;
+
+		const vec3* positions = NULL;
+		const uint32_t* indices = NULL;
+		uint32_t index_count = mesh_get_occluder(kept[i].mesh, &positions, &indices);
+
+		// Triangles crossing the near plane are skipped, which can only make less of the scene occluded
+		for (uint32_t j = 0; j + 2 < index_count; j += 3)
+		{
+			vec3 a, b, c;
+			if (occlusion_project(mat4_transform_vec3(model_matrix, positions[indices[j]]), &a) &&
+				occlusion_project(mat4_transform_vec3(model_matrix, positions[indices[j + 1]]), &b) &&
+				occlusion_project(mat4_transform_vec3(model_matrix, positions[indices[j + 2]]), &c))
+				occlusion_rasterize(a, b, c);
+		}
+	}
+
+	occlusion_build_pyramid();
+}
+
+void occlusion_add_occluder(Mesh* mesh, Transform* transform, float size)
+{
+	if (!active || mesh == NULL || size < OCCLUSION_MIN_OCCLUDER_SIZE)
+		return;
+
+	const vec3* positions = NULL;
+	const uint32_t* indices = NULL;
+	uint32_t index_count = mesh_get_occluder(mesh, &positions, &indices);
+	if (index_count == 0 || index_count > OCCLUSION_MAX_OCCLUDER_INDICES)
+		return;
+
+	uint32_t index = occluder_count;
+	// Replace the smallest occluder when full
+	if (occluder_count == OCCLUSION_MAX_OCCLUDERS)
+	{
+		index = 0;
+		for (uint32_t i = 1; i < occluder_count; i++)
+		{
+			if (occluders[i].size < occluders[index].size)
+				index = i;
+		}
+		if (occluders[index].size >= size)
+			return;
+	}
+	else
+		occluder_count++;
+
+	occluders[index] = (struct Occluder){mesh, transform, size};
+}
+
+// Removes the occluders of transform from a list by moving the last ones into their place
+static void occlusion_remove_from(struct Occluder* list, uint32_t* count, const Transform* transform)
+{
+	for (uint32_t i = *count; i-- > 0;)
+	{
+		if (list[i].transform == transform)
+			list[i] = list[--*count];
+	}
+}
+
+void occlusion_remove_occluder(const Transform* transform)
+{
+	occlusion_remove_from(occluders, &occluder_count, transform);
+	occlusion_remove_from(kept, &kept_count, transform);
+}
+
+void occlusion_end()
+{
+	kept_count = active ? occluder_count : 0;
+	memcpy(kept, occluders, kept_count * sizeof *kept);
+	occluder_count = 0;
+}
+
+bool occlusion_test_box(vec3 box_min, vec3 box_max)
+{
+	if (!active)
+		return true;
+
+	// The projection of the box is bounded by the projection of its corners
+	float x0 = FLT_MAX, y0 = FLT_MAX, x1 = -FLT_MAX, y1 = -FLT_MAX, z = FLT_MAX;
+	for (uint32_t i = 0; i < 8; i++)
+	{
+		vec3 corner = {i & 1 ? box_max.x : box_min.x, i & 2 ? box_max.y : box_min.y, i & 4 ? box_max.z : box_min.z};
+		vec3 p;
+		if (!occlusion_project(corner, &p))
+			return true;
+		x0 = min(x0, p.x);
+		y0 = min(y0, p.y);
+		x1 = max(x1, p.x);
+		y1 = max(y1, p.y);
+		z = min(z, p.z);
+	}
+
+	// Entirely outside the depth buffer, left to frustum culling
+	if (x1 < 0.0f || y1 < 0.0f || x0 >= OCCLUSION_WIDTH || y0 >= OCCLUSION_HEIGHT)
+		return true;
+
+	int px0 = (int)max(x0, 0.0f);
+	int py0 = (int)max(y0, 0.0f);
+	int px1 = (int)min(x1, OCCLUSION_WIDTH - 1.0f);
+	int py1 = (int)min(y1, OCCLUSION_HEIGHT - 1.0f);
+
+	// Use the finest level where the rectangle covers at most 2x2 texels
+	uint32_t l = 0;
+	while (l < OCCLUSION_LEVELS - 1 && ((px1 >> l) - (px0 >> l) > 1 || (py1 >> l) - (py0 >> l) > 1))
+		l++;
+
+	uint32_t width = OCCLUSION_WIDTH >> l;
+	float furthest = -FLT_MAX;
+	for (int y = py0 >> l; y <= py1 >> l; y++)
+	{
+		for (int x = px0 >> l; x <= px1 >> l; x++)
+			furthest = max(furthest, levels[l][y * width + x]);
+	}
+
+	return z <= furthest;
+}
+
+bool occlusion_test_sphere(vec3 center, float radius)
+{
+	return occlusion_test_box((vec3){center.x - radius, center.y - radius, center.z - radius}, (vec3){center.x + radius, center.y + radius, center.z + radius});
+}
+
+void occlusion_destroy()
+{
+	kept_count = 0;
+	occluder_count = 0;
+	active = false;
+}
@@ -0,0 +1,59 @@
+#ifndef OCCLUSION_H
+#define OCCLUSION_H
+#include <stdbool.h>
+#include "graphics/camera.h"
+#include "graphics/model.h"
+#include "transform.h"
+#include "math/vec.h"
+
+// Occlusion culling against a software rasterized depth buffer
+// The largest visible entities of a frame are kept as occluders and rasterized on the CPU at the start of the next frame
+// Rasterizing them with the current camera and transforms instead of reusing last frame's depth keeps the test conservative when the camera or occluders move
+// Only pixels entirely covered by an occluder triangle are written, with the furthest depth of the triangle within them
+// The depth buffer is reduced into a pyramid holding the furthest depth of each texel, which bounds are tested against
+// Occluders use the full detail level of their mesh, as simplified levels can reach outside it
+// Enabled by the occlusion_culling setting
+
+// The resolution of the depth buffer
+#define OCCLUSION_WIDTH	 256
+#define OCCLUSION_HEIGHT 128
+// The number of levels of the depth pyramid, the last level is 2x1
+#define OCCLUSION_LEVELS 8
+// The number of occluders rasterized each frame, the largest on screen are kept
+#define OCCLUSION_MAX_OCCLUDERS 64
+// Entities smaller than this many pixels on screen are not used as occluders
+#define OCCLUSION_MIN_OCCLUDER_SIZE 64.0f
+// Meshes with more indices are not used as occluders
+#define OCCLUSION_MAX_OCCLUDER_INDICES 3072
+
+bool occlusion_enabled();
+
+// Rasterizes the occluders gathered last frame with the camera and builds the depth pyramid
+// The transforms of the occluders are updated first, so they are rasterized where they are this frame
+// Starts gathering the occluders of this frame
+// Tests pass until the next call if camera is NULL or occlusion culling is disabled
+// Called before rendertree_render
+void occlusion_begin(Camera* camera);
+
+// Offers a visible entity as an occluder for the next frame
+// The transform is kept until then and needs to be removed with occlusion_remove_occluder if it is destroyed before
+// size is the diameter of the entity in pixels on screen
+void occlusion_add_occluder(Mesh* mesh, Transform* transform, float size);
+
+// Drops the occluders of a transform about to be destroyed
+void occlusion_remove_occluder(const Transform* transform);
+
+// Keeps the occluders gathered this frame to be rasterized at the start of the next
+// Called after rendertree_render
+void occlusion_end();
+
+// Returns false if the axis aligned box is hidden behind the occluders
+// Boxes crossing the near plane are always visible
+bool occlusion_test_box(vec3 box_min, vec3 box_max);
+
+// Returns false if the bounding sphere is hidden behind the occluders
+bool occlusion_test_sphere(vec3 center, float radius);
+
+// Drops the occluders of the next frame
+void occlusion_destroy();
+#endif
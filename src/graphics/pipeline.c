@@ -3,33 +3,81 @@
 #include "hashtable.h"
 #include "log.h"
 #include "utils.h"
+#include "jobs.h"
 #include <vulkan/vulkan.h>
 #include <string.h>
+#include <stdio.h>
 #include <magpie.h>
 
 // Holds all currently loaded pipelines
-// The hash function will hash the info struct
+// Keyed by a hash of the full pipeline info
 static hashtable_t* pipeline_table = NULL;
 
-static uint32_t hash_pipelineinfo(const void* pkey)
+// Shared by all pipeline creations and persisted across runs
+static VkPipelineCache pipeline_cache = VK_NULL_HANDLE;
+
+// A compact key identifying a pipeline
+// The hash covers the full info, the info is only compared on hash matches
+struct PipelineKey
+{
+	uint64_t hash;
+	const struct PipelineInfo* info;
+};
+
+struct Pipeline
+{
+	VkPipeline pipeline;
+	VkPipelineLayout layout;
+	struct PipelineInfo info;
+	struct PipelineKey key;
+	// Copy of the layouts referenced by info, as the creator's array may not outlive the pipeline
+	VkDescriptorSetLayout descriptor_layouts[PIPELINE_MAX_DESCRIPTOR_LAYOUTS];
+	// Nonzero while the pipeline is being compiled on a worker thread
+	JobCounter compiling;
+};
+
+// 64 bit FNV-1a
+static uint64_t hash_bytes(uint64_t hash, const void* data, size_t size)
 {
-	struct PipelineInfo* info = (struct PipelineInfo*)pkey;
-	uint32_t result = 0;
-	if (info->vertexshader)
-		result += hashtable_hashfunc_string(info->vertexshader);
-	if (info->geometryshader)
-		result += hashtable_hashfunc_string(info->geometryshader);
-	if (info->fragmentshader)
-		result += hashtable_hashfunc_string(info->fragmentshader);
-	
-	return result;
+	const uint8_t* bytes = data;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+static uint64_t hash_pipelineinfo(const struct PipelineInfo* info)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	// Include the terminators so that moving characters between the paths changes the hash
+	hash = hash_bytes(hash, info->vertexshader, strlen(info->vertexshader) + 1);
+	hash = hash_bytes(hash, info->fragmentshader, strlen(info->fragmentshader) + 1);
+	hash = hash_bytes(hash, info->geometryshader, strlen(info->geometryshader) + 1);
+	hash = hash_bytes(hash, &info->cullmode, sizeof info->cullmode);
+
+	hash = hash_bytes(hash, &info->descriptor_layout_count, sizeof info->descriptor_layout_count);
+	hash = hash_bytes(hash, info->descriptor_layouts, info->descriptor_layout_count * sizeof *info->descriptor_layouts);
+
+	hash = hash_bytes(hash, &info->push_constant_count, sizeof info->push_constant_count);
+	hash = hash_bytes(hash, info->push_constants, info->push_constant_count * sizeof *info->push_constants);
+
+	const VertexInputDescription* vertex = &info->vertex_description;
+	hash = hash_bytes(hash, &vertex->binding_description, sizeof vertex->binding_description);
+	hash = hash_bytes(hash, &vertex->attribute_count, sizeof vertex->attribute_count);
+	hash = hash_bytes(hash, vertex->attributes, vertex->attribute_count * sizeof *vertex->attributes);
+	return hash;
 }
 
-static int32_t comp_pipelineinfo(const void* pkey1, const void* pkey2)
+static uint32_t hash_pipelinekey(const void* pkey)
 {
-	struct PipelineInfo* info1 = (struct PipelineInfo*)pkey1;
-	struct PipelineInfo* info2 = (struct PipelineInfo*)pkey2;
+	const struct PipelineKey* key = pkey;
+	return (uint32_t)(key->hash ^ (key->hash >> 32));
+}
 
+static int32_t comp_pipelineinfo(const struct PipelineInfo* info1, const struct PipelineInfo* info2)
+{
 	// Check to see if the shaders are identical
 	if (strcmp_s(info1->vertexshader, info2->vertexshader))
 		return 1;
@@ -41,6 +89,8 @@ static int32_t comp_pipelineinfo(const void* pkey1, const void* pkey2)
 		return 1;
 	if (info1->push_constant_count != info2->push_constant_count)
 		return 1;
+	if (info1->descriptor_layout_count != info2->descriptor_layout_count)
+		return 1;
 
 	for (uint32_t i = 0; i < info1->push_constant_count; i++)
 	{
@@ -51,28 +101,62 @@ static int32_t comp_pipelineinfo(const void* pkey1, const void* pkey2)
 		if (info1->push_constants[i].stageFlags != info2->push_constants[i].stageFlags)
 			return 1;
 	}
+
+	for (uint32_t i = 0; i < info1->descriptor_layout_count; i++)
+	{
+		if (info1->descriptor_layouts[i] != info2->descriptor_layouts[i])
+			return 1;
+	}
+
+	const VertexInputDescription* vertex1 = &info1->vertex_description;
+	const VertexInputDescription* vertex2 = &info2->vertex_description;
+	if (vertex1->attribute_count != vertex2->attribute_count)
+		return 1;
+	if (memcmp(&vertex1->binding_description, &vertex2->binding_description, sizeof vertex1->binding_description))
+		return 1;
+	if (memcmp(vertex1->attributes, vertex2->attributes, vertex1->attribute_count * sizeof *vertex1->attributes))
+		return 1;
+
 	// Match
 	return 0;
 }
 
-static int pipeline_create(struct PipelineInfo* info, VkPipeline* pipeline, VkPipelineLayout* layout);
+static int32_t comp_pipelinekey(const void* pkey1, const void* pkey2)
+{
+	const struct PipelineKey* key1 = pkey1;
+	const struct PipelineKey* key2 = pkey2;
+	if (key1->hash != key2->hash)
+		return 1;
+	return comp_pipelineinfo(key1->info, key2->info);
+}
+
+static int pipeline_layout_create(struct PipelineInfo* info, VkPipelineLayout* layout);
+static int pipeline_create(struct PipelineInfo* info, VkPipelineLayout layout, VkPipeline* pipeline);
 
-struct Pipeline
+static void pipeline_compile_job(void* arg)
 {
-	VkPipeline pipeline;
-	VkPipelineLayout layout;
-	struct PipelineInfo info;
-};
+	Pipeline* pipeline = arg;
+	if (pipeline_create(&pipeline->info, pipeline->layout, &pipeline->pipeline) != 0)
+		pipeline->pipeline = VK_NULL_HANDLE;
+}
 
 Pipeline* pipeline_get(struct PipelineInfo* info)
 {
 	// Create the hashtable with the custom types
 	if (pipeline_table == NULL)
-		pipeline_table = hashtable_create(hash_pipelineinfo, comp_pipelineinfo);
+		pipeline_table = hashtable_create(hash_pipelinekey, comp_pipelinekey);
 
-	Pipeline* pipeline = hashtable_find(pipeline_table, info);
-	// Destroy duplicate info
+	if (info->descriptor_layout_count > PIPELINE_MAX_DESCRIPTOR_LAYOUTS)
+	{
+		LOG_E("Pipeline using shaders %s and %s has %d descriptor layouts, the maximum is %d", info->vertexshader, info->fragmentshader, info->descriptor_layout_count,
+			  PIPELINE_MAX_DESCRIPTOR_LAYOUTS);
+		free(info->push_constants);
+		return NULL;
+	}
 
+	struct PipelineKey key = {hash_pipelineinfo(info), info};
+	Pipeline* pipeline = hashtable_find(pipeline_table, &key);
+	// Destroy duplicate info
 	if (pipeline)
 	{
 		free(info->push_constants);
@@ -82,21 +166,37 @@ Pipeline* pipeline_get(struct PipelineInfo* info)
 	// Pipeline does not exist
 	pipeline = malloc(sizeof(Pipeline));
 	pipeline->info = *info;
-	int result = pipeline_create(info, &pipeline->pipeline, &pipeline->layout);
+	memcpy(pipeline->descriptor_layouts, info->descriptor_layouts, info->descriptor_layout_count * sizeof *info->descriptor_layouts);
+	pipeline->info.descriptor_layouts = pipeline->descriptor_layouts;
+	pipeline->key.hash = key.hash;
+	pipeline->key.info = &pipeline->info;
+	pipeline->pipeline = VK_NULL_HANDLE;
+	pipeline->compiling.value = 0;
+
+	// The layout is cheap and created immediately so it can be used while the pipeline compiles
+	int result = pipeline_layout_create(&pipeline->info, &pipeline->layout);
 	if (result != 0)
 	{
 		LOG_E("Pipeline creation using shaders %s, %s, and %s failed with code - %d", info->vertexshader, info->geometryshader, info->fragmentshader,
 			  result);
+		free(pipeline->info.push_constants);
+		free(pipeline);
 		return NULL;
 	}
 
+	// Compile on a worker, the first bind waits for it
+	job_submit(pipeline_compile_job, pipeline, &pipeline->compiling);
+
 	// Insert into table
-	hashtable_insert(pipeline_table, &pipeline->info, pipeline);
+	hashtable_insert(pipeline_table, &pipeline->key, pipeline);
 	return pipeline;
 }
+
 void pipeline_destroy(Pipeline* pipeline)
 {
-	hashtable_remove(pipeline_table, &pipeline->info);
+	job_wait(&pipeline->compiling);
+
+	hashtable_remove(pipeline_table, &pipeline->key);
 
 	// Last pipeline was removed
 	if (hashtable_get_count(pipeline_table) == 0)
@@ -126,6 +226,12 @@ void pipeline_destroy_all()
 
 void pipeline_bind(Pipeline* pipeline, VkCommandBuffer command_buffer)
 {
+	job_wait(&pipeline->compiling);
+
+	// Compilation failed and has been reported
+	if (pipeline->pipeline == VK_NULL_HANDLE)
+		return;
+
 	vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->pipeline);
 }
 
@@ -134,31 +240,181 @@ VkPipelineLayout pipeline_get_layout(Pipeline* pipeline)
 	return pipeline->layout;
 }
 
+void pipeline_wait(Pipeline* pipeline)
+{
+	job_wait(&pipeline->compiling);
+}
+
+void pipeline_wait_all()
+{
+	if (pipeline_table == NULL)
+		return;
+
+	hashtable_iterator* it = hashtable_iterator_begin(pipeline_table);
+	Pipeline* pipeline = NULL;
+	while ((pipeline = hashtable_iterator_next(it)))
+	{
+		job_wait(&pipeline->compiling);
+	}
+	hashtable_iterator_end(it);
+}
+
 void pipeline_recreate(Pipeline* pipeline)
 {
-	// Destroy old
-	vkDestroyPipeline(device, pipeline->pipeline, NULL);
-	vkDestroyPipelineLayout(device, pipeline->layout, NULL);
+	job_wait(&pipeline->compiling);
 
-	int result = pipeline_create(&pipeline->info, &pipeline->pipeline, &pipeline->layout);
+	// The layout does not depend on the swapchain or shaders and is kept
+	VkPipeline new_pipeline = VK_NULL_HANDLE;
+	int result = pipeline_create(&pipeline->info, pipeline->layout, &new_pipeline);
+	// Keep the old pipeline so a broken shader doesn't leave it unusable
 	if (result != 0)
 	{
 		LOG_E("Pipeline recreation using shaders %s, %s, and %s failed with code - %d", pipeline->info.vertexshader, pipeline->info.geometryshader,
 			  pipeline->info.fragmentshader, result);
 		return;
 	}
+
+	// Destroy old
+	vkDestroyPipeline(device, pipeline->pipeline, NULL);
+	pipeline->pipeline = new_pipeline;
+}
+
+static void pipeline_recreate_job(void* arg)
+{
+	pipeline_recreate(arg);
 }
 
 void pipeline_recreate_all()
 {
+	if (pipeline_table == NULL)
+		return;
+
 	LOG_S("Recreating all pipelines");
+
+	// Pipelines are independent and recreated in parallel
+	JobCounter counter = {0};
+	hashtable_iterator* it = hashtable_iterator_begin(pipeline_table);
+	Pipeline* pipeline = NULL;
+	while ((pipeline = hashtable_iterator_next(it)))
+	{
+		job_submit(pipeline_recreate_job, pipeline, &counter);
+	}
+	hashtable_iterator_end(it);
+	job_wait(&counter);
+}
+
+// Returns true if the saved cache data was created by the current driver and device
+// Header layout is VkPipelineCacheHeaderVersionOne
+static bool pipeline_cache_compatible(const uint8_t* data, size_t size)
+{
+	if (size < 16 + VK_UUID_SIZE)
+		return false;
+
+	uint32_t header[4];
+	memcpy(header, data, sizeof header);
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physical_device, &properties);
+
+	return header[0] >= 16 + VK_UUID_SIZE && header[1] == VK_PIPELINE_CACHE_HEADER_VERSION_ONE && header[2] == properties.vendorID && header[3] == properties.deviceID &&
+		   memcmp(data + 16, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+void pipeline_cache_init()
+{
+	if (pipeline_cache != VK_NULL_HANDLE)
+		return;
+
+	size_t size = read_fileb(PIPELINE_CACHE_PATH, NULL);
+	uint8_t* data = NULL;
+	if (size)
+	{
+		data = malloc(size);
+		read_fileb(PIPELINE_CACHE_PATH, (char*)data);
+		// A driver update or another GPU invalidates the cache
+		if (!pipeline_cache_compatible(data, size))
+		{
+			LOG_W("Discarding incompatible pipeline cache %s", PIPELINE_CACHE_PATH);
+			size = 0;
+		}
+	}
+
+	VkPipelineCacheCreateInfo create_info = {0};
+	create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	create_info.initialDataSize = size;
+	create_info.pInitialData = size ? data : NULL;
+
+	VkResult result = vkCreatePipelineCache(device, &create_info, NULL, &pipeline_cache);
+	free(data);
+	if (result != VK_SUCCESS)
+	{
+		LOG_E("Failed to create pipeline cache - code %d", result);
+		pipeline_cache = VK_NULL_HANDLE;
+		return;
+	}
+	LOG_S("Loaded pipeline cache of %d bytes", (int)size);
+}
+
+void pipeline_cache_terminate()
+{
+	if (pipeline_cache == VK_NULL_HANDLE)
+		return;
+
+	size_t size = 0;
+	vkGetPipelineCacheData(device, pipeline_cache, &size, NULL);
+	uint8_t* data = malloc(size);
+	if (size && vkGetPipelineCacheData(device, pipeline_cache, &size, data) == VK_SUCCESS)
+	{
+		char dir[256];
+		get_dir(PIPELINE_CACHE_PATH, dir, sizeof dir);
+		create_dirs(dir);
+		FILE* file = fopen(PIPELINE_CACHE_PATH, "wb");
+		if (file)
+		{
+			fwrite(data, 1, size, file);
+			fclose(file);
+			LOG_S("Saved pipeline cache of %d bytes", (int)size);
+		}
+		else
+		{
+			LOG_W("Failed to save pipeline cache to %s", PIPELINE_CACHE_PATH);
+		}
+	}
+	free(data);
+
+	vkDestroyPipelineCache(device, pipeline_cache, NULL);
+	pipeline_cache = VK_NULL_HANDLE;
+}
+
+uint32_t pipeline_reload_shader(const char* path)
+{
+	if (pipeline_table == NULL)
+		return 0;
+
+	uint32_t count = 0;
 	hashtable_iterator* it = hashtable_iterator_begin(pipeline_table);
 	Pipeline* pipeline = NULL;
 	while ((pipeline = hashtable_iterator_next(it)))
 	{
-		pipeline_recreate(pipeline);
+		if (pipeline_uses_shader(pipeline, path))
+		{
+			// The pipelines may be in use by frames in flight
+			if (count == 0)
+				vkDeviceWaitIdle(device);
+			LOG_S("Reloading pipeline using shader %s", path);
+			pipeline_recreate(pipeline);
+			count++;
+		}
 	}
 	hashtable_iterator_end(it);
+	return count;
+}
+
+bool pipeline_uses_shader(Pipeline* pipeline, const char* path)
+{
+	struct PipelineInfo* info = &pipeline->info;
+	return (info->vertexshader[0] && path_equal(info->vertexshader, path)) || (info->fragmentshader[0] && path_equal(info->fragmentshader, path)) ||
+		   (info->geometryshader[0] && path_equal(info->geometryshader, path));
 }
 
 // Vulkan implementation of pipeline creation
@@ -177,7 +433,27 @@ VkShaderModule create_shader_module(char* code, size_t size)
 	return shader_module;
 }
 
-static int pipeline_create(struct PipelineInfo* info, VkPipeline* pipeline, VkPipelineLayout* layout)
+static int pipeline_layout_create(struct PipelineInfo* info, VkPipelineLayout* layout)
+{
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {0};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = info->descriptor_layout_count;
+	pipelineLayoutInfo.pSetLayouts = info->descriptor_layouts;
+	pipelineLayoutInfo.pushConstantRangeCount = info->push_constant_count;
+	pipelineLayoutInfo.pPushConstantRanges = info->push_constants;
+
+	VkResult result = vkCreatePipelineLayout(device, &pipelineLayoutInfo, NULL, layout);
+	if (result != VK_SUCCESS)
+	{
+		LOG_E("Failed to create pipeline layout - code %d", result);
+		return -3;
+	}
+	return 0;
+}
+
+// Compiles the pipeline using an existing layout
+// Thread safe, as the pipeline cache is internally synchronized
+static int pipeline_create(struct PipelineInfo* info, VkPipelineLayout layout, VkPipeline* pipeline)
 {
 	// Read vertex shader from SPIR-V
 	size_t vert_code_size = read_fileb(info->vertexshader, NULL);
@@ -191,9 +467,10 @@ static int pipeline_create(struct PipelineInfo* info, VkPipeline* pipeline, VkPi
 
 	// Read fragment shader from SPIR-V
 	size_t frag_code_size = read_fileb(info->fragmentshader, NULL);
-	if (vert_code_size == 0)
+	if (frag_code_size == 0)
 	{
-		LOG_E("Failed to read vertex shader %s from binary file", info->fragmentshader);
+		free(vert_shader_code);
+		LOG_E("Failed to read fragment shader %s from binary file", info->fragmentshader);
 		return -2;
 	}
 	char* frag_shader_code = malloc(frag_code_size);
@@ -341,20 +618,6 @@ static int pipeline_create(struct PipelineInfo* info, VkPipeline* pipeline, VkPi
 	dynamicState.dynamicStateCount = 2;
 	dynamicState.pDynamicStates = dynamicStates;*/
 
-	// Pipeline layout
-	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {0};
-	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-	pipelineLayoutInfo.setLayoutCount = info->descriptor_layout_count;
-	pipelineLayoutInfo.pSetLayouts = info->descriptor_layouts;
-	pipelineLayoutInfo.pushConstantRangeCount = info->push_constant_count;
-	pipelineLayoutInfo.pPushConstantRanges = info->push_constants;
-
-	VkResult result = vkCreatePipelineLayout(device, &pipelineLayoutInfo, NULL, layout);
-	if (result != VK_SUCCESS)
-	{
-		LOG_E("Failed to create pipeline layout - code %d", result);
-		return -3;
-	}
 	VkGraphicsPipelineCreateInfo pipelineInfo = {0};
 	pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
 	pipelineInfo.flags = 0;
@@ -371,7 +634,7 @@ static int pipeline_create(struct PipelineInfo* info, VkPipeline* pipeline, VkPi
 	pipelineInfo.pDynamicState = NULL; // Optional
 
 	// Reference pipeline layout
-	pipelineInfo.layout = *layout;
+	pipelineInfo.layout = layout;
 
 	// Render passes
 	pipelineInfo.renderPass = renderPass;
@@ -382,12 +645,8 @@ static int pipeline_create(struct PipelineInfo* info, VkPipeline* pipeline, VkPi
 	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; // Optional
 	pipelineInfo.basePipelineIndex = -1;			  // Optional
 
-	result = vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, NULL, pipeline);
-	if (result != VK_SUCCESS)
-	{
-		LOG_E("Failed to create graphics - code %d", result);
-		return -4;
-	}
+	VkResult result = vkCreateGraphicsPipelines(device, pipeline_cache, 1, &pipelineInfo, NULL, pipeline);
+
 	// Free the temporary resources
 	free(vert_shader_code);
 	free(frag_shader_code);
@@ -395,5 +654,11 @@ static int pipeline_create(struct PipelineInfo* info, VkPipeline* pipeline, VkPi
 	// Modules are not needed after the creaton
 	vkDestroyShaderModule(device, vert_shader_module, NULL);
 	vkDestroyShaderModule(device, frag_shader_module, NULL);
+
+	if (result != VK_SUCCESS)
+	{
+		LOG_E("Failed to create graphics - code %d", result);
+		return -4;
+	}
 	return 0;
 }
@@ -12,6 +12,12 @@
 #include "utils.h"
 #include "magpie.h"
 #include "defines.h"
+#include "graphics/assets.h"
+#include "bindless.h"
+#include "indirect.h"
+#include "geometry.h"
+#include "occlusion.h"
+#include "settings.h"
 
 #define ONE_FRAME_LIMIT 512
 
@@ -34,6 +40,16 @@ static int oneframe_draw_index = 0;
 // The last framebuffer and renderer to the window
 static Framebuffer framebuffers[3] = {0};
 
+// The geometry version the render tree was recorded with
+static uint32_t recorded_geometry_version = 0;
+
+static bool renderer_mark_all(Entity* entity, void* arg)
+{
+	(void)entity;
+	(void)arg;
+	return true;
+}
+
 // Rebuilds command buffers for the current frame
 // Needs to be called after renderer_begin
 static void renderer_rebuild(Scene* scene)
@@ -56,7 +72,12 @@ static void renderer_rebuild(Scene* scene)
 	// Iterate all entities
 	RenderTreeNode* rendertree = scene_get_rendertree(scene);
 	Camera* camera = scene_get_camera(scene, 0);
+	indirect_begin(image_index);
+	occlusion_begin(camera);
 	rendertree_render(rendertree, commandbuffer, camera, image_index);
+	occlusion_end();
+	if (indirect_enabled())
+		indirect_render(commandbuffer, camera, image_index);
 
 	// One frame draws
 	commandbuffer_end(oneframe_commands[image_index]);
@@ -90,7 +111,7 @@ int renderer_init()
 	// Load primitive models
 	model_load_collada("./assets/models/primitive.dae");
 
-	oneframe_buffer = ub_create(sizeof(struct EntityData) * ONE_FRAME_LIMIT, 0);
+	oneframe_buffer = sb_create(sizeof(struct EntityData) * ONE_FRAME_LIMIT, 0);
 
 	oneframe_descriptors = descriptorpack_create(rendertree_get_descriptor_layout(), rendertree_get_descriptor_bindings(), rendertree_get_descriptor_binding_count());
 
@@ -98,12 +119,18 @@ int renderer_init()
 
 	renderer_create_framebuffers();
 
+	rendertree_set_limit(settings_get_rendertree_limit());
+
 	// Create command buffers
 	for (int i = 0; i < 3; i++)
 	{
 		primarycommands[i] = commandbuffer_create_primary(0);
 		oneframe_commands[i] = commandbuffer_create_secondary(0, primarycommands[i], renderPass, framebuffers[i]);
 	}
+
+	// Entities are drawn by the render tree alone if GPU culling fails
+	if (indirect_init() != 0)
+		LOG_W("Failed to initialize GPU culling");
 	return 0;
 }
 
@@ -160,9 +187,13 @@ void renderer_submit(Scene* scene)
 	submit_info.pWaitDstStageMask = wait_stages;
 
 	// Specify which command buffers to submit for execution
-	submit_info.commandBufferCount = 1;
-	VkCommandBuffer vkcommandbuffer = commandbuffer_vk(primarycommands[image_index]);
-	submit_info.pCommandBuffers = &vkcommandbuffer;
+	// GPU culling runs before the draws reading its results
+	VkCommandBuffer vkcommandbuffers[2];
+	submit_info.commandBufferCount = 0;
+	if (indirect_enabled())
+		vkcommandbuffers[submit_info.commandBufferCount++] = indirect_get_cull_commands(image_index);
+	vkcommandbuffers[submit_info.commandBufferCount++] = commandbuffer_vk(primarycommands[image_index]);
+	submit_info.pCommandBuffers = vkcommandbuffers;
 
 	// Specify which semaphores to signal on completion
 	VkSemaphore signal_semaphores[] = {semaphores_render_finished[current_frame]};
@@ -236,14 +267,33 @@ void renderer_begin()
 		resize_event = 0;
 	}
 
+	// Upload assets that finished loading in the background
+	assets_update();
+
+	// Recorded command buffers bind the geometry buffers, which are recreated when they grow
+	if (recorded_geometry_version != geometry_get_version() && scene_get_current())
+	{
+		recorded_geometry_version = geometry_get_version();
+		rendertree_mark_changed(scene_get_rendertree(scene_get_current()), renderer_mark_all, NULL);
+	}
+
 	VkFence fence = commandbuffer_fence(primarycommands[current_frame]);
 
 	vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX);
 
+	// Reuse descriptor sets no longer referenced by frames in flight
+	descriptorpool_update();
+
 	vkAcquireNextImageKHR(device, swapchain, UINT64_MAX, semaphores_image_available[current_frame], VK_NULL_HANDLE, &image_index);
 
+	// Point the descriptors of this frame at textures whose resident levels changed
+	Material changed[ASSETS_MAX_DEPENDENTS];
+	assets_mark_materials(changed, material_update_descriptors(image_index, changed, ASSETS_MAX_DEPENDENTS));
+	bindless_update(image_index);
+
 	// Begin one frame draws
 	commandbuffer_begin(oneframe_commands[image_index]);
+	geometry_bind(oneframe_commands[image_index]);
 	material_bind(material_get_default(), oneframe_commands[image_index], oneframe_descriptors->sets[image_index]);
 	oneframe_draw_index = 0;
 }
@@ -274,9 +324,9 @@ void renderer_draw_custom(Mesh* mesh, vec3 position, quaternion rotation, vec3 s
 	struct EntityData data = {0};
 	data.model_matrix = transform.model_matrix;
 	data.color = color;
+	data.material_index = material_get_bindless_index(material_get_default());
 
 	// Binding is done by renderer
-	mesh_bind(mesh, oneframe_commands[image_index]);
 	ub_update(oneframe_buffer, &data, sizeof(struct EntityData) * oneframe_draw_index, sizeof(struct EntityData), image_index);
 	// Set push constant for model matrix
 	material_push_constants(material_get_default(), oneframe_commands[image_index], 0, &oneframe_draw_index);
@@ -305,6 +355,8 @@ void renderer_terminate()
 	// Free all remaining command buffers in destroy queue
 	commandbuffer_handle_destructions();
 	ub_destroy(oneframe_buffer);
+	indirect_destroy();
+	occlusion_destroy();
 	for (uint32_t i = 0; i < 3; i++)
 	{
 		commandbuffer_destroy(oneframe_commands[i]);
@@ -4,7 +4,14 @@
 #include "log.h"
 #include "graphics/vulkan_members.h"
 #include "graphics/renderer.h"
+#include "graphics/texture.h"
+#include "indirect.h"
+#include "geometry.h"
+#include "occlusion.h"
+#include "jobs.h"
 #include <string.h>
+#include <math.h>
+#include <float.h>
 #include <assert.h>
 #include "stdio.h"
 
@@ -12,11 +19,47 @@
 
 static uint32_t node_count = 0;
 static mempool_t node_pool = MEMPOOL_INIT(sizeof(RenderTreeNode), 1024);
+
+// The deepest level nodes are subdivided to, nodes there grow past the limit instead
+#define RENDERTREE_MAX_DEPTH 10
+// The number of bits of each axis in the Morton codes of the bulk build, one for each level
+#define RENDERTREE_MORTON_BITS RENDERTREE_MAX_DEPTH
+// The number of entities a node first makes room for
+#define RENDERTREE_MIN_CAPACITY 16
+// The number of blocks the radix sort of the bulk build is split into
+#define RENDERTREE_SORT_BLOCKS 64
+
+// Leaves split when they hold more than this many entities, subtrees merge when they hold fewer than half of it
+// The gap keeps nodes close to the limit from splitting and merging back and forth
+static uint32_t node_limit = RENDER_TREE_LIM;
+// The number of updates in a row a subtree needs to stay below half the limit before it merges
+#define RENDERTREE_MERGE_DELAY 30
+
+// Shader resources given up by a node, kept for reuse by other nodes
+typedef struct RenderTreeResources
+{
+	Commandbuffer commandbuffers[3];
+	UniformBuffer* entity_data;
+	DescriptorPack* entity_data_descriptors;
+	uint32_t entity_data_capacity;
+	uint8_t thread_idx;
+	// The update the resources were released at
+	uint32_t released;
+} RenderTreeResources;
+
+// The most resources kept, the rest are destroyed when released
+#define RENDERTREE_FREE_MAX 256
+// Released resources may still be used by frames in flight and are not reused for this many updates
+#define RENDERTREE_RECYCLE_DELAY 3
+static RenderTreeResources free_resources[RENDERTREE_FREE_MAX];
+static uint32_t free_count = 0;
+// The number of times the tree has been updated from a root
+static uint32_t update_count = 0;
 static VkDescriptorSetLayout entity_data_layout = VK_NULL_HANDLE;
 static VkDescriptorSetLayoutBinding entity_data_binding = (VkDescriptorSetLayoutBinding){
 	.binding = 0,
 	.descriptorCount = 1,
-	.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+	.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
 	.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
 	.pImmutableSamplers = 0};
 
@@ -41,8 +84,36 @@ VkDescriptorSetLayout rendertree_get_descriptor_layout(void)
 	return entity_data_layout;
 }
 
+void rendertree_set_limit(uint32_t limit)
+{
+	node_limit = limit > 1 ? limit : 1;
+}
+
+uint32_t rendertree_get_limit(void)
+{
+	return node_limit;
+}
+
+// Creates the shader resources of a node for the entities it has room for
 static void rendertree_create_shader_data(RenderTreeNode* node)
 {
+	// Reuse the resources of a node released long enough ago on the same thread
+	for (uint32_t i = free_count; i-- > 0;)
+	{
+		RenderTreeResources* resources = &free_resources[i];
+		if (resources->thread_idx != node->thread_idx || resources->entity_data_capacity < node->entity_capacity ||
+			update_count - resources->released < RENDERTREE_RECYCLE_DELAY)
+			continue;
+
+		for (uint8_t j = 0; j < 3; j++)
+			node->commandbuffers[j] = resources->commandbuffers[j];
+		node->entity_data = resources->entity_data;
+		node->entity_data_descriptors = resources->entity_data_descriptors;
+		node->entity_data_capacity = resources->entity_data_capacity;
+		*resources = free_resources[--free_count];
+		return;
+	}
+
 	// Create secondary command buffers
 	for (uint8_t i = 0; i < 3; i++)
 	{
@@ -50,14 +121,94 @@ static void rendertree_create_shader_data(RenderTreeNode* node)
 		node->commandbuffers[i] = commandbuffer_create_secondary(node->thread_idx, INVALID(Commandbuffer), renderPass, node->framebuffers[i]);
 	}
 
-	// Create uniform buffers for entity data
-	node->entity_data = ub_create(LENOF(node->entities) * sizeof(struct EntityData), node->thread_idx);
+	// Create storage buffers for entity data, nodes at the deepest level can hold more than a uniform buffer range
+	node->entity_data = sb_create(node->entity_capacity * sizeof(struct EntityData), node->thread_idx);
+	node->entity_data_capacity = node->entity_capacity;
 
 	// Create and write set=2 for entity data
 	node->entity_data_descriptors = descriptorpack_create(rendertree_get_descriptor_layout(), &entity_data_binding, 1);
 	descriptorpack_write(node->entity_data_descriptors, &entity_data_binding, 1, &node->entity_data, NULL, NULL);
 }
 
+static void rendertree_destroy_resources(Commandbuffer* commandbuffers, UniformBuffer* entity_data, DescriptorPack* entity_data_descriptors)
+{
+	for (uint32_t i = 0; i < 3; i++)
+	{
+		commandbuffer_destroy(commandbuffers[i]);
+	}
+	ub_destroy(entity_data);
+	descriptorpack_destroy(entity_data_descriptors);
+}
+
+// Gives the shader resources of a node to the free list
+// They are created again on render if the node gets entities
+static void rendertree_release_shader_data(RenderTreeNode* node)
+{
+	if (node->entity_data == NULL)
+		return;
+
+	if (free_count < RENDERTREE_FREE_MAX)
+	{
+		RenderTreeResources* resources = &free_resources[free_count++];
+		for (uint8_t i = 0; i < 3; i++)
+			resources->commandbuffers[i] = node->commandbuffers[i];
+		resources->entity_data = node->entity_data;
+		resources->entity_data_descriptors = node->entity_data_descriptors;
+		resources->entity_data_capacity = node->entity_data_capacity;
+		resources->thread_idx = node->thread_idx;
+		resources->released = update_count;
+	}
+	else
+	{
+		rendertree_destroy_resources(node->commandbuffers, node->entity_data, node->entity_data_descriptors);
+	}
+
+	for (uint8_t i = 0; i < 3; i++)
+		node->commandbuffers[i] = INVALID(Commandbuffer);
+	node->entity_data = NULL;
+	node->entity_data_descriptors = NULL;
+	node->entity_data_capacity = 0;
+}
+
+// Makes room for count entities in node
+static void rendertree_reserve(RenderTreeNode* node, uint32_t count)
+{
+	if (count <= node->entity_capacity)
+		return;
+
+	uint32_t capacity = node->entity_capacity ? node->entity_capacity : RENDERTREE_MIN_CAPACITY;
+	while (capacity < count)
+		capacity *= 2;
+	node->entities = realloc(node->entities, capacity * sizeof *node->entities);
+	node->entity_capacity = capacity;
+}
+
+// Frees the room of entities no longer needed, all of it for empty nodes
+static void rendertree_shrink(RenderTreeNode* node)
+{
+	if (node->entity_count == 0)
+	{
+		free(node->entities);
+		node->entities = NULL;
+		node->entity_capacity = 0;
+	}
+	// Halves only when a quarter full so nodes changing by a few entities don't reallocate each update
+	else if (node->entity_capacity > RENDERTREE_MIN_CAPACITY && node->entity_count <= node->entity_capacity / 4)
+	{
+		node->entity_capacity /= 2;
+		node->entities = realloc(node->entities, node->entity_capacity * sizeof *node->entities);
+	}
+}
+
+// Adds an entity to the entities of node
+static void rendertree_insert(RenderTreeNode* node, Entity* entity)
+{
+	rendertree_reserve(node, node->entity_count + 1);
+	node->entities[node->entity_count++] = entity;
+	entity_set_rendertree_node(entity, node);
+	node->changed = ALL_CHANGED;
+}
+
 RenderTreeNode* rendertree_create(float halfwidth, vec3 center, uint32_t thread_idx, Framebuffer* framebuffers)
 {
 	RenderTreeNode* node = mempool_alloc(&node_pool);
@@ -67,7 +218,7 @@ RenderTreeNode* rendertree_create(float halfwidth, vec3 center, uint32_t thread_
 	node->center = center;
 	node->halfwidth = halfwidth;
 	node->changed = ALL_CHANGED;
-	node->depth = 0;
+	node->merge_delay = 0;
 	node->thread_idx = thread_idx;
 	node->id = node_count++;
 	for (uint32_t i = 0; i < swapchain_image_count; i++)
@@ -77,6 +228,8 @@ RenderTreeNode* rendertree_create(float halfwidth, vec3 center, uint32_t thread_
 		node->children[i] = NULL;
 
 	node->entity_count = 0;
+	node->entity_capacity = 0;
+	node->entities = NULL;
 	// Create command buffers for eac swapchain image
 	for (uint8_t i = 0; i < 3; i++)
 	{
@@ -86,6 +239,7 @@ RenderTreeNode* rendertree_create(float halfwidth, vec3 center, uint32_t thread_
 
 	node->entity_data = NULL;
 	node->entity_data_descriptors = NULL;
+	node->entity_data_capacity = 0;
 
 	return node;
 }
@@ -157,26 +311,31 @@ void rendertree_merge(RenderTreeNode* node)
 {
 	if (node->children[0] == NULL)
 		return;
+
+	// As the first child gets set to NULL, it signifies that there are no children
+	RenderTreeNode* children[8];
 	for (uint32_t i = 0; i < 8; i++)
 	{
-		// As the first child gets set to NULL, it signifies that there are no children
-		RenderTreeNode* child = node->children[i];
-		// Merge children recursively if not leaf
-		if (child->children[i])
-		{
-			LOG_E("Cannot merge node with non-leaf children");
-			//rendertree_merge(child);
-		}
-
-		// 'remove' child
+		children[i] = node->children[i];
 		node->children[i] = NULL;
-		// Replace all children entities in this node or higher
+		// Merge deeper levels into the child first
+		rendertree_merge(children[i]);
+	}
+
+	for (uint32_t i = 0; i < 8; i++)
+	{
+		RenderTreeNode* child = children[i];
+		// Move all children entities into this node
 		for (uint32_t j = 0; j < child->entity_count; j++)
 		{
 			Entity* entity = child->entities[j];
-			// Place all entities in the parent
-			rendertree_place_up(node, entity);
+			if (node->children[0] == NULL && node->entity_count < node_limit)
+				rendertree_insert(node, entity);
+			// More entities than the limit, it subdivides again
+			else
+				rendertree_place_down(node, entity);
 		}
+		child->entity_count = 0;
 		rendertree_destroy(child);
 	}
 	node->changed = ALL_CHANGED;
@@ -197,10 +356,13 @@ static void rendertree_check(RenderTreeNode* node)
 			memmove(node->entities + i, node->entities + i + 1, (node->entity_count - i - 1) * sizeof *node->entities);
 			node->entities[node->entity_count - 1] = NULL;
 			node->entity_count--;
+			entity_set_rendertree_node(entity, NULL);
 
 			// Re-place up
 			rendertree_place_up(node, entity);
 			node->changed = ALL_CHANGED;
+			// The next entity moved into this slot
+			i--;
 		}
 		// Entity still fits, check if it fits in any child j (if subdivided)
 		else
@@ -213,10 +375,12 @@ static void rendertree_check(RenderTreeNode* node)
 					memmove(node->entities + i, node->entities + i + 1, (node->entity_count - i - 1) * sizeof *node->entities);
 					node->entities[node->entity_count - 1] = NULL;
 					node->entity_count--;
+					entity_set_rendertree_node(entity, NULL);
 
 					// Re-place down into child
 					rendertree_place_down(node->children[j], entity);
 					node->changed = ALL_CHANGED;
+					i--;
 
 					break;
 				}
@@ -225,52 +389,195 @@ static void rendertree_check(RenderTreeNode* node)
 	}
 }
 
+// Updates node and its children and returns the number of entities below node
+static uint32_t rendertree_update_node(RenderTreeNode* node)
+{
+	// Update entities if not empty
+	if (node->entity_count != 0)
+	{
+		//LOG("Updating %d entities", node->entity_count);
+
+		// Check and replace necessary entities
+		rendertree_check(node);
+	}
+
+	// Recursively update children
+	uint32_t entity_count = 0;
+	for (uint32_t i = 0; node->children[0] && i < 8; i++)
+	{
+		entity_count += rendertree_update_node(node->children[i]);
+	}
+	entity_count += node->entity_count;
+
+	// Check if it needs to merge
+	// Merges only after staying small for a while so nodes changing often keep their children
+	if (node->children[0] == NULL || entity_count >= node_limit / 2)
+		node->merge_delay = 0;
+	else if (++node->merge_delay >= RENDERTREE_MERGE_DELAY)
+	{
+		LOG("Merging node with %d entities in children", entity_count);
+		rendertree_merge(node);
+		node->merge_delay = 0;
+	}
+
+	// Empty nodes don't render and give their resources to nodes that do
+	if (node->entity_count == 0)
+		rendertree_release_shader_data(node);
+	rendertree_shrink(node);
+
+	return entity_count;
+}
+
 void rendertree_update(RenderTreeNode* node, uint32_t frame)
 {
-	// Check if need merge
-	if (node->children[0] && node->children[0]->children[0] == NULL)
+	(void)frame;
+	// Counts the updates for recycling resources once per tree
+	if (node->parent == NULL)
+		update_count++;
+	rendertree_update_node(node);
+}
+
+// Gets the bounding sphere of an entity in world space
+static void rendertree_get_bounds(Entity* entity, vec3* center, float* radius)
+{
+	const SphereCollider* sphere = entity_get_boundingsphere(entity);
+	*center = sphere->base.transform->position;
+	*radius = sphere->radius * vec3_largest(sphere->base.transform->scale);
+}
+
+// Returns the diameter in pixels of the bounding sphere of an entity on screen
+// scale converts radius over distance into the diameter, see rendertree_screen_scale
+static float rendertree_projected_size(Entity* entity, vec3 eye, float scale)
+{
+	vec3 center;
+	float radius;
+	rendertree_get_bounds(entity, &center, &radius);
+	float distance = sqrtf(vec3_sqrdistance(center, eye)) - radius;
+	if (distance < 0.1f)
+		distance = 0.1f;
+	return radius * scale / distance;
+}
+
+static float rendertree_screen_scale(Camera* camera)
+{
+	return camera_get_projection_matrix(camera).raw[1][1] * swapchain_extent.height;
+}
+
+// Requests the texture levels of the entities in the node by their size on screen
+static void rendertree_request_textures(RenderTreeNode* node, Camera* camera)
+{
+	vec3 eye = camera_get_transform(camera)->position;
+	float scale = rendertree_screen_scale(camera);
+
+	for (uint32_t i = 0; i < node->entity_count; i++)
+		material_request_textures(entity_get_material(node->entities[i]), rendertree_projected_size(node->entities[i], eye, scale));
+}
+
+// Tests the entities of a visible node against the occluders
+// Visible entities drawn indirectly are marked for this frame, and large ones are offered as occluders for the next frame
+// Entities drawn by the node's secondary command buffer are culled with the node only, to not re-record it as they move in and out of view
+static void rendertree_cull_entities(RenderTreeNode* node, Camera* camera)
+{
+	vec3 eye = camera ? camera_get_transform(camera)->position : (vec3){0, 0, 0};
+	float scale = camera ? rendertree_screen_scale(camera) : 0.0f;
+
+	for (uint32_t i = 0; i < node->entity_count; i++)
 	{
-		// Check if it needs to merge
-		uint32_t entity_count = node->entity_count;
-		bool is_leaf = true;
-		for (uint32_t i = 0; node->children[0] && i < 8; i++)
-		{
-			if (node->children[i]->children[0])
-			{
-				is_leaf = false;
-				break;
-			}
-			entity_count += node->children[i]->entity_count;
-		}
+		Entity* entity = node->entities[i];
+		bool indirect = indirect_accepts(entity_get_material(entity));
+		float size = camera ? rendertree_projected_size(entity, eye, scale) : 0.0f;
+		if (!indirect && size < OCCLUSION_MIN_OCCLUDER_SIZE)
+			continue;
 
-		if (is_leaf && entity_count < RENDER_TREE_LIM * 0.8)
-		{
-			LOG("Merging node with %d entities in children", entity_count);
-			rendertree_merge(node);
-			return;
-		}
+		vec3 center;
+		float radius;
+		rendertree_get_bounds(entity, &center, &radius);
+		if (!occlusion_test_sphere(center, radius))
+			continue;
+
+		if (indirect)
+			indirect_add(entity);
+		occlusion_add_occluder(entity_get_mesh(entity), entity_get_transform(entity), size);
 	}
+}
 
-	// Update entities if not empty
-	if (node->entity_count != 0)
+// Selects the mesh level of detail of the entities in the node by their size on screen
+// Returns true if any level changed
+static bool rendertree_select_lods(RenderTreeNode* node, Camera* camera)
+{
+	vec3 eye = camera_get_transform(camera)->position;
+	float scale = rendertree_screen_scale(camera);
+
+	bool changed = false;
+	for (uint32_t i = 0; i < node->entity_count; i++)
 	{
-		//LOG("Updating %d entities", node->entity_count);
+		Entity* entity = node->entities[i];
+		Mesh* mesh = entity_get_mesh(entity);
+		if (mesh == NULL || mesh_get_lod_count(mesh) < 2)
+			continue;
 
-		// Map entity info
-		if (node->entity_count > RENDER_TREE_LIM)
+		uint32_t current = entity_get_lod(entity);
+		uint32_t lod = mesh_select_lod(mesh, rendertree_projected_size(entity, eye, scale), current);
+		if (lod != current)
 		{
-			LOG_E("Entities in tree node exceeds capacity of %d", RENDER_TREE_LIM);
+			entity_set_lod(entity, lod);
+			changed = true;
 		}
+	}
+	return changed;
+}
 
-		// Check and replace necessary entities
-		rendertree_check(node);
+// Returns true if entity a should be drawn before entity b
+// Entities are grouped by pipeline, mesh, and level of detail
+static bool rendertree_draw_before(Entity* a, Entity* b)
+{
+	uintptr_t key_a = material_get_sort_key(entity_get_material(a));
+	uintptr_t key_b = material_get_sort_key(entity_get_material(b));
+	if (key_a != key_b)
+		return key_a < key_b;
+	if (entity_get_mesh(a) != entity_get_mesh(b))
+		return (uintptr_t)entity_get_mesh(a) < (uintptr_t)entity_get_mesh(b);
+	return entity_get_lod(a) < entity_get_lod(b);
+}
+
+// Sorts the entities of the node in draw order so that batches are consecutive in the entity data
+// Insertion sort is stable and fast on the mostly sorted order of a previous frame
+// Returns true if the order changed
+static bool rendertree_sort_entities(RenderTreeNode* node)
+{
+	bool changed = false;
+	for (uint32_t i = 1; i < node->entity_count; i++)
+	{
+		Entity* entity = node->entities[i];
+		uint32_t j = i;
+		while (j > 0 && rendertree_draw_before(entity, node->entities[j - 1]))
+		{
+			node->entities[j] = node->entities[j - 1];
+			j--;
+		}
+		if (j != i)
+		{
+			node->entities[j] = entity;
+			changed = true;
+		}
 	}
+	return changed;
+}
 
-	// Recursively update children
-	for (uint32_t i = 0; node->children[0] && i < 8; i++)
+// Returns the number of entities from start that can be drawn with a single instanced draw
+static uint32_t rendertree_batch_count(RenderTreeNode* node, uint32_t start)
+{
+	Entity* first = node->entities[start];
+	uint32_t count = 1;
+	while (start + count < node->entity_count)
 	{
-		rendertree_update(node->children[i], frame);
+		Entity* entity = node->entities[start + count];
+		if (entity_get_mesh(entity) != entity_get_mesh(first) || entity_get_lod(entity) != entity_get_lod(first) ||
+			!material_can_batch(entity_get_material(entity), entity_get_material(first)))
+			break;
+		count++;
 	}
+	return count;
 }
 
 void rendertree_render(RenderTreeNode* node, Commandbuffer primary, Camera* camera, uint32_t frame)
@@ -278,14 +585,26 @@ void rendertree_render(RenderTreeNode* node, Commandbuffer primary, Camera* came
 	// Render entities if not empty
 	if (node->entity_count != 0)
 	{
-		// Create shader resources if not yet created (rendertree node was previously empty)
-		if (node->entity_data == NULL)
+		// Create shader resources if not yet created (rendertree node was previously empty) or too small for the entities
+		if (node->entity_data_capacity < node->entity_count)
 		{
+			rendertree_release_shader_data(node);
 			rendertree_create_shader_data(node);
 			node->changed = ALL_CHANGED;
 		}
 
+		// Draws of entities whose level of detail changed need to be re-recorded
+		if (camera && rendertree_select_lods(node, camera))
+			node->changed = ALL_CHANGED;
+
+		// Entities are reordered before recording, all frames use the new indices
+		if (node->changed && rendertree_sort_entities(node))
+			node->changed = ALL_CHANGED;
+
 		// Update entity shader data
+		// The bounds of the node are the bounds of its entities after they moved
+		vec3 bounds_min = {FLT_MAX, FLT_MAX, FLT_MAX};
+		vec3 bounds_max = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
 		void* p_entity_data = ub_map(node->entity_data, 0, node->entity_count * sizeof(struct EntityData), frame);
 		for (uint32_t i = 0; i < node->entity_count; i++)
 		{
@@ -294,25 +613,44 @@ void rendertree_render(RenderTreeNode* node, Commandbuffer primary, Camera* came
 			// Update entity normally
 			entity_update(entity);
 			entity_update_shaderdata(entity, p_entity_data, i);
+
+			vec3 center;
+			float radius;
+			rendertree_get_bounds(entity, &center, &radius);
+			bounds_min = (vec3){fminf(bounds_min.x, center.x - radius), fminf(bounds_min.y, center.y - radius), fminf(bounds_min.z, center.z - radius)};
+			bounds_max = (vec3){fmaxf(bounds_max.x, center.x + radius), fmaxf(bounds_max.y, center.y + radius), fmaxf(bounds_max.z, center.z + radius)};
 		}
 		ub_unmap(node->entity_data, frame);
 
+		// Entities are still updated when the node is occluded, only drawing is skipped
+		bool visible = occlusion_test_box(bounds_min, bounds_max);
+		if (visible)
+			rendertree_cull_entities(node, camera);
+
+		if (visible && camera && texture_stream_enabled())
+			rendertree_request_textures(node, camera);
+
 		// Assign fence from primary for proper destruction
 		commandbuffer_set_info(node->commandbuffers[frame], primary, renderPass, node->framebuffers[frame]);
 
 		// Needs to rerecord secondary
-		if (node->changed & (1 << frame))
+		// Occluded nodes keep their changed bits and are recorded when visible again
+		if (visible && node->changed & (1 << frame))
 		{
 			//LOG("Recording %d entities", node->entity_count);
 			//LOG("Re-recording node at depth %d", node->depth);
 			// Begin recording
 			commandbuffer_begin(node->commandbuffers[frame]);
+			geometry_bind(node->commandbuffers[frame]);
 			//LOG("Rendering tree with depth %d", node->depth);
-			// Map entity info
-			for (uint32_t i = 0; i < node->entity_count; i++)
+			// Entities with bindless materials sharing a pipeline and mesh are drawn instanced
+			// Batches culled on the GPU are drawn by indirect_render
+			for (uint32_t i = 0; i < node->entity_count;)
 			{
-				Entity* entity = node->entities[i];
-				entity_render(entity, node->commandbuffers[frame], i, node->entity_data_descriptors->sets[frame]);
+				uint32_t count = rendertree_batch_count(node, i);
+				if (!indirect_accepts(entity_get_material(node->entities[i])))
+					entity_render_instanced(node->entities[i], node->commandbuffers[frame], i, count, node->entity_data_descriptors->sets[frame]);
+				i += count;
 			}
 
 			// End recording
@@ -320,12 +658,15 @@ void rendertree_render(RenderTreeNode* node, Commandbuffer primary, Camera* came
 			//renderer_draw_cube(node->center, quat_identity, (vec3){1.0f / node->depth, 1.0f / node->depth, 1.0f / node->depth}, vec4_hsv(node->depth, 1, 1));
 		}
 		//renderer_draw_cube_wire(node->center, quat_identity, (vec3){node->halfwidth, node->halfwidth, node->halfwidth}, vec4_hsv(node->depth, 1, 1));
-		// Record into primary
-		VkCommandBuffer commands_tmp = commandbuffer_vk(node->commandbuffers[frame]);
-		vkCmdExecuteCommands(commandbuffer_vk(primary), 1, &commands_tmp);
+		if (visible)
+		{
+			// Record into primary
+			VkCommandBuffer commands_tmp = commandbuffer_vk(node->commandbuffers[frame]);
+			vkCmdExecuteCommands(commandbuffer_vk(primary), 1, &commands_tmp);
 
-		// Remove changed bit for this frame
-		node->changed = node->changed & ~(1 << frame);
+			// Remove changed bit for this frame
+			node->changed = node->changed & ~(1 << frame);
+		}
 	}
 
 	// For debug mode, show tree
@@ -336,74 +677,38 @@ void rendertree_render(RenderTreeNode* node, Commandbuffer primary, Camera* came
 	}
 }
 
-bool rendertree_fits(RenderTreeNode* node, Entity* entity)
+uint32_t rendertree_mark_changed(RenderTreeNode* node, bool (*func)(Entity* entity, void* arg), void* arg)
 {
-	SphereCollider* e_bound = (SphereCollider*)entity_get_boundingsphere(entity);
-	/*// Left bound (-x)
-	if (e_bound->base.transform->position.x < node->center.x - node->halfwidth)
-	{
-		return false;
-	}
-	// Right bound (+x)
-	if (e_bound->base.transform->position.x > node->center.x + node->halfwidth)
-	{
-		return false;
-	}
-	// Bottom bound (-y)
-	if (e_bound->base.transform->position.y < node->center.y - node->halfwidth)
-	{
-		return false;
-	}
-	// Top bound (+y)
-	if (e_bound->base.transform->position.y > node->center.y + node->halfwidth)
-	{
-		return false;
-	}
-
-	// Front bound (z)
-	if (e_bound->base.transform->position.z < node->center.z - node->halfwidth)
+	uint32_t count = 0;
+	for (uint32_t i = 0; i < node->entity_count; i++)
 	{
-		return false;
+		if (func(node->entities[i], arg))
+		{
+			node->changed = ALL_CHANGED;
+			count++;
+			break;
+		}
 	}
-	// back bound (-z)
-	if (e_bound->base.transform->position.z > node->center.z + node->halfwidth)
-	{
-		return false;
-	}*/
 
-	if (e_bound->base.transform->position.x + e_bound->radius < node->center.x - node->halfwidth)
-	{
-		return false;
-	}
-	// Right bound (+x)
-	if (e_bound->base.transform->position.x + e_bound->radius > node->center.x + node->halfwidth)
-	{
-		return false;
-	}
-	// Bottom bound (-y)
-	if (e_bound->base.transform->position.y + e_bound->radius < node->center.y - node->halfwidth)
-	{
-		return false;
-	}
-	// Top bound (+y)
-	if (e_bound->base.transform->position.y + e_bound->radius > node->center.y + node->halfwidth)
+	for (uint32_t i = 0; node->children[0] && i < 8; i++)
 	{
-		return false;
+		count += rendertree_mark_changed(node->children[i], func, arg);
 	}
+	return count;
+}
 
-	// Front bound (z)
-	if (e_bound->base.transform->position.z + e_bound->radius < node->center.z - node->halfwidth)
-	{
-		return false;
-	}
-	// back bound (-z)
-	if (e_bound->base.transform->position.z + e_bound->radius > node->center.z + node->halfwidth)
-	{
-		return false;
-	}
+// Returns true if a point is inside the bounds of node
+static bool rendertree_contains(const RenderTreeNode* node, vec3 point)
+{
+	return fabsf(point.x - node->center.x) <= node->halfwidth && fabsf(point.y - node->center.y) <= node->halfwidth &&
+		   fabsf(point.z - node->center.z) <= node->halfwidth;
+}
 
-	return true;
+bool rendertree_fits(RenderTreeNode* node, Entity* entity)
+{
+	return rendertree_contains(node, entity_get_boundingsphere(entity)->base.transform->position);
 }
+
 bool rendertree_place_down(RenderTreeNode* node, Entity* entity)
 {
 	// Check if it fits in current node
@@ -417,18 +722,12 @@ bool rendertree_place_down(RenderTreeNode* node, Entity* entity)
 		return false;
 	}
 
-	// Check if node is still full when subdivided
-	if (node->children[0] && node->entity_count >= RENDER_TREE_LIM)
-	{
-		LOG_E("Subdivided node it still full");
-	}
 	// Check if the tree needs to be subdivided
-	if (node->children[0] == NULL && node->entity_count >= RENDER_TREE_LIM)
+	if (node->children[0] == NULL && node->entity_count >= node_limit && node->depth < RENDERTREE_MAX_DEPTH)
 	{
 		rendertree_subdivide(node);
 		rendertree_check(node);
 		LOG_S("Subdivided tree");
-		return true;
 	}
 
 	// Check if it fits in any children
@@ -439,9 +738,7 @@ bool rendertree_place_down(RenderTreeNode* node, Entity* entity)
 	}
 
 	// Fits only in this node
-	// Insert
-	node->entities[node->entity_count++] = entity;
-	node->changed = ALL_CHANGED;
+	rendertree_insert(node, entity);
 	return true;
 }
 
@@ -465,6 +762,397 @@ bool rendertree_place_up(RenderTreeNode* node, Entity* entity)
 	return true;
 }
 
+// Returns the first child of node the entity fits in, or 8 if it only fits in node
+static uint32_t rendertree_child_fitting(RenderTreeNode* node, Entity* entity)
+{
+	// Try the child containing the center first
+	vec3 position = entity_get_transform(entity)->position;
+	uint32_t octant = (position.x > node->center.x) | (position.y > node->center.y) << 1 | (position.z > node->center.z) << 2;
+	if (rendertree_fits(node->children[octant], entity))
+		return octant;
+
+	for (uint32_t i = 0; i < 8; i++)
+	{
+		if (rendertree_fits(node->children[i], entity))
+			return i;
+	}
+	return 8;
+}
+
+// Places entities fitting node into it or its children
+// The entities are reordered by child through scratch, children holds the child of each entity
+// Returns the number of entities placed
+static uint32_t rendertree_place_range(RenderTreeNode* node, Entity** entities, Entity** scratch, uint8_t* children, uint32_t count)
+{
+	// Fits in the leaf without subdividing
+	if (node->children[0] == NULL && (node->entity_count + count <= node_limit || node->depth == RENDERTREE_MAX_DEPTH))
+	{
+		rendertree_reserve(node, node->entity_count + count);
+		for (uint32_t i = 0; i < count; i++)
+			rendertree_insert(node, entities[i]);
+		return count;
+	}
+
+	if (node->children[0] == NULL)
+	{
+		rendertree_subdivide(node);
+		rendertree_check(node);
+	}
+
+	// Sort the entities by the child they fit in, the last bucket stays in this node
+	uint32_t offsets[10] = {0};
+	for (uint32_t i = 0; i < count; i++)
+	{
+		children[i] = rendertree_child_fitting(node, entities[i]);
+		offsets[children[i] + 1]++;
+	}
+	for (uint32_t i = 0; i < 9; i++)
+		offsets[i + 1] += offsets[i];
+
+	uint32_t ends[9];
+	memcpy(ends, offsets, sizeof ends);
+	for (uint32_t i = 0; i < count; i++)
+		scratch[ends[children[i]]++] = entities[i];
+	memcpy(entities, scratch, count * sizeof *entities);
+
+	uint32_t placed = count - offsets[8];
+	rendertree_reserve(node, node->entity_count + placed);
+	for (uint32_t i = offsets[8]; i < count; i++)
+		rendertree_insert(node, entities[i]);
+
+	for (uint32_t i = 0; i < 8; i++)
+	{
+		if (offsets[i + 1] > offsets[i])
+			placed += rendertree_place_range(node->children[i], entities + offsets[i], scratch + offsets[i], children + offsets[i], offsets[i + 1] - offsets[i]);
+	}
+	return placed;
+}
+
+uint32_t rendertree_place_batch(RenderTreeNode* root, Entity* const* entities, uint32_t count)
+{
+	// The batch is reordered in a copy
+	Entity** sorted = malloc(2 * count * sizeof *sorted);
+	uint8_t* children = malloc(count);
+	uint32_t fitting = 0;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		if (rendertree_fits(root, entities[i]))
+			sorted[fitting++] = entities[i];
+	}
+	if (fitting < count)
+		LOG_W("%d entities do not fit in the bounds of the tree", count - fitting);
+
+	uint32_t placed = fitting ? rendertree_place_range(root, sorted, sorted + fitting, children, fitting) : 0;
+	free(sorted);
+	free(children);
+	return placed;
+}
+
+// An entity with its bounds gathered for the bulk build
+typedef struct RenderTreeItem
+{
+	vec3 center;
+	Entity* entity;
+} RenderTreeItem;
+
+// The state of a bulk build shared by its jobs
+typedef struct RenderTreeBuild
+{
+	RenderTreeNode* root;
+	Entity* const* entities;
+	uint32_t count;
+	// The items in the order of entities, and sorted by their Morton codes
+	RenderTreeItem* items;
+	RenderTreeItem* sorted;
+	uint32_t* keys;
+	uint32_t* index;
+	uint32_t* keys_tmp;
+	uint32_t* index_tmp;
+	// The radix sort digit being sorted and the offsets of each block for each digit
+	uint32_t shift;
+	uint32_t block_size;
+	uint32_t offsets[RENDERTREE_SORT_BLOCKS][256];
+} RenderTreeBuild;
+
+// Spreads the lower 10 bits of v to every third bit
+static uint32_t rendertree_expand_bits(uint32_t v)
+{
+	v = (v * 0x00010001u) & 0xFF0000FFu;
+	v = (v * 0x00000101u) & 0x0F00F00Fu;
+	v = (v * 0x00000011u) & 0xC30C30C3u;
+	v = (v * 0x00000005u) & 0x49249249u;
+	return v;
+}
+
+// Returns the cell of a coordinate along an axis starting at min
+// Computed in double precision so that centers fall in the same child as rendertree_contains places them
+static uint32_t rendertree_quantize(float v, float min, double cell)
+{
+	double q = ((double)v - min) / cell;
+	if (q < 0.0)
+		return 0;
+	if (q >= (1 << RENDERTREE_MORTON_BITS) - 1)
+		return (1 << RENDERTREE_MORTON_BITS) - 1;
+	return (uint32_t)q;
+}
+
+// Gathers the bounds of the entities and computes the Morton codes of their centers within root
+// The x bit of each octal digit is the lowest to match the order of the children
+// Entities not fitting root get the largest key and are sorted last
+static void rendertree_morton_job(void* arg, uint32_t begin, uint32_t end)
+{
+	RenderTreeBuild* build = arg;
+	RenderTreeNode* root = build->root;
+	double cell = 2.0 * root->halfwidth / (1 << RENDERTREE_MORTON_BITS);
+	vec3 min = {root->center.x - root->halfwidth, root->center.y - root->halfwidth, root->center.z - root->halfwidth};
+	for (uint32_t i = begin; i < end; i++)
+	{
+		vec3 center = entity_get_boundingsphere(build->entities[i])->base.transform->position;
+		build->items[i] = (RenderTreeItem){center, build->entities[i]};
+		build->index[i] = i;
+
+		if (!rendertree_contains(root, center))
+		{
+			build->keys[i] = UINT32_MAX;
+			continue;
+		}
+
+		uint32_t x = rendertree_quantize(center.x, min.x, cell);
+		uint32_t y = rendertree_quantize(center.y, min.y, cell);
+		uint32_t z = rendertree_quantize(center.z, min.z, cell);
+		build->keys[i] = rendertree_expand_bits(x) | rendertree_expand_bits(y) << 1 | rendertree_expand_bits(z) << 2;
+	}
+}
+
+// Counts the digits of each block of keys
+static void rendertree_histogram_job(void* arg, uint32_t begin, uint32_t end)
+{
+	RenderTreeBuild* build = arg;
+	for (uint32_t block = begin; block < end; block++)
+	{
+		uint32_t* offsets = build->offsets[block];
+		memset(offsets, 0, sizeof build->offsets[block]);
+		uint32_t last = min((block + 1) * build->block_size, build->count);
+		for (uint32_t i = block * build->block_size; i < last; i++)
+			offsets[(build->keys[i] >> build->shift) & 0xff]++;
+	}
+}
+
+// Moves the keys of each block to their sorted position
+static void rendertree_scatter_job(void* arg, uint32_t begin, uint32_t end)
+{
+	RenderTreeBuild* build = arg;
+	for (uint32_t block = begin; block < end; block++)
+	{
+		uint32_t* offsets = build->offsets[block];
+		uint32_t last = min((block + 1) * build->block_size, build->count);
+		for (uint32_t i = block * build->block_size; i < last; i++)
+		{
+			uint32_t dst = offsets[(build->keys[i] >> build->shift) & 0xff]++;
+			build->keys_tmp[dst] = build->keys[i];
+			build->index_tmp[dst] = build->index[i];
+		}
+	}
+}
+
+static void rendertree_permute_job(void* arg, uint32_t begin, uint32_t end)
+{
+	RenderTreeBuild* build = arg;
+	for (uint32_t i = begin; i < end; i++)
+		build->sorted[i] = build->items[build->index[i]];
+}
+
+// Sorts the keys with a least significant digit radix sort
+// Each pass counts and scatters blocks of keys in parallel, the blocks keep the sort stable
+static void rendertree_sort_keys(RenderTreeBuild* build)
+{
+	uint32_t block_count = RENDERTREE_SORT_BLOCKS;
+	build->block_size = (build->count + block_count - 1) / block_count;
+	for (build->shift = 0; build->shift < 32; build->shift += 8)
+	{
+		job_parallel_for(block_count, 1, rendertree_histogram_job, build);
+
+		// All keys share the digit
+		uint32_t digit = (build->keys[0] >> build->shift) & 0xff;
+		uint32_t digit_count = 0;
+		for (uint32_t block = 0; block < block_count; block++)
+			digit_count += build->offsets[block][digit];
+		if (digit_count == build->count)
+			continue;
+
+		uint32_t sum = 0;
+		for (uint32_t i = 0; i < 256; i++)
+		{
+			for (uint32_t block = 0; block < block_count; block++)
+			{
+				uint32_t block_digit_count = build->offsets[block][i];
+				build->offsets[block][i] = sum;
+				sum += block_digit_count;
+			}
+		}
+
+		job_parallel_for(block_count, 1, rendertree_scatter_job, build);
+
+		uint32_t* keys = build->keys;
+		build->keys = build->keys_tmp;
+		build->keys_tmp = keys;
+		uint32_t* index = build->index;
+		build->index = build->index_tmp;
+		build->index_tmp = index;
+	}
+}
+
+// Replaces the entities of node
+// The node is left as is if it already holds the same entities, which keeps its command buffers
+static void rendertree_set_entities(RenderTreeNode* node, Entity** entities, uint32_t count)
+{
+	// The entities are not assigned yet, so they still point to their previous node
+	bool same = count == node->entity_count;
+	for (uint32_t i = 0; same && i < count; i++)
+		same = entity_get_rendertree_node(entities[i]) == node;
+	if (same)
+		return;
+
+	rendertree_reserve(node, count);
+	memcpy(node->entities, entities, count * sizeof *entities);
+	for (uint32_t i = 0; i < count; i++)
+		entity_set_rendertree_node(entities[i], node);
+	node->entity_count = count;
+	node->changed = ALL_CHANGED;
+}
+
+// Builds the subtree of node from items sorted by their Morton codes, which all fit node
+// Entities staying in node are gathered in stays, which has room for count entities
+static void rendertree_build_range(RenderTreeNode* node, RenderTreeItem* items, uint32_t* keys, Entity** stays, uint32_t count, uint32_t depth)
+{
+	if (count <= node_limit || depth == RENDERTREE_MAX_DEPTH)
+	{
+		if (node->children[0])
+		{
+			for (uint32_t i = 0; i < 8; i++)
+			{
+				rendertree_destroy(node->children[i]);
+				node->children[i] = NULL;
+			}
+			node->changed = ALL_CHANGED;
+		}
+
+		for (uint32_t i = 0; i < count; i++)
+			stays[i] = items[i].entity;
+		rendertree_set_entities(node, stays, count);
+		return;
+	}
+
+	if (node->children[0] == NULL)
+		rendertree_subdivide(node);
+
+	// The items of each child are consecutive and share the next octal digit
+	uint32_t shift = 3 * (RENDERTREE_MORTON_BITS - 1 - depth);
+	uint32_t child_begin[8];
+	uint32_t child_count[8];
+	uint32_t stay_count = 0;
+	uint32_t begin = 0;
+	for (uint32_t i = 0; i < 8; i++)
+	{
+		uint32_t end = begin;
+		while (end < count && ((keys[end] >> shift) & 7) == i)
+			end++;
+
+		// Items rounded into the wrong child stay in node, the rest keep their order
+		uint32_t kept = begin;
+		for (uint32_t j = begin; j < end; j++)
+		{
+			if (rendertree_contains(node->children[i], items[j].center))
+			{
+				items[kept] = items[j];
+				keys[kept] = keys[j];
+				kept++;
+			}
+			else
+				stays[stay_count++] = items[j].entity;
+		}
+
+		child_begin[i] = begin;
+		child_count[i] = kept - begin;
+		begin = end;
+	}
+
+	rendertree_set_entities(node, stays, stay_count);
+
+	for (uint32_t i = 0; i < 8; i++)
+		rendertree_build_range(node->children[i], items + child_begin[i], keys + child_begin[i], stays + child_begin[i], child_count[i], depth + 1);
+}
+
+uint32_t rendertree_build(RenderTreeNode* root, Entity* const* entities, uint32_t count)
+{
+	RenderTreeBuild* build = malloc(sizeof *build);
+	build->root = root;
+	build->entities = entities;
+	build->count = count;
+	build->items = malloc(count * sizeof *build->items);
+	build->sorted = malloc(count * sizeof *build->sorted);
+	build->keys = malloc(count * sizeof *build->keys);
+	build->index = malloc(count * sizeof *build->index);
+	build->keys_tmp = malloc(count * sizeof *build->keys_tmp);
+	build->index_tmp = malloc(count * sizeof *build->index_tmp);
+
+	job_parallel_for(count, 0, rendertree_morton_job, build);
+	if (count)
+		rendertree_sort_keys(build);
+	job_parallel_for(count, 0, rendertree_permute_job, build);
+
+	// Entities not fitting root were sorted last
+	uint32_t fitting = count;
+	while (fitting > 0 && build->keys[fitting - 1] == UINT32_MAX)
+	{
+		fitting--;
+		entity_set_rendertree_node(build->sorted[fitting].entity, NULL);
+	}
+	if (fitting < count)
+		LOG_W("%d entities do not fit in the bounds of the tree", count - fitting);
+
+	// The item and key arrays are no longer needed in entity order
+	Entity** stays = (Entity**)build->items;
+	rendertree_build_range(root, build->sorted, build->keys, stays, fitting, 0);
+
+	uint32_t placed = 0;
+	for (uint32_t i = 0; i < fitting; i++)
+		placed += entity_get_rendertree_node(build->sorted[i].entity) != NULL;
+
+	free(build->items);
+	free(build->sorted);
+	free(build->keys);
+	free(build->index);
+	free(build->keys_tmp);
+	free(build->index_tmp);
+	free(build);
+	return placed;
+}
+
+void rendertree_remove(Entity* entity)
+{
+	// Entities outside the tree may still be resident or kept as occluders from when they were in it
+	indirect_remove(entity);
+	occlusion_remove_occluder(entity_get_transform(entity));
+
+	RenderTreeNode* node = entity_get_rendertree_node(entity);
+	if (node == NULL)
+		return;
+
+	for (uint32_t i = 0; i < node->entity_count; i++)
+	{
+		if (node->entities[i] == entity)
+		{
+			memmove(node->entities + i, node->entities + i + 1, (node->entity_count - i - 1) * sizeof *node->entities);
+			node->entities[node->entity_count - 1] = NULL;
+			node->entity_count--;
+			node->changed = ALL_CHANGED;
+			break;
+		}
+	}
+	entity_set_rendertree_node(entity, NULL);
+}
+
 void rendertree_destroy(RenderTreeNode* node)
 {
 	for (uint32_t i = 0; node->children[0] && i < 8; i++)
@@ -472,19 +1160,31 @@ void rendertree_destroy(RenderTreeNode* node)
 		rendertree_destroy(node->children[i]);
 	}
 
-	if (node->entity_data)
+	// Merged nodes are destroyed after their entities are placed elsewhere
+	for (uint32_t i = 0; i < node->entity_count; i++)
 	{
-		for (uint32_t i = 0; i < 3; i++)
-		{
-			commandbuffer_destroy(node->commandbuffers[i]);
-		}
-		ub_destroy(node->entity_data);
-		descriptorpack_destroy(node->entity_data_descriptors);
+		if (entity_get_rendertree_node(node->entities[i]) == node)
+			entity_set_rendertree_node(node->entities[i], NULL);
 	}
 
+	rendertree_release_shader_data(node);
+	free(node->entities);
+
 	mempool_free(&node_pool, node);
 
 	// Last node
 	if (node_pool.alloc_count == 0)
-		vkDestroyDescriptorSetLayout(device, entity_data_layout, NULL);
+	{
+		for (uint32_t i = 0; i < free_count; i++)
+		{
+			RenderTreeResources* resources = &free_resources[i];
+			rendertree_destroy_resources(resources->commandbuffers, resources->entity_data, resources->entity_data_descriptors);
+		}
+		free_count = 0;
+
+		// The layout is created on first render
+		if (entity_data_layout != VK_NULL_HANDLE)
+			vkDestroyDescriptorSetLayout(device, entity_data_layout, NULL);
+		entity_data_layout = VK_NULL_HANDLE;
+	}
 }
\ No newline at end of file
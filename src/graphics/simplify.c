@@ -0,0 +1,316 @@
+#include "simplify.h"
+#include "magpie.h"
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+
+// Border planes are weighted higher than face planes to keep the outline of open meshes
+#define SIMPLIFY_BORDER_WEIGHT 10.0
+
+// A symmetric 4x4 matrix summing the squared distances to a set of planes
+// w is the total weight of the planes, used to normalize the error
+typedef struct
+{
+	double a2, ab, ac, ad;
+	double b2, bc, bd;
+	double c2, cd;
+	double d2;
+	double w;
+} Quadric;
+
+// An edge collapse moving a welded vertex onto another
+struct Collapse
+{
+	uint32_t from;
+	uint32_t to;
+	double cost;
+};
+
+static void quadric_add_plane(Quadric* q, vec3 n, float d, double weight)
+{
+	q->a2 += weight * n.x * n.x;
+	q->ab += weight * n.x * n.y;
+	q->ac += weight * n.x * n.z;
+	q->ad += weight * n.x * d;
+	q->b2 += weight * n.y * n.y;
+	q->bc += weight * n.y * n.z;
+	q->bd += weight * n.y * d;
+	q->c2 += weight * n.z * n.z;
+	q->cd += weight * n.z * d;
+	q->d2 += weight * d * d;
+	q->w += weight;
+}
+
+static void quadric_add(Quadric* dst, const Quadric* src)
+{
+	dst->a2 += src->a2;
+	dst->ab += src->ab;
+	dst->ac += src->ac;
+	dst->ad += src->ad;
+	dst->b2 += src->b2;
+	dst->bc += src->bc;
+	dst->bd += src->bd;
+	dst->c2 += src->c2;
+	dst->cd += src->cd;
+	dst->d2 += src->d2;
+	dst->w += src->w;
+}
+
+// Returns the mean squared distance of p to the planes of the sum of a and b
+static double quadric_error(const Quadric* a, const Quadric* b, vec3 p)
+{
+	Quadric q = *a;
+	quadric_add(&q, b);
+	double x = p.x, y = p.y, z = p.z;
+	double r = q.a2 * x * x + 2 * q.ab * x * y + 2 * q.ac * x * z + 2 * q.ad * x + q.b2 * y * y + 2 * q.bc * y * z + 2 * q.bd * y + q.c2 * z * z + 2 * q.cd * z + q.d2;
+	r = r < 0 ? 0 : r;
+	return q.w > 0 ? r / q.w : r;
+}
+
+static uint32_t hash_position(vec3 p)
+{
+	uint32_t bits[3];
+	memcpy(bits, &p, sizeof bits);
+	return (bits[0] * 73856093) ^ (bits[1] * 19349663) ^ (bits[2] * 83492791);
+}
+
+// Maps each vertex to a welded vertex shared by all vertices with the same position
+// welded_rep is filled with the first vertex of each welded vertex
+// Returns the number of welded vertices
+static uint32_t simplify_weld(const Vertex* vertices, uint32_t vertex_count, uint32_t* remap, uint32_t* welded_rep)
+{
+	uint32_t table_size = 1;
+	while (table_size < vertex_count * 2)
+		table_size *= 2;
+
+	uint32_t* table = malloc(table_size * sizeof *table);
+	memset(table, 0xff, table_size * sizeof *table);
+
+	uint32_t count = 0;
+	for (uint32_t i = 0; i < vertex_count; i++)
+	{
+		vec3 p = vertices[i].position;
+		uint32_t slot = hash_position(p) & (table_size - 1);
+		while (table[slot] != (uint32_t)-1 && memcmp(&vertices[welded_rep[table[slot]]].position, &p, sizeof p) != 0)
+			slot = (slot + 1) & (table_size - 1);
+
+		if (table[slot] == (uint32_t)-1)
+		{
+			table[slot] = count;
+			welded_rep[count++] = i;
+		}
+		remap[i] = table[slot];
+	}
+
+	free(table);
+	return count;
+}
+
+// Fills the triangles adjacent to each welded vertex
+// offsets needs to hold vertex_count + 1 elements and adjacency index_count elements
+static void simplify_adjacency(const uint32_t* ids, uint32_t index_count, uint32_t vertex_count, uint32_t* offsets, uint32_t* adjacency)
+{
+	memset(offsets, 0, (vertex_count + 1) * sizeof *offsets);
+	for (uint32_t i = 0; i < index_count; i++)
+		offsets[ids[i] + 1]++;
+	for (uint32_t i = 0; i < vertex_count; i++)
+		offsets[i + 1] += offsets[i];
+
+	// offsets is shifted back while filling
+	for (uint32_t i = 0; i < index_count; i++)
+		adjacency[offsets[ids[i]]++] = i / 3;
+	for (uint32_t i = vertex_count; i > 0; i--)
+		offsets[i] = offsets[i - 1];
+	offsets[0] = 0;
+}
+
+// Returns the number of triangles adjacent to both a and b
+static uint32_t simplify_shared_triangles(const uint32_t* ids, const uint32_t* offsets, const uint32_t* adjacency, uint32_t a, uint32_t b)
+{
+	uint32_t count = 0;
+	for (uint32_t i = offsets[a]; i < offsets[a + 1]; i++)
+	{
+		const uint32_t* tri = &ids[adjacency[i] * 3];
+		count += tri[0] == b || tri[1] == b || tri[2] == b;
+	}
+	return count;
+}
+
+// Returns true if moving from onto to flips or degenerates any remaining triangle around from
+static bool simplify_flips(const uint32_t* ids, const uint32_t* offsets, const uint32_t* adjacency, const vec3* positions, uint32_t from, uint32_t to)
+{
+	for (uint32_t i = offsets[from]; i < offsets[from + 1]; i++)
+	{
+		const uint32_t* tri = &ids[adjacency[i] * 3];
+		// Triangles containing the edge are removed by the collapse
+		if (tri[0] == to || tri[1] == to || tri[2] == to)
+			continue;
+
+		vec3 before[3], after[3];
+		for (uint32_t j = 0; j < 3; j++)
+		{
+			before[j] = positions[tri[j]];
+			after[j] = tri[j] == from ? positions[to] : positions[tri[j]];
+		}
+
+		vec3 n0 = vec3_cross(vec3_sub(before[1], before[0]), vec3_sub(before[2], before[0]));
+		vec3 n1 = vec3_cross(vec3_sub(after[1], after[0]), vec3_sub(after[2], after[0]));
+		if (vec3_dot(n0, n1) <= 0.0f)
+			return true;
+	}
+	return false;
+}
+
+static int collapse_compare(const void* a, const void* b)
+{
+	double ca = ((const struct Collapse*)a)->cost;
+	double cb = ((const struct Collapse*)b)->cost;
+	return (ca > cb) - (ca < cb);
+}
+
+uint32_t simplify_mesh(uint32_t* dst, const uint32_t* indices, uint32_t index_count, const Vertex* vertices, uint32_t vertex_count, uint32_t target_index_count,
+					   float max_error, float* error)
+{
+	*error = 0.0f;
+	memcpy(dst, indices, index_count * sizeof *dst);
+	if (index_count < 3 || vertex_count == 0)
+		return index_count;
+
+	uint32_t* remap = malloc(vertex_count * sizeof *remap);
+	uint32_t* welded_rep = malloc(vertex_count * sizeof *welded_rep);
+	uint32_t welded_count = simplify_weld(vertices, vertex_count, remap, welded_rep);
+
+	vec3* positions = malloc(welded_count * sizeof *positions);
+	for (uint32_t i = 0; i < welded_count; i++)
+		positions[i] = vertices[welded_rep[i]].position;
+
+	// The welded vertex of each corner
+	uint32_t* ids = malloc(index_count * sizeof *ids);
+	for (uint32_t i = 0; i < index_count; i++)
+		ids[i] = remap[dst[i]];
+
+	uint32_t* offsets = malloc((welded_count + 1) * sizeof *offsets);
+	uint32_t* adjacency = malloc(index_count * sizeof *adjacency);
+	simplify_adjacency(ids, index_count, welded_count, offsets, adjacency);
+
+	// Sum the planes of the adjacent triangles of each vertex
+	Quadric* quadrics = calloc(welded_count, sizeof *quadrics);
+	for (uint32_t i = 0; i < index_count; i += 3)
+	{
+		vec3 p0 = positions[ids[i]], p1 = positions[ids[i + 1]], p2 = positions[ids[i + 2]];
+		vec3 n = vec3_cross(vec3_sub(p1, p0), vec3_sub(p2, p0));
+		float area = vec3_mag(n);
+		if (area <= 0.0f)
+			continue;
+		n = vec3_scale(n, 1.0f / area);
+
+		for (uint32_t j = 0; j < 3; j++)
+			quadric_add_plane(&quadrics[ids[i + j]], n, -vec3_dot(n, p0), area * 0.5);
+
+		// Edges with a single triangle are borders, constrained by a plane perpendicular to the triangle
+		for (uint32_t j = 0; j < 3; j++)
+		{
+			uint32_t a = ids[i + j], b = ids[i + (j + 1) % 3];
+			if (simplify_shared_triangles(ids, offsets, adjacency, a, b) != 1)
+				continue;
+
+			vec3 edge = vec3_sub(positions[b], positions[a]);
+			float length = vec3_mag(edge);
+			if (length <= 0.0f)
+				continue;
+			vec3 border = vec3_norm(vec3_cross(edge, n));
+			double weight = SIMPLIFY_BORDER_WEIGHT * length * length;
+			quadric_add_plane(&quadrics[a], border, -vec3_dot(border, positions[a]), weight);
+			quadric_add_plane(&quadrics[b], border, -vec3_dot(border, positions[a]), weight);
+		}
+	}
+
+	uint32_t* collapsed = malloc(welded_count * sizeof *collapsed);
+	for (uint32_t i = 0; i < welded_count; i++)
+		collapsed[i] = i;
+	bool* locked = malloc(welded_count * sizeof *locked);
+	struct Collapse* collapses = malloc(index_count * sizeof *collapses);
+
+	double max_cost = (double)max_error * max_error;
+	double worst_cost = 0.0;
+
+	// Each pass collapses independent edges in order of cost and rebuilds the triangles
+	while (index_count > target_index_count)
+	{
+		uint32_t collapse_count = 0;
+		for (uint32_t i = 0; i < index_count; i++)
+		{
+			uint32_t a = ids[i], b = ids[i - i % 3 + (i + 1) % 3];
+			if (a == b)
+				continue;
+			double cost_ab = quadric_error(&quadrics[a], &quadrics[b], positions[b]);
+			double cost_ba = quadric_error(&quadrics[a], &quadrics[b], positions[a]);
+			collapses[collapse_count++] = cost_ab <= cost_ba ? (struct Collapse){a, b, cost_ab} : (struct Collapse){b, a, cost_ba};
+		}
+		qsort(collapses, collapse_count, sizeof *collapses, collapse_compare);
+
+		memset(locked, 0, welded_count * sizeof *locked);
+		uint32_t triangle_count = index_count / 3;
+		uint32_t removed = 0;
+		uint32_t performed = 0;
+		for (uint32_t i = 0; i < collapse_count && (triangle_count - removed) * 3 > target_index_count; i++)
+		{
+			struct Collapse* c = &collapses[i];
+			if (c->cost > max_cost)
+				break;
+			if (locked[c->from] || locked[c->to] || simplify_flips(ids, offsets, adjacency, positions, c->from, c->to))
+				continue;
+
+			collapsed[c->from] = c->to;
+			quadric_add(&quadrics[c->to], &quadrics[c->from]);
+			removed += simplify_shared_triangles(ids, offsets, adjacency, c->from, c->to);
+			worst_cost = c->cost > worst_cost ? c->cost : worst_cost;
+			performed++;
+
+			// The triangles around from changed, their vertices wait for the next pass
+			for (uint32_t j = offsets[c->from]; j < offsets[c->from + 1]; j++)
+			{
+				const uint32_t* tri = &ids[adjacency[j] * 3];
+				locked[tri[0]] = locked[tri[1]] = locked[tri[2]] = true;
+			}
+		}
+
+		if (performed == 0)
+			break;
+
+		// Move the corners onto the surviving vertices and drop degenerate triangles
+		uint32_t count = 0;
+		for (uint32_t i = 0; i < index_count; i += 3)
+		{
+			uint32_t tri[3];
+			for (uint32_t j = 0; j < 3; j++)
+				tri[j] = collapsed[ids[i + j]];
+			if (tri[0] == tri[1] || tri[1] == tri[2] || tri[0] == tri[2])
+				continue;
+
+			for (uint32_t j = 0; j < 3; j++)
+			{
+				// Corners of moved vertices take the vertex of the new position, keeping uvs where possible
+				dst[count + j] = tri[j] == ids[i + j] ? dst[i + j] : welded_rep[tri[j]];
+				ids[count + j] = tri[j];
+			}
+			count += 3;
+		}
+		index_count = count;
+		simplify_adjacency(ids, index_count, welded_count, offsets, adjacency);
+	}
+
+	*error = (float)sqrt(worst_cost);
+
+	free(collapses);
+	free(locked);
+	free(collapsed);
+	free(quadrics);
+	free(adjacency);
+	free(offsets);
+	free(ids);
+	free(positions);
+	free(welded_rep);
+	free(remap);
+	return index_count;
+}
@@ -0,0 +1,17 @@
+#ifndef SIMPLIFY_H
+#define SIMPLIFY_H
+#include <stdint.h>
+#include "graphics/vertexbuffer.h"
+
+// Simplifies a triangle list by collapsing edges in order of their quadric error
+// Vertices sharing a position are welded so that uv seams collapse together
+// Collapses move a vertex onto its neighbour, so the result references the original vertices and shares their buffer
+// Border edges are weighted to keep the silhouette of open meshes
+// Simplification stops at target_index_count indices or when a collapse would exceed max_error in object units
+// dst needs to hold index_count indices
+// error is set to the largest error of a collapse, measured as the root mean square distance to the original planes
+// Returns the number of indices written to dst
+// Does not use any graphics state and can run on any thread
+uint32_t simplify_mesh(uint32_t* dst, const uint32_t* indices, uint32_t index_count, const Vertex* vertices, uint32_t vertex_count, uint32_t target_index_count,
+					   float max_error, float* error);
+#endif
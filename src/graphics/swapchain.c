@@ -5,6 +5,8 @@
 #include "log.h"
 #include "graphics/uniforms.h"
 #include "graphics/pipeline.h"
+#include "graphics/bindless.h"
+#include "graphics/indirect.h"
 
 int swapchain_create()
 {
@@ -83,6 +85,8 @@ int swapchain_create()
 int swapchain_recreate()
 {
 	vkDeviceWaitIdle(device);
+	// Compiling pipelines reference the render pass about to be destroyed
+	pipeline_wait_all();
 	LOG("Recreating swapchain");
 
 	swapchain_destroy();
@@ -92,6 +96,11 @@ int swapchain_recreate()
 
 	pipeline_recreate_all();
 
+	// The bindless sets and indirect frames are per swapchain image and the image count may have changed
+	if (bindless_recreate())
+		LOG_E("Failed to recreate bindless descriptors");
+	indirect_recreate();
+
 	// TODO: framebuffer recreation
 	/*create_color_buffer();
 	create_depth_buffer();
@@ -5,43 +5,93 @@
 #include "magpie.h"
 #include "stb_image.h"
 #include "handlepool.h"
+#include "handletable.h"
+#include "jobs.h"
+#include "utils.h"
+#include "settings.h"
+#include "bcn.h"
+#include "ktx.h"
+#include "defines.h"
+#include <math.h>
+#include <stdlib.h>
 
 struct SamplerInfo
 {
 	SamplerFilterMode filterMode;
 	SamplerWrapMode wrapMode;
 	int maxAnisotropy;
+	float minLod;
+	float maxLod;
+	float lodBias;
 };
 
 typedef struct Sampler_raw
 {
 	VkSampler vksampler;
 	struct SamplerInfo info;
+	// The number of sampler_get calls not yet matched by sampler_destroy
+	uint32_t ref_count;
 } Sampler_raw;
 
-static int32_t comp_sampler(const struct SamplerInfo* info1, const struct SamplerInfo* info2)
+static int32_t comp_sampler(const void* pkey1, const void* pkey2)
 {
-	return (info1->filterMode == info2->filterMode && info1->wrapMode == info2->wrapMode && info1->maxAnisotropy == info2->maxAnisotropy) == 0;
+	const struct SamplerInfo* info1 = pkey1;
+	const struct SamplerInfo* info2 = pkey2;
+	return (info1->filterMode == info2->filterMode && info1->wrapMode == info2->wrapMode && info1->maxAnisotropy == info2->maxAnisotropy &&
+			info1->minLod == info2->minLod && info1->maxLod == info2->maxLod && info1->lodBias == info2->lodBias) == 0;
+}
+
+// Combines the bits of a float, +0 and -0 compare equal and need the same hash
+static uint32_t hash_float(uint32_t hash, float value)
+{
+	uint32_t bits = 0;
+	if (value != 0.0f)
+		memcpy(&bits, &value, sizeof bits);
+	return (hash ^ bits) * 16777619u;
+}
+
+static uint32_t hash_sampler(const void* pkey)
+{
+	const struct SamplerInfo* info = pkey;
+	// FNV-1a over each field
+	uint32_t hash = 2166136261u;
+	hash = (hash ^ (uint32_t)info->filterMode) * 16777619u;
+	hash = (hash ^ (uint32_t)info->wrapMode) * 16777619u;
+	hash = (hash ^ (uint32_t)info->maxAnisotropy) * 16777619u;
+	hash = hash_float(hash, info->minLod);
+	hash = hash_float(hash, info->maxLod);
+	hash = hash_float(hash, info->lodBias);
+	return hash;
 }
 
 static handlepool_t sampler_pool = HANDLEPOOL_INIT(sizeof(Sampler_raw), "Sampler");
+// Samplers keyed by their info
+static handletable_t* sampler_table = NULL;
+
+static const void* keyfunc_sampler(GenericHandle handle)
+{
+	return &((Sampler_raw*)handlepool_get_raw(&sampler_pool, handle))->info;
+}
 
 // Creates a sampler
-Sampler sampler_get(SamplerFilterMode filterMode, SamplerWrapMode wrapMode, int maxAnisotropy)
+Sampler sampler_get(SamplerFilterMode filterMode, SamplerWrapMode wrapMode, int maxAnisotropy, float minLod, float maxLod, float lodBias)
 {
+	// Anisotropy of 0 and 1 both disable it and give the same sampler
+	if (maxAnisotropy < 1)
+		maxAnisotropy = 1;
+
 	// Look if sampler already exists
-	struct SamplerInfo samplerInfo = {.filterMode = filterMode, .wrapMode = wrapMode, .maxAnisotropy = maxAnisotropy};
+	struct SamplerInfo samplerInfo = {
+		.filterMode = filterMode, .wrapMode = wrapMode, .maxAnisotropy = maxAnisotropy, .minLod = minLod, .maxLod = maxLod, .lodBias = lodBias};
 
-	for (uint32_t i = 0; i < sampler_pool.size; i++)
-	{
-		if (HANDLEPOOL_INDEX((&sampler_pool), i)->next != NULL)
-			continue;
+	if (sampler_table == NULL)
+		sampler_table = handletable_create(keyfunc_sampler, hash_sampler, comp_sampler);
 
-		Sampler_raw* found = (Sampler_raw*)HANDLEPOOL_INDEX((&sampler_pool), i)->data;
-		if (comp_sampler(&samplerInfo, &found->info) == 0)
-		{
-			return PUN_HANDLE(HANDLEPOOL_INDEX((&sampler_pool), i)->handle, Sampler);
-		}
+	GenericHandle found = handletable_find(sampler_table, &samplerInfo);
+	if (HANDLE_VALID(found))
+	{
+		((Sampler_raw*)handlepool_get_raw(&sampler_pool, found))->ref_count++;
+		return PUN_HANDLE(found, Sampler);
 	}
 
 	// Create new sampler
@@ -52,6 +102,7 @@ Sampler sampler_get(SamplerFilterMode filterMode, SamplerWrapMode wrapMode, int
 	// Create sampler
 	LOG("Creating new sampler");
 	raw->info = samplerInfo;
+	raw->ref_count = 1;
 
 	VkSamplerCreateInfo samplerCreateInfo = {0};
 
@@ -71,6 +122,8 @@ Sampler sampler_get(SamplerFilterMode filterMode, SamplerWrapMode wrapMode, int
 	}
 
 	samplerCreateInfo.minFilter = samplerCreateInfo.magFilter;
+	// Trilinear for linear filtering
+	samplerCreateInfo.mipmapMode = filterMode == SAMPLER_FILTER_NEAREST ? VK_SAMPLER_MIPMAP_MODE_NEAREST : VK_SAMPLER_MIPMAP_MODE_LINEAR;
 
 	// Tiling
 	switch (wrapMode)
@@ -108,18 +161,20 @@ Sampler sampler_get(SamplerFilterMode filterMode, SamplerWrapMode wrapMode, int
 	samplerCreateInfo.compareOp = VK_COMPARE_OP_ALWAYS;
 
 	// Mipmapping
-	samplerCreateInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
-	samplerCreateInfo.mipLodBias = 0.0f;
-	samplerCreateInfo.minLod = 0.0f;
-	samplerCreateInfo.maxLod = 0.0f;
+	samplerCreateInfo.mipLodBias = lodBias;
+	samplerCreateInfo.minLod = minLod;
+	samplerCreateInfo.maxLod = maxLod;
 
 	// Samplers are not combined with one specific image
 	VkResult result = vkCreateSampler(device, &samplerCreateInfo, NULL, &raw->vksampler);
 	if (result != VK_SUCCESS)
 	{
 		LOG_E("Failed to create image sampler - code %d", result);
+		handlepool_free(&sampler_pool, PUN_HANDLE(handle, GenericHandle));
 		return INVALID(Sampler);
 	}
+
+	handletable_insert(sampler_table, PUN_HANDLE(handle, GenericHandle));
 	return handle;
 }
 
@@ -128,13 +183,32 @@ VkSampler sampler_get_vksampler(Sampler sampler)
 	return ((Sampler_raw*)handlepool_get_raw(&sampler_pool, PUN_HANDLE(sampler, GenericHandle)))->vksampler;
 }
 
-void sampler_destroy(Sampler sampler)
+// Destroys a sampler regardless of references
+static void sampler_free(Sampler sampler)
 {
 	Sampler_raw* raw = handlepool_get_raw(&sampler_pool, PUN_HANDLE(sampler, GenericHandle));
 
 	vkDestroySampler(device, raw->vksampler, NULL);
+	handletable_remove(sampler_table, &raw->info);
 
 	handlepool_free(&sampler_pool, PUN_HANDLE(sampler, GenericHandle));
+
+	// Last sampler was removed
+	if (handletable_get_count(sampler_table) == 0)
+	{
+		handletable_destroy(sampler_table);
+		sampler_table = NULL;
+	}
+}
+
+void sampler_destroy(Sampler sampler)
+{
+	Sampler_raw* raw = handlepool_get_raw(&sampler_pool, PUN_HANDLE(sampler, GenericHandle));
+	if (raw == NULL)
+		return;
+
+	if (--raw->ref_count == 0)
+		sampler_free(sampler);
 }
 
 void sampler_destroy_all()
@@ -144,10 +218,25 @@ void sampler_destroy_all()
 		if (HANDLEPOOL_INDEX((&sampler_pool), i)->next != NULL)
 			continue;
 
-		sampler_destroy(PUN_HANDLE(HANDLEPOOL_INDEX((&sampler_pool), i)->handle, Sampler));
+		sampler_free(PUN_HANDLE(HANDLEPOOL_INDEX((&sampler_pool), i)->handle, Sampler));
 	}
 }
 
+// The contents of all mip levels of a texture ready for upload
+typedef struct
+{
+	VkFormat format;
+	int width;
+	int height;
+	uint32_t mip_levels;
+	const uint8_t* levels[TEXTURE_MAX_MIP_LEVELS];
+	size_t level_sizes[TEXTURE_MAX_MIP_LEVELS];
+	// Storage of the levels if they were built in memory
+	uint8_t* data;
+	// The cooked file the levels point into
+	KtxFile ktx;
+} TextureLevels;
+
 typedef struct Texture_raw
 {
 	// Name should not be modified after creation
@@ -165,57 +254,703 @@ typedef struct Texture_raw
 	VkSampleCountFlagBits samples;
 	VkImageAspectFlagBits aspect;
 	VkImageUsageFlags usage;
+	// The number of mip levels in the full chain, 1 for textures not loaded from files
+	uint32_t mip_levels;
+	// The finest level in the image, width and height are of level 0 even if it is not resident
+	uint32_t base_level;
+	// Incremented every time the view is recreated
+	uint32_t view_version;
+	// All levels of a streamed texture, NULL if the whole chain is resident
+	TextureLevels* source;
+	// The coarsest base level of a streamed texture
+	uint32_t resident_level;
+	// The finest level requested during the frame last_used
+	uint32_t requested_level;
+	uint64_t last_used;
 	// If set to true, the texture owns the vkimage and will free it on destruction
 	bool owns_image;
+	TextureState state;
 } Texture_raw;
 
 static handlepool_t texture_pool = HANDLEPOOL_INIT(sizeof(Texture_raw), "Texture");
 
+// A texture being decoded on a worker thread
+// The handlepool may be reallocated at any time, so workers only touch this struct
+typedef struct TextureLoad
+{
+	Texture tex;
+	char file[256];
+	TextureLevels levels;
+	int result;
+	// Why loading failed, written on the worker
+	char error[128];
+	struct TextureLoad* next;
+} TextureLoad;
+
+// Decoded textures waiting for upload, pushed by the workers
+static TextureLoad* volatile texture_loads_done = NULL;
+static JobCounter texture_jobs = {0};
+
+#define MIP_DIM(dim, level) ((dim) >> (level) > 0 ? (dim) >> (level) : 1)
+
+// Offsets in staging buffers need to be aligned to the largest block size
+#define TEXTURE_STAGING_ALIGNMENT 16
+#define TEXTURE_STAGING_ALIGN(size) (((size) + TEXTURE_STAGING_ALIGNMENT - 1) & ~(VkDeviceSize)(TEXTURE_STAGING_ALIGNMENT - 1))
+
+// Returns the number of levels in a full mip chain down to 1x1
+static uint32_t texture_mip_count(int width, int height)
+{
+	uint32_t levels = 1;
+	int size = width > height ? width : height;
+	while (size > 1 && levels < TEXTURE_MAX_MIP_LEVELS)
+	{
+		size >>= 1;
+		levels++;
+	}
+	return levels;
+}
+
+// Returns the size in bytes of an RGBA8 mip chain
+static VkDeviceSize texture_chain_size(int width, int height, uint32_t mip_levels)
+{
+	VkDeviceSize size = 0;
+	for (uint32_t i = 0; i < mip_levels; i++)
+	{
+		size += 4 * (VkDeviceSize)MIP_DIM(width, i) * MIP_DIM(height, i);
+	}
+	return size;
+}
+
+// Returns true if the format stores 4 bytes per texel in 8 bit channels
+static bool texture_format_is_rgba8(VkFormat format)
+{
+	switch (format)
+	{
+	case VK_FORMAT_R8G8B8A8_UNORM:
+	case VK_FORMAT_R8G8B8A8_SRGB:
+	case VK_FORMAT_B8G8R8A8_UNORM:
+	case VK_FORMAT_B8G8R8A8_SRGB:
+		return true;
+	default:
+		return false;
+	}
+}
+
+// Returns the size in bytes of a single level in either RGBA8 or a block compressed format
+static size_t texture_level_size(VkFormat format, int width, int height)
+{
+	if (bcn_block_size(format))
+		return bcn_image_size(format, width, height);
+	return 4 * (size_t)width * height;
+}
+
+struct MipDownsample
+{
+	const uint8_t* src;
+	uint8_t* dst;
+	int src_width;
+	int src_height;
+	int dst_width;
+};
+
+// Box filters rows [begin, end) of the next level
+// Color is averaged with a gamma of 2 as an approximation of sRGB so that the levels don't darken
+static void texture_downsample_rows(void* arg, uint32_t begin, uint32_t end)
+{
+	const struct MipDownsample* job = arg;
+	for (uint32_t y = begin; y < end; y++)
+	{
+		int y0 = 2 * y;
+		int y1 = y0 + 1 < job->src_height ? y0 + 1 : y0;
+		for (int x = 0; x < job->dst_width; x++)
+		{
+			int x0 = 2 * x;
+			int x1 = x0 + 1 < job->src_width ? x0 + 1 : x0;
+			const uint8_t* p[4] = {job->src + 4 * (y0 * job->src_width + x0), job->src + 4 * (y0 * job->src_width + x1), job->src + 4 * (y1 * job->src_width + x0),
+								   job->src + 4 * (y1 * job->src_width + x1)};
+			uint8_t* out = job->dst + 4 * (y * job->dst_width + x);
+
+			for (int c = 0; c < 3; c++)
+			{
+				uint32_t sum = p[0][c] * p[0][c] + p[1][c] * p[1][c] + p[2][c] * p[2][c] + p[3][c] * p[3][c];
+				out[c] = (uint8_t)(sqrtf(sum * 0.25f) + 0.5f);
+			}
+			out[3] = (p[0][3] + p[1][3] + p[2][3] + p[3][3] + 2) / 4;
+		}
+	}
+}
+
+// Allocates an RGBA8 mip chain with the first level copied from pixels and the rest box filtered
+// Large levels are split over the job system
+static uint8_t* texture_generate_mips(const uint8_t* pixels, int width, int height, uint32_t mip_levels)
+{
+	uint8_t* chain = malloc(texture_chain_size(width, height, mip_levels));
+	memcpy(chain, pixels, 4 * (size_t)width * height);
+
+	uint8_t* src = chain;
+	for (uint32_t i = 1; i < mip_levels; i++)
+	{
+		struct MipDownsample job = {src, src + 4 * (size_t)MIP_DIM(width, i - 1) * MIP_DIM(height, i - 1), MIP_DIM(width, i - 1), MIP_DIM(height, i - 1), MIP_DIM(width, i)};
+		job_parallel_for(MIP_DIM(height, i), 64, texture_downsample_rows, &job);
+		src = job.dst;
+	}
+	return chain;
+}
+
+// Builds the mip chain from an RGBA8 base level
+// The levels are compressed if format is block compressed
+static void texture_levels_build(TextureLevels* levels, const uint8_t* pixels, int width, int height, uint32_t mip_levels, VkFormat format)
+{
+	memset(levels, 0, sizeof *levels);
+	levels->format = format;
+	levels->width = width;
+	levels->height = height;
+	levels->mip_levels = mip_levels;
+
+	uint8_t* chain = texture_generate_mips(pixels, width, height, mip_levels);
+
+	size_t total = 0;
+	for (uint32_t i = 0; i < mip_levels; i++)
+		total += texture_level_size(format, MIP_DIM(width, i), MIP_DIM(height, i));
+
+	if (bcn_block_size(format) == 0)
+		levels->data = chain;
+	else
+		levels->data = malloc(total);
+
+	const uint8_t* src = chain;
+	uint8_t* dst = levels->data;
+	for (uint32_t i = 0; i < mip_levels; i++)
+	{
+		int level_width = MIP_DIM(width, i), level_height = MIP_DIM(height, i);
+		levels->level_sizes[i] = texture_level_size(format, level_width, level_height);
+		levels->levels[i] = dst;
+
+		if (dst != src)
+			bcn_compress(format, src, level_width, level_height, dst);
+
+		src += 4 * (size_t)level_width * level_height;
+		dst += levels->level_sizes[i];
+	}
+
+	if (levels->data != chain)
+		free(chain);
+}
+
+static void texture_levels_free(TextureLevels* levels)
+{
+	free(levels->data);
+	levels->data = NULL;
+	ktx_close(&levels->ktx);
+}
+
+// Returns the staging size of the levels from base_level including alignment
+static VkDeviceSize texture_levels_staging_size(const TextureLevels* levels, uint32_t base_level)
+{
+	VkDeviceSize size = 0;
+	for (uint32_t i = base_level; i < levels->mip_levels; i++)
+		size += TEXTURE_STAGING_ALIGN(levels->level_sizes[i]);
+	return size;
+}
+
+// Copies the resident levels into the mapped staging buffer at offset and records the copy to the image
+// The image is transitioned to its layout
+// Returns the offset after the levels
+static VkDeviceSize texture_record_upload(Commandbuffer commandbuffer, Texture_raw* raw, VkBuffer staging_buffer, uint8_t* staging_data, VkDeviceSize offset,
+										  const TextureLevels* levels)
+{
+	VkImageMemoryBarrier barrier = {0};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = raw->vkimage;
+	barrier.subresourceRange = (VkImageSubresourceRange){VK_IMAGE_ASPECT_COLOR_BIT, 0, raw->mip_levels - raw->base_level, 0, 1};
+	barrier.srcAccessMask = 0;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	vkCmdPipelineBarrier(commandbuffer_vk(commandbuffer), VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
+
+	// One region per level, the image starts at the base level
+	VkBufferImageCopy regions[TEXTURE_MAX_MIP_LEVELS] = {0};
+	uint32_t region_count = raw->mip_levels - raw->base_level;
+	for (uint32_t i = 0; i < region_count; i++)
+	{
+		uint32_t level = raw->base_level + i;
+		memcpy(staging_data + offset, levels->levels[level], levels->level_sizes[level]);
+		regions[i].bufferOffset = offset;
+		regions[i].imageSubresource = (VkImageSubresourceLayers){VK_IMAGE_ASPECT_COLOR_BIT, i, 0, 1};
+		regions[i].imageExtent = (VkExtent3D){MIP_DIM(raw->width, level), MIP_DIM(raw->height, level), 1};
+		offset += TEXTURE_STAGING_ALIGN(levels->level_sizes[level]);
+	}
+	vkCmdCopyBufferToImage(commandbuffer_vk(commandbuffer), staging_buffer, raw->vkimage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, region_count, regions);
+
+	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.newLayout = raw->layout;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	vkCmdPipelineBarrier(commandbuffer_vk(commandbuffer), VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
+
+	return offset;
+}
+
+// Uploads the levels of a single texture through a temporary staging buffer
+static void texture_upload_levels(Texture_raw* raw, const TextureLevels* levels)
+{
+	VkBuffer staging_buffer;
+	VkDeviceMemory staging_buffer_memory;
+	VkDeviceSize staging_size = texture_levels_staging_size(levels, raw->base_level);
+
+	buffer_create(staging_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &staging_buffer,
+				  &staging_buffer_memory, NULL, NULL);
+
+	uint8_t* data;
+	vkMapMemory(device, staging_buffer_memory, 0, staging_size, 0, (void**)&data);
+
+	// Copy all levels in one submission
+	Commandbuffer commandbuffer = single_use_commands_begin();
+	texture_record_upload(commandbuffer, raw, staging_buffer, data, 0, levels);
+	single_use_commands_end(commandbuffer);
+
+	vkUnmapMemory(device, staging_buffer_memory);
+	vkDestroyBuffer(device, staging_buffer, NULL);
+	vkFreeMemory(device, staging_buffer_memory, NULL);
+}
+
+// Creates the image and view holding the levels from the base level
+// Does not transition the layout
+static void texture_alloc_image(Texture_raw* raw)
+{
+	uint32_t levels = raw->mip_levels - raw->base_level;
+	raw->size = image_create(MIP_DIM(raw->width, raw->base_level), MIP_DIM(raw->height, raw->base_level), levels, raw->format, VK_IMAGE_TILING_OPTIMAL, raw->usage,
+							 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &raw->vkimage, &raw->memory, raw->samples);
+	raw->view = image_view_create(raw->vkimage, raw->format, raw->aspect, levels);
+	raw->view_version++;
+}
+
+// Returns the coarsest base level of a streamed texture
+// Levels with no side larger than TEXTURE_STREAM_MIN_SIZE are always resident
+static uint32_t texture_stream_resident_level(const TextureLevels* levels)
+{
+	uint32_t level = 0;
+	while (level + 1 < levels->mip_levels && (MIP_DIM(levels->width, level) > TEXTURE_STREAM_MIN_SIZE || MIP_DIM(levels->height, level) > TEXTURE_STREAM_MIN_SIZE))
+		level++;
+	return level;
+}
+
+// Fills in a texture from loaded levels and creates its image
+// If streaming is enabled and the texture has a mip chain, only the coarse levels are allocated
+// and the texture takes ownership of the level data, which is cleared from levels
+// The levels are still valid for upload until the texture is destroyed
+static void texture_init_levels(Texture_raw* raw, TextureLevels* levels)
+{
+	raw->width = levels->width;
+	raw->height = levels->height;
+	raw->format = levels->format;
+	raw->mip_levels = levels->mip_levels;
+	raw->base_level = 0;
+	raw->source = NULL;
+
+	if (texture_stream_enabled() && levels->mip_levels > 1)
+	{
+		raw->source = malloc(sizeof *raw->source);
+		*raw->source = *levels;
+		levels->data = NULL;
+		levels->ktx.mapping = NULL;
+		levels->ktx.mapping_size = 0;
+
+		raw->resident_level = texture_stream_resident_level(raw->source);
+		raw->requested_level = raw->resident_level;
+		raw->base_level = raw->resident_level;
+		raw->last_used = 0;
+	}
+
+	texture_alloc_image(raw);
+}
+
+// Allocates a texture that is filled in when its file has been loaded
+static Texture texture_alloc_file(const char* file)
+{
+	const struct handle_wrapper* wrapper = handlepool_alloc(&texture_pool);
+	Texture_raw* raw = (Texture_raw*)wrapper->data;
+	Texture handle = PUN_HANDLE(wrapper->handle, Texture);
+
+	memset(raw, 0, sizeof *raw);
+	snprintf(raw->name, sizeof raw->name, "%s", file);
+	raw->layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	// The format is decided when the file has been loaded
+	raw->format = VK_FORMAT_R8G8B8A8_SRGB;
+	raw->vkimage = VK_NULL_HANDLE;
+	raw->memory = VK_NULL_HANDLE;
+	raw->view = VK_NULL_HANDLE;
+	raw->samples = VK_SAMPLE_COUNT_1_BIT;
+	raw->aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+	raw->usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	raw->mip_levels = 1;
+	raw->owns_image = true;
+	raw->state = TEXTURE_STATE_PENDING;
+	return handle;
+}
+
+// Decodes a texture file into pixels
+// "col:white" creates a solid white 256*256 texture
+static uint8_t* texture_decode(const char* file, int* width, int* height)
+{
+	if (strcmp(file, "col:white") == 0)
+	{
+		*width = 256;
+		*height = 256;
+		uint8_t* pixels = malloc(4 * *width * *height);
+		memset(pixels, 255, 4 * *width * *height);
+		return pixels;
+	}
+
+	int channels = 0;
+	return stbi_load(file, width, height, &channels, STBI_rgb_alpha);
+}
+
+// Returns why the last stbi decode on the calling thread failed
+static const char* texture_decode_error()
+{
+	const char* reason = stbi_failure_reason();
+	return reason && reason[0] ? reason : "unknown error";
+}
+
+static bool texture_format_supported(VkFormat format)
+{
+	VkFormatProperties properties;
+	vkGetPhysicalDeviceFormatProperties(physical_device, format, &properties);
+	return (properties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) != 0;
+}
+
+// Returns true if a cooked texture in format can be used with the current compression setting
+static bool texture_cooked_usable(VkFormat format)
+{
+	switch (settings_get_texture_compression())
+	{
+	case TEXTURE_COMPRESSION_BC1_BC3:
+		return (format == VK_FORMAT_BC1_RGB_SRGB_BLOCK || format == VK_FORMAT_BC3_SRGB_BLOCK) && texture_format_supported(format);
+	case TEXTURE_COMPRESSION_BC7:
+		return format == VK_FORMAT_BC7_SRGB_BLOCK && texture_format_supported(format);
+	default:
+		return false;
+	}
+}
+
+// Returns the format a decoded texture is cooked to
+// Falls back to RGBA8 if compression is disabled or not supported by the device
+static VkFormat texture_cook_format(const uint8_t* pixels, int width, int height)
+{
+	VkFormat format = VK_FORMAT_R8G8B8A8_SRGB;
+	switch (settings_get_texture_compression())
+	{
+	case TEXTURE_COMPRESSION_BC1_BC3:
+		format = bcn_has_alpha(pixels, width, height) ? VK_FORMAT_BC3_SRGB_BLOCK : VK_FORMAT_BC1_RGB_SRGB_BLOCK;
+		break;
+	case TEXTURE_COMPRESSION_BC7:
+		format = VK_FORMAT_BC7_SRGB_BLOCK;
+		break;
+	default:
+		return format;
+	}
+	return texture_format_supported(format) ? format : VK_FORMAT_R8G8B8A8_SRGB;
+}
+
+// The key of the key/value data of a cooked file holding the stamp of the source it was cooked from
+#define TEXTURE_SOURCE_KEY "MantaSource"
+
+// Writes the path of the cooked file of a texture into result
+// The file name is the name of the source followed by a hash of its path,
+// so different sources never share a cooked file
+static void texture_cooked_path(const char* file, char* result, size_t size)
+{
+	if (strncmp(file, "./", 2) == 0)
+		file += 2;
+
+	// 64 bit FNV-1a over the path, both separators hash the same
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	const char* name = file;
+	for (const char* c = file; *c; c++)
+	{
+		if (*c == '/' || *c == '\\' || *c == ':')
+			name = c + 1;
+		hash ^= (uint8_t)(*c == '\\' ? '/' : *c);
+		hash *= 0x100000001b3ULL;
+	}
+	snprintf(result, size, "%s%.128s_%016llx.ktx2", TEXTURE_CACHE_DIR, name, (unsigned long long)hash);
+}
+
+// Writes the modification time and size of a source file, stored in the files cooked from it
+// Returns -1 if the source doesn't exist
+static int texture_source_stamp(const char* file, char* result, size_t size)
+{
+	uint64_t mtime = 0, file_size = 0;
+	if (file_stamp(file, &mtime, &file_size) != 0)
+		return -1;
+	snprintf(result, size, "%llu %llu", (unsigned long long)mtime, (unsigned long long)file_size);
+	return 0;
+}
+
+// Points the levels into a mapped cooked file
+// Returns false if the file doesn't describe a complete mip chain
+static bool texture_levels_from_ktx(TextureLevels* levels)
+{
+	const KtxFile* ktx = &levels->ktx;
+	if (ktx->mip_levels > TEXTURE_MAX_MIP_LEVELS)
+		return false;
+
+	levels->format = ktx->format;
+	levels->width = ktx->width;
+	levels->height = ktx->height;
+	levels->mip_levels = ktx->mip_levels;
+	for (uint32_t i = 0; i < ktx->mip_levels; i++)
+	{
+		if (ktx->level_sizes[i] != texture_level_size(ktx->format, MIP_DIM(ktx->width, i), MIP_DIM(ktx->height, i)))
+			return false;
+		levels->levels[i] = ktx->levels[i];
+		levels->level_sizes[i] = ktx->level_sizes[i];
+	}
+	return true;
+}
+
+// Decodes a texture file, builds its mip chain and writes the cooked file if compressed
+// Returns -1 if the file could not be decoded and 1 if the levels were built but the cooked file could not be written
+// Writes why into error on failure
+static int texture_levels_cook(const char* file, const char* cooked, TextureLevels* levels, char* error, size_t error_size)
+{
+	// Taken before decoding, so a source changed while cooking is cooked again on the next load
+	char stamp[64];
+	KtxKeyValue source = {TEXTURE_SOURCE_KEY, stamp, 0};
+	if (cooked && texture_source_stamp(file, stamp, sizeof stamp) == 0)
+		source.size = strlen(stamp) + 1;
+
+	int width = 0, height = 0;
+	uint8_t* pixels = texture_decode(file, &width, &height);
+	if (pixels == NULL)
+	{
+		snprintf(error, error_size, "%s", texture_decode_error());
+		return -1;
+	}
+
+	VkFormat format = cooked ? texture_cook_format(pixels, width, height) : VK_FORMAT_R8G8B8A8_SRGB;
+	texture_levels_build(levels, pixels, width, height, texture_mip_count(width, height), format);
+	stbi_image_free(pixels);
+
+	if (cooked && bcn_block_size(format))
+	{
+		if (ktx_write(cooked, format, width, height, levels->mip_levels, levels->levels, levels->level_sizes, &source, source.size ? 1 : 0) != 0)
+		{
+			snprintf(error, error_size, "failed to write %s", cooked);
+			return 1;
+		}
+		LOG_S("Cooked texture %s to %s", file, cooked);
+	}
+	return 0;
+}
+
+// Loads all levels of a texture file
+// Prefers the cooked file if it was cooked from the current version of the source, and cooks the texture otherwise
+// Returns -1 if the file could not be loaded and writes why into error
+// Thread safe
+static int texture_levels_load(const char* file, TextureLevels* levels, char* error, size_t error_size)
+{
+	memset(levels, 0, sizeof *levels);
+
+	// Solid colors are not cooked
+	if (settings_get_texture_compression() == TEXTURE_COMPRESSION_NONE || strncmp(file, "col:", 4) == 0)
+		return texture_levels_cook(file, NULL, levels, error, error_size);
+
+	char cooked[512];
+	texture_cooked_path(file, cooked, sizeof cooked);
+
+	// The modification time and size of the source need to match the ones it was cooked from
+	// The cooked file is used as is if the source is missing
+	char stamp[64];
+	bool has_source = texture_source_stamp(file, stamp, sizeof stamp) == 0;
+	if (ktx_open(cooked, &levels->ktx) == 0)
+	{
+		uint32_t stamp_size = 0;
+		const char* cooked_stamp = ktx_find_value(&levels->ktx, TEXTURE_SOURCE_KEY, &stamp_size);
+		bool current = !has_source || (cooked_stamp && stamp_size == strlen(stamp) + 1 && memcmp(cooked_stamp, stamp, stamp_size) == 0);
+		if (current && texture_cooked_usable(levels->ktx.format) && texture_levels_from_ktx(levels))
+			return 0;
+		ktx_close(&levels->ktx);
+	}
+
+	// Failing to write the cooked file only means the texture is cooked again on the next load
+	return texture_levels_cook(file, cooked, levels, error, error_size) < 0 ? -1 : 0;
+}
+
+int texture_cook(const char* file)
+{
+	char cooked[512];
+	texture_cooked_path(file, cooked, sizeof cooked);
+
+	TextureLevels levels;
+	memset(&levels, 0, sizeof levels);
+	char error[128];
+	int result = texture_levels_cook(file, cooked, &levels, error, sizeof error);
+	// Nothing is written if the texture was not compressed
+	if (result == 0 && bcn_block_size(levels.format) == 0)
+	{
+		snprintf(error, sizeof error, "compression is disabled or not supported by the device");
+		result = -1;
+	}
+
+	texture_levels_free(&levels);
+	if (result != 0)
+	{
+		LOG_E("Failed to cook texture %s - %s", file, error);
+		return -1;
+	}
+	return 0;
+}
+
 // Loads a texture from a file
 // The textures name is the full file path
 Texture texture_load(const char* file)
 {
 	LOG_S("Loading texture %s", file);
 
-	uint8_t* pixels;
-	int width = 0, height = 0, channels = 0;
+	TextureLevels levels;
+	char error[128];
+	if (texture_levels_load(file, &levels, error, sizeof error) != 0)
+	{
+		LOG_E("Failed to load texture %s - %s", file, error);
+		return (Texture){.index = -1, .pattern = -1};
+	}
 
-	// Solid color requested
-	// Create a solid white 256*256 texture
-	if (strcmp(file, "col:white") == 0)
+	Texture tex = texture_alloc_file(file);
+	Texture_raw* raw = handlepool_get_raw(&texture_pool, tex);
+	texture_init_levels(raw, &levels);
+	texture_upload_levels(raw, &levels);
+	raw->state = TEXTURE_STATE_READY;
+
+	texture_levels_free(&levels);
+	return tex;
+}
+
+static void texture_decode_job(void* arg)
+{
+	TextureLoad* load = arg;
+	load->result = texture_levels_load(load->file, &load->levels, load->error, sizeof load->error);
+
+	// Push onto the list of decoded textures
+	TextureLoad* head = __atomic_load_n(&texture_loads_done, __ATOMIC_RELAXED);
+	do
+	{
+		load->next = head;
+	} while (!__atomic_compare_exchange_n(&texture_loads_done, &head, load, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+Texture texture_load_async(const char* file)
+{
+	Texture handle = texture_alloc_file(file);
+
+	TextureLoad* load = malloc(sizeof(TextureLoad));
+	load->tex = handle;
+	snprintf(load->file, sizeof load->file, "%s", file);
+	memset(&load->levels, 0, sizeof load->levels);
+	load->result = -1;
+	load->error[0] = '\0';
+	load->next = NULL;
+
+	job_submit(texture_decode_job, load, &texture_jobs);
+	return handle;
+}
+
+uint32_t texture_upload_pending()
+{
+	TextureLoad* loads = __atomic_exchange_n(&texture_loads_done, NULL, __ATOMIC_ACQUIRE);
+	if (loads == NULL)
+		return 0;
+
+	// Create the images and sum the staging size
+	VkDeviceSize staging_size = 0;
+	uint32_t count = 0;
+	for (TextureLoad* load = loads; load; load = load->next)
 	{
-		width = 256;
-		height = 256;
-		pixels = calloc(4 * width * height, sizeof(*pixels));
-		memset(pixels, 255, 4 * width * height);
+		Texture_raw* raw = handlepool_get_raw(&texture_pool, load->tex);
+		if (load->result != 0)
+		{
+			LOG_E("Failed to load texture %s - %s", load->file, load->error);
+			raw->state = TEXTURE_STATE_FAILED;
+			continue;
+		}
+
+		texture_init_levels(raw, &load->levels);
+		staging_size += texture_levels_staging_size(&load->levels, raw->base_level);
+		count++;
 	}
-	else
+
+	VkBuffer staging_buffer = VK_NULL_HANDLE;
+	VkDeviceMemory staging_buffer_memory = VK_NULL_HANDLE;
+	uint8_t* data = NULL;
+	if (count)
 	{
-		pixels = stbi_load(file, &width, &height, &channels, STBI_rgb_alpha);
+		buffer_create(staging_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &staging_buffer,
+					  &staging_buffer_memory, NULL, NULL);
+		vkMapMemory(device, staging_buffer_memory, 0, staging_size, 0, (void**)&data);
 	}
 
-	if (pixels == NULL)
+	// Record all transitions and copies into one command buffer
+	Commandbuffer commandbuffer = count ? single_use_commands_begin() : INVALID(Commandbuffer);
+	VkDeviceSize offset = 0;
+	for (TextureLoad* load = loads; load; load = load->next)
 	{
-		LOG_E("Failed to load texture %s", file);
-		stbi_image_free(pixels);
-		return (Texture){.index = -1, .pattern = -1};
+		if (load->result != 0)
+			continue;
+
+		Texture_raw* raw = handlepool_get_raw(&texture_pool, load->tex);
+		offset = texture_record_upload(commandbuffer, raw, staging_buffer, data, offset, &load->levels);
+		raw->state = TEXTURE_STATE_READY;
 	}
 
-	// Save the name
-	char name[256];
-	snprintf(name, sizeof name, "%s", file);
-	Texture tex = texture_create(name, width, height, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_SAMPLE_COUNT_1_BIT,
-								 VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_ASPECT_COLOR_BIT);
+	if (count)
+	{
+		single_use_commands_end(commandbuffer);
+		vkUnmapMemory(device, staging_buffer_memory);
+		vkDestroyBuffer(device, staging_buffer, NULL);
+		vkFreeMemory(device, staging_buffer_memory, NULL);
+	}
 
-	texture_update(tex, pixels);
+	// Free the decoded data and unmap the cooked files
+	while (loads)
+	{
+		TextureLoad* next = loads->next;
+		texture_levels_free(&loads->levels);
+		free(loads);
+		loads = next;
+	}
 
-	stbi_image_free(pixels);
-	return tex;
+	LOG_S("Uploaded %d textures", count);
+	return count;
+}
+
+void texture_wait_pending()
+{
+	job_wait(&texture_jobs);
+	texture_upload_pending();
 }
 
+TextureState texture_get_state(Texture tex)
+{
+	Texture_raw* raw = (Texture_raw*)handlepool_get_raw(&texture_pool, PUN_HANDLE(tex, GenericHandle));
+	return raw->state;
+}
+
+static Texture texture_create_levels(const char* name, int width, int height, uint32_t mip_levels, VkFormat format, VkImageUsageFlags usage, VkSampleCountFlagBits samples,
+									 VkImageLayout layout, VkImageAspectFlags imageAspect);
+
 // Creates a texture with no data
 Texture texture_create(const char* name, int width, int height, VkFormat format, VkImageUsageFlags usage, VkSampleCountFlagBits samples, VkImageLayout layout,
 					   VkImageAspectFlags imageAspect)
+{
+	return texture_create_levels(name, width, height, 1, format, usage, samples, layout, imageAspect);
+}
+
+static Texture texture_create_levels(const char* name, int width, int height, uint32_t mip_levels, VkFormat format, VkImageUsageFlags usage, VkSampleCountFlagBits samples,
+									 VkImageLayout layout, VkImageAspectFlags imageAspect)
 {
 	const struct handle_wrapper* wrapper = handlepool_alloc(&texture_pool);
 	Texture_raw* raw = (Texture_raw*)wrapper->data;
@@ -237,16 +972,19 @@ Texture texture_create(const char* name, int width, int height, VkFormat format,
 	raw->samples = samples;
 	raw->aspect = imageAspect;
 	raw->usage = usage;
+	raw->mip_levels = mip_levels;
+	raw->base_level = 0;
+	raw->view_version = 0;
+	raw->source = NULL;
 	raw->owns_image = true;
+	raw->state = TEXTURE_STATE_READY;
 
-	raw->size = image_create(raw->width, raw->height, format, VK_IMAGE_TILING_OPTIMAL, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &raw->vkimage, &raw->memory, samples);
-
-	// Create image view
-	raw->view = image_view_create(raw->vkimage, format, imageAspect);
+	// Create image and view
+	texture_alloc_image(raw);
 
 	// Transition image if format is specified
 	if (layout != VK_IMAGE_LAYOUT_UNDEFINED)
-		transition_image_layout(raw->vkimage, format, VK_IMAGE_LAYOUT_UNDEFINED, layout);
+		transition_image_layout(raw->vkimage, format, VK_IMAGE_LAYOUT_UNDEFINED, layout, mip_levels);
 
 	return handle;
 }
@@ -273,7 +1011,12 @@ Texture texture_create_existing(const char* name, int width, int height, VkForma
 	raw->samples = samples;
 	raw->aspect = imageAspect;
 	raw->usage = 0;
+	raw->mip_levels = 1;
+	raw->base_level = 0;
+	raw->view_version = 0;
+	raw->source = NULL;
 	raw->owns_image = false;
+	raw->state = TEXTURE_STATE_READY;
 
 	// Get image size
 	VkMemoryRequirements memRequirements;
@@ -283,39 +1026,36 @@ Texture texture_create_existing(const char* name, int width, int height, VkForma
 	raw->vkimage = image;
 
 	// Create image view
-	raw->view = image_view_create(raw->vkimage, format, imageAspect);
+	raw->view = image_view_create(raw->vkimage, format, imageAspect, 1);
 
 	return handle;
 }
 
 // Updates the texture data from host memory
 void texture_update(Texture tex, uint8_t* pixeldata)
-{ // Create a staging bufer
-	VkBuffer staging_buffer;
-	VkDeviceMemory staging_buffer_memory;
+{
 	Texture_raw* raw = (Texture_raw*)handlepool_get_raw(&texture_pool, PUN_HANDLE(tex, GenericHandle));
-	VkDeviceSize image_size = raw->size;
 
-	buffer_create(image_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &staging_buffer, &staging_buffer_memory,
-				  NULL, NULL);
-
-	// Transfer image data to host visible staging buffer
-	void* data;
-	vkMapMemory(device, staging_buffer_memory, 0, image_size, 0, &data);
-	memcpy(data, pixeldata, image_size);
-	vkUnmapMemory(device, staging_buffer_memory);
-
-	// Transition image layout
-	transition_image_layout(raw->vkimage, raw->format, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-
-	copy_buffer_to_image(staging_buffer, raw->vkimage, raw->width, raw->height);
+	// pixeldata only contains the base level in RGBA8
+	// Block compressed formats are encoded from it, other formats can't be built from it
+	if (!texture_format_is_rgba8(raw->format) && bcn_block_size(raw->format) == 0)
+	{
+		LOG_E("Texture update only supports RGBA8 and block compressed formats, format %d given", raw->format);
+		return;
+	}
 
-	// Transition image layout
-	transition_image_layout(raw->vkimage, raw->format, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, raw->layout);
+	TextureLevels levels;
+	texture_levels_build(&levels, pixeldata, raw->width, raw->height, raw->mip_levels, raw->format);
+	texture_upload_levels(raw, &levels);
 
-	// Clean up staging buffer
-	vkDestroyBuffer(device, staging_buffer, NULL);
-	vkFreeMemory(device, staging_buffer_memory, NULL);
+	// Streamed textures upload later levels from the new data
+	if (raw->source)
+	{
+		texture_levels_free(raw->source);
+		*raw->source = levels;
+	}
+	else
+		texture_levels_free(&levels);
 }
 
 void texture_resize(Texture tex, int width, int height)
@@ -333,15 +1073,22 @@ void texture_resize(Texture tex, int width, int height)
 	// Create anew
 	raw->width = width;
 	raw->height = height;
+	if (raw->mip_levels > 1)
+		raw->mip_levels = texture_mip_count(width, height);
+	if (raw->base_level >= raw->mip_levels)
+		raw->base_level = raw->mip_levels - 1;
 	if (raw->owns_image)
-		raw->size = image_create(raw->width, raw->height, raw->format, VK_IMAGE_TILING_OPTIMAL, raw->usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &raw->vkimage, &raw->memory, raw->samples);
-
-	// Create image view
-	raw->view = image_view_create(raw->vkimage, raw->format, raw->aspect);
+		texture_alloc_image(raw);
+	else
+	{
+		// Create image view
+		raw->view = image_view_create(raw->vkimage, raw->format, raw->aspect, raw->mip_levels);
+		raw->view_version++;
+	}
 
 	// Transition image if format is specified
 	if (raw->layout != VK_IMAGE_LAYOUT_UNDEFINED)
-		transition_image_layout(raw->vkimage, raw->format, VK_IMAGE_LAYOUT_UNDEFINED, raw->layout);
+		transition_image_layout(raw->vkimage, raw->format, VK_IMAGE_LAYOUT_UNDEFINED, raw->layout, raw->mip_levels - raw->base_level);
 }
 
 void texture_supply_image(Texture tex, VkImage image)
@@ -374,21 +1121,114 @@ Texture texture_get(const char* name)
 	return texture_load(name);
 }
 
+Texture texture_find_file(const char* path)
+{
+	for (uint32_t i = 0; i < texture_pool.size; i++)
+	{
+		if (HANDLEPOOL_INDEX((&texture_pool), i)->next != NULL)
+			continue;
+
+		Texture_raw* raw = (Texture_raw*)HANDLEPOOL_INDEX((&texture_pool), i)->data;
+		if (path_equal(path, raw->name))
+		{
+			return PUN_HANDLE(HANDLEPOOL_INDEX((&texture_pool), i)->handle, Texture);
+		}
+	}
+	return INVALID(Texture);
+}
+
+int texture_reload(Texture tex)
+{
+	Texture_raw* raw = handlepool_get_raw(&texture_pool, tex);
+	if (raw->state == TEXTURE_STATE_PENDING)
+	{
+		texture_wait_pending();
+		raw = handlepool_get_raw(&texture_pool, tex);
+	}
+
+	if (raw->owns_image == false || (raw->format != VK_FORMAT_R8G8B8A8_SRGB && bcn_block_size(raw->format) == 0))
+	{
+		LOG_W("Texture %s was not loaded from a file and cannot be reloaded", raw->name);
+		return -1;
+	}
+
+	// Recooks the texture as the source is newer
+	TextureLevels levels;
+	char error[128];
+	if (texture_levels_load(raw->name, &levels, error, sizeof error) != 0)
+	{
+		LOG_E("Failed to reload texture %s - %s", raw->name, error);
+		return -1;
+	}
+
+	LOG_S("Reloading texture %s", raw->name);
+
+	// The image may be in use by frames in flight
+	vkDeviceWaitIdle(device);
+
+	int recreated = 0;
+	if (raw->state == TEXTURE_STATE_FAILED || levels.width != raw->width || levels.height != raw->height || levels.format != raw->format ||
+		levels.mip_levels != raw->mip_levels)
+	{
+		// A failed texture has null handles which are safe to destroy
+		raw->format = levels.format;
+		raw->mip_levels = levels.mip_levels;
+		// Streamed textures start over from the always resident levels
+		if (raw->source)
+			raw->base_level = texture_stream_resident_level(&levels);
+		texture_resize(tex, levels.width, levels.height);
+		raw->state = TEXTURE_STATE_READY;
+		recreated = 1;
+	}
+
+	texture_upload_levels(raw, &levels);
+
+	// Streamed textures keep the new levels
+	if (raw->source)
+	{
+		texture_levels_free(raw->source);
+		*raw->source = levels;
+		raw->resident_level = texture_stream_resident_level(raw->source);
+		if (raw->requested_level > raw->resident_level)
+			raw->requested_level = raw->resident_level;
+	}
+	else
+		texture_levels_free(&levels);
+	return recreated;
+}
+
 void texture_destroy(Texture tex)
 {
 	Texture_raw* raw = handlepool_get_raw(&texture_pool, tex);
 
+	// The worker still references the handle
+	if (raw->state == TEXTURE_STATE_PENDING)
+	{
+		texture_wait_pending();
+		raw = handlepool_get_raw(&texture_pool, tex);
+	}
+
 	if (raw->owns_image)
 	{
 		vkDestroyImage(device, raw->vkimage, NULL);
 		vkFreeMemory(device, raw->memory, NULL);
 	}
 	vkDestroyImageView(device, raw->view, NULL);
+
+	if (raw->source)
+	{
+		texture_levels_free(raw->source);
+		free(raw->source);
+	}
 	handlepool_free(&texture_pool, tex);
 }
 
+static void texture_stream_release(bool all);
+
 void texture_destroy_all()
 {
+	texture_stream_release(true);
+
 	for (uint32_t i = 0; i < texture_pool.size; i++)
 	{
 		if (HANDLEPOOL_INDEX((&texture_pool), i)->next != NULL)
@@ -400,5 +1240,270 @@ void texture_destroy_all()
 
 void* texture_get_image_view(Texture tex)
 {
-	return ((Texture_raw*)handlepool_get_raw(&texture_pool, tex))->view;
-}
\ No newline at end of file
+	Texture_raw* raw = handlepool_get_raw(&texture_pool, tex);
+	if (raw->state == TEXTURE_STATE_PENDING)
+	{
+		texture_wait_pending();
+		raw = handlepool_get_raw(&texture_pool, tex);
+	}
+	return raw->view;
+}
+uint32_t texture_get_view_version(Texture tex)
+{
+	Texture_raw* raw = handlepool_get_raw(&texture_pool, tex);
+	return raw->view_version;
+}
+
+// The number of frames after which a replaced image can no longer be referenced by a frame in flight
+// Each swapchain image rewrites its descriptors when it is next rendered, and then needs to finish
+#define TEXTURE_STREAM_RETIRE_FRAMES 8
+
+// An image replaced by streaming waiting for the frames in flight to finish
+struct RetiredImage
+{
+	VkImage image;
+	VkDeviceMemory memory;
+	VkImageView view;
+	uint64_t frame;
+};
+
+static struct RetiredImage retired_images[TEXTURE_STREAM_MAX_UPDATES * (TEXTURE_STREAM_RETIRE_FRAMES + 1)];
+static uint32_t retired_count = 0;
+
+// Incremented every texture_stream_update
+static uint64_t stream_frame = 1;
+static TextureStreamStats stream_stats = {0};
+
+// A texture changing its base level
+struct StreamChange
+{
+	Texture tex;
+	uint32_t level;
+	// The gap for upgrades and last use for evictions
+	uint64_t priority;
+};
+
+bool texture_stream_enabled()
+{
+	return settings_get_texture_budget() > 0;
+}
+
+void texture_stream_request(Texture tex, float size)
+{
+	Texture_raw* raw = handlepool_get_raw(&texture_pool, tex);
+	if (raw->source == NULL)
+		return;
+
+	// First request this frame
+	if (raw->last_used != stream_frame)
+	{
+		raw->requested_level = raw->resident_level;
+		raw->last_used = stream_frame;
+	}
+
+	// The coarsest level still covering size texels
+	int dim = raw->width > raw->height ? raw->width : raw->height;
+	uint32_t level = 0;
+	while (level < raw->requested_level && (dim >> (level + 1)) >= size)
+		level++;
+	raw->requested_level = level;
+}
+
+// Destroys retired images older than TEXTURE_STREAM_RETIRE_FRAMES
+// If all is true, all retired images are destroyed
+static void texture_stream_release(bool all)
+{
+	uint32_t kept = 0;
+	for (uint32_t i = 0; i < retired_count; i++)
+	{
+		struct RetiredImage* retired = &retired_images[i];
+		if (all || retired->frame + TEXTURE_STREAM_RETIRE_FRAMES <= stream_frame)
+		{
+			vkDestroyImageView(device, retired->view, NULL);
+			vkDestroyImage(device, retired->image, NULL);
+			vkFreeMemory(device, retired->memory, NULL);
+		}
+		else
+			retired_images[kept++] = *retired;
+	}
+	retired_count = kept;
+}
+
+static void texture_stream_retire(Texture_raw* raw)
+{
+	if (retired_count == LENOF(retired_images))
+	{
+		LOG_W("Too many retired texture images, waiting for device");
+		vkDeviceWaitIdle(device);
+		texture_stream_release(true);
+	}
+	retired_images[retired_count++] = (struct RetiredImage){raw->vkimage, raw->memory, raw->view, stream_frame};
+}
+
+// Returns the size of the levels from level to base_level
+static VkDeviceSize texture_stream_size(const Texture_raw* raw, uint32_t level, uint32_t base_level)
+{
+	VkDeviceSize size = 0;
+	for (uint32_t i = level; i < base_level; i++)
+		size += raw->source->level_sizes[i];
+	return size;
+}
+
+// Sorts upgrades by the largest gap first
+static int texture_stream_comp_upgrade(const void* a, const void* b)
+{
+	const struct StreamChange* c1 = a;
+	const struct StreamChange* c2 = b;
+	return (c1->priority < c2->priority) - (c1->priority > c2->priority);
+}
+
+// Sorts evictions by the least recently used first
+static int texture_stream_comp_eviction(const void* a, const void* b)
+{
+	const struct StreamChange* c1 = a;
+	const struct StreamChange* c2 = b;
+	return (c1->priority > c2->priority) - (c1->priority < c2->priority);
+}
+
+// Recreates the images of the changed textures at their new base level in a single upload
+static void texture_stream_apply(struct StreamChange* changes, uint32_t count)
+{
+	VkDeviceSize staging_size = 0;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		Texture_raw* raw = handlepool_get_raw(&texture_pool, changes[i].tex);
+		staging_size += texture_levels_staging_size(raw->source, changes[i].level);
+	}
+
+	VkBuffer staging_buffer;
+	VkDeviceMemory staging_buffer_memory;
+	buffer_create(staging_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &staging_buffer,
+				  &staging_buffer_memory, NULL, NULL);
+
+	uint8_t* data;
+	vkMapMemory(device, staging_buffer_memory, 0, staging_size, 0, (void**)&data);
+
+	Commandbuffer commandbuffer = single_use_commands_begin();
+	VkDeviceSize offset = 0;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		Texture_raw* raw = handlepool_get_raw(&texture_pool, changes[i].tex);
+		if (changes[i].level < raw->base_level)
+			stream_stats.loads++;
+		else
+			stream_stats.evictions++;
+
+		// The descriptors of frames in flight still reference the old image
+		texture_stream_retire(raw);
+		raw->base_level = changes[i].level;
+		texture_alloc_image(raw);
+		offset = texture_record_upload(commandbuffer, raw, staging_buffer, data, offset, raw->source);
+	}
+	single_use_commands_end(commandbuffer);
+	stream_stats.uploaded_bytes += staging_size;
+
+	vkUnmapMemory(device, staging_buffer_memory);
+	vkDestroyBuffer(device, staging_buffer, NULL);
+	vkFreeMemory(device, staging_buffer_memory, NULL);
+}
+
+void texture_stream_update()
+{
+	texture_stream_release(false);
+
+	VkDeviceSize budget = (VkDeviceSize)settings_get_texture_budget() * 1024 * 1024;
+	stream_stats.budget = budget;
+	stream_stats.resident_bytes = 0;
+	stream_stats.requested_bytes = 0;
+	stream_stats.texture_count = 0;
+	stream_stats.starved_count = 0;
+
+	struct StreamChange* upgrades = malloc(texture_pool.size * sizeof *upgrades);
+	struct StreamChange* evictions = malloc(texture_pool.size * sizeof *evictions);
+	uint32_t upgrade_count = 0, eviction_count = 0;
+
+	for (uint32_t i = 0; i < texture_pool.size; i++)
+	{
+		if (HANDLEPOOL_INDEX((&texture_pool), i)->next != NULL)
+			continue;
+
+		Texture_raw* raw = (Texture_raw*)HANDLEPOOL_INDEX((&texture_pool), i)->data;
+		if (raw->source == NULL || raw->state != TEXTURE_STATE_READY)
+			continue;
+
+		Texture tex = PUN_HANDLE(HANDLEPOOL_INDEX((&texture_pool), i)->handle, Texture);
+		bool used = raw->last_used == stream_frame;
+		uint32_t wanted = used ? raw->requested_level : raw->base_level;
+
+		stream_stats.texture_count++;
+		stream_stats.resident_bytes += texture_stream_size(raw, raw->base_level, raw->mip_levels);
+		stream_stats.requested_bytes += texture_stream_size(raw, wanted, raw->mip_levels);
+
+		if (wanted < raw->base_level)
+			upgrades[upgrade_count++] = (struct StreamChange){tex, wanted, raw->base_level - wanted};
+
+		// Unused textures can drop to the resident levels, used ones to what they requested
+		uint32_t target = used ? raw->requested_level : raw->resident_level;
+		if (target > raw->base_level)
+			evictions[eviction_count++] = (struct StreamChange){tex, target, raw->last_used};
+	}
+
+	qsort(upgrades, upgrade_count, sizeof *upgrades, texture_stream_comp_upgrade);
+	qsort(evictions, eviction_count, sizeof *evictions, texture_stream_comp_eviction);
+
+	struct StreamChange changes[TEXTURE_STREAM_MAX_UPDATES];
+	uint32_t change_count = 0;
+	uint32_t evicted = 0;
+	VkDeviceSize resident = stream_stats.resident_bytes;
+
+	for (uint32_t i = 0; i < upgrade_count; i++)
+	{
+		Texture_raw* raw = handlepool_get_raw(&texture_pool, upgrades[i].tex);
+		uint32_t applied = raw->base_level;
+
+		// Settle for a coarser level if the requested one doesn't fit even after evicting
+		for (uint32_t level = upgrades[i].level; level < raw->base_level && change_count < TEXTURE_STREAM_MAX_UPDATES; level++)
+		{
+			VkDeviceSize size = texture_stream_size(raw, level, raw->base_level);
+			while (resident + size > budget && evicted < eviction_count && change_count + 1 < TEXTURE_STREAM_MAX_UPDATES)
+			{
+				Texture_raw* victim = handlepool_get_raw(&texture_pool, evictions[evicted].tex);
+				resident -= texture_stream_size(victim, victim->base_level, evictions[evicted].level);
+				changes[change_count++] = evictions[evicted++];
+			}
+
+			if (resident + size <= budget)
+			{
+				resident += size;
+				changes[change_count++] = (struct StreamChange){upgrades[i].tex, level, 0};
+				applied = level;
+				break;
+			}
+		}
+
+		if (applied != upgrades[i].level)
+			stream_stats.starved_count++;
+	}
+
+	// Stay within budget if it was lowered
+	while (resident > budget && evicted < eviction_count && change_count < TEXTURE_STREAM_MAX_UPDATES)
+	{
+		Texture_raw* victim = handlepool_get_raw(&texture_pool, evictions[evicted].tex);
+		resident -= texture_stream_size(victim, victim->base_level, evictions[evicted].level);
+		changes[change_count++] = evictions[evicted++];
+	}
+
+	free(upgrades);
+	free(evictions);
+
+	if (change_count)
+		texture_stream_apply(changes, change_count);
+
+	stream_stats.resident_bytes = resident;
+	stream_frame++;
+}
+
+void texture_stream_get_stats(TextureStreamStats* stats)
+{
+	*stats = stream_stats;
+}
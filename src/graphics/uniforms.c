@@ -10,29 +10,59 @@
 #include "defines.h"
 #include <assert.h>
 
-// The different flavors of descriptor pools
-// If pool is VK_NULL_HANDLE, it is a hole from a destroyed pool
-struct DescriptorPool
+// Descriptor sets are allocated per size class, one class for each distinct set of bindings
+// A class owns its own layout, which is compatible with every layout created from the same bindings
+// and outlives them, so freed sets can be reused by any pack with the same bindings
+// Freed sets are recycled after DESCRIPTOR_RETIRE_FRAMES when no frame in flight can use them
+struct DescriptorClass
 {
-	// How many uniform type descriptors are left in the pool
+	VkDescriptorSetLayoutBinding bindings[DESCRIPTOR_CLASS_MAX_BINDINGS];
+	uint32_t binding_count;
+	uint32_t hash;
+	VkDescriptorSetLayout layout;
+
+	// Descriptors of each type in one set
 	uint32_t uniform_count;
-	// How many sampler type descriptors are left in the pool
+	uint32_t storage_count;
 	uint32_t sampler_count;
-	// Describes how many descriptors currently use the pool
-	uint32_t alloc_count;
-	VkDescriptorPool vkpool;
+
+	// All pools of the class, the last one is allocated from
+	VkDescriptorPool* pools;
+	uint32_t pool_count;
+	// The number of sets the last pool was created with and how many are left in it
+	uint32_t pool_capacity;
+	uint32_t pool_remaining;
+
+	// Sets ready for reuse
+	VkDescriptorSet* free_sets;
+	uint32_t free_count;
+	uint32_t free_size;
+};
+
+// A freed set waiting for the frames in flight to finish
+struct RetiredSet
+{
+	VkDescriptorSet set;
+	uint32_t class_index;
+	uint64_t frame;
 };
 
-struct DescriptorPool* descriptor_pools = NULL;
-// How many active pools there are
-uint32_t descriptor_pool_count = 0;
-// How large the list of pools is, including holes
-uint32_t descriptor_pool_size = 0;
+static struct DescriptorClass* descriptor_classes = NULL;
+static uint32_t descriptor_class_count = 0;
+
+// Ordered by the frame they were freed
+static struct RetiredSet* retired_sets = NULL;
+static uint32_t retired_count = 0;
+static uint32_t retired_size = 0;
+static uint64_t descriptor_frame = 0;
 
 static BufferPool ub_pool[RENDERER_MAX_THREADS] = {0};
+static BufferPool sb_pool[RENDERER_MAX_THREADS] = {0};
 
 struct UniformBuffer
 {
+	// The pool of uniform or storage buffers the frames are allocated from
+	BufferPool* pool;
 	// The size of one frame of the command buffer
 	uint32_t size;
 	uint32_t offsets[3];
@@ -41,114 +71,211 @@ struct UniformBuffer
 	uint8_t thread_idx;
 };
 
-// Attempts to find and return a descriptor pool with a minimum of the supplied descriptor types remaining
-// If no qualifying pool was found, a new one is created
-// Returns the index of the pool
-// Does not return the pointer since it is liable to change with realloc when new pools are added
-uint32_t descriptorpool_get(uint32_t uniform_count, uint32_t sampler_count)
+static uint32_t descriptorclass_hash(const VkDescriptorSetLayoutBinding* bindings, uint32_t binding_count)
 {
-	for (uint32_t i = 0; i < descriptor_pool_size; i++)
+	// FNV-1a over the fields affecting compatibility
+	uint32_t hash = 2166136261u;
+	for (uint32_t i = 0; i < binding_count; i++)
 	{
-		// Hole from destroyed pool
-		if (descriptor_pools[i].vkpool == VK_NULL_HANDLE)
-			continue;
-		// Qualifying pool
-		if (descriptor_pools[i].uniform_count >= uniform_count && descriptor_pools[i].sampler_count >= sampler_count)
-		{
-			// Remove the requested amount of descriptors from the pool
-			descriptor_pools[i].uniform_count -= uniform_count;
-			descriptor_pools[i].sampler_count -= sampler_count;
-			++descriptor_pools[i].alloc_count;
+		uint32_t fields[4] = {bindings[i].binding, bindings[i].descriptorType, bindings[i].descriptorCount, bindings[i].stageFlags};
+		for (uint32_t j = 0; j < LENOF(fields); j++)
+			hash = (hash ^ fields[j]) * 16777619u;
+	}
+	return hash;
+}
+
+static bool descriptorclass_match(const struct DescriptorClass* class, const VkDescriptorSetLayoutBinding* bindings, uint32_t binding_count, uint32_t hash)
+{
+	if (class->hash != hash || class->binding_count != binding_count)
+		return false;
+
+	for (uint32_t i = 0; i < binding_count; i++)
+	{
+		const VkDescriptorSetLayoutBinding* a = &class->bindings[i];
+		const VkDescriptorSetLayoutBinding* b = &bindings[i];
+		if (a->binding != b->binding || a->descriptorType != b->descriptorType || a->descriptorCount != b->descriptorCount || a->stageFlags != b->stageFlags)
+			return false;
+	}
+	return true;
+}
 
+// Returns the index of the class for the bindings, creating it if it doesn't exist
+// Returns -1 on failure
+static uint32_t descriptorclass_get(const VkDescriptorSetLayoutBinding* bindings, uint32_t binding_count)
+{
+	uint32_t hash = descriptorclass_hash(bindings, binding_count);
+	for (uint32_t i = 0; i < descriptor_class_count; i++)
+	{
+		if (descriptorclass_match(&descriptor_classes[i], bindings, binding_count, hash))
 			return i;
-		}
 	}
 
-	// No pool was found
-	// Allocate a new one
-	DescriptorPool* new_pool = NULL;
-	uint32_t index = 0;
-	// Search for a free hole in the list
-	for (uint32_t i = 0; i < descriptor_pool_size; i++)
+	if (binding_count > DESCRIPTOR_CLASS_MAX_BINDINGS)
+	{
+		LOG_E("Descriptor sets with %d bindings exceed the maximum of %d", binding_count, DESCRIPTOR_CLASS_MAX_BINDINGS);
+		return (uint32_t)-1;
+	}
+
+	struct DescriptorClass class = {0};
+	memcpy(class.bindings, bindings, binding_count * sizeof *bindings);
+	class.binding_count = binding_count;
+	class.hash = hash;
+
+	for (uint32_t i = 0; i < binding_count; i++)
 	{
-		// Reuse space
-		if (descriptor_pools[i].vkpool == VK_NULL_HANDLE)
+		if (bindings[i].pImmutableSamplers)
+		{
+			LOG_E("Descriptor set creation: Immutable samplers are not supported");
+			return (uint32_t)-1;
+		}
+
+		if (bindings[i].descriptorType == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER)
+		{
+			class.uniform_count += bindings[i].descriptorCount;
+		}
+		else if (bindings[i].descriptorType == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
 		{
-			LOG("Reusing free slot for descriptor pool");
-			new_pool = &descriptor_pools[i];
-			index = i;
+			class.storage_count += bindings[i].descriptorCount;
+		}
+		else if (bindings[i].descriptorType == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER)
+		{
+			class.sampler_count += bindings[i].descriptorCount;
+		}
+		else
+		{
+			LOG_W("Descriptor set creation: Unsupported descriptor type");
 		}
 	}
 
-	// No free space was found
-	if (new_pool == NULL)
+	if (descriptorlayout_create(class.bindings, binding_count, &class.layout) != 0)
+		return (uint32_t)-1;
+
+	descriptor_classes = realloc(descriptor_classes, (descriptor_class_count + 1) * sizeof *descriptor_classes);
+	descriptor_classes[descriptor_class_count] = class;
+	return descriptor_class_count++;
+}
+
+// Creates the next pool of a class, twice as large as the previous one
+static int descriptorclass_grow(struct DescriptorClass* class)
+{
+	uint32_t capacity = class->pool_capacity ? class->pool_capacity * 2 : DESCRIPTOR_POOL_MIN_SETS;
+	if (capacity > DESCRIPTOR_POOL_MAX_SETS)
+		capacity = DESCRIPTOR_POOL_MAX_SETS;
+
+	VkDescriptorPoolSize pool_sizes[3] = {0};
+	uint32_t pool_size_count = 0;
+	if (class->uniform_count)
+		pool_sizes[pool_size_count++] = (VkDescriptorPoolSize){VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, class->uniform_count * capacity};
+	if (class->storage_count)
+		pool_sizes[pool_size_count++] = (VkDescriptorPoolSize){VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, class->storage_count * capacity};
+	if (class->sampler_count)
+		pool_sizes[pool_size_count++] = (VkDescriptorPoolSize){VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, class->sampler_count * capacity};
+	// Pools need at least one size even if the sets are empty
+	if (pool_size_count == 0)
+		pool_sizes[pool_size_count++] = (VkDescriptorPoolSize){VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1};
+
+	VkDescriptorPoolCreateInfo pool_info = {0};
+	pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	pool_info.poolSizeCount = pool_size_count;
+	pool_info.pPoolSizes = pool_sizes;
+	pool_info.maxSets = capacity;
+	// Sets are never freed individually, they are recycled within the class
+	pool_info.flags = 0;
+
+	VkDescriptorPool pool;
+	VkResult result = vkCreateDescriptorPool(device, &pool_info, NULL, &pool);
+	if (result != VK_SUCCESS)
 	{
-		++descriptor_pool_count;
-		++descriptor_pool_size;
-		descriptor_pools = realloc(descriptor_pools, descriptor_pool_size * sizeof(struct DescriptorPool));
-		index = descriptor_pool_size - 1;
-		new_pool = &descriptor_pools[index];
+		LOG_E("Failed to create descriptor pool - code %d", result);
+		return -1;
 	}
 
-	// Allocate a larger block of memory than the minimum to make room for more similar allocations and reduce memory
-	// allocations
-	new_pool->uniform_count = uniform_count * 256;
-	new_pool->sampler_count = sampler_count * 256;
-	// Make one allocation for the pool before returning
-	new_pool->alloc_count = 0;
+	LOG_S("Creating descriptor pool for %d sets with %d uniform, %d storage and %d sampler descriptors each", capacity, class->uniform_count, class->storage_count,
+		  class->sampler_count);
 
-	LOG_S("Creating new descriptor pool with capacity for %d uniform types and %d sampler types", new_pool->uniform_count, new_pool->sampler_count);
+	class->pools = realloc(class->pools, (class->pool_count + 1) * sizeof *class->pools);
+	class->pools[class->pool_count++] = pool;
+	class->pool_capacity = capacity;
+	class->pool_remaining = capacity;
+	return 0;
+}
 
-	VkDescriptorPoolSize poolSizes[2] = {0};
-	poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	poolSizes[0].descriptorCount = new_pool->uniform_count;
-	poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	poolSizes[1].descriptorCount = new_pool->sampler_count;
+// Allocates a set from the class, reusing a recycled one if available
+static VkDescriptorSet descriptorclass_alloc(struct DescriptorClass* class)
+{
+	if (class->free_count)
+		return class->free_sets[--class->free_count];
 
-	VkDescriptorPoolCreateInfo poolInfo = {0};
-	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-	poolInfo.poolSizeCount = uniform_count && sampler_count ? 2 : 1;
-	poolInfo.pPoolSizes = uniform_count ? poolSizes : sampler_count ? &poolSizes[1] : NULL;
+	if (class->pool_remaining == 0 && descriptorclass_grow(class) != 0)
+		return VK_NULL_HANDLE;
 
-	poolInfo.maxSets = new_pool->uniform_count + new_pool->sampler_count;
-	poolInfo.flags = 0; //VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
+	VkDescriptorSetAllocateInfo alloc_info = {0};
+	alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	alloc_info.descriptorPool = class->pools[class->pool_count - 1];
+	alloc_info.descriptorSetCount = 1;
+	alloc_info.pSetLayouts = &class->layout;
 
-	VkResult result = vkCreateDescriptorPool(device, &poolInfo, NULL, &new_pool->vkpool);
+	VkDescriptorSet set;
+	VkResult result = vkAllocateDescriptorSets(device, &alloc_info, &set);
 	if (result != VK_SUCCESS)
 	{
-		LOG_E("Failed to create descriptor pool - code %d", result);
-		return (uint32_t)-1;
+		LOG_E("Failed to allocate descriptor set - code %d", result);
+		return VK_NULL_HANDLE;
 	}
+	class->pool_remaining--;
+	return set;
+}
 
-	// 'allocate'
-	new_pool->uniform_count -= uniform_count;
-	new_pool->sampler_count -= sampler_count;
-	new_pool->alloc_count = 1;
-	return index;
+static void descriptorclass_recycle(struct DescriptorClass* class, VkDescriptorSet set)
+{
+	if (class->free_count == class->free_size)
+	{
+		class->free_size = class->free_size ? class->free_size * 2 : DESCRIPTOR_POOL_MIN_SETS;
+		class->free_sets = realloc(class->free_sets, class->free_size * sizeof *class->free_sets);
+	}
+	class->free_sets[class->free_count++] = set;
 }
 
-void descriptorpool_destroy(DescriptorPool* pool)
+void descriptorpool_update()
 {
-	vkDeviceWaitIdle(device);
-	LOG_S("Destroying descriptor pool");
+	descriptor_frame++;
 
-	if (pool->vkpool == VK_NULL_HANDLE)
+	// Retired sets are ordered by frame
+	uint32_t recycled = 0;
+	while (recycled < retired_count && retired_sets[recycled].frame + DESCRIPTOR_RETIRE_FRAMES <= descriptor_frame)
 	{
-		LOG_E("Attempting to destroy already destroyed pool");
-		return;
+		descriptorclass_recycle(&descriptor_classes[retired_sets[recycled].class_index], retired_sets[recycled].set);
+		recycled++;
 	}
 
-	vkDestroyDescriptorPool(device, pool->vkpool, NULL);
-	--descriptor_pool_count;
-	pool->vkpool = VK_NULL_HANDLE;
+	if (recycled)
+	{
+		memmove(retired_sets, retired_sets + recycled, (retired_count - recycled) * sizeof *retired_sets);
+		retired_count -= recycled;
+	}
+}
 
-	// Last pool is being destroyed
-	if (descriptor_pool_count == 0)
+void descriptorpool_destroy_all()
+{
+	for (uint32_t i = 0; i < descriptor_class_count; i++)
 	{
-		free(descriptor_pools);
-		descriptor_pools = NULL;
-		descriptor_pool_size = 0;
+		struct DescriptorClass* class = &descriptor_classes[i];
+		// Destroying the pools frees all their sets
+		for (uint32_t j = 0; j < class->pool_count; j++)
+			vkDestroyDescriptorPool(device, class->pools[j], NULL);
+		vkDestroyDescriptorSetLayout(device, class->layout, NULL);
+		free(class->pools);
+		free(class->free_sets);
 	}
+
+	free(descriptor_classes);
+	descriptor_classes = NULL;
+	descriptor_class_count = 0;
+
+	free(retired_sets);
+	retired_sets = NULL;
+	retired_count = 0;
+	retired_size = 0;
 }
 
 int descriptorlayout_create(VkDescriptorSetLayoutBinding* bindings, uint32_t binding_count, VkDescriptorSetLayout* dst_layout)
@@ -167,63 +294,45 @@ int descriptorlayout_create(VkDescriptorSetLayoutBinding* bindings, uint32_t bin
 	return 0;
 }
 
-DescriptorPack* descriptorpack_create(VkDescriptorSetLayout layout, VkDescriptorSetLayoutBinding* bindings, uint32_t binding_count)
+VkDescriptorSetLayout descriptorlayout_get(VkDescriptorSetLayoutBinding* bindings, uint32_t binding_count)
 {
-	// Fill the layouts for all swapchain image count
-	VkDescriptorSetLayout* layouts = malloc(swapchain_image_count * sizeof(VkDescriptorSetLayout));
-	for (size_t i = 0; i < swapchain_image_count; i++)
-		layouts[i] = layout;
-
-	// Find out how many of each type of descriptor type is required
-	uint32_t uniform_count = 0;
-	uint32_t sampler_count = 0;
+	uint32_t class_index = descriptorclass_get(bindings, binding_count);
+	if (class_index == (uint32_t)-1)
+		return VK_NULL_HANDLE;
+	return descriptor_classes[class_index].layout;
+}
 
-	for (uint32_t i = 0; i < binding_count; i++)
+DescriptorPack* descriptorpack_create(VkDescriptorSetLayout layout, VkDescriptorSetLayoutBinding* bindings, uint32_t binding_count)
+{
+	// The sets are allocated with the layout of the class, which is compatible with layout
+	(void)layout;
+	uint32_t class_index = descriptorclass_get(bindings, binding_count);
+	if (class_index == (uint32_t)-1)
 	{
-		if (bindings[i].descriptorType == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER)
-		{
-			uniform_count += bindings[i].descriptorCount;
-		}
-		else if (bindings[i].descriptorType == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER)
-		{
-			sampler_count += bindings[i].descriptorCount;
-		}
-		else
-		{
-			LOG_W("Descriptor set creation: Unsupported descriptor type");
-		}
+		LOG_E("Failed to get descriptor pool");
+		return NULL;
 	}
 
-	// Request uniform and sampler types for each frame in flight
-	uniform_count *= swapchain_image_count;
-	sampler_count *= swapchain_image_count;
-
-	VkDescriptorSetAllocateInfo allocInfo = {0};
-
 	DescriptorPack* pack = malloc(sizeof(DescriptorPack));
+	pack->class_index = class_index;
+	pack->count = swapchain_image_count;
 
-	pack->pool_index = descriptorpool_get(uniform_count, sampler_count);
-	if (pack->pool_index == (uint32_t)-1)
+	for (uint32_t i = 0; i < pack->count; i++)
 	{
-		LOG_E("Failed to get descriptor pool");
-		return NULL;
+		pack->sets[i] = descriptorclass_alloc(&descriptor_classes[class_index]);
+		if (pack->sets[i] == VK_NULL_HANDLE)
+		{
+			pack->count = i;
+			descriptorpack_destroy(pack);
+			return NULL;
+		}
 	}
-	pack->uniform_count = uniform_count;
-	pack->sampler_count = sampler_count;
-	pack->count = swapchain_image_count;
-
-	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-	allocInfo.descriptorPool = descriptor_pools[pack->pool_index].vkpool;
-	allocInfo.descriptorSetCount = pack->count;
-	allocInfo.pSetLayouts = layouts;
-	allocInfo.pNext = 0;
-
-	vkAllocateDescriptorSets(device, &allocInfo, pack->sets);
-	free(layouts);
 	return pack;
 }
 
-void descriptorpack_write(DescriptorPack* pack, VkDescriptorSetLayoutBinding* bindings, uint32_t binding_count, UniformBuffer** uniformbuffers, Texture* textures, Sampler* samplers)
+// Writes the descriptor sets of frames [first, end)
+static void descriptorpack_write_frames(DescriptorPack* pack, VkDescriptorSetLayoutBinding* bindings, uint32_t binding_count, UniformBuffer** uniformbuffers, Texture* textures,
+										Sampler* samplers, uint32_t first, uint32_t end)
 {
 	// vkDeviceWaitIdle(device);
 	// Find out how many of each type of descriptor type is required
@@ -232,7 +341,8 @@ void descriptorpack_write(DescriptorPack* pack, VkDescriptorSetLayoutBinding* bi
 
 	for (uint32_t i = 0; i < binding_count; i++)
 	{
-		if (bindings[i].descriptorType == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER)
+		// Storage buffers are written from the uniform buffers as well
+		if (bindings[i].descriptorType == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER || bindings[i].descriptorType == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
 		{
 			uniform_count += bindings[i].descriptorCount;
 		}
@@ -251,15 +361,15 @@ void descriptorpack_write(DescriptorPack* pack, VkDescriptorSetLayoutBinding* bi
 	VkDescriptorImageInfo* image_infos = malloc(sampler_count * sizeof(VkDescriptorImageInfo));
 
 	// Write descriptors, repeat for each frame in flight
-	for (uint32_t i = 0; i < swapchain_image_count; i++)
+	for (uint32_t i = first; i < end; i++)
 	{
 		uint32_t buffer_it = 0;
 		uint32_t sampler_it = 0;
 		// Iterate and fill a descriptor info for each binding
 		for (uint32_t j = 0; j < binding_count; j++)
 		{
-			// Uniform buffer
-			if (bindings[j].descriptorType == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER)
+			// Uniform or storage buffer
+			if (bindings[j].descriptorType == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER || bindings[j].descriptorType == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
 			{
 				buffer_infos[buffer_it].buffer = uniformbuffers[buffer_it]->buffers[i];
 				buffer_infos[buffer_it].offset = uniformbuffers[buffer_it]->offsets[i];
@@ -269,7 +379,7 @@ void descriptorpack_write(DescriptorPack* pack, VkDescriptorSetLayoutBinding* bi
 				descriptor_writes[j].dstSet = pack->sets[i];
 				descriptor_writes[j].dstBinding = bindings[j].binding;
 				descriptor_writes[j].dstArrayElement = 0;
-				descriptor_writes[j].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+				descriptor_writes[j].descriptorType = bindings[j].descriptorType;
 				descriptor_writes[j].descriptorCount = 1;
 				descriptor_writes[j].pBufferInfo = &buffer_infos[buffer_it];
 				descriptor_writes[j].pImageInfo = NULL;
@@ -311,40 +421,40 @@ void descriptorpack_write(DescriptorPack* pack, VkDescriptorSetLayoutBinding* bi
 	return;
 }
 
-void descriptorpack_destroy(DescriptorPack* pack)
+void descriptorpack_write(DescriptorPack* pack, VkDescriptorSetLayoutBinding* bindings, uint32_t binding_count, UniformBuffer** uniformbuffers, Texture* textures, Sampler* samplers)
 {
-	struct DescriptorPool* pool = &descriptor_pools[pack->pool_index];
-	if (pool == NULL)
-	{
-		LOG_E("Invalid pool");
-	}
-	//vkFreeDescriptorSets(device, pool->vkpool, pack->count, pack->sets);
+	descriptorpack_write_frames(pack, bindings, binding_count, uniformbuffers, textures, samplers, 0, swapchain_image_count);
+}
 
-	// Put back the available descriptor types to the pool
-	//pool->uniform_count += pack->uniform_count;
-	//pool->sampler_count += pack->sampler_count;
+void descriptorpack_write_frame(DescriptorPack* pack, VkDescriptorSetLayoutBinding* bindings, uint32_t binding_count, UniformBuffer** uniformbuffers, Texture* textures,
+								Sampler* samplers, uint32_t frame)
+{
+	descriptorpack_write_frames(pack, bindings, binding_count, uniformbuffers, textures, samplers, frame, frame + 1);
+}
 
-	// Descrease size of pool
-	--pool->alloc_count;
-	// Free descriptor set in pool
-	// Pool is empty
-	if (pool->alloc_count == 0)
+void descriptorpack_destroy(DescriptorPack* pack)
+{
+	// Frames in flight may still use the sets, they are recycled by descriptorpool_update when retired
+	if (retired_count + pack->count > retired_size)
 	{
-		descriptorpool_destroy(pool);
+		retired_size = retired_size ? retired_size * 2 : 64;
+		if (retired_size < retired_count + pack->count)
+			retired_size = retired_count + pack->count;
+		retired_sets = realloc(retired_sets, retired_size * sizeof *retired_sets);
 	}
 
+	for (uint32_t i = 0; i < pack->count; i++)
+		retired_sets[retired_count++] = (struct RetiredSet){pack->sets[i], pack->class_index, descriptor_frame};
+
 	free(pack);
 }
 static mempool_t ub_ptr_pool = MEMPOOL_INIT(sizeof(UniformBuffer), 128);
 
-UniformBuffer* ub_create(uint32_t size, uint8_t thread_idx)
+// Allocates the frames of a buffer from pool, setting the usage of the pool if not set
+static UniformBuffer* ub_create_from(BufferPool* pool, VkBufferUsageFlags usage, uint32_t size, uint8_t thread_idx)
 {
-	//LOG_S("Creating uniform buffer");
 	UniformBuffer* ub = mempool_alloc(&ub_ptr_pool);
-	if (size > memory_limits.maxUniformBufferRange)
-	{
-		LOG_E("Uniform buffer size %d is larger than device limit %d", size, memory_limits.maxUniformBufferRange);
-	}
+	ub->pool = pool;
 	ub->size = size;
 	ub->thread_idx = thread_idx;
 
@@ -352,14 +462,33 @@ UniformBuffer* ub_create(uint32_t size, uint8_t thread_idx)
 	for (uint32_t i = 0; i < swapchain_image_count; i++)
 	{
 		// Sets buffer pool usage if not set
-		if (ub_pool[thread_idx].usage == 0)
-			ub_pool[thread_idx].usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
-		buffer_pool_alloc(&ub_pool[thread_idx], size, &ub->buffers[i], &ub->memories[i], &ub->offsets[i]);
+		if (pool->usage == 0)
+			pool->usage = usage;
+		buffer_pool_alloc(pool, size, &ub->buffers[i], &ub->memories[i], &ub->offsets[i]);
 	}
 
 	return ub;
 }
 
+UniformBuffer* ub_create(uint32_t size, uint8_t thread_idx)
+{
+	//LOG_S("Creating uniform buffer");
+	if (size > memory_limits.maxUniformBufferRange)
+	{
+		LOG_E("Uniform buffer size %d is larger than device limit %d", size, memory_limits.maxUniformBufferRange);
+	}
+	return ub_create_from(&ub_pool[thread_idx], VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, size, thread_idx);
+}
+
+UniformBuffer* sb_create(uint32_t size, uint8_t thread_idx)
+{
+	if (size > memory_limits.maxStorageBufferRange)
+	{
+		LOG_E("Storage buffer size %d is larger than device limit %d", size, memory_limits.maxStorageBufferRange);
+	}
+	return ub_create_from(&sb_pool[thread_idx], VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, size, thread_idx);
+}
+
 // Maps the uniform buffer data for specified frame and returns a pointer to it
 void* ub_map(UniformBuffer* ub, uint32_t offset, uint32_t size, uint32_t frame)
 {
@@ -423,7 +552,7 @@ void ub_destroy(UniformBuffer* ub)
 	//LOG_S("Destroying uniform buffer");
 	for (size_t i = 0; i < swapchain_image_count; i++)
 	{
-		buffer_pool_free(&ub_pool[ub->thread_idx], ub->size, ub->buffers[i], ub->memories[i], ub->offsets[i]);
+		buffer_pool_free(ub->pool, ub->size, ub->buffers[i], ub->memories[i], ub->offsets[i]);
 	}
 	mempool_free(&ub_ptr_pool, ub);
 }
@@ -434,5 +563,7 @@ void ub_pools_destroy()
 	{
 		if (ub_pool[i].usage != 0)
 			buffer_pool_array_destroy(&ub_pool[i]);
+		if (sb_pool[i].usage != 0)
+			buffer_pool_array_destroy(&sb_pool[i]);
 	}
 }
@@ -13,12 +13,15 @@
 #include "magpie.h"
 #include "graphics/model.h"
 #include "graphics/material.h"
+#include "graphics/assets.h"
 #include "graphics/pipeline.h"
 #include <stdbool.h>
 #include "graphics/uniforms.h"
 #include "graphics/shadertypes.h"
 #include "graphics/texture.h"
 #include "graphics/camera.h"
+#include "bindless.h"
+#include "geometry.h"
 #include "scene.h"
 
 static uint32_t global_uniform_count = 0;
@@ -30,6 +33,9 @@ static Texture* global_textures = NULL;
 static void** global_resource_map = NULL;
 
 static Window* surface_window = NULL;
+
+// The api version the instance was created with
+static uint32_t instance_api_version = VK_API_VERSION_1_0;
 // src/graphics/vulkan.c
 
 // Some arguments are unused but are require for the callback to work
@@ -93,7 +99,14 @@ int create_instance()
 	appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
 	appInfo.pEngineName = "manta";
 	appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-	appInfo.apiVersion = VK_API_VERSION_1_0;
+	// Vulkan 1.1 is used when available to query descriptor indexing support
+	// vkEnumerateInstanceVersion does not exist in 1.0 loaders
+	PFN_vkEnumerateInstanceVersion enumerate_version = (PFN_vkEnumerateInstanceVersion)vkGetInstanceProcAddr(NULL, "vkEnumerateInstanceVersion");
+	uint32_t loader_version = VK_API_VERSION_1_0;
+	if (enumerate_version == NULL || enumerate_version(&loader_version) != VK_SUCCESS)
+		loader_version = VK_API_VERSION_1_0;
+	instance_api_version = loader_version >= VK_API_VERSION_1_1 ? VK_API_VERSION_1_1 : VK_API_VERSION_1_0;
+	appInfo.apiVersion = instance_api_version;
 
 	VkInstanceCreateInfo createInfo = {0};
 	createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -256,6 +269,62 @@ bool check_device_extension_support(VkPhysicalDevice device)
 	return 0;
 }
 
+// Returns true if the device supports the named extension
+static bool device_has_extension(VkPhysicalDevice device, const char* name)
+{
+	uint32_t extension_count = 0;
+	vkEnumerateDeviceExtensionProperties(device, NULL, &extension_count, NULL);
+	VkExtensionProperties* available_extensions = malloc(extension_count * sizeof(VkExtensionProperties));
+	vkEnumerateDeviceExtensionProperties(device, NULL, &extension_count, available_extensions);
+
+	bool exists = false;
+	for (uint32_t i = 0; i < extension_count && !exists; i++)
+	{
+		exists = strcmp(name, available_extensions[i].extensionName) == 0;
+	}
+
+	free(available_extensions);
+	return exists;
+}
+
+// Checks if the device supports the descriptor indexing features needed for bindless materials
+// Fills in the features to enable
+// Returns the number of textures a bindless texture array can hold, 0 if unsupported
+static uint32_t query_descriptor_indexing(VkPhysicalDevice device, VkPhysicalDeviceDescriptorIndexingFeaturesEXT* enabled)
+{
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(device, &properties);
+
+	// The feature queries are core in 1.1
+	if (instance_api_version < VK_API_VERSION_1_1 || properties.apiVersion < VK_API_VERSION_1_1 || !device_has_extension(device, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME))
+		return 0;
+
+	VkPhysicalDeviceDescriptorIndexingFeaturesEXT supported = {0};
+	supported.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+	VkPhysicalDeviceFeatures2 features = {0};
+	features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	features.pNext = &supported;
+	vkGetPhysicalDeviceFeatures2(device, &features);
+
+	if (!supported.runtimeDescriptorArray || !supported.descriptorBindingPartiallyBound || !supported.shaderSampledImageArrayNonUniformIndexing ||
+		!supported.descriptorBindingSampledImageUpdateAfterBind)
+		return 0;
+
+	VkPhysicalDeviceDescriptorIndexingPropertiesEXT limits = {0};
+	limits.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES_EXT;
+	VkPhysicalDeviceProperties2 properties2 = {0};
+	properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+	properties2.pNext = &limits;
+	vkGetPhysicalDeviceProperties2(device, &properties2);
+
+	enabled->runtimeDescriptorArray = VK_TRUE;
+	enabled->descriptorBindingPartiallyBound = VK_TRUE;
+	enabled->shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+	enabled->descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+
+	return min(limits.maxPerStageDescriptorUpdateAfterBindSampledImages, limits.maxDescriptorSetUpdateAfterBindSampledImages);
+}
+
 int create_surface()
 {
 	VkResult result = glfwCreateWindowSurface(instance, window_get_raw(surface_window), NULL, &surface);
@@ -405,8 +474,18 @@ int create_logical_device()
 		queueCreateInfos[i].pQueuePriorities = &queue_priority;
 	}
 
+	VkPhysicalDeviceFeatures supportedFeatures;
+	vkGetPhysicalDeviceFeatures(physical_device, &supportedFeatures);
+
 	VkPhysicalDeviceFeatures deviceFeatures = {0};
 	deviceFeatures.samplerAnisotropy = VK_TRUE;
+	// Cooked textures are block compressed, textures fall back to RGBA8 if unsupported
+	deviceFeatures.textureCompressionBC = supportedFeatures.textureCompressionBC;
+	// GPU culling draws all batches of a pipeline at once, offsetting the instances of each draw by its first instance
+	deviceFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+	deviceFeatures.drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance;
+	multi_draw_indirect_supported = supportedFeatures.multiDrawIndirect;
+	draw_indirect_first_instance_supported = supportedFeatures.drawIndirectFirstInstance;
 
 	VkDeviceCreateInfo createInfo = {0};
 	createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -415,8 +494,38 @@ int create_logical_device()
 
 	// The device specific extension
 	// The physical device extension support has been checked before
-	createInfo.enabledExtensionCount = device_extensions_count;
-	createInfo.ppEnabledExtensionNames = device_extensions;
+	const char** extensions = malloc((device_extensions_count + 2) * sizeof(char*));
+	uint32_t extension_count = 0;
+	for (size_t i = 0; i < device_extensions_count; i++)
+	{
+		extensions[extension_count++] = device_extensions[i];
+	}
+
+	// Materials fall back to per material descriptors without descriptor indexing
+	VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexing_features = {0};
+	indexing_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+	bindless_texture_limit = query_descriptor_indexing(physical_device, &indexing_features);
+	if (bindless_texture_limit)
+	{
+		LOG("Enabling extension '%s'", VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+		extensions[extension_count++] = VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME;
+		createInfo.pNext = &indexing_features;
+	}
+	else
+	{
+		LOG_W("Descriptor indexing is not supported, bindless materials are disabled");
+	}
+
+	// Indirect draws of empty batches are skipped by the GPU if supported
+	draw_indirect_count_supported = device_has_extension(physical_device, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+	if (draw_indirect_count_supported)
+	{
+		LOG("Enabling extension '%s'", VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+		extensions[extension_count++] = VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME;
+	}
+
+	createInfo.enabledExtensionCount = extension_count;
+	createInfo.ppEnabledExtensionNames = extensions;
 
 	createInfo.pEnabledFeatures = &deviceFeatures;
 
@@ -433,6 +542,7 @@ int create_logical_device()
 
 	// Create a logical device to interface with the previously picked physical device
 	VkResult result = vkCreateDevice(physical_device, &createInfo, NULL, &device);
+	free(extensions);
 	if (result != VK_SUCCESS)
 	{
 		LOG_E("Failed to create logical device - code %d", result);
@@ -453,7 +563,7 @@ int create_logical_device()
 	size_t i = 0;
 	for (i = 0; i < swapchain_image_count; i++)
 	{
-		swapchain_image_views[i] = image_view_create(swapchain_images[i], swapchain_image_format, VK_IMAGE_ASPECT_COLOR_BIT);
+		swapchain_image_views[i] = image_view_create(swapchain_images[i], swapchain_image_format, VK_IMAGE_ASPECT_COLOR_BIT, 1);
 	}
 	return 0;
 }*/
@@ -552,11 +662,11 @@ int create_render_pass()
 {
 	VkFormat colorFormat = swapchain_image_format;
 
-	image_create(swapchain_extent.width, swapchain_extent.height, colorFormat, VK_IMAGE_TILING_OPTIMAL,
+	image_create(swapchain_extent.width, swapchain_extent.height, 1, colorFormat, VK_IMAGE_TILING_OPTIMAL,
 				 VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &color_image, &color_image_memory,
 				 msaa_samples);
 
-	color_image_view = image_view_create(color_image, colorFormat, VK_IMAGE_ASPECT_COLOR_BIT);
+	color_image_view = image_view_create(color_image, colorFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1);
 	return 0;
 }
 
@@ -564,13 +674,13 @@ int create_depth_buffer()
 {
 	depth_image_format = find_depth_format();
 
-	image_create(swapchain_extent.width, swapchain_extent.height, depth_image_format, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+	image_create(swapchain_extent.width, swapchain_extent.height, 1, depth_image_format, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
 				 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &depth_image, &depth_image_memory, msaa_samples);
 
-	depth_image_view = image_view_create(depth_image, depth_image_format, VK_IMAGE_ASPECT_DEPTH_BIT);
+	depth_image_view = image_view_create(depth_image, depth_image_format, VK_IMAGE_ASPECT_DEPTH_BIT, 1);
 
 	// Transition image layout explicitely
-	transition_image_layout(depth_image, depth_image_format, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+	transition_image_layout(depth_image, depth_image_format, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, 1);
 	return 0;
 }*/
 
@@ -722,6 +832,12 @@ int graphics_init(Window* window, struct LayoutInfo* global_layout)
 	{
 		return -14;
 	}
+	if (bindless_init())
+	{
+		return -15;
+	}
+
+	pipeline_cache_init();
 	LOG_S("Successfully initialized vulkan");
 	return 0;
 }
@@ -762,14 +878,19 @@ void graphics_terminate()
 	LOG_S("Terminating vulkan");
 
 	vkDeviceWaitIdle(device);
+	pipeline_wait_all();
 
 	swapchain_destroy();
 
 	vkDestroyDescriptorSetLayout(device, global_descriptor_layout, NULL);
 
+	assets_unwatch();
+
 	// Free textures and materials
 	material_destroy_all();
+	bindless_destroy();
 	model_destroy_all();
+	geometry_destroy();
 	texture_destroy_all();
 	sampler_destroy_all();
 
@@ -784,9 +905,11 @@ void graphics_terminate()
 	global_uniform_count = 0;
 
 	pipeline_destroy_all();
+	pipeline_cache_terminate();
 
 	if (global_descriptors->count)
 		descriptorpack_destroy(global_descriptors);
+	descriptorpool_destroy_all();
 
 	ub_pools_destroy();
 
@@ -19,6 +19,9 @@ int create_depth_buffer();
 
 VkSampleCountFlagBits get_max_sample_count(VkPhysicalDevice device);
 
+// Defined in pipeline.c
+VkShaderModule create_shader_module(char* code, size_t size);
+
 // Defined in vulkan.c
 int create_image_views();
 int create_render_pass();
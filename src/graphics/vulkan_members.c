@@ -9,6 +9,11 @@ VkPhysicalDeviceLimits memory_limits = (VkPhysicalDeviceLimits){0};
 VkPhysicalDeviceMemoryProperties memory_properties = (VkPhysicalDeviceMemoryProperties){0};
 VkDevice device = VK_NULL_HANDLE;
 
+uint32_t bindless_texture_limit = 0;
+bool draw_indirect_count_supported = false;
+bool multi_draw_indirect_supported = false;
+bool draw_indirect_first_instance_supported = false;
+
 VkQueue graphics_queue = VK_NULL_HANDLE;
 VkQueue present_queue = VK_NULL_HANDLE;
 
@@ -1,6 +1,7 @@
 #ifndef VULKAN_MEMBERS_H
 #define VULKAN_MEMBERS_H
 #include <stdint.h>
+#include <stdbool.h>
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
 #include "window.h"
@@ -47,6 +48,17 @@ extern VkPhysicalDeviceLimits memory_limits;
 extern VkPhysicalDeviceMemoryProperties memory_properties;
 extern VkDevice device;
 
+// The number of textures the bindless texture array can hold
+// 0 if the device does not support descriptor indexing and materials use per material descriptors
+extern uint32_t bindless_texture_limit;
+
+// True if indirect draws can take their draw count from a buffer
+extern bool draw_indirect_count_supported;
+// True if a single indirect draw can record more than one draw command
+extern bool multi_draw_indirect_supported;
+// True if indirect draw commands can start at an instance other than 0
+extern bool draw_indirect_first_instance_supported;
+
 extern VkQueue graphics_queue;
 extern VkQueue present_queue;
 
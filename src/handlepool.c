@@ -10,7 +10,7 @@ const struct handle_wrapper* handlepool_alloc(handlepool_t* pool)
 	if (pool->free_handles)
 	{
 		struct handle_wrapper* wrapper = pool->free_handles;
-		pool->free_handles = pool->free_handles->next;
+		pool->free_handles = wrapper->next != HANDLEPOOL_FREE_END ? wrapper->next : NULL;
 		wrapper->next = NULL;
 		wrapper->handle.pattern += 1;
 		pool->count++;
@@ -36,16 +36,17 @@ const struct handle_wrapper* handlepool_alloc(handlepool_t* pool)
 	}
 	pool->handles = realloc(pool->handles, pool->size * pool->stride);
 
-	// Initialize new handles
+	// Initialize new handles as free
 	for (uint32_t i = old_size; i < pool->size; i++)
 	{
 		struct handle_wrapper* wrapper = HANDLEPOOL_INDEX(pool, i);
-		wrapper->next = NULL;
+		wrapper->next = HANDLEPOOL_FREE_END;
 		wrapper->handle.index = i;
 		wrapper->handle.pattern = 0;
 	}
 
 	pool->count++;
+	HANDLEPOOL_INDEX(pool, pool->count - 1)->next = NULL;
 	return HANDLEPOOL_INDEX(pool, pool->count - 1);
 }
 
@@ -74,7 +75,7 @@ void handlepool_free(handlepool_t* pool, GenericHandle handle)
 	}
 
 	// Insert into linked list of free handles
-	wrapper->next = pool->free_handles;
+	wrapper->next = pool->free_handles ? pool->free_handles : HANDLEPOOL_FREE_END;
 	pool->free_handles = wrapper;
 
 	pool->count--;
@@ -7,10 +7,15 @@ DEFINE_HANDLE(GenericHandle)
 
 #define HANDLEPOOL_INDEX(pool, i) ((struct handle_wrapper*)((uint8_t*)(pool)->handles + (pool)->stride * (i)))
 
+// The next pointer of free slots without a next free slot
+// Slots in use are the only ones with a NULL next pointer, which makes iterating the pool possible
+#define HANDLEPOOL_FREE_END ((struct handle_wrapper*)1)
+
 struct handle_wrapper
 {
 	GenericHandle handle;
-	// Points to next free element if free
+	// Points to next free element if free, or HANDLEPOOL_FREE_END
+	// NULL if in use
 	struct handle_wrapper* next;
 	// The data that immediately follows in memory
 	uint8_t data[];
@@ -0,0 +1,443 @@
+#include "jobs.h"
+#include "defines.h"
+#include "log.h"
+#include "magpie.h"
+#include <string.h>
+
+#if PL_LINUX
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+typedef pthread_t thread_t;
+typedef pthread_mutex_t mutex_t;
+typedef pthread_cond_t cond_t;
+#define THREAD_FUNC(name)	   static void* name(void* arg)
+#define THREAD_RETURN		   return NULL
+#define THREAD_CREATE(t, f, a) (pthread_create(&(t), NULL, f, a) == 0)
+#define THREAD_JOIN(t)		   pthread_join(t, NULL)
+#define THREAD_YIELD()		   sched_yield()
+#define MUTEX_INIT(m)		   pthread_mutex_init(&(m), NULL)
+#define MUTEX_DESTROY(m)	   pthread_mutex_destroy(&(m))
+#define MUTEX_LOCK(m)		   pthread_mutex_lock(&(m))
+#define MUTEX_UNLOCK(m)		   pthread_mutex_unlock(&(m))
+#define COND_INIT(c)		   pthread_cond_init(&(c), NULL)
+#define COND_DESTROY(c)		   pthread_cond_destroy(&(c))
+#define COND_WAIT(c, m)		   pthread_cond_wait(&(c), &(m))
+#define COND_SIGNAL(c)		   pthread_cond_signal(&(c))
+#define COND_BROADCAST(c)	   pthread_cond_broadcast(&(c))
+#elif PL_WINDOWS
+#include <windows.h>
+typedef HANDLE thread_t;
+typedef CRITICAL_SECTION mutex_t;
+typedef CONDITION_VARIABLE cond_t;
+#define THREAD_FUNC(name)	   static DWORD WINAPI name(LPVOID arg)
+#define THREAD_RETURN		   return 0
+#define THREAD_CREATE(t, f, a) (((t) = CreateThread(NULL, 0, f, a, 0, NULL)) != NULL)
+#define THREAD_JOIN(t)		   (WaitForSingleObject(t, INFINITE), CloseHandle(t))
+#define THREAD_YIELD()		   SwitchToThread()
+#define MUTEX_INIT(m)		   InitializeCriticalSection(&(m))
+#define MUTEX_DESTROY(m)	   DeleteCriticalSection(&(m))
+#define MUTEX_LOCK(m)		   EnterCriticalSection(&(m))
+#define MUTEX_UNLOCK(m)		   LeaveCriticalSection(&(m))
+#define COND_INIT(c)		   InitializeConditionVariable(&(c))
+#define COND_DESTROY(c)
+#define COND_WAIT(c, m)	  SleepConditionVariableCS(&(c), &(m), INFINITE)
+#define COND_SIGNAL(c)	  WakeConditionVariable(&(c))
+#define COND_BROADCAST(c) WakeAllConditionVariable(&(c))
+#endif
+
+#define JOBS_QUEUE_MASK (JOBS_QUEUE_SIZE - 1)
+
+typedef struct
+{
+	JobFunc func;
+	JobRangeFunc range_func;
+	void* arg;
+	uint32_t begin;
+	uint32_t end;
+	JobCounter* counter;
+	JobCounter* dependency;
+} Job;
+
+// Chase-Lev work stealing deque
+// The owning thread pushes and pops at the bottom, other threads steal from the top
+typedef struct
+{
+	volatile int64_t top;
+	// Keep the ends on separate cache lines
+	char pad0[56];
+	volatile int64_t bottom;
+	char pad1[56];
+	Job jobs[JOBS_QUEUE_SIZE];
+} JobQueue;
+
+static JobQueue* queues = NULL;
+static thread_t threads[JOBS_MAX_THREADS];
+static uint32_t thread_count = 0;
+static volatile int running = 0;
+
+// Number of queued jobs not yet taken by any thread
+static volatile int32_t jobs_queued = 0;
+// Number of workers waiting for jobs
+static volatile int32_t jobs_sleeping = 0;
+static mutex_t sleep_mutex;
+static cond_t sleep_cond;
+
+// Jobs submitted after a dependency which had not reached zero
+// Released when a job brings a counter to zero, as the dependency can't be read once it has
+static Job* parked = NULL;
+static volatile uint32_t parked_count = 0;
+static uint32_t parked_size = 0;
+static mutex_t parked_mutex;
+
+static THREAD_LOCAL uint32_t thread_idx = 0;
+
+static int queue_push(JobQueue* queue, const Job* job)
+{
+	int64_t b = __atomic_load_n(&queue->bottom, __ATOMIC_RELAXED);
+	int64_t t = __atomic_load_n(&queue->top, __ATOMIC_ACQUIRE);
+
+	// Full
+	if (b - t >= JOBS_QUEUE_SIZE)
+		return -1;
+
+	queue->jobs[b & JOBS_QUEUE_MASK] = *job;
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	__atomic_store_n(&queue->bottom, b + 1, __ATOMIC_RELAXED);
+	return 0;
+}
+
+static int queue_pop(JobQueue* queue, Job* job)
+{
+	int64_t b = __atomic_load_n(&queue->bottom, __ATOMIC_RELAXED) - 1;
+	__atomic_store_n(&queue->bottom, b, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	int64_t t = __atomic_load_n(&queue->top, __ATOMIC_RELAXED);
+
+	// Empty
+	if (t > b)
+	{
+		__atomic_store_n(&queue->bottom, b + 1, __ATOMIC_RELAXED);
+		return 0;
+	}
+
+	*job = queue->jobs[b & JOBS_QUEUE_MASK];
+
+	// Last job, race against stealers
+	if (t == b)
+	{
+		int won = __atomic_compare_exchange_n(&queue->top, &t, t + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+		__atomic_store_n(&queue->bottom, b + 1, __ATOMIC_RELAXED);
+		return won;
+	}
+	return 1;
+}
+
+static int queue_steal(JobQueue* queue, Job* job)
+{
+	int64_t t = __atomic_load_n(&queue->top, __ATOMIC_ACQUIRE);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	int64_t b = __atomic_load_n(&queue->bottom, __ATOMIC_ACQUIRE);
+
+	if (t >= b)
+		return 0;
+
+	// The slot can't be overwritten before top is moved past it
+	*job = queue->jobs[t & JOBS_QUEUE_MASK];
+	return __atomic_compare_exchange_n(&queue->top, &t, t + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+}
+
+// Takes a job from the own queue or steals one from another thread
+static int job_take(Job* job)
+{
+	if (__atomic_load_n(&jobs_queued, __ATOMIC_ACQUIRE) <= 0)
+		return 0;
+
+	if (queue_pop(&queues[thread_idx], job))
+		goto found;
+
+	// Start stealing from the next thread to spread contention
+	for (uint32_t i = 1; i < thread_count; i++)
+	{
+		if (queue_steal(&queues[(thread_idx + i) % thread_count], job))
+			goto found;
+	}
+	return 0;
+
+found:
+	__atomic_sub_fetch(&jobs_queued, 1, __ATOMIC_RELEASE);
+	return 1;
+}
+
+static void job_release_parked();
+
+static void job_execute(Job* job)
+{
+	if (job->range_func)
+		job->range_func(job->arg, job->begin, job->end);
+	else
+		job->func(job->arg);
+
+	// The counter may go out of scope as soon as it reaches zero, so only the parked jobs are looked at after
+	if (job->counter && __atomic_sub_fetch(&job->counter->value, 1, __ATOMIC_SEQ_CST) == 0 && __atomic_load_n(&parked_count, __ATOMIC_SEQ_CST) > 0)
+		job_release_parked();
+}
+
+// Queues a job whose counter has already been incremented
+static void job_enqueue(Job* job)
+{
+	// Run immediately if there are no workers or the queue is full
+	if (queues == NULL || queue_push(&queues[thread_idx], job) != 0)
+	{
+		job_execute(job);
+		return;
+	}
+
+	__atomic_add_fetch(&jobs_queued, 1, __ATOMIC_SEQ_CST);
+
+	// Wake a worker if any are sleeping
+	if (__atomic_load_n(&jobs_sleeping, __ATOMIC_SEQ_CST) > 0)
+	{
+		MUTEX_LOCK(sleep_mutex);
+		COND_SIGNAL(sleep_cond);
+		MUTEX_UNLOCK(sleep_mutex);
+	}
+}
+
+static void job_push(Job* job)
+{
+	if (job->counter)
+		__atomic_add_fetch(&job->counter->value, 1, __ATOMIC_RELAXED);
+	job_enqueue(job);
+}
+
+// Queues the parked jobs whose dependency has reached zero
+// The dependencies of parked jobs are still valid
+static void job_release_parked()
+{
+	Job ready[64];
+	uint32_t ready_count;
+	do
+	{
+		ready_count = 0;
+		MUTEX_LOCK(parked_mutex);
+		for (uint32_t i = 0; i < parked_count && ready_count < 64;)
+		{
+			if (__atomic_load_n(&parked[i].dependency->value, __ATOMIC_ACQUIRE) == 0)
+			{
+				ready[ready_count++] = parked[i];
+				parked[i] = parked[parked_count - 1];
+				__atomic_store_n(&parked_count, parked_count - 1, __ATOMIC_SEQ_CST);
+			}
+			else
+				i++;
+		}
+		MUTEX_UNLOCK(parked_mutex);
+
+		// Outside the lock since a full queue runs the job right away, which can release more jobs
+		for (uint32_t i = 0; i < ready_count; i++)
+			job_enqueue(&ready[i]);
+	} while (ready_count == 64);
+}
+
+THREAD_FUNC(worker_main)
+{
+	thread_idx = (uint32_t)(uintptr_t)arg;
+
+	Job job;
+	uint32_t idle = 0;
+	while (1)
+	{
+		if (job_take(&job))
+		{
+			job_execute(&job);
+			idle = 0;
+			continue;
+		}
+
+		// Spin for a short while before sleeping to not add latency to frequent small jobs
+		if (++idle < 64)
+		{
+			THREAD_YIELD();
+			continue;
+		}
+
+		MUTEX_LOCK(sleep_mutex);
+		__atomic_add_fetch(&jobs_sleeping, 1, __ATOMIC_SEQ_CST);
+		while (__atomic_load_n(&jobs_queued, __ATOMIC_SEQ_CST) <= 0 && running)
+		{
+			COND_WAIT(sleep_cond, sleep_mutex);
+		}
+		__atomic_sub_fetch(&jobs_sleeping, 1, __ATOMIC_SEQ_CST);
+		MUTEX_UNLOCK(sleep_mutex);
+
+		if (!running && __atomic_load_n(&jobs_queued, __ATOMIC_SEQ_CST) <= 0)
+			break;
+		idle = 0;
+	}
+
+	THREAD_RETURN;
+}
+
+static uint32_t core_count()
+{
+#if PL_LINUX
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count > 0 ? count : 1;
+#elif PL_WINDOWS
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors;
+#endif
+}
+
+int jobs_init(uint32_t count)
+{
+	if (queues)
+		return 1;
+
+	if (count == 0)
+		count = core_count() - 1;
+
+	if (count + 1 > JOBS_MAX_THREADS)
+	{
+		LOG_W("Worker count of %d exceeds the maximum of %d threads", count, JOBS_MAX_THREADS);
+		count = JOBS_MAX_THREADS - 1;
+	}
+
+	// Include main thread
+	thread_count = count + 1;
+	queues = calloc(thread_count, sizeof *queues);
+	thread_idx = 0;
+	running = 1;
+	jobs_queued = 0;
+	jobs_sleeping = 0;
+	MUTEX_INIT(sleep_mutex);
+	COND_INIT(sleep_cond);
+	MUTEX_INIT(parked_mutex);
+
+	for (uint32_t i = 1; i < thread_count; i++)
+	{
+		if (!THREAD_CREATE(threads[i], worker_main, (void*)(uintptr_t)i))
+		{
+			LOG_E("Failed to create worker thread %d", i);
+			thread_count = i;
+			break;
+		}
+	}
+
+	LOG_S("Started job system with %d threads", thread_count);
+	return 0;
+}
+
+void jobs_terminate()
+{
+	if (queues == NULL)
+		return;
+
+	// Finish the jobs queued on the main thread
+	Job job;
+	while (job_take(&job))
+		job_execute(&job);
+
+	MUTEX_LOCK(sleep_mutex);
+	running = 0;
+	COND_BROADCAST(sleep_cond);
+	MUTEX_UNLOCK(sleep_mutex);
+
+	for (uint32_t i = 1; i < thread_count; i++)
+	{
+		THREAD_JOIN(threads[i]);
+	}
+
+	if (parked_count)
+		LOG_W("%d jobs were never started as their dependencies did not complete", parked_count);
+
+	MUTEX_DESTROY(sleep_mutex);
+	COND_DESTROY(sleep_cond);
+	MUTEX_DESTROY(parked_mutex);
+	free(parked);
+	parked = NULL;
+	parked_count = 0;
+	parked_size = 0;
+	free(queues);
+	queues = NULL;
+	thread_count = 0;
+}
+
+uint32_t jobs_thread_count()
+{
+	return thread_count ? thread_count : 1;
+}
+
+uint32_t jobs_thread_idx()
+{
+	return thread_idx;
+}
+
+void job_submit(JobFunc func, void* arg, JobCounter* counter)
+{
+	Job job = {.func = func, .arg = arg, .counter = counter};
+	job_push(&job);
+}
+
+void job_submit_after(JobCounter* dependency, JobFunc func, void* arg, JobCounter* counter)
+{
+	Job job = {.func = func, .arg = arg, .counter = counter, .dependency = dependency};
+	// Without workers every job has completed by the time it was submitted
+	if (queues == NULL || __atomic_load_n(&dependency->value, __ATOMIC_ACQUIRE) == 0)
+	{
+		job_push(&job);
+		return;
+	}
+
+	if (counter)
+		__atomic_add_fetch(&counter->value, 1, __ATOMIC_RELAXED);
+
+	MUTEX_LOCK(parked_mutex);
+	if (parked_count == parked_size)
+	{
+		parked_size = parked_size ? parked_size * 2 : 64;
+		parked = realloc(parked, parked_size * sizeof *parked);
+	}
+	parked[parked_count] = job;
+	__atomic_store_n(&parked_count, parked_count + 1, __ATOMIC_SEQ_CST);
+	MUTEX_UNLOCK(parked_mutex);
+
+	// The dependency may have reached zero before the job was parked and seen no parked jobs
+	if (__atomic_load_n(&dependency->value, __ATOMIC_SEQ_CST) == 0)
+		job_release_parked();
+}
+
+void job_wait(JobCounter* counter)
+{
+	Job job;
+	while (__atomic_load_n(&counter->value, __ATOMIC_ACQUIRE) > 0)
+	{
+		if (queues && job_take(&job))
+			job_execute(&job);
+		else
+			THREAD_YIELD();
+	}
+}
+
+void job_parallel_for_async(uint32_t count, uint32_t batch_size, JobRangeFunc func, void* arg, JobCounter* counter)
+{
+	// Aim for a few batches per thread to even out uneven work
+	if (batch_size == 0)
+		batch_size = count / (jobs_thread_count() * 4) + 1;
+
+	for (uint32_t begin = 0; begin < count; begin += batch_size)
+	{
+		uint32_t end = begin + batch_size < count ? begin + batch_size : count;
+		Job job = {.range_func = func, .arg = arg, .begin = begin, .end = end, .counter = counter};
+		job_push(&job);
+	}
+}
+
+void job_parallel_for(uint32_t count, uint32_t batch_size, JobRangeFunc func, void* arg)
+{
+	JobCounter counter = {0};
+	job_parallel_for_async(count, batch_size, func, arg, &counter);
+	job_wait(&counter);
+}
@@ -3,7 +3,9 @@
 #include "math/math.h"
 #include "utils.h"
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include "math/mat4.h"
@@ -28,11 +30,278 @@ void set_print_color(int color)
 
 static FILE* log_file = NULL;
 static size_t last_log_length = 0;
+static int log_mode = LOG_MODE_TEXT;
 
 // Specifies the frame number the previous log was on, to indicate if a new message is on a new frame
 static size_t last_log_frame = 0;
 static int last_severity = 0;
 
+// Binary log format
+// The file starts with LOG_BINARY_MAGIC and a uint32_t version followed by records
+// Each record starts with a one byte tag
+// -> 'S' : string definition; uint32_t id, uint16_t length, characters
+// -> 'M' : message; uint8_t severity, uint32_t name id, uint32_t format id, uint32_t frame, int64_t time, uint16_t size, arguments
+// -> 'T' : preformatted message; same as 'M' but format id is LOG_BINARY_NONE and the arguments are the message text
+// Arguments are stored in the order of the format specifiers
+// -> integers as int32_t, floats as double, pointers as uint64_t, vectors and matrices as floats
+// -> strings as uint16_t length followed by the characters, truncated to LOG_BINARY_MAX_STRING
+#define LOG_BINARY_MAGIC	  "MLOG"
+#define LOG_BINARY_VERSION	  1
+#define LOG_BINARY_NONE		  0xFFFFFFFF
+#define LOG_BINARY_HEADER	  24
+#define LOG_BINARY_MAX_ARGS	  16
+#define LOG_BINARY_MAX_STRING 254
+// Each argument fits in 256 bytes
+#define LOG_BINARY_MAX_PAYLOAD (LOG_BINARY_MAX_ARGS * 256)
+// Needs to be a power of two
+#define LOG_BINARY_STRINGS 4096
+#define LOG_BINARY_BUFFER  (1 << 16)
+
+typedef struct
+{
+	// The interned string, identified by address
+	const char* str;
+	uint32_t id;
+	// Argument types of the format string, parsed once
+	char sig[LOG_BINARY_MAX_ARGS + 1];
+} LogString;
+
+static LogString log_strings[LOG_BINARY_STRINGS];
+static uint32_t log_string_count = 0;
+
+// Finds the next format specifier using the same grammar as string_vformat
+// Returns a pointer to the conversion character or NULL if there are no more
+// start is set to the '%' and width to the parsed field width
+static const char* log_next_spec(const char* fmt, const char** start, unsigned int* width)
+{
+	fmt = strchr(fmt, '%');
+	if (fmt == NULL)
+		return NULL;
+
+	*start = fmt++;
+	*width = 0;
+	int precision = 0;
+	while (*fmt && strchr("-+#*.0123456789", *fmt))
+	{
+		if (*fmt == '.')
+			precision = 1;
+		else if (*fmt >= '0' && *fmt <= '9' && precision == 0)
+			*width = *width * 10 + *fmt - '0';
+		fmt++;
+	}
+
+	return *fmt ? fmt : NULL;
+}
+
+// Returns the argument type consumed by a conversion character, or 0 if none is consumed
+// 'i' int, 'f' double, 's' string, 'p' pointer, '1'-'4' vector, 'm' matrix
+static char log_arg_type(char spec, unsigned int width)
+{
+	switch (spec)
+	{
+	case 'c':
+	case 'b':
+	case 'o':
+	case 'd':
+	case 'u':
+	case 'x':
+	case 'X':
+		return 'i';
+	case 'f':
+	case 'e':
+	case 'g':
+		return 'f';
+	case 's':
+		return 's';
+	case 'p':
+		return 'p';
+	case 'v':
+		return width >= 1 && width <= 4 ? '0' + width : 0;
+	case 'm':
+		return 'm';
+	default:
+		return 0;
+	}
+}
+
+static void log_binary_begin()
+{
+	static char buffer[LOG_BINARY_BUFFER];
+	setvbuf(log_file, buffer, _IOFBF, sizeof buffer);
+
+	uint32_t version = LOG_BINARY_VERSION;
+	fwrite(LOG_BINARY_MAGIC, 4, 1, log_file);
+	fwrite(&version, sizeof version, 1, log_file);
+
+	memset(log_strings, 0, sizeof log_strings);
+	log_string_count = 0;
+}
+
+// Returns the interned entry of str and writes its definition the first time it is seen
+// Returns NULL if the table is full or str has too many arguments
+static LogString* log_binary_intern(const char* str)
+{
+	uintptr_t hash = ((uintptr_t)str >> 3) * 2654435761u;
+	for (uint32_t i = 0; i < LOG_BINARY_STRINGS; i++)
+	{
+		LogString* entry = &log_strings[(hash + i) & (LOG_BINARY_STRINGS - 1)];
+		if (entry->str == str)
+			return entry;
+		if (entry->str != NULL)
+			continue;
+
+		// Keep the probe sequences short
+		if (log_string_count >= LOG_BINARY_STRINGS / 4 * 3)
+			return NULL;
+
+		// Parse the argument types
+		char sig[sizeof entry->sig];
+		size_t arg_count = 0;
+		const char* start;
+		unsigned int width;
+		const char* spec = str;
+		while ((spec = log_next_spec(spec, &start, &width)))
+		{
+			char type = log_arg_type(*spec++, width);
+			if (type == 0)
+				continue;
+			if (arg_count == LOG_BINARY_MAX_ARGS)
+				return NULL;
+			sig[arg_count++] = type;
+		}
+		sig[arg_count] = '\0';
+
+		size_t len = strlen(str);
+		if (len > UINT16_MAX)
+			return NULL;
+
+		entry->str = str;
+		entry->id = log_string_count++;
+		memcpy(entry->sig, sig, arg_count + 1);
+
+		uint16_t len16 = len;
+		fputc('S', log_file);
+		fwrite(&entry->id, sizeof entry->id, 1, log_file);
+		fwrite(&len16, sizeof len16, 1, log_file);
+		fwrite(str, 1, len, log_file);
+		return entry;
+	}
+	return NULL;
+}
+
+// Writes a record with the given format id and payload
+static void log_binary_record(char tag, int severity, const char* name, uint32_t fmt_id, char* record, size_t payload_size)
+{
+	LogString* name_entry = name ? log_binary_intern(name) : NULL;
+	uint32_t name_id = name_entry ? name_entry->id : LOG_BINARY_NONE;
+	uint32_t frame = time_framecount();
+	int64_t now = time(NULL);
+	uint16_t size = payload_size;
+
+	record[0] = tag;
+	record[1] = severity;
+	memcpy(record + 2, &name_id, 4);
+	memcpy(record + 6, &fmt_id, 4);
+	memcpy(record + 10, &frame, 4);
+	memcpy(record + 14, &now, 8);
+	memcpy(record + 22, &size, 2);
+	fwrite(record, 1, LOG_BINARY_HEADER + payload_size, log_file);
+}
+
+// Writes an already formatted message
+static void log_binary_text(int severity, const char* name, const char* msg)
+{
+	char record[LOG_BINARY_HEADER + LOG_BINARY_MAX_PAYLOAD];
+	size_t len = min(strlen(msg), LOG_BINARY_MAX_PAYLOAD);
+	memcpy(record + LOG_BINARY_HEADER, msg, len);
+	log_binary_record('T', severity, name, LOG_BINARY_NONE, record, len);
+	fflush(log_file);
+}
+
+static int log_text_message(int severity, const char* name, const char* fmt, va_list args);
+
+// Records the format string id and the raw arguments without formatting
+static int log_binary_message(int severity, const char* name, const char* fmt, va_list args)
+{
+	LogString* entry = log_binary_intern(fmt);
+	// Fall back to formatting if the format string can't be interned
+	if (entry == NULL)
+		return log_text_message(severity, name, fmt, args);
+
+	char record[LOG_BINARY_HEADER + LOG_BINARY_MAX_PAYLOAD];
+	char* payload = record + LOG_BINARY_HEADER;
+
+	for (const char* type = entry->sig; *type; type++)
+	{
+		switch (*type)
+		{
+		case 'i': {
+			int32_t val = va_arg(args, int);
+			memcpy(payload, &val, sizeof val);
+			payload += sizeof val;
+			break;
+		}
+		case 'f': {
+			double val = va_arg(args, double);
+			memcpy(payload, &val, sizeof val);
+			payload += sizeof val;
+			break;
+		}
+		case 's': {
+			const char* val = va_arg(args, const char*);
+			if (val == NULL)
+				val = "(null)";
+			uint16_t len = strnlen(val, LOG_BINARY_MAX_STRING);
+			memcpy(payload, &len, sizeof len);
+			memcpy(payload + sizeof len, val, len);
+			payload += sizeof len + len;
+			break;
+		}
+		case 'p': {
+			uint64_t val = (uintptr_t)va_arg(args, void*);
+			memcpy(payload, &val, sizeof val);
+			payload += sizeof val;
+			break;
+		}
+		case '1': {
+			float val = va_arg(args, double);
+			memcpy(payload, &val, sizeof val);
+			payload += sizeof val;
+			break;
+		}
+		case '2': {
+			vec2 val = va_arg(args, vec2);
+			memcpy(payload, &val, sizeof val);
+			payload += sizeof val;
+			break;
+		}
+		case '3': {
+			vec3 val = va_arg(args, vec3);
+			memcpy(payload, &val, sizeof val);
+			payload += sizeof val;
+			break;
+		}
+		case '4': {
+			vec4 val = va_arg(args, vec4);
+			memcpy(payload, &val, sizeof val);
+			payload += sizeof val;
+			break;
+		}
+		case 'm': {
+			mat4 val = va_arg(args, mat4);
+			memcpy(payload, &val, sizeof val);
+			payload += sizeof val;
+			break;
+		}
+		}
+	}
+
+	size_t payload_size = payload - (record + LOG_BINARY_HEADER);
+	log_binary_record('M', severity, name, entry->id, record, payload_size);
+	last_severity = severity;
+	return payload_size;
+}
+
 int log_init()
 {
 	if (log_file)
@@ -49,6 +318,17 @@ int log_init()
 	timeinfo = localtime(&rawtime);
 	create_dirs("./logs");
 	strftime(fname, sizeof fname, "./logs/%F_%H", timeinfo);
+
+	if (log_mode == LOG_MODE_BINARY)
+	{
+		strcat(fname, ".blog");
+		log_file = fopen(fname, "wb");
+		if (log_file == NULL)
+			return -1;
+		log_binary_begin();
+		return 0;
+	}
+
 	strcat(fname, ".log");
 	log_file = fopen(fname, "w");
 	if (log_file == NULL)
@@ -56,6 +336,11 @@ int log_init()
 	return 0;
 }
 
+void log_set_mode(int mode)
+{
+	log_mode = mode;
+}
+
 void log_terminate()
 {
 	if (log_file == NULL)
@@ -64,18 +349,25 @@ void log_terminate()
 	log_file = NULL;
 }
 
+// The binary log file receives the whole message as a text record instead
 #ifdef DEBUG
-#define WRITE(s)        \
-	fputs(s, stdout);   \
-	fputs(s, log_file); \
-	fflush(log_file);
+#define WRITE(s)                   \
+	fputs(s, stdout);              \
+	if (log_mode == LOG_MODE_TEXT) \
+	{                              \
+		fputs(s, log_file);        \
+		fflush(log_file);          \
+	}
 #else
 #define WRITE(s)      \
 	fputs(s, stdout); \
-	fputs(s, log_file);
+	if (log_mode == LOG_MODE_TEXT) \
+		fputs(s, log_file);
 #endif
 
 static int message_count[LOG_SEVERIY_MAX] = {0};
+// Serializes messages from worker threads
+static volatile int log_lock = 0;
 
 int log_get_count(int severity)
 {
@@ -87,6 +379,9 @@ int log_get_count(int severity)
 
 int log_call(int severity, const char* name, const char* fmt, ...)
 {
+	while (__atomic_exchange_n(&log_lock, 1, __ATOMIC_ACQUIRE))
+		;
+
 	if (severity <= -1)
 		severity = last_severity;
 
@@ -95,6 +390,38 @@ int log_call(int severity, const char* name, const char* fmt, ...)
 
 	++message_count[severity];
 
+	va_list args;
+	va_start(args, fmt);
+	int result;
+	if (log_mode == LOG_MODE_BINARY && severity < LOG_SEVERITY_WARNING)
+		result = log_binary_message(severity, name, fmt, args);
+	else
+		result = log_text_message(severity, name, fmt, args);
+	va_end(args);
+
+	__atomic_store_n(&log_lock, 0, __ATOMIC_RELEASE);
+
+#ifdef DEBUG
+	if (severity == LOG_SEVERITY_ERROR)
+	{
+		SLEEP(1);
+	}
+#endif
+
+	// Terminate at assert
+	if (severity == LOG_SEVERITY_ASSERT)
+	{
+		if (log_file)
+			fflush(log_file);
+		SLEEP(1);
+		abort();
+	}
+
+	return result;
+}
+
+static int log_text_message(int severity, const char* name, const char* fmt, va_list args)
+{
 	static const int color_map[] = {CONSOLE_WHITE, CONSOLE_BLUE, CONSOLE_YELLOW, CONSOLE_RED, CONSOLE_MAGENTA};
 	set_print_color(color_map[severity]);
 	last_severity = severity;
@@ -155,30 +482,285 @@ int log_call(int severity, const char* name, const char* fmt, ...)
 	}
 
 	// Format the message
-	va_list args;
-	va_start(args, fmt);
 	string_vformat(buf, sizeof buf, fmt, args);
 	last_log_length += strlen(buf);
 
-	va_end(args);
-
 	WRITE(buf);
 	WRITE("\n");
 
-#ifdef DEBUG
-	if (severity == LOG_SEVERITY_ERROR)
+	if (log_mode == LOG_MODE_BINARY)
+		log_binary_text(severity, name, buf);
+
+	set_print_color(CONSOLE_WHITE);
+	return last_log_length;
+}
+// Formats a binary message by formatting each specifier separately with its recorded argument
+static void log_decode_message(char* str, size_t size, const char* fmt, const char* data, const char* end)
+{
+	char spec_fmt[64];
+	char tmp[1024];
+	size_t len = 0;
+	const char* start;
+	unsigned int width;
+	const char* spec;
+
+	str[0] = '\0';
+	while ((spec = log_next_spec(fmt, &start, &width)))
 	{
-		SLEEP(1);
+		// Literal text before the specifier
+		size_t lit = min((size_t)(start - fmt), size - len - 1);
+		memcpy(str + len, fmt, lit);
+		len += lit;
+
+		size_t spec_len = min((size_t)(spec - start + 1), sizeof spec_fmt - 1);
+		memcpy(spec_fmt, start, spec_len);
+		spec_fmt[spec_len] = '\0';
+		fmt = spec + 1;
+
+		char type = log_arg_type(*spec, width);
+		size_t arg_size = 0;
+		switch (type)
+		{
+		case 'i':
+			arg_size = sizeof(int32_t);
+			break;
+		case 'f':
+		case 'p':
+			arg_size = 8;
+			break;
+		case 's':
+			arg_size = sizeof(uint16_t);
+			break;
+		case '1':
+		case '2':
+		case '3':
+		case '4':
+			arg_size = (type - '0') * sizeof(float);
+			break;
+		case 'm':
+			arg_size = sizeof(mat4);
+			break;
+		}
+
+		// Truncated record
+		if (data + arg_size > end)
+			break;
+
+		// Strings are followed by their characters
+		uint16_t str_len = 0;
+		if (type == 's')
+		{
+			memcpy(&str_len, data, sizeof str_len);
+			if (data + arg_size + str_len > end)
+				break;
+		}
+
+		switch (type)
+		{
+		case 'i': {
+			int32_t val;
+			memcpy(&val, data, sizeof val);
+			string_format(tmp, sizeof tmp, spec_fmt, val);
+			break;
+		}
+		case 'f': {
+			double val;
+			memcpy(&val, data, sizeof val);
+			string_format(tmp, sizeof tmp, spec_fmt, val);
+			break;
+		}
+		case 's': {
+			// The writer never stores more, longer strings come from a corrupt file and are cut
+			uint16_t copy_len = str_len < LOG_BINARY_MAX_STRING ? str_len : LOG_BINARY_MAX_STRING;
+			char val[LOG_BINARY_MAX_STRING + 1];
+			memcpy(val, data + arg_size, copy_len);
+			val[copy_len] = '\0';
+			arg_size += str_len;
+			string_format(tmp, sizeof tmp, spec_fmt, val);
+			break;
+		}
+		case 'p': {
+			uint64_t val;
+			memcpy(&val, data, sizeof val);
+			string_format(tmp, sizeof tmp, spec_fmt, (void*)(uintptr_t)val);
+			break;
+		}
+		case '1': {
+			float val;
+			memcpy(&val, data, sizeof val);
+			string_format(tmp, sizeof tmp, spec_fmt, (double)val);
+			break;
+		}
+		case '2': {
+			vec2 val;
+			memcpy(&val, data, sizeof val);
+			string_format(tmp, sizeof tmp, spec_fmt, val);
+			break;
+		}
+		case '3': {
+			vec3 val;
+			memcpy(&val, data, sizeof val);
+			string_format(tmp, sizeof tmp, spec_fmt, val);
+			break;
+		}
+		case '4': {
+			vec4 val;
+			memcpy(&val, data, sizeof val);
+			string_format(tmp, sizeof tmp, spec_fmt, val);
+			break;
+		}
+		case 'm': {
+			mat4 val;
+			memcpy(&val, data, sizeof val);
+			string_format(tmp, sizeof tmp, spec_fmt, val);
+			break;
+		}
+		default:
+			string_format(tmp, sizeof tmp, spec_fmt);
+			break;
+		}
+		data += arg_size;
+
+		size_t tmp_len = min(strlen(tmp), size - len - 1);
+		memcpy(str + len, tmp, tmp_len);
+		len += tmp_len;
+		str[len] = '\0';
 	}
-#endif
 
-	// Terminate at assert
-	if (severity == LOG_SEVERITY_ASSERT)
+	// Remaining literal text
+	size_t lit = min(strlen(fmt), size - len - 1);
+	memcpy(str + len, fmt, lit);
+	str[len + lit] = '\0';
+}
+
+int log_decode(FILE* in, FILE* out)
+{
+	char magic[4];
+	uint32_t version;
+	if (fread(magic, sizeof magic, 1, in) != 1 || memcmp(magic, LOG_BINARY_MAGIC, sizeof magic) != 0)
+		return -1;
+	if (fread(&version, sizeof version, 1, in) != 1 || version != LOG_BINARY_VERSION)
+		return -1;
+
+	char** strings = NULL;
+	uint32_t string_count = 0;
+
+	int result = 0;
+	uint32_t last_frame = 0;
+	size_t last_length = 0;
+	char record[LOG_BINARY_HEADER + LOG_BINARY_MAX_PAYLOAD];
+	char buf[4096];
+
+	int tag;
+	while ((tag = fgetc(in)) != EOF)
 	{
-		SLEEP(1);
-		abort();
+		if (tag == 'S')
+		{
+			uint32_t id;
+			uint16_t len;
+			if (fread(&id, sizeof id, 1, in) != 1 || fread(&len, sizeof len, 1, in) != 1)
+			{
+				result = -1;
+				break;
+			}
+
+			if (id >= string_count)
+			{
+				strings = realloc(strings, (id + 1) * sizeof *strings);
+				memset(strings + string_count, 0, (id + 1 - string_count) * sizeof *strings);
+				string_count = id + 1;
+			}
+
+			free(strings[id]);
+			strings[id] = malloc(len + 1);
+			if (fread(strings[id], 1, len, in) != len)
+			{
+				result = -1;
+				break;
+			}
+			strings[id][len] = '\0';
+			continue;
+		}
+
+		if (tag != 'M' && tag != 'T')
+		{
+			result = -1;
+			break;
+		}
+
+		record[0] = tag;
+		if (fread(record + 1, 1, LOG_BINARY_HEADER - 1, in) != LOG_BINARY_HEADER - 1)
+		{
+			result = -1;
+			break;
+		}
+
+		uint32_t name_id, fmt_id, frame;
+		int64_t time_point;
+		uint16_t size;
+		int severity = min((unsigned char)record[1], LOG_SEVERIY_MAX);
+		memcpy(&name_id, record + 2, 4);
+		memcpy(&fmt_id, record + 6, 4);
+		memcpy(&frame, record + 10, 4);
+		memcpy(&time_point, record + 14, 8);
+		memcpy(&size, record + 22, 2);
+
+		char* payload = record + LOG_BINARY_HEADER;
+		if (size > LOG_BINARY_MAX_PAYLOAD || fread(payload, 1, size, in) != size)
+		{
+			result = -1;
+			break;
+		}
+
+		// Divider between frames
+		if (frame != last_frame)
+		{
+			last_frame = frame;
+			last_length = min(64, last_length);
+			for (size_t i = 0; i < last_length; i++)
+				fputc('-', out);
+			fputc('\n', out);
+		}
+
+		last_length = 0;
+
+		const char* name = name_id < string_count ? strings[name_id] : NULL;
+		if (name)
+		{
+			static const char* severity_names[] = {"", "", " WARNING ", " ERROR ", " ASSERT "};
+			time_t rawtime = time_point;
+			char timestr[32];
+			strftime(timestr, sizeof timestr, "%H:%M.%S", localtime(&rawtime));
+			last_length += fprintf(out, "[ %s @ %s ]%s: ", name, timestr, severity_names[severity]);
+		}
+		else
+		{
+			last_length += fprintf(out, " -> ");
+		}
+
+		if (tag == 'T')
+		{
+			size = min(size, sizeof buf - 1);
+			memcpy(buf, payload, size);
+			buf[size] = '\0';
+		}
+		else if (fmt_id < string_count && strings[fmt_id])
+		{
+			log_decode_message(buf, sizeof buf, strings[fmt_id], payload, payload + size);
+		}
+		else
+		{
+			string_format(buf, sizeof buf, "[unknown format string %d]", fmt_id);
+		}
+
+		last_length += strlen(buf);
+		fputs(buf, out);
+		fputc('\n', out);
 	}
 
-	set_print_color(CONSOLE_WHITE);
-	return last_log_length;
-}
\ No newline at end of file
+	for (uint32_t i = 0; i < string_count; i++)
+		free(strings[i]);
+	free(strings);
+
+	return result;
+}
@@ -0,0 +1,625 @@
+#include "physics.h"
+#include "jobs.h"
+#include "log.h"
+#include "magpie.h"
+#include "math/math.h"
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+// The solver state of a point of a contact
+// Impulses are applied along the normal and two tangents, in that order
+struct ContactPoint
+{
+	// From the centers of mass to the point
+	vec3 ra;
+	vec3 rb;
+	// The change in angular velocity of each body by a unit impulse along each direction
+	// Found once per step since the inertia of a body needs to be rotated into world space
+	vec3 angular_a[3];
+	vec3 angular_b[3];
+	// The inverse of the mass an impulse along each direction acts on
+	float mass[3];
+	// The separating velocity the point is solved towards
+	float bias;
+	// The total impulses applied this step
+	float impulse[3];
+};
+
+// The solver state of a contact
+struct ContactConstraint
+{
+	struct ContactPoint points[COLLIDER_MAX_CONTACT_POINTS];
+	uint32_t point_count;
+	// The normal and two tangents
+	vec3 directions[3];
+	float friction;
+};
+
+struct Physics
+{
+	vec3 gravity;
+	// The time not yet simulated
+	float accumulator;
+	Broadphase* broadphase;
+
+	// Per body
+	const BaseCollider** colliders;
+	// The union find forest grouping bodies into islands
+	uint32_t* parents;
+	// The island of each body, UINT32_MAX if not in an island
+	uint32_t* body_islands;
+	// The bodies sorted by island, the bodies of island i start at island_body_start[i]
+	uint32_t* island_bodies;
+	uint32_t* island_body_start;
+	uint32_t body_size;
+
+	// Per tested pair
+	BroadphasePair* pairs;
+	Contact* contacts;
+	struct ContactConstraint* constraints;
+	// The contacts of the last step, their impulses are the starting point for the contacts of this step
+	Contact* previous_contacts;
+	struct ContactConstraint* previous_constraints;
+	uint32_t previous_count;
+	// The previous contacts of each body as a, linked through previous_next
+	uint32_t* previous_first;
+	uint32_t* previous_next;
+	// The contacts sorted by island, the contacts of island i start at island_contact_start[i]
+	uint32_t* island_contacts;
+	uint32_t* island_contact_start;
+	uint32_t contact_count;
+	uint32_t contact_size;
+
+	uint32_t island_count;
+
+	// The step being solved by the island jobs
+	const PhysicsBody* bodies;
+	float dt;
+};
+
+Physics* physics_create()
+{
+	Physics* physics = calloc(1, sizeof *physics);
+	physics->gravity = (vec3){0, -9.81f, 0};
+	physics->broadphase = broadphase_create();
+	return physics;
+}
+
+void physics_set_gravity(Physics* physics, vec3 gravity)
+{
+	physics->gravity = gravity;
+}
+
+vec3 physics_get_gravity(Physics* physics)
+{
+	return physics->gravity;
+}
+
+static void physics_reserve_bodies(Physics* physics, uint32_t count)
+{
+	if (count <= physics->body_size)
+		return;
+
+	uint32_t size = physics->body_size ? physics->body_size : 64;
+	while (size < count)
+		size <<= 1;
+	physics->colliders = realloc(physics->colliders, size * sizeof *physics->colliders);
+	physics->parents = realloc(physics->parents, size * sizeof *physics->parents);
+	physics->body_islands = realloc(physics->body_islands, size * sizeof *physics->body_islands);
+	physics->island_bodies = realloc(physics->island_bodies, size * sizeof *physics->island_bodies);
+	physics->previous_first = realloc(physics->previous_first, size * sizeof *physics->previous_first);
+	// There is at most one island per body
+	physics->island_body_start = realloc(physics->island_body_start, (size + 1) * sizeof *physics->island_body_start);
+	physics->island_contact_start = realloc(physics->island_contact_start, (size + 1) * sizeof *physics->island_contact_start);
+	physics->body_size = size;
+}
+
+static void physics_reserve_contacts(Physics* physics, uint32_t count)
+{
+	if (count <= physics->contact_size)
+		return;
+
+	uint32_t size = physics->contact_size ? physics->contact_size : 64;
+	while (size < count)
+		size <<= 1;
+	physics->pairs = realloc(physics->pairs, size * sizeof *physics->pairs);
+	physics->contacts = realloc(physics->contacts, size * sizeof *physics->contacts);
+	physics->constraints = realloc(physics->constraints, size * sizeof *physics->constraints);
+	physics->previous_contacts = realloc(physics->previous_contacts, size * sizeof *physics->previous_contacts);
+	physics->previous_constraints = realloc(physics->previous_constraints, size * sizeof *physics->previous_constraints);
+	physics->previous_next = realloc(physics->previous_next, size * sizeof *physics->previous_next);
+	physics->island_contacts = realloc(physics->island_contacts, size * sizeof *physics->island_contacts);
+	physics->contact_size = size;
+}
+
+// Kinematic bodies are moving if they have a velocity, dynamic bodies if they are awake
+static bool physics_is_active(const Rigidbody* rigidbody)
+{
+	if (rigidbody_is_dynamic(rigidbody))
+		return !rigidbody->asleep;
+	return vec3_sqrmag(rigidbody->velocity) > 0 || vec3_sqrmag(rigidbody->angular_velocity) > 0;
+}
+
+// Contacts are only needed if they can push an awake dynamic body or wake up a sleeping one
+static bool physics_pair_needed(const PhysicsBody* a, const PhysicsBody* b)
+{
+	if (a->collider == NULL || b->collider == NULL)
+		return false;
+	if (!rigidbody_is_dynamic(a->rigidbody) && !rigidbody_is_dynamic(b->rigidbody))
+		return false;
+	return physics_is_active(a->rigidbody) || physics_is_active(b->rigidbody);
+}
+
+// Keeps the solved contacts of the last step and links them to their first body
+static void physics_keep_previous(Physics* physics, uint32_t count)
+{
+	Contact* contacts = physics->previous_contacts;
+	physics->previous_contacts = physics->contacts;
+	physics->contacts = contacts;
+	struct ContactConstraint* constraints = physics->previous_constraints;
+	physics->previous_constraints = physics->constraints;
+	physics->constraints = constraints;
+	physics->previous_count = physics->contact_count;
+	physics->contact_count = 0;
+
+	for (uint32_t i = 0; i < count; i++)
+		physics->previous_first[i] = UINT32_MAX;
+
+	// Bodies may have been removed since
+	for (uint32_t i = 0; i < physics->previous_count; i++)
+	{
+		uint32_t a = physics->previous_contacts[i].a;
+		if (a >= count)
+			continue;
+		physics->previous_next[i] = physics->previous_first[a];
+		physics->previous_first[a] = i;
+	}
+}
+
+// Finds the pairs of overlapping bounds and tests their colliders
+static void physics_find_contacts(Physics* physics, const PhysicsBody* bodies, uint32_t count)
+{
+	broadphase_set_count(physics->broadphase, count);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const SphereCollider* sphere = bodies[i].bounds;
+		vec3 center = vec3_add(sphere->base.transform->position, sphere->base.origin);
+		broadphase_set(physics->broadphase, i, center, sphere->radius * vec3_largest(sphere->base.transform->scale));
+		physics->colliders[i] = bodies[i].collider;
+	}
+
+	uint32_t overlap_count = broadphase_update(physics->broadphase);
+	const BroadphasePair* overlaps = broadphase_get_pairs(physics->broadphase, &overlap_count);
+	physics_reserve_contacts(physics, overlap_count);
+
+	uint32_t pair_count = 0;
+	for (uint32_t i = 0; i < overlap_count; i++)
+	{
+		if (physics_pair_needed(&bodies[overlaps[i].a], &bodies[overlaps[i].b]))
+			physics->pairs[pair_count++] = overlaps[i];
+	}
+
+	physics->contact_count = collider_intersect_pairs(physics->colliders, physics->pairs, pair_count, physics->contacts);
+}
+
+static uint32_t physics_find_root(uint32_t* parents, uint32_t i)
+{
+	while (parents[i] != i)
+	{
+		// Halve the path on the way up
+		parents[i] = parents[parents[i]];
+		i = parents[i];
+	}
+	return i;
+}
+
+// A contact belongs to the island of its dynamic bodies
+static uint32_t physics_contact_island(const Physics* physics, const Contact* contact)
+{
+	uint32_t island = physics->body_islands[contact->a];
+	return island != UINT32_MAX ? island : physics->body_islands[contact->b];
+}
+
+// Groups the awake dynamic bodies connected by contacts into islands
+// Sleeping bodies touched by an awake body are woken up
+static void physics_build_islands(Physics* physics, const PhysicsBody* bodies, uint32_t count)
+{
+	uint32_t* parents = physics->parents;
+	for (uint32_t i = 0; i < count; i++)
+		parents[i] = i;
+
+	for (uint32_t i = 0; i < physics->contact_count; i++)
+	{
+		Rigidbody* a = bodies[physics->contacts[i].a].rigidbody;
+		Rigidbody* b = bodies[physics->contacts[i].b].rigidbody;
+		if (rigidbody_is_dynamic(a) && a->asleep)
+			rigidbody_wake(a);
+		if (rigidbody_is_dynamic(b) && b->asleep)
+			rigidbody_wake(b);
+
+		if (rigidbody_is_dynamic(a) && rigidbody_is_dynamic(b))
+		{
+			uint32_t root_a = physics_find_root(parents, physics->contacts[i].a);
+			uint32_t root_b = physics_find_root(parents, physics->contacts[i].b);
+			// The lower index becomes the root to number the islands in body order
+			parents[max(root_a, root_b)] = min(root_a, root_b);
+		}
+	}
+
+	// Number the islands by their first body, a root always comes before the rest of its island
+	physics->island_count = 0;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		physics->body_islands[i] = UINT32_MAX;
+		if (!rigidbody_is_dynamic(bodies[i].rigidbody) || bodies[i].rigidbody->asleep)
+			continue;
+
+		uint32_t root = physics_find_root(parents, i);
+		physics->body_islands[i] = root == i ? physics->island_count++ : physics->body_islands[root];
+	}
+
+	// Sort the bodies and contacts by island by counting them
+	uint32_t* body_start = physics->island_body_start;
+	uint32_t* contact_start = physics->island_contact_start;
+	memset(body_start, 0, (physics->island_count + 1) * sizeof *body_start);
+	memset(contact_start, 0, (physics->island_count + 1) * sizeof *contact_start);
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		if (physics->body_islands[i] != UINT32_MAX)
+			body_start[physics->body_islands[i] + 1]++;
+	}
+
+	for (uint32_t i = 0; i < physics->contact_count; i++)
+		contact_start[physics_contact_island(physics, &physics->contacts[i]) + 1]++;
+
+	for (uint32_t i = 0; i < physics->island_count; i++)
+	{
+		body_start[i + 1] += body_start[i];
+		contact_start[i + 1] += contact_start[i];
+	}
+
+	// Scattering moves each start to the start of the next island
+	for (uint32_t i = 0; i < count; i++)
+	{
+		if (physics->body_islands[i] != UINT32_MAX)
+			physics->island_bodies[body_start[physics->body_islands[i]]++] = i;
+	}
+	for (uint32_t i = 0; i < physics->contact_count; i++)
+		physics->island_contacts[contact_start[physics_contact_island(physics, &physics->contacts[i])]++] = i;
+
+	for (uint32_t i = physics->island_count; i > 0; i--)
+	{
+		body_start[i] = body_start[i - 1];
+		contact_start[i] = contact_start[i - 1];
+	}
+	body_start[0] = 0;
+	contact_start[0] = 0;
+}
+
+// Returns the inverse inertia of a body applied to v, zero for kinematic bodies
+static vec3 physics_angular(const PhysicsBody* body, vec3 v)
+{
+	if (!rigidbody_is_dynamic(body->rigidbody))
+		return vec3_zero;
+	return rigidbody_apply_inverse_inertia(body->rigidbody, body->transform, v);
+}
+
+static float physics_inverse_mass(const PhysicsBody* body)
+{
+	return rigidbody_is_dynamic(body->rigidbody) ? body->rigidbody->inverse_mass : 0;
+}
+
+// Returns the velocity of the contact point on b relative to a
+static vec3 physics_relative_velocity(const PhysicsBody* a, const PhysicsBody* b, const struct ContactPoint* point)
+{
+	vec3 va = vec3_add(a->rigidbody->velocity, vec3_cross(a->rigidbody->angular_velocity, point->ra));
+	vec3 vb = vec3_add(b->rigidbody->velocity, vec3_cross(b->rigidbody->angular_velocity, point->rb));
+	return vec3_sub(vb, va);
+}
+
+// Pushes b by impulse along direction i of the constraint and a the opposite way
+// Kinematic bodies are shared between islands and never written
+static void physics_apply_impulse(const PhysicsBody* a, const PhysicsBody* b, const struct ContactConstraint* constraint, const struct ContactPoint* point,
+								  uint32_t i, float impulse)
+{
+	if (rigidbody_is_dynamic(a->rigidbody))
+	{
+		Rigidbody* rigidbody = a->rigidbody;
+		rigidbody->velocity = vec3_sub(rigidbody->velocity, vec3_scale(constraint->directions[i], impulse * rigidbody->inverse_mass));
+		rigidbody->angular_velocity = vec3_sub(rigidbody->angular_velocity, vec3_scale(point->angular_a[i], impulse));
+	}
+	if (rigidbody_is_dynamic(b->rigidbody))
+	{
+		Rigidbody* rigidbody = b->rigidbody;
+		rigidbody->velocity = vec3_add(rigidbody->velocity, vec3_scale(constraint->directions[i], impulse * rigidbody->inverse_mass));
+		rigidbody->angular_velocity = vec3_add(rigidbody->angular_velocity, vec3_scale(point->angular_b[i], impulse));
+	}
+}
+
+// Returns the constraint of the same pair of bodies last step
+static const struct ContactConstraint* physics_find_previous(const Physics* physics, const Contact* contact)
+{
+	for (uint32_t i = physics->previous_first[contact->a]; i != UINT32_MAX; i = physics->previous_next[i])
+	{
+		if (physics->previous_contacts[i].b == contact->b)
+			return &physics->previous_constraints[i];
+	}
+	return NULL;
+}
+
+static void physics_prepare_contact(Physics* physics, uint32_t index)
+{
+	const Contact* contact = &physics->contacts[index];
+	struct ContactConstraint* constraint = &physics->constraints[index];
+	const PhysicsBody* a = &physics->bodies[contact->a];
+	const PhysicsBody* b = &physics->bodies[contact->b];
+	vec3 normal = contact->normal;
+
+	// Any two directions perpendicular to the normal and each other
+	vec3 tangent = fabsf(normal.x) >= 0.57735f ? (vec3){normal.y, -normal.x, 0} : (vec3){0, normal.z, -normal.y};
+	constraint->directions[0] = normal;
+	constraint->directions[1] = vec3_norm(tangent);
+	constraint->directions[2] = vec3_cross(normal, constraint->directions[1]);
+	constraint->friction = sqrtf(a->rigidbody->friction * b->rigidbody->friction);
+	float restitution = max(a->rigidbody->restitution, b->rigidbody->restitution);
+	float inverse_mass = physics_inverse_mass(a) + physics_inverse_mass(b);
+
+	vec3 positions[COLLIDER_MAX_CONTACT_POINTS];
+	float depths[COLLIDER_MAX_CONTACT_POINTS];
+	constraint->point_count = collider_contact_points(a->collider, b->collider, contact, positions, depths);
+	for (uint32_t i = 0; i < constraint->point_count; i++)
+	{
+		struct ContactPoint* point = &constraint->points[i];
+		point->ra = vec3_sub(positions[i], a->transform->position);
+		point->rb = vec3_sub(positions[i], b->transform->position);
+
+		for (uint32_t j = 0; j < 3; j++)
+		{
+			vec3 direction = constraint->directions[j];
+			point->angular_a[j] = physics_angular(a, vec3_cross(point->ra, direction));
+			point->angular_b[j] = physics_angular(b, vec3_cross(point->rb, direction));
+			vec3 angular = vec3_add(vec3_cross(point->angular_a[j], point->ra), vec3_cross(point->angular_b[j], point->rb));
+			float k = inverse_mass + vec3_dot(angular, direction);
+			point->mass[j] = k > 0 ? 1 / k : 0;
+			point->impulse[j] = 0;
+		}
+
+		// Push apart penetrating bodies over several steps, or bounce if approaching fast enough
+		float approach = vec3_dot(physics_relative_velocity(a, b, point), normal);
+		point->bias = PHYSICS_BAUMGARTE / physics->dt * max(depths[i] - PHYSICS_SLOP, 0.0f);
+		if (approach < -PHYSICS_RESTITUTION_VELOCITY)
+			point->bias = max(point->bias, -restitution * approach);
+	}
+
+	// Points which barely moved since the last step start with the impulses they ended with
+	const struct ContactConstraint* previous = physics_find_previous(physics, contact);
+	for (uint32_t i = 0; previous && i < constraint->point_count; i++)
+	{
+		struct ContactPoint* point = &constraint->points[i];
+		for (uint32_t j = 0; j < previous->point_count; j++)
+		{
+			const struct ContactPoint* previous_point = &previous->points[j];
+			if (vec3_sqrdistance(point->ra, previous_point->ra) < PHYSICS_MATCH_DISTANCE * PHYSICS_MATCH_DISTANCE)
+			{
+				memcpy(point->impulse, previous_point->impulse, sizeof point->impulse);
+				break;
+			}
+		}
+	}
+}
+
+// Applies the impulses a contact started with
+static void physics_warm_start_contact(Physics* physics, uint32_t index)
+{
+	const Contact* contact = &physics->contacts[index];
+	const struct ContactConstraint* constraint = &physics->constraints[index];
+	const PhysicsBody* a = &physics->bodies[contact->a];
+	const PhysicsBody* b = &physics->bodies[contact->b];
+
+	for (uint32_t i = 0; i < constraint->point_count; i++)
+	{
+		const struct ContactPoint* point = &constraint->points[i];
+		for (uint32_t j = 0; j < 3; j++)
+			physics_apply_impulse(a, b, constraint, point, j, point->impulse[j]);
+	}
+}
+
+static void physics_solve_contact(Physics* physics, uint32_t index)
+{
+	const Contact* contact = &physics->contacts[index];
+	struct ContactConstraint* constraint = &physics->constraints[index];
+	const PhysicsBody* a = &physics->bodies[contact->a];
+	const PhysicsBody* b = &physics->bodies[contact->b];
+
+	for (uint32_t i = 0; i < constraint->point_count; i++)
+	{
+		struct ContactPoint* point = &constraint->points[i];
+
+		// Friction is limited by the current normal impulse
+		float max_friction = constraint->friction * point->impulse[0];
+		for (uint32_t j = 1; j < 3; j++)
+		{
+			vec3 velocity = physics_relative_velocity(a, b, point);
+			float impulse = -vec3_dot(velocity, constraint->directions[j]) * point->mass[j];
+			float total = point->impulse[j] + impulse;
+			total = total < -max_friction ? -max_friction : total > max_friction ? max_friction : total;
+			impulse = total - point->impulse[j];
+			point->impulse[j] = total;
+			physics_apply_impulse(a, b, constraint, point, j, impulse);
+		}
+
+		// The total impulse can only push the bodies apart, earlier iterations may have pushed too much
+		vec3 velocity = physics_relative_velocity(a, b, point);
+		float impulse = (point->bias - vec3_dot(velocity, constraint->directions[0])) * point->mass[0];
+		float total = max(point->impulse[0] + impulse, 0.0f);
+		impulse = total - point->impulse[0];
+		point->impulse[0] = total;
+		physics_apply_impulse(a, b, constraint, point, 0, impulse);
+	}
+}
+
+// Solves the contacts of an island, moves its bodies and puts it to sleep if it stayed still
+static void physics_solve_island(Physics* physics, uint32_t island)
+{
+	const uint32_t* contacts = physics->island_contacts + physics->island_contact_start[island];
+	uint32_t contact_count = physics->island_contact_start[island + 1] - physics->island_contact_start[island];
+	const uint32_t* bodies = physics->island_bodies + physics->island_body_start[island];
+	uint32_t body_count = physics->island_body_start[island + 1] - physics->island_body_start[island];
+
+	for (uint32_t i = 0; i < contact_count; i++)
+		physics_prepare_contact(physics, contacts[i]);
+
+	// After all contacts are prepared, so that the bounce of each contact is found from the velocities before solving
+	for (uint32_t i = 0; i < contact_count; i++)
+		physics_warm_start_contact(physics, contacts[i]);
+
+	for (uint32_t iteration = 0; iteration < PHYSICS_ITERATIONS; iteration++)
+	{
+		for (uint32_t i = 0; i < contact_count; i++)
+			physics_solve_contact(physics, contacts[i]);
+	}
+
+	float rest_time = FLT_MAX;
+	for (uint32_t i = 0; i < body_count; i++)
+	{
+		const PhysicsBody* body = &physics->bodies[bodies[i]];
+		Rigidbody* rigidbody = body->rigidbody;
+		const float sleep_velocity = PHYSICS_SLEEP_VELOCITY * PHYSICS_SLEEP_VELOCITY;
+		if (vec3_sqrmag(rigidbody->velocity) > sleep_velocity || vec3_sqrmag(rigidbody->angular_velocity) > sleep_velocity)
+			rigidbody->rest_time = 0;
+		else
+			rigidbody->rest_time += physics->dt;
+		rest_time = min(rest_time, rigidbody->rest_time);
+
+		rigidbody_update(rigidbody, body->transform, physics->dt);
+	}
+
+	// The whole island sleeps at once so that no awake body rests on a sleeping one
+	if (rest_time < PHYSICS_SLEEP_TIME)
+		return;
+
+	for (uint32_t i = 0; i < body_count; i++)
+	{
+		Rigidbody* rigidbody = physics->bodies[bodies[i]].rigidbody;
+		rigidbody->velocity = vec3_zero;
+		rigidbody->angular_velocity = vec3_zero;
+		rigidbody->asleep = true;
+	}
+}
+
+static void physics_solve_islands(void* arg, uint32_t begin, uint32_t end)
+{
+	Physics* physics = arg;
+	for (uint32_t i = begin; i < end; i++)
+		physics_solve_island(physics, i);
+}
+
+void physics_step(Physics* physics, const PhysicsBody* bodies, uint32_t count, float dt)
+{
+	physics_reserve_bodies(physics, count);
+
+	for (uint32_t i = 0; i < count; i++)
+		rigidbody_integrate_forces(bodies[i].rigidbody, bodies[i].transform, physics->gravity, dt);
+
+	physics_keep_previous(physics, count);
+	physics_find_contacts(physics, bodies, count);
+	physics_build_islands(physics, bodies, count);
+
+	physics->bodies = bodies;
+	physics->dt = dt;
+	job_parallel_for(physics->island_count, 0, physics_solve_islands, physics);
+
+	// Kinematic bodies are read by the islands and moved after them
+	for (uint32_t i = 0; i < count; i++)
+	{
+		if (!rigidbody_is_dynamic(bodies[i].rigidbody))
+			rigidbody_update(bodies[i].rigidbody, bodies[i].transform, dt);
+	}
+}
+
+uint32_t physics_update(Physics* physics, const PhysicsBody* bodies, uint32_t count, float delta)
+{
+	physics->accumulator += delta;
+
+	uint32_t steps = 0;
+	while (physics->accumulator >= PHYSICS_TIMESTEP && steps < PHYSICS_MAX_STEPS)
+	{
+		physics_step(physics, bodies, count, PHYSICS_TIMESTEP);
+		physics->accumulator -= PHYSICS_TIMESTEP;
+		steps++;
+	}
+
+	// Drop the time that could not be caught up with
+	if (physics->accumulator >= PHYSICS_TIMESTEP)
+		physics->accumulator = 0;
+
+	return steps;
+}
+
+void physics_remove_body(Physics* physics, uint32_t index, uint32_t count)
+{
+	uint32_t last = count - 1;
+	uint32_t kept = 0;
+	for (uint32_t i = 0; i < physics->contact_count; i++)
+	{
+		Contact contact = physics->contacts[i];
+		if (contact.a == index || contact.b == index)
+			continue;
+
+		if (contact.a == last)
+			contact.a = index;
+		if (contact.b == last)
+			contact.b = index;
+		// Pairs are found with a < b, a swapped pair would apply its impulses the wrong way around
+		if (contact.a > contact.b)
+			continue;
+
+		physics->contacts[kept] = contact;
+		physics->constraints[kept] = physics->constraints[i];
+		kept++;
+	}
+	physics->contact_count = kept;
+}
+
+const BroadphasePair* physics_get_overlaps(Physics* physics, uint32_t* count)
+{
+	return broadphase_get_pairs(physics->broadphase, count);
+}
+
+const Broadphase* physics_get_broadphase(Physics* physics)
+{
+	return physics->broadphase;
+}
+
+const Contact* physics_get_contacts(Physics* physics, uint32_t* count)
+{
+	*count = physics->contact_count;
+	return physics->contacts;
+}
+
+uint32_t physics_get_island_count(Physics* physics)
+{
+	return physics->island_count;
+}
+
+void physics_destroy(Physics* physics)
+{
+	broadphase_destroy(physics->broadphase);
+	free(physics->colliders);
+	free(physics->parents);
+	free(physics->body_islands);
+	free(physics->island_bodies);
+	free(physics->island_body_start);
+	free(physics->island_contact_start);
+	free(physics->pairs);
+	free(physics->contacts);
+	free(physics->constraints);
+	free(physics->previous_contacts);
+	free(physics->previous_constraints);
+	free(physics->previous_first);
+	free(physics->previous_next);
+	free(physics->island_contacts);
+	free(physics);
+}
@@ -1,7 +1,95 @@
 #include "rigidbody.h"
-#include "cr_time.h"
 
-void rigidbody_update(Rigidbody* rigidbody, Transform* transform)
+Rigidbody rigidbody_create(float mass, vec3 inertia, float restitution, float friction)
 {
-	transform->position = vec3_add(transform->position, vec3_scale(rigidbody->velocity, time_delta()));
+	Rigidbody rigidbody = {0};
+	rigidbody.restitution = restitution;
+	rigidbody.friction = friction;
+	if (mass <= 0)
+		return rigidbody;
+
+	rigidbody.inverse_mass = 1 / mass;
+	// Axes without inertia can not be rotated
+	rigidbody.inverse_inertia = (vec3){inertia.x > 0 ? 1 / inertia.x : 0, inertia.y > 0 ? 1 / inertia.y : 0, inertia.z > 0 ? 1 / inertia.z : 0};
+	return rigidbody;
+}
+
+vec3 rigidbody_inertia_box(float mass, vec3 halfwidth)
+{
+	vec3 sqr = vec3_prod(halfwidth, halfwidth);
+	return vec3_scale((vec3){sqr.y + sqr.z, sqr.x + sqr.z, sqr.x + sqr.y}, mass / 3);
+}
+
+vec3 rigidbody_inertia_sphere(float mass, float radius)
+{
+	float inertia = 0.4f * mass * radius * radius;
+	return (vec3){inertia, inertia, inertia};
+}
+
+void rigidbody_add_force(Rigidbody* rigidbody, vec3 force)
+{
+	rigidbody->force = vec3_add(rigidbody->force, force);
+	rigidbody->asleep = false;
+}
+
+void rigidbody_add_force_at(Rigidbody* rigidbody, const Transform* transform, vec3 force, vec3 point)
+{
+	rigidbody->force = vec3_add(rigidbody->force, force);
+	rigidbody->torque = vec3_add(rigidbody->torque, vec3_cross(vec3_sub(point, transform->position), force));
+	rigidbody->asleep = false;
+}
+
+void rigidbody_add_impulse(Rigidbody* rigidbody, const Transform* transform, vec3 impulse, vec3 point)
+{
+	if (!rigidbody_is_dynamic(rigidbody))
+		return;
+
+	rigidbody->velocity = vec3_add(rigidbody->velocity, vec3_scale(impulse, rigidbody->inverse_mass));
+	vec3 angular = vec3_cross(vec3_sub(point, transform->position), impulse);
+	rigidbody->angular_velocity = vec3_add(rigidbody->angular_velocity, rigidbody_apply_inverse_inertia(rigidbody, transform, angular));
+	rigidbody->asleep = false;
+}
+
+void rigidbody_wake(Rigidbody* rigidbody)
+{
+	rigidbody->asleep = false;
+	rigidbody->rest_time = 0;
+}
+
+vec3 rigidbody_apply_inverse_inertia(const Rigidbody* rigidbody, const Transform* transform, vec3 v)
+{
+	// Rotate into local space, scale by the principal moments and rotate back
+	vec3 local = quat_transform_vec3(quat_conjugate(transform->rotation), v);
+	return quat_transform_vec3(transform->rotation, vec3_prod(local, rigidbody->inverse_inertia));
+}
+
+void rigidbody_integrate_forces(Rigidbody* rigidbody, const Transform* transform, vec3 gravity, float dt)
+{
+	if (rigidbody_is_dynamic(rigidbody) && !rigidbody->asleep)
+	{
+		vec3 acceleration = vec3_add(gravity, vec3_scale(rigidbody->force, rigidbody->inverse_mass));
+		rigidbody->velocity = vec3_add(rigidbody->velocity, vec3_scale(acceleration, dt));
+		vec3 angular_acceleration = rigidbody_apply_inverse_inertia(rigidbody, transform, rigidbody->torque);
+		rigidbody->angular_velocity = vec3_add(rigidbody->angular_velocity, vec3_scale(angular_acceleration, dt));
+	}
+
+	rigidbody->force = vec3_zero;
+	rigidbody->torque = vec3_zero;
+}
+
+void rigidbody_update(Rigidbody* rigidbody, Transform* transform, float dt)
+{
+	if (rigidbody->asleep)
+		return;
+
+	transform->position = vec3_add(transform->position, vec3_scale(rigidbody->velocity, dt));
+
+	vec3 w = rigidbody->angular_velocity;
+	if (vec3_sqrmag(w) == 0)
+		return;
+
+	// The derivative of the rotation is half the angular velocity times the rotation
+	// Transforms rotate by the conjugate of their quaternion, hence the order and sign
+	quaternion spin = quat_mul(transform->rotation, (quaternion){w.x, w.y, w.z, 0});
+	transform->rotation = quat_norm(quat_add(transform->rotation, quat_scale(spin, -dt * 0.5f)));
 }
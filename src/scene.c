@@ -4,6 +4,26 @@
 #include "log.h"
 #include "graphics/renderer.h"
 #include "graphics/rendertree.h"
+#include "cr_time.h"
+#include "physics.h"
+#include "jobs.h"
+
+// The state of the query broadphase
+enum
+{
+	SCENE_QUERIES_CLEAN,
+	// Entities were added, removed or updated since it was built
+	SCENE_QUERIES_DIRTY,
+	// Being rebuilt by a query
+	SCENE_QUERIES_BUILDING,
+};
+
+// Links the entities sharing a name, the first one is in the name index
+typedef struct SceneNameLink
+{
+	Entity* prev;
+	Entity* next;
+} SceneNameLink;
 
 struct Scene
 {
@@ -13,10 +33,24 @@ struct Scene
 	uint32_t entity_count;
 	// The size of the array
 	uint32_t entities_size;
+	// Entities are removed by moving the last one into their slot
 	Entity** entities;
+	// The links of each slot to the entities with the same name
+	SceneNameLink* name_links;
+	hashtable_t* entity_names;
 	uint32_t camera_count;
 	Camera* cameras[CAMERA_MAX];
 	RenderTreeNode* rendertree_root;
+	// Rebuild the render tree each update instead of re-placing moved entities
+	bool rebuild_rendertree;
+	// Simulates the rigidbodies of the entities, the bodies are in the same order as entities
+	Physics* physics;
+	PhysicsBody* bodies;
+	uint32_t bodies_size;
+	// The bounding spheres of the entities for spatial queries, in the same order as entities
+	// Kept apart from the physics broadphase, which holds the bounds from before the last step
+	Broadphase* queries;
+	uint32_t queries_state;
 };
 
 static Scene* scene_current = NULL;
@@ -32,6 +66,10 @@ Scene* scene_create(const char* name)
 
 	// Create the render tree root node
 	scene->rendertree_root = rendertree_create(300, vec3_zero, 0, renderer_get_framebuffers());
+	scene->physics = physics_create();
+	scene->queries = broadphase_create();
+	scene->queries_state = SCENE_QUERIES_DIRTY;
+	scene->entity_names = hashtable_create_string();
 
 	return scene;
 }
@@ -48,61 +86,126 @@ Scene* scene_get_current()
 	return scene_current;
 }
 
-void scene_add_entity(Scene* scene, Entity* entity)
+// Makes room for count more entities
+static void scene_reserve_entities(Scene* scene, uint32_t count)
 {
 	// Allocate list
 	if (scene->entities == NULL)
 	{
 		scene->entities_size = 4;
 		scene->entities = malloc(scene->entities_size * sizeof(Entity*));
+		scene->name_links = malloc(scene->entities_size * sizeof *scene->name_links);
 	}
 	// Resize array up
-	if (scene->entity_count + 1 >= scene->entities_size)
+	if (scene->entity_count + count >= scene->entities_size)
 	{
-		scene->entities_size = scene->entities_size << 1;
+		while (scene->entity_count + count >= scene->entities_size)
+			scene->entities_size = scene->entities_size << 1;
 		scene->entities = realloc(scene->entities, scene->entities_size * sizeof(*scene->entities));
+		scene->name_links = realloc(scene->name_links, scene->entities_size * sizeof *scene->name_links);
 	}
-	// Add at end of array
-	scene->entities[scene->entity_count] = entity;
-	++scene->entity_count;
+}
+
+// Rebuilds the query broadphase at the next query
+static void scene_invalidate_queries(Scene* scene)
+{
+	__atomic_store_n(&scene->queries_state, SCENE_QUERIES_DIRTY, __ATOMIC_RELAXED);
+}
+
+// Adds an entity to the end of the list and the name index
+static void scene_insert_entity(Scene* scene, Entity* entity)
+{
+	uint32_t index = scene->entity_count++;
+	scene->entities[index] = entity;
+	entity_set_scene_index(entity, index);
+
+	// Link after the first entity with the same name so that it stays the one found
+	Entity* first = hashtable_find(scene->entity_names, entity_get_name(entity));
+	if (first == NULL)
+	{
+		scene->name_links[index] = (SceneNameLink){NULL, NULL};
+		hashtable_insert(scene->entity_names, entity_get_name(entity), entity);
+	}
+	else
+	{
+		SceneNameLink* first_link = &scene->name_links[entity_get_scene_index(first)];
+		scene->name_links[index] = (SceneNameLink){first, first_link->next};
+		if (first_link->next)
+			scene->name_links[entity_get_scene_index(first_link->next)].prev = entity;
+		first_link->next = entity;
+	}
+}
+
+void scene_add_entity(Scene* scene, Entity* entity)
+{
+	scene_reserve_entities(scene, 1);
+	scene_insert_entity(scene, entity);
 	rendertree_place_down(scene->rendertree_root, entity);
+	scene_invalidate_queries(scene);
+	renderer_flag_rebuild();
+}
+
+void scene_add_entities(Scene* scene, Entity* const* entities, uint32_t count)
+{
+	scene_reserve_entities(scene, count);
+	for (uint32_t i = 0; i < count; i++)
+		scene_insert_entity(scene, entities[i]);
+
+	// Building the whole tree again is cheaper than inserting a batch larger than the tree
+	if (count >= scene->entity_count - count)
+		rendertree_build(scene->rendertree_root, scene->entities, scene->entity_count);
+	else
+		rendertree_place_batch(scene->rendertree_root, entities, count);
+	scene_invalidate_queries(scene);
 	renderer_flag_rebuild();
 }
 
 void scene_remove_entity(Scene* scene, Entity* entity)
 {
-	for (uint32_t i = 0; i < scene->entity_count; i++)
+	uint32_t index = entity_get_scene_index(entity);
+	if (index >= scene->entity_count || scene->entities[index] != entity)
 	{
-		// Found
-		if (scene->entities[i] == entity)
-		{
-			// Fill gap
-			memmove(scene->entities + i, scene->entities + i + 1, (scene->entity_count - i - 1) * sizeof *scene->entities);
-			--scene->entity_count;
+		LOG_W("Entity %s is not in scene %s", entity_get_name(entity), scene->name);
+		return;
+	}
 
-			// Resize array down
-			if (scene->entity_count < scene->entities_size / 2)
-			{
-				scene->entities_size = scene->entities_size >> 1;
-				scene->entities = realloc(scene->entities, scene->entities_size * sizeof(*scene->entities));
-			}
-			renderer_flag_rebuild();
-			return;
-		}
+	// Unlink from the entities with the same name
+	// The name index holds the name of the first entity as key
+	SceneNameLink link = scene->name_links[index];
+	if (link.prev)
+		scene->name_links[entity_get_scene_index(link.prev)].next = link.next;
+	else
+	{
+		hashtable_remove(scene->entity_names, entity_get_name(entity));
+		if (link.next)
+			hashtable_insert(scene->entity_names, entity_get_name(link.next), link.next);
 	}
+	if (link.next)
+		scene->name_links[entity_get_scene_index(link.next)].prev = link.prev;
+
+	rendertree_remove(entity);
+	physics_remove_body(scene->physics, index, scene->entity_count);
+
+	// Fill the gap with the last entity
+	uint32_t last = --scene->entity_count;
+	scene->entities[index] = scene->entities[last];
+	scene->name_links[index] = scene->name_links[last];
+	entity_set_scene_index(scene->entities[index], index);
+
+	// Resize array down, leaving room to add entities again without growing
+	if (scene->entities_size > 4 && scene->entity_count < scene->entities_size / 4)
+	{
+		scene->entities_size = scene->entities_size >> 1;
+		scene->entities = realloc(scene->entities, scene->entities_size * sizeof(*scene->entities));
+		scene->name_links = realloc(scene->name_links, scene->entities_size * sizeof *scene->name_links);
+	}
+	scene_invalidate_queries(scene);
+	renderer_flag_rebuild();
 }
 
 Entity* scene_find_entity(Scene* scene, const char* name)
 {
-	for (uint32_t i = 0; i < scene->entity_count; i++)
-	{
-		// Found
-		if (strcmp(entity_get_name(scene->entities[i]), name) == 0)
-		{
-			return scene->entities[i];
-		}
-	}
-	return NULL;
+	return hashtable_find(scene->entity_names, name);
 }
 // Get the entity at index
 // Returns NULL if out of bounds
@@ -113,6 +216,11 @@ Entity* scene_get_entity(Scene* scene, uint32_t index)
 	return scene->entities[index];
 }
 
+uint32_t scene_get_entity_count(Scene* scene)
+{
+	return scene->entity_count;
+}
+
 void scene_add_camera(Scene* scene, Camera* camera)
 {
 	if (scene->camera_count >= CAMERA_MAX)
@@ -136,9 +244,126 @@ RenderTreeNode* scene_get_rendertree(Scene* scene)
 	return scene->rendertree_root;
 }
 
+void scene_set_rendertree_rebuild(Scene* scene, bool rebuild)
+{
+	scene->rebuild_rendertree = rebuild;
+}
+
+Physics* scene_get_physics(Scene* scene)
+{
+	return scene->physics;
+}
+
+// Advances the physics of the entities by the frame time
+static void scene_update_physics(Scene* scene)
+{
+	if (scene->entity_count > scene->bodies_size)
+	{
+		scene->bodies_size = scene->entities_size;
+		scene->bodies = realloc(scene->bodies, scene->bodies_size * sizeof *scene->bodies);
+	}
+
+	for (uint32_t i = 0; i < scene->entity_count; i++)
+	{
+		Entity* entity = scene->entities[i];
+		scene->bodies[i] = (PhysicsBody){entity_get_rigidbody(entity), entity_get_transform(entity), entity_get_collider(entity), entity_get_boundingsphere(entity)};
+	}
+
+	physics_update(scene->physics, scene->bodies, scene->entity_count, time_delta());
+}
+
+const BroadphasePair* scene_get_overlaps(Scene* scene, uint32_t* count)
+{
+	return physics_get_overlaps(scene->physics, count);
+}
+
+const Contact* scene_get_contacts(Scene* scene, uint32_t* count)
+{
+	return physics_get_contacts(scene->physics, count);
+}
+
+// Rebuilds the query broadphase from the current bounding spheres if the entities changed
+// The first query to find it dirty rebuilds it while concurrent queries wait
+static const Broadphase* scene_get_queries(Scene* scene)
+{
+	uint32_t state = __atomic_load_n(&scene->queries_state, __ATOMIC_ACQUIRE);
+	while (state != SCENE_QUERIES_CLEAN)
+	{
+		uint32_t dirty = SCENE_QUERIES_DIRTY;
+		if (state == SCENE_QUERIES_DIRTY &&
+			__atomic_compare_exchange_n(&scene->queries_state, &dirty, SCENE_QUERIES_BUILDING, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+		{
+			broadphase_set_count(scene->queries, scene->entity_count);
+			for (uint32_t i = 0; i < scene->entity_count; i++)
+			{
+				const SphereCollider* sphere = entity_get_boundingsphere(scene->entities[i]);
+				vec3 center = vec3_add(sphere->base.transform->position, sphere->base.origin);
+				broadphase_set(scene->queries, i, center, sphere->radius * vec3_largest(sphere->base.transform->scale));
+			}
+			broadphase_build(scene->queries);
+			__atomic_store_n(&scene->queries_state, SCENE_QUERIES_CLEAN, __ATOMIC_RELEASE);
+			break;
+		}
+		state = __atomic_load_n(&scene->queries_state, __ATOMIC_ACQUIRE);
+	}
+	return scene->queries;
+}
+
+bool scene_raycast(Scene* scene, vec3 origin, vec3 direction, float max_distance, RaycastHit* hit)
+{
+	BroadphaseHit result;
+	*hit = (RaycastHit){0};
+	if (!broadphase_raycast(scene_get_queries(scene), origin, direction, max_distance, &result))
+		return false;
+
+	hit->entity = scene->entities[result.index];
+	hit->distance = result.distance;
+	hit->point = result.point;
+	hit->normal = result.normal;
+	return true;
+}
+
+typedef struct RaycastBatch
+{
+	Scene* scene;
+	const Ray* rays;
+	RaycastHit* hits;
+} RaycastBatch;
+
+static void scene_raycast_job(void* arg, uint32_t begin, uint32_t end)
+{
+	RaycastBatch* batch = arg;
+	for (uint32_t i = begin; i < end; i++)
+		(void)scene_raycast(batch->scene, batch->rays[i].origin, batch->rays[i].direction, batch->rays[i].max_distance, &batch->hits[i]);
+}
+
+void scene_raycast_batch(Scene* scene, const Ray* rays, uint32_t count, RaycastHit* hits)
+{
+	RaycastBatch batch = {scene, rays, hits};
+	// Rebuild before the jobs start so that they don't wait on each other
+	(void)scene_get_queries(scene);
+	job_parallel_for(count, 0, scene_raycast_job, &batch);
+}
+
+uint32_t scene_overlap_sphere(Scene* scene, vec3 center, float radius, uint32_t* results, uint32_t max_results)
+{
+	return broadphase_query_sphere(scene_get_queries(scene), center, radius, results, max_results);
+}
+
+uint32_t scene_overlap_aabb(Scene* scene, vec3 box_min, vec3 box_max, uint32_t* results, uint32_t max_results)
+{
+	return broadphase_query_box(scene_get_queries(scene), box_min, box_max, results, max_results);
+}
+
 void scene_update(Scene* scene)
 {
+	// Move entities before they are placed in the render tree
+	scene_update_physics(scene);
+	scene_invalidate_queries(scene);
+
 	// Update entities
+	if (scene->rebuild_rendertree)
+		rendertree_build(scene->rendertree_root, scene->entities, scene->entity_count);
 	rendertree_update(scene->rendertree_root, renderer_get_frameindex());
 
 	// Update cameras
@@ -150,18 +375,27 @@ void scene_update(Scene* scene)
 
 void scene_destroy_entities(Scene* scene)
 {
-	for (uint32_t i = 0; i < scene->entity_count; i++)
+	// Destroying the last entity removes it without moving any other
+	while (scene->entity_count > 0)
 	{
-		entity_destroy(scene->entities[i]);
+		entity_destroy(scene->entities[scene->entity_count - 1]);
 	}
 	free(scene->entities);
+	free(scene->name_links);
+	scene->entities = NULL;
+	scene->name_links = NULL;
 	scene->entity_count = 0;
 	scene->entities_size = 0;
+	scene_invalidate_queries(scene);
 }
 
 // Destroys a scene and all entities within not marked with keep
 void scene_destroy(Scene* scene)
 {
 	rendertree_destroy(scene->rendertree_root);
+	physics_destroy(scene->physics);
+	broadphase_destroy(scene->queries);
+	hashtable_destroy(scene->entity_names);
+	free(scene->bodies);
 	free(scene);
 }
\ No newline at end of file
@@ -0,0 +1,594 @@
+#include "scenefile.h"
+#include "log.h"
+#include "jobs.h"
+#include "utils.h"
+#include "hashtable.h"
+#include "magpie.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SCENEFILE_ID(a, b, c, d) ((uint32_t)(a) | (uint32_t)(b) << 8 | (uint32_t)(c) << 16 | (uint32_t)(d) << 24)
+#define SCENEFILE_MAGIC			 SCENEFILE_ID('M', 'S', 'C', 'N')
+
+// The number of strings, the offset of each string and the null terminated strings
+#define SCENEFILE_CHUNK_STRINGS SCENEFILE_ID('S', 'T', 'R', 'S')
+// The name, material and mesh of each entity as indices into the string table
+#define SCENEFILE_CHUNK_ENTITIES SCENEFILE_ID('E', 'N', 'T', 'S')
+#define SCENEFILE_ENTITY_SIZE	 (3 * sizeof(uint32_t))
+// The position, rotation and scale of each entity
+#define SCENEFILE_CHUNK_TRANSFORMS SCENEFILE_ID('T', 'R', 'F', 'M')
+#define SCENEFILE_TRANSFORM_SIZE   (sizeof(vec3) + sizeof(quaternion) + sizeof(vec3))
+// The velocities and mass properties of the rigidbody of each entity
+#define SCENEFILE_CHUNK_BODIES SCENEFILE_ID('B', 'O', 'D', 'Y')
+#define SCENEFILE_BODY_SIZE	   (4 * sizeof(vec3) + 3 * sizeof(float) + sizeof(uint8_t))
+// The color of each entity
+#define SCENEFILE_CHUNK_COLORS SCENEFILE_ID('C', 'O', 'L', 'R')
+#define SCENEFILE_COLOR_SIZE   sizeof(vec4)
+
+typedef struct SceneFileHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t chunk_count;
+	uint32_t entity_count;
+} SceneFileHeader;
+
+typedef struct SceneFileChunk
+{
+	uint32_t id;
+	uint32_t version;
+	// The size of the data following the chunk without padding
+	uint64_t size;
+} SceneFileChunk;
+
+// The entities of a scene as a structure of arrays
+// The arrays point into the chunks, which are in the mapped file when loading
+typedef struct SceneFileData
+{
+	Scene* scene;
+	uint32_t count;
+	Entity** entities;
+
+	uint32_t* names;
+	uint32_t* materials;
+	uint32_t* meshes;
+
+	vec3* positions;
+	quaternion* rotations;
+	vec3* scales;
+
+	vec3* velocities;
+	vec3* angular_velocities;
+	float* inverse_masses;
+	vec3* inverse_inertias;
+	float* restitutions;
+	float* frictions;
+	uint8_t* asleep;
+
+	vec4* colors;
+
+	// Decoded from the arrays for entity_create_batch when loading
+	Transform* transforms;
+	Rigidbody* rigidbodies;
+} SceneFileData;
+
+// The unique strings of a scene being saved
+typedef struct SceneFileStrings
+{
+	// Maps a string to its index plus one
+	hashtable_t* table;
+	char** strings;
+	uint32_t count;
+	uint32_t size;
+	// The bytes of all strings with their terminators
+	size_t bytes;
+} SceneFileStrings;
+
+static size_t scenefile_padding(uint64_t size)
+{
+	return (SCENEFILE_ALIGN - size % SCENEFILE_ALIGN) % SCENEFILE_ALIGN;
+}
+
+// Returns an array of count elements at data and advances data past it
+static void* scenefile_array(uint8_t** data, uint32_t count, size_t size)
+{
+	void* array = *data;
+	*data += (size_t)count * size;
+	return array;
+}
+
+static void scenefile_layout_entities(SceneFileData* data, uint8_t* chunk)
+{
+	data->names = scenefile_array(&chunk, data->count, sizeof *data->names);
+	data->materials = scenefile_array(&chunk, data->count, sizeof *data->materials);
+	data->meshes = scenefile_array(&chunk, data->count, sizeof *data->meshes);
+}
+
+static void scenefile_layout_transforms(SceneFileData* data, uint8_t* chunk)
+{
+	data->positions = scenefile_array(&chunk, data->count, sizeof *data->positions);
+	data->rotations = scenefile_array(&chunk, data->count, sizeof *data->rotations);
+	data->scales = scenefile_array(&chunk, data->count, sizeof *data->scales);
+}
+
+static void scenefile_layout_bodies(SceneFileData* data, uint8_t* chunk)
+{
+	data->velocities = scenefile_array(&chunk, data->count, sizeof *data->velocities);
+	data->angular_velocities = scenefile_array(&chunk, data->count, sizeof *data->angular_velocities);
+	data->inverse_inertias = scenefile_array(&chunk, data->count, sizeof *data->inverse_inertias);
+	data->inverse_masses = scenefile_array(&chunk, data->count, sizeof *data->inverse_masses);
+	data->restitutions = scenefile_array(&chunk, data->count, sizeof *data->restitutions);
+	data->frictions = scenefile_array(&chunk, data->count, sizeof *data->frictions);
+	data->asleep = scenefile_array(&chunk, data->count, sizeof *data->asleep);
+}
+
+static void scenefile_layout_colors(SceneFileData* data, uint8_t* chunk)
+{
+	data->colors = scenefile_array(&chunk, data->count, sizeof *data->colors);
+}
+
+// Returns the index of a string in the string table, adding it if new
+static uint32_t scenefile_add_string(SceneFileStrings* strings, const char* str)
+{
+	uintptr_t index = (uintptr_t)hashtable_find(strings->table, str);
+	if (index)
+		return index - 1;
+
+	if (strings->count == strings->size)
+	{
+		strings->size = strings->size ? strings->size * 2 : 16;
+		strings->strings = realloc(strings->strings, strings->size * sizeof *strings->strings);
+	}
+
+	size_t length = strlen(str) + 1;
+	char* copy = malloc(length);
+	memcpy(copy, str, length);
+	strings->strings[strings->count++] = copy;
+	strings->bytes += length;
+	hashtable_insert(strings->table, copy, (void*)(uintptr_t)strings->count);
+	return strings->count - 1;
+}
+
+// Writes the name a mesh is found by with mesh_find to name
+static void scenefile_mesh_name(Mesh* mesh, char* name, size_t size)
+{
+	if (mesh == NULL)
+		name[0] = '\0';
+	else if (mesh_get_model(mesh))
+		snprintf(name, size, "%s:%s", model_get_name(mesh_get_model(mesh)), mesh_get_name(mesh));
+	else
+		snprintf(name, size, "%s", mesh_get_name(mesh));
+}
+
+// Copies the transforms, rigidbodies and colors of the entities into the arrays
+static void scenefile_encode_job(void* arg, uint32_t begin, uint32_t end)
+{
+	SceneFileData* data = arg;
+	for (uint32_t i = begin; i < end; i++)
+	{
+		Entity* entity = scene_get_entity(data->scene, i);
+		const Transform* transform = entity_get_transform(entity);
+		data->positions[i] = transform->position;
+		data->rotations[i] = transform->rotation;
+		data->scales[i] = transform->scale;
+
+		const Rigidbody* rigidbody = entity_get_rigidbody(entity);
+		data->velocities[i] = rigidbody->velocity;
+		data->angular_velocities[i] = rigidbody->angular_velocity;
+		data->inverse_inertias[i] = rigidbody->inverse_inertia;
+		data->inverse_masses[i] = rigidbody->inverse_mass;
+		data->restitutions[i] = rigidbody->restitution;
+		data->frictions[i] = rigidbody->friction;
+		data->asleep[i] = rigidbody->asleep;
+
+		data->colors[i] = entity_get_color(entity);
+	}
+}
+
+static void scenefile_write_chunk(FILE* file, uint32_t id, const void* data, uint64_t size)
+{
+	static const uint8_t padding[SCENEFILE_ALIGN] = {0};
+	SceneFileChunk chunk = {.id = id, .version = SCENEFILE_VERSION, .size = size};
+	fwrite(&chunk, sizeof chunk, 1, file);
+	fwrite(data, 1, size, file);
+	fwrite(padding, 1, scenefile_padding(size), file);
+}
+
+int scene_save(Scene* scene, const char* path)
+{
+	FILE* file = fopen(path, "wb");
+	if (file == NULL)
+	{
+		LOG_E("Failed to open scene file %s for writing", path);
+		return -1;
+	}
+
+	SceneFileData data = {.scene = scene, .count = scene_get_entity_count(scene)};
+	uint8_t* entities = malloc(data.count * SCENEFILE_ENTITY_SIZE);
+	uint8_t* transforms = malloc(data.count * SCENEFILE_TRANSFORM_SIZE);
+	uint8_t* bodies = malloc(data.count * SCENEFILE_BODY_SIZE);
+	uint8_t* colors = malloc(data.count * SCENEFILE_COLOR_SIZE);
+	scenefile_layout_entities(&data, entities);
+	scenefile_layout_transforms(&data, transforms);
+	scenefile_layout_bodies(&data, bodies);
+	scenefile_layout_colors(&data, colors);
+
+	job_parallel_for(data.count, 0, scenefile_encode_job, &data);
+
+	// Consecutive entities mostly share their strings, which are only looked up when they change
+	SceneFileStrings strings = {.table = hashtable_create_string()};
+	const char* last_name = NULL;
+	Material last_material = INVALID(Material);
+	Mesh* last_mesh = NULL;
+	uint32_t name_index = 0;
+	uint32_t material_index = scenefile_add_string(&strings, "");
+	uint32_t mesh_index = material_index;
+	for (uint32_t i = 0; i < data.count; i++)
+	{
+		Entity* entity = scene_get_entity(scene, i);
+		const char* name = entity_get_name(entity);
+		if (last_name == NULL || strcmp(name, last_name) != 0)
+		{
+			name_index = scenefile_add_string(&strings, name);
+			last_name = name;
+		}
+
+		Material material = entity_get_material(entity);
+		if (!HANDLE_COMPARE(material, last_material))
+		{
+			material_index = scenefile_add_string(&strings, material_get_name(material));
+			last_material = material;
+		}
+
+		Mesh* mesh = entity_get_mesh(entity);
+		if (mesh != last_mesh)
+		{
+			char mesh_name[512];
+			scenefile_mesh_name(mesh, mesh_name, sizeof mesh_name);
+			mesh_index = scenefile_add_string(&strings, mesh_name);
+			last_mesh = mesh;
+		}
+
+		data.names[i] = name_index;
+		data.materials[i] = material_index;
+		data.meshes[i] = mesh_index;
+	}
+
+	// The string table holds the count, the offsets and the strings
+	uint64_t strings_size = sizeof(uint32_t) * (1 + strings.count) + strings.bytes;
+	uint8_t* string_table = malloc(strings_size);
+	uint32_t* offsets = (uint32_t*)string_table;
+	char* chars = (char*)(offsets + 1 + strings.count);
+	offsets[0] = strings.count;
+	uint32_t offset = 0;
+	for (uint32_t i = 0; i < strings.count; i++)
+	{
+		size_t length = strlen(strings.strings[i]) + 1;
+		memcpy(chars + offset, strings.strings[i], length);
+		offsets[1 + i] = offset;
+		offset += length;
+		free(strings.strings[i]);
+	}
+	free(strings.strings);
+	hashtable_destroy(strings.table);
+
+	SceneFileHeader header = {.magic = SCENEFILE_MAGIC, .version = SCENEFILE_VERSION, .chunk_count = 5, .entity_count = data.count};
+	fwrite(&header, sizeof header, 1, file);
+	scenefile_write_chunk(file, SCENEFILE_CHUNK_STRINGS, string_table, strings_size);
+	scenefile_write_chunk(file, SCENEFILE_CHUNK_ENTITIES, entities, (uint64_t)data.count * SCENEFILE_ENTITY_SIZE);
+	scenefile_write_chunk(file, SCENEFILE_CHUNK_TRANSFORMS, transforms, (uint64_t)data.count * SCENEFILE_TRANSFORM_SIZE);
+	scenefile_write_chunk(file, SCENEFILE_CHUNK_BODIES, bodies, (uint64_t)data.count * SCENEFILE_BODY_SIZE);
+	scenefile_write_chunk(file, SCENEFILE_CHUNK_COLORS, colors, (uint64_t)data.count * SCENEFILE_COLOR_SIZE);
+
+	free(string_table);
+	free(entities);
+	free(transforms);
+	free(bodies);
+	free(colors);
+
+	int failed = ferror(file);
+	if (fclose(file) != 0 || failed)
+	{
+		LOG_E("Failed to write scene file %s", path);
+		return -1;
+	}
+	return 0;
+}
+
+// Builds the transforms and rigidbodies of the entities from the arrays
+static void scenefile_decode_job(void* arg, uint32_t begin, uint32_t end)
+{
+	SceneFileData* data = arg;
+	for (uint32_t i = begin; i < end; i++)
+	{
+		data->transforms[i] = (Transform){.position = data->positions[i], .rotation = data->rotations[i], .scale = data->scales[i]};
+
+		if (data->velocities == NULL)
+		{
+			data->rigidbodies[i] = rigidbody_stationary;
+			continue;
+		}
+
+		data->rigidbodies[i] = (Rigidbody){
+			.velocity = data->velocities[i],
+			.angular_velocity = data->angular_velocities[i],
+			.inverse_mass = data->inverse_masses[i],
+			.inverse_inertia = data->inverse_inertias[i],
+			.restitution = data->restitutions[i],
+			.friction = data->frictions[i],
+			.asleep = data->asleep[i],
+		};
+	}
+}
+
+static void scenefile_color_job(void* arg, uint32_t begin, uint32_t end)
+{
+	SceneFileData* data = arg;
+	for (uint32_t i = begin; i < end; i++)
+	{
+		if (data->entities[i])
+			entity_set_color(data->entities[i], data->colors[i]);
+	}
+}
+
+// Finds the strings in a string table chunk
+// Returns the number of strings, or 0 if the table is malformed
+static uint32_t scenefile_read_strings(const uint8_t* chunk, uint64_t size, const char*** strings)
+{
+	if (size < sizeof(uint32_t))
+		return 0;
+
+	const uint32_t* offsets = (const uint32_t*)chunk;
+	uint32_t count = offsets[0];
+	// Computed in 64 bits so a count of UINT32_MAX can't wrap around
+	uint64_t chars_offset = (1 + (uint64_t)count) * sizeof(uint32_t);
+	if (count == 0 || chars_offset >= size)
+		return 0;
+
+	// Every string needs to end within the table
+	const char* chars = (const char*)chunk + chars_offset;
+	uint64_t chars_size = size - chars_offset;
+	if (chars[chars_size - 1] != '\0')
+		return 0;
+
+	*strings = malloc(count * sizeof **strings);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		if (offsets[1 + i] >= chars_size)
+		{
+			free(*strings);
+			*strings = NULL;
+			return 0;
+		}
+		(*strings)[i] = chars + offsets[1 + i];
+	}
+	return count;
+}
+
+int scene_load(Scene* scene, const char* path)
+{
+	size_t size = 0;
+	uint8_t* file = map_file(path, &size);
+	if (file == NULL)
+	{
+		LOG_E("Failed to open scene file %s", path);
+		return -1;
+	}
+
+	const SceneFileHeader* header = (const SceneFileHeader*)file;
+	if (size < sizeof *header || header->magic != SCENEFILE_MAGIC)
+	{
+		LOG_E("%s is not a scene file", path);
+		unmap_file(file, size);
+		return -1;
+	}
+	if (header->version > SCENEFILE_VERSION)
+	{
+		LOG_E("Scene file %s has version %d, newer than the supported version %d", path, header->version, SCENEFILE_VERSION);
+		unmap_file(file, size);
+		return -1;
+	}
+
+	SceneFileData data = {.scene = scene, .count = header->entity_count};
+	const char** strings = NULL;
+	uint32_t string_count = 0;
+	bool truncated = false;
+	size_t offset = sizeof *header;
+	for (uint32_t i = 0; i < header->chunk_count && !truncated; i++)
+	{
+		const SceneFileChunk* chunk = (const SceneFileChunk*)(file + offset);
+		if (size - offset < sizeof *chunk || chunk->size > size - offset - sizeof *chunk)
+		{
+			truncated = true;
+			break;
+		}
+
+		// A newer layout of a known chunk can't be read as the current one
+		uint8_t* chunk_data = file + offset + sizeof *chunk;
+		uint32_t id = chunk->id;
+		if (chunk->version > SCENEFILE_VERSION)
+		{
+			LOG_W("Skipping chunk %.4s of scene file %s with version %d, newer than the supported version %d", (const char*)&chunk->id, path, chunk->version,
+				  SCENEFILE_VERSION);
+			id = 0;
+		}
+
+		switch (id)
+		{
+		case SCENEFILE_CHUNK_STRINGS:
+			free(strings);
+			strings = NULL;
+			string_count = scenefile_read_strings(chunk_data, chunk->size, &strings);
+			truncated = string_count == 0;
+			break;
+		case SCENEFILE_CHUNK_ENTITIES:
+			truncated = chunk->size < (uint64_t)data.count * SCENEFILE_ENTITY_SIZE;
+			scenefile_layout_entities(&data, chunk_data);
+			break;
+		case SCENEFILE_CHUNK_TRANSFORMS:
+			truncated = chunk->size < (uint64_t)data.count * SCENEFILE_TRANSFORM_SIZE;
+			scenefile_layout_transforms(&data, chunk_data);
+			break;
+		case SCENEFILE_CHUNK_BODIES:
+			truncated = chunk->size < (uint64_t)data.count * SCENEFILE_BODY_SIZE;
+			scenefile_layout_bodies(&data, chunk_data);
+			break;
+		case SCENEFILE_CHUNK_COLORS:
+			truncated = chunk->size < (uint64_t)data.count * SCENEFILE_COLOR_SIZE;
+			scenefile_layout_colors(&data, chunk_data);
+			break;
+		// Unknown chunks and chunks of newer versions
+		default:
+			break;
+		}
+
+		offset += sizeof *chunk + chunk->size + scenefile_padding(chunk->size);
+		if (offset > size)
+			offset = size;
+	}
+
+	// Rigidbodies and colors are optional
+	bool valid = !truncated && strings && data.names && data.positions;
+	for (uint32_t i = 0; valid && i < data.count; i++)
+		valid = data.names[i] < string_count && data.materials[i] < string_count && data.meshes[i] < string_count;
+
+	if (!valid)
+	{
+		LOG_E("Scene file %s is truncated or corrupt", path);
+		free(strings);
+		unmap_file(file, size);
+		return -1;
+	}
+
+	data.transforms = malloc(data.count * sizeof *data.transforms);
+	data.rigidbodies = malloc(data.count * sizeof *data.rigidbodies);
+	data.entities = calloc(data.count, sizeof *data.entities);
+	job_parallel_for(data.count, 0, scenefile_decode_job, &data);
+
+	// Entities are created into the scene being loaded
+	Scene* previous = scene_set_current(scene);
+	uint32_t skipped = 0;
+	for (uint32_t begin = 0; begin < data.count;)
+	{
+		uint32_t end = begin + 1;
+		while (end < data.count && data.names[end] == data.names[begin] && data.materials[end] == data.materials[begin] &&
+			   data.meshes[end] == data.meshes[begin])
+			end++;
+
+		const char* material_name = strings[data.materials[begin]];
+		const char* mesh_name = strings[data.meshes[begin]];
+		Mesh* mesh = NULL;
+		if (mesh_name[0] != '\0')
+		{
+			mesh = mesh_find(mesh_name);
+			if (mesh == NULL)
+			{
+				LOG_E("Unknown mesh %s, skipping %d entities", mesh_name, end - begin);
+				skipped += end - begin;
+				begin = end;
+				continue;
+			}
+		}
+
+		Material material = material_name[0] != '\0' ? material_get(material_name) : INVALID(Material);
+		if (mesh && !HANDLE_VALID(material))
+			LOG_W("Unknown material %s. Using default material", material_name);
+
+		entity_create_batch(strings[data.names[begin]], material, mesh, data.transforms + begin, data.rigidbodies + begin, end - begin,
+							data.entities + begin);
+		begin = end;
+	}
+	(void)scene_set_current(previous);
+
+	if (data.colors)
+		job_parallel_for(data.count, 0, scenefile_color_job, &data);
+
+	LOG_S("Loaded %d entities from %s", data.count - skipped, path);
+
+	free(data.transforms);
+	free(data.rigidbodies);
+	free(data.entities);
+	free(strings);
+	unmap_file(file, size);
+	return 0;
+}
+
+// Writes a string with the characters reserved by XML escaped
+static void scenefile_write_escaped(FILE* file, const char* str)
+{
+	for (; *str; str++)
+	{
+		switch (*str)
+		{
+		case '<':
+			fputs("&lt;", file);
+			break;
+		case '>':
+			fputs("&gt;", file);
+			break;
+		case '&':
+			fputs("&amp;", file);
+			break;
+		case '"':
+			fputs("&quot;", file);
+			break;
+		default:
+			fputc(*str, file);
+		}
+	}
+}
+
+int scene_export_xml(Scene* scene, const char* path)
+{
+	// Written directly since the entities would be sorted into the document one by one by xml_add_child
+	FILE* file = fopen(path, "w");
+	if (file == NULL)
+	{
+		LOG_E("Failed to open %s for writing", path);
+		return -1;
+	}
+
+	uint32_t count = scene_get_entity_count(scene);
+	fprintf(file, "<scene entities=\"%d\">\n", count);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		Entity* entity = scene_get_entity(scene, i);
+		char mesh_name[512];
+		scenefile_mesh_name(entity_get_mesh(entity), mesh_name, sizeof mesh_name);
+
+		fputs("\t<entity name=\"", file);
+		scenefile_write_escaped(file, entity_get_name(entity));
+		fputs("\" material=\"", file);
+		scenefile_write_escaped(file, material_get_name(entity_get_material(entity)));
+		fputs("\" mesh=\"", file);
+		scenefile_write_escaped(file, mesh_name);
+		fputs("\">\n", file);
+
+		const Transform* transform = entity_get_transform(entity);
+		const Rigidbody* rigidbody = entity_get_rigidbody(entity);
+		vec3 p = transform->position;
+		quaternion r = transform->rotation;
+		vec3 s = transform->scale;
+		vec3 v = rigidbody->velocity;
+		vec3 w = rigidbody->angular_velocity;
+		vec4 c = entity_get_color(entity);
+		fprintf(file, "\t\t<position>%g %g %g</position>\n", p.x, p.y, p.z);
+		fprintf(file, "\t\t<rotation>%g %g %g %g</rotation>\n", r.x, r.y, r.z, r.w);
+		fprintf(file, "\t\t<scale>%g %g %g</scale>\n", s.x, s.y, s.z);
+		fprintf(file, "\t\t<velocity>%g %g %g</velocity>\n", v.x, v.y, v.z);
+		fprintf(file, "\t\t<angular_velocity>%g %g %g</angular_velocity>\n", w.x, w.y, w.z);
+		fprintf(file, "\t\t<inverse_mass>%g</inverse_mass>\n", rigidbody->inverse_mass);
+		fprintf(file, "\t\t<color>%g %g %g %g</color>\n", c.x, c.y, c.z, c.w);
+		fputs("\t</entity>\n", file);
+	}
+	fputs("</scene>\n", file);
+
+	int failed = ferror(file);
+	if (fclose(file) != 0 || failed)
+	{
+		LOG_E("Failed to write %s", path);
+		return -1;
+	}
+	return 0;
+}
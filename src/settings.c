@@ -1,6 +1,7 @@
 #include "settings.h"
 #include "log.h"
 #include "window.h"
+#include "defines.h"
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -9,6 +10,11 @@ ivec2 resolution = {800, 600};
 int window_style = WS_WINDOWED;
 enum VsyncMode vsync = VSYNC_NONE;
 int msaa = 1;
+enum TextureCompression texture_compression = TEXTURE_COMPRESSION_BC1_BC3;
+int texture_budget = 256;
+int gpu_culling = 1;
+int occlusion_culling = 1;
+int rendertree_limit = RENDER_TREE_LIM;
 
 #define STRING(s) #s
 
@@ -52,6 +58,26 @@ void settings_load()
 		{
 			msaa = atoi(rh);
 		}
+		else if (strcmp(lh, "texture_compression") == 0)
+		{
+			texture_compression = atoi(rh);
+		}
+		else if (strcmp(lh, "texture_budget") == 0)
+		{
+			texture_budget = atoi(rh);
+		}
+		else if (strcmp(lh, "gpu_culling") == 0)
+		{
+			gpu_culling = atoi(rh);
+		}
+		else if (strcmp(lh, "occlusion_culling") == 0)
+		{
+			occlusion_culling = atoi(rh);
+		}
+		else if (strcmp(lh, "rendertree_limit") == 0)
+		{
+			rendertree_limit = atoi(rh);
+		}
 	}
 	fclose(file);
 }
@@ -70,6 +96,11 @@ void settings_save()
 	fprintf(file, "window_style %d\n", window_style);
 	fprintf(file, "vsync %d\n", vsync);
 	fprintf(file, "msaa %d\n", msaa);
+	fprintf(file, "texture_compression %d\n", texture_compression);
+	fprintf(file, "texture_budget %d\n", texture_budget);
+	fprintf(file, "gpu_culling %d\n", gpu_culling);
+	fprintf(file, "occlusion_culling %d\n", occlusion_culling);
+	fprintf(file, "rendertree_limit %d\n", rendertree_limit);
 
 	fclose(file);
 }
@@ -92,6 +123,26 @@ int settings_get_msaa()
 {
 	return msaa;
 }
+enum TextureCompression settings_get_texture_compression()
+{
+	return texture_compression;
+}
+int settings_get_texture_budget()
+{
+	return texture_budget;
+}
+int settings_get_gpu_culling()
+{
+	return gpu_culling;
+}
+int settings_get_occlusion_culling()
+{
+	return occlusion_culling;
+}
+int settings_get_rendertree_limit()
+{
+	return rendertree_limit;
+}
 
 void settings_set_resolution(ivec2 res)
 {
@@ -105,3 +156,23 @@ void settings_set_vsync(enum VsyncMode mode)
 {
 	vsync = mode;
 }
+void settings_set_texture_compression(enum TextureCompression compression)
+{
+	texture_compression = compression;
+}
+void settings_set_texture_budget(int megabytes)
+{
+	texture_budget = megabytes;
+}
+void settings_set_gpu_culling(int enabled)
+{
+	gpu_culling = enabled;
+}
+void settings_set_occlusion_culling(int enabled)
+{
+	occlusion_culling = enabled;
+}
+void settings_set_rendertree_limit(int limit)
+{
+	rendertree_limit = limit;
+}
@@ -13,6 +13,8 @@
 #include <dirent.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/mman.h>
+#include <fcntl.h>
 
 #elif PL_WINDOWS
 #include <Windows.h>
@@ -25,14 +27,16 @@
 int is_regular_file(const char* path)
 {
 	struct stat path_stat;
-	stat(path, &path_stat);
+	if (stat(path, &path_stat) != 0)
+		return 0;
 	return S_ISREG(path_stat.st_mode);
 }
 
 int is_dir(const char* path)
 {
 	struct stat path_stat;
-	stat(path, &path_stat);
+	if (stat(path, &path_stat) != 0)
+		return 0;
 	return S_ISDIR(path_stat.st_mode);
 }
 
@@ -385,6 +389,129 @@ void set_workingdir(const char* dir)
 }
 #endif
 
+#if PL_LINUX
+int path_equal(const char* path1, const char* path2)
+{
+	char full1[PATH_MAX];
+	char full2[PATH_MAX];
+	// Fall back to comparing the strings if a path doesn't exist
+	if (realpath(path1, full1) == NULL || realpath(path2, full2) == NULL)
+		return strcmp(path1, path2) == 0;
+	return strcmp(full1, full2) == 0;
+}
+#elif PL_WINDOWS
+int path_equal(const char* path1, const char* path2)
+{
+	char full1[MAX_PATH];
+	char full2[MAX_PATH];
+	if (_fullpath(full1, path1, sizeof full1) == NULL || _fullpath(full2, path2, sizeof full2) == NULL)
+		return strcmp(path1, path2) == 0;
+	return _stricmp(full1, full2) == 0;
+}
+#endif
+
+#if PL_LINUX
+int64_t file_mtime(const char* path)
+{
+	struct stat path_stat;
+	if (stat(path, &path_stat) != 0)
+		return -1;
+	return path_stat.st_mtime;
+}
+
+int file_stamp(const char* path, uint64_t* mtime, uint64_t* size)
+{
+	struct stat path_stat;
+	if (stat(path, &path_stat) != 0)
+		return -1;
+	*mtime = (uint64_t)path_stat.st_mtim.tv_sec * 1000000000ULL + path_stat.st_mtim.tv_nsec;
+	*size = path_stat.st_size;
+	return 0;
+}
+
+void* map_file(const char* path, size_t* size)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+
+	struct stat path_stat;
+	if (fstat(fd, &path_stat) != 0 || path_stat.st_size == 0)
+	{
+		close(fd);
+		return NULL;
+	}
+
+	void* data = mmap(NULL, path_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	// The mapping keeps the file alive
+	close(fd);
+	if (data == MAP_FAILED)
+		return NULL;
+
+	*size = path_stat.st_size;
+	return data;
+}
+
+void unmap_file(void* data, size_t size)
+{
+	munmap(data, size);
+}
+#elif PL_WINDOWS
+int64_t file_mtime(const char* path)
+{
+	WIN32_FILE_ATTRIBUTE_DATA attributes;
+	if (!GetFileAttributesExA(path, GetFileExInfoStandard, &attributes))
+		return -1;
+	// Convert from 100ns intervals since 1601 to seconds since 1970
+	uint64_t time = ((uint64_t)attributes.ftLastWriteTime.dwHighDateTime << 32) | attributes.ftLastWriteTime.dwLowDateTime;
+	return (int64_t)(time / 10000000ULL) - 11644473600LL;
+}
+
+int file_stamp(const char* path, uint64_t* mtime, uint64_t* size)
+{
+	WIN32_FILE_ATTRIBUTE_DATA attributes;
+	if (!GetFileAttributesExA(path, GetFileExInfoStandard, &attributes))
+		return -1;
+	*mtime = ((uint64_t)attributes.ftLastWriteTime.dwHighDateTime << 32) | attributes.ftLastWriteTime.dwLowDateTime;
+	*size = ((uint64_t)attributes.nFileSizeHigh << 32) | attributes.nFileSizeLow;
+	return 0;
+}
+
+void* map_file(const char* path, size_t* size)
+{
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return NULL;
+
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0)
+	{
+		CloseHandle(file);
+		return NULL;
+	}
+
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(file);
+	if (mapping == NULL)
+		return NULL;
+
+	void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	// The view keeps the mapping alive
+	CloseHandle(mapping);
+	if (data == NULL)
+		return NULL;
+
+	*size = file_size.QuadPart;
+	return data;
+}
+
+void unmap_file(void* data, size_t size)
+{
+	(void)size;
+	UnmapViewOfFile(data);
+}
+#endif
+
 void dir_up(const char* path, char* result, size_t size, size_t steps)
 {
 
@@ -6,6 +6,7 @@
 #include "magpie.h"
 
 #include "mempool.h"
+#include "defines.h"
 
 struct attribute_t
 {
@@ -26,7 +27,8 @@ struct XMLNode
 	XMLNode* children;
 };
 
-static mempool_t node_pool = MEMPOOL_INIT(sizeof(XMLNode), 64);
+// Per thread since documents are parsed on worker threads
+static THREAD_LOCAL mempool_t node_pool = MEMPOOL_INIT(sizeof(XMLNode), 64);
 
 XMLNode* xml_loadfile(const char* filepath)
 {
@@ -0,0 +1,209 @@
+#include "benchmark.h"
+#include "broadphase.h"
+#include "jobs.h"
+#include <math.h>
+#include <stdlib.h>
+
+#define SPHERE_COUNT 100000
+// Spheres are spread in a cube of this width, giving around one overlap per sphere
+#define WORLD_WIDTH 100.0f
+#define MIN_RADIUS	0.5f
+#define MAX_RADIUS	1.0f
+// The number of spheres compared against brute force
+#define VERIFY_COUNT 4096
+// The number of queries of each kind timed
+#define QUERY_COUNT	 10000
+#define QUERY_RADIUS 5.0f
+#define MAX_RESULTS	 1024
+
+static vec3* positions;
+static vec3* velocities;
+static float* radii;
+
+static void move_spheres(Broadphase* broadphase, uint32_t count)
+{
+	for (uint32_t i = 0; i < count; i++)
+	{
+		positions[i] = vec3_add(positions[i], vec3_scale(velocities[i], 1 / 60.0f));
+		broadphase_set(broadphase, i, positions[i], radii[i]);
+	}
+}
+
+// Compares the pairs of the broadphase with testing all pairs
+static void bench_verify()
+{
+	Broadphase* broadphase = broadphase_create();
+	broadphase_set_count(broadphase, VERIFY_COUNT);
+	move_spheres(broadphase, VERIFY_COUNT);
+	uint32_t count = broadphase_update(broadphase);
+
+	uint32_t expected = 0;
+	for (uint32_t i = 0; i < VERIFY_COUNT; i++)
+	{
+		for (uint32_t j = i + 1; j < VERIFY_COUNT; j++)
+		{
+			float radius = radii[i] + radii[j];
+			if (vec3_sqrdistance(positions[i], positions[j]) < radius * radius)
+				expected++;
+		}
+	}
+
+	BENCHMARK_RESULT("pairs of first spheres, brute force", "%d, %d %s", count, expected, count == expected ? "ok" : "MISMATCH");
+	broadphase_destroy(broadphase);
+}
+
+static void bench_update(uint32_t threads)
+{
+	Broadphase* broadphase = broadphase_create();
+	broadphase_set_count(broadphase, SPHERE_COUNT);
+	move_spheres(broadphase, SPHERE_COUNT);
+
+	// The spheres are unsorted on the first update
+	float t = BENCHMARK_TIME(1, broadphase_update(broadphase));
+	uint32_t pair_count = 0;
+	(void)broadphase_get_pairs(broadphase, &pair_count);
+	char name[64];
+	snprintf(name, sizeof name, "first update, %d threads", threads);
+	BENCHMARK_RESULT(name, "%f ms, %d pairs", t * 1000, pair_count);
+
+	// Includes writing the moved spheres into the broadphase
+	t = BENCHMARK_TIME(20, move_spheres(broadphase, SPHERE_COUNT); broadphase_update(broadphase));
+	snprintf(name, sizeof name, "move and update, %d threads", threads);
+	BENCHMARK_RESULT(name, "%f ms", t * 1000);
+
+	broadphase_destroy(broadphase);
+}
+
+// Returns the closest sphere hit by the ray by testing all spheres, or UINT32_MAX
+static uint32_t raycast_brute_force(vec3 origin, vec3 direction, float* distance)
+{
+	uint32_t closest = UINT32_MAX;
+	*distance = INFINITY;
+	for (uint32_t i = 0; i < SPHERE_COUNT; i++)
+	{
+		vec3 oc = vec3_sub(origin, positions[i]);
+		float b = vec3_dot(oc, direction);
+		float c = vec3_sqrmag(oc) - radii[i] * radii[i];
+		if (c <= 0 || b > 0 || b * b < c)
+			continue;
+		float t = -b - sqrtf(b * b - c);
+		if (t < *distance)
+		{
+			*distance = t;
+			closest = i;
+		}
+	}
+	return closest;
+}
+
+typedef struct RaycastBatch
+{
+	const Broadphase* broadphase;
+	const vec3* origins;
+	const vec3* directions;
+	uint32_t hit_count;
+} RaycastBatch;
+
+static void raycast_job(void* arg, uint32_t begin, uint32_t end)
+{
+	RaycastBatch* batch = arg;
+	BroadphaseHit hit;
+	uint32_t hit_count = 0;
+	for (uint32_t i = begin; i < end; i++)
+		hit_count += broadphase_raycast(batch->broadphase, batch->origins[i], batch->directions[i], INFINITY, &hit);
+	__atomic_fetch_add(&batch->hit_count, hit_count, __ATOMIC_RELAXED);
+}
+
+// Compares queries with testing all spheres and times them
+static void bench_queries()
+{
+	Broadphase* broadphase = broadphase_create();
+	broadphase_set_count(broadphase, SPHERE_COUNT);
+	move_spheres(broadphase, SPHERE_COUNT);
+	broadphase_update(broadphase);
+
+	vec3* origins = malloc(QUERY_COUNT * sizeof *origins);
+	vec3* directions = malloc(QUERY_COUNT * sizeof *directions);
+	uint32_t* results = malloc(MAX_RESULTS * sizeof *results);
+	for (uint32_t i = 0; i < QUERY_COUNT; i++)
+	{
+		origins[i] = benchmark_random_vec3(0, WORLD_WIDTH);
+		directions[i] = vec3_norm(benchmark_random_vec3(-1, 1));
+	}
+
+	uint32_t mismatches = 0;
+	for (uint32_t i = 0; i < 64; i++)
+	{
+		vec3 center = origins[i];
+		vec3 box_min = vec3_sub(center, (vec3){QUERY_RADIUS, QUERY_RADIUS / 2, QUERY_RADIUS});
+		vec3 box_max = vec3_add(center, (vec3){QUERY_RADIUS, QUERY_RADIUS / 2, QUERY_RADIUS});
+		uint32_t expected_sphere = 0;
+		uint32_t expected_box = 0;
+		for (uint32_t j = 0; j < SPHERE_COUNT; j++)
+		{
+			float radius = radii[j] + QUERY_RADIUS;
+			expected_sphere += vec3_sqrdistance(positions[j], center) <= radius * radius;
+			vec3 p = positions[j];
+			vec3 closest = {fminf(fmaxf(p.x, box_min.x), box_max.x), fminf(fmaxf(p.y, box_min.y), box_max.y), fminf(fmaxf(p.z, box_min.z), box_max.z)};
+			expected_box += vec3_sqrdistance(p, closest) <= radii[j] * radii[j];
+		}
+		mismatches += broadphase_query_sphere(broadphase, center, QUERY_RADIUS, results, MAX_RESULTS) != expected_sphere;
+		mismatches += broadphase_query_box(broadphase, box_min, box_max, results, MAX_RESULTS) != expected_box;
+
+		float distance;
+		BroadphaseHit hit = {.index = UINT32_MAX};
+		(void)broadphase_raycast(broadphase, origins[i], directions[i], INFINITY, &hit);
+		mismatches += raycast_brute_force(origins[i], directions[i], &distance) != hit.index;
+	}
+	BENCHMARK_RESULT("queries, brute force", "%d mismatches %s", mismatches, mismatches == 0 ? "ok" : "MISMATCH");
+
+	char name[64];
+	uint32_t found = 0;
+	float t = BENCHMARK_TIME(1, for (uint32_t i = 0; i < QUERY_COUNT; i++) found += broadphase_query_sphere(broadphase, origins[i], QUERY_RADIUS, results, MAX_RESULTS));
+	snprintf(name, sizeof name, "%d sphere queries", QUERY_COUNT);
+	BENCHMARK_RESULT(name, "%f ms, %d found", t * 1000, found);
+
+	RaycastBatch batch = {broadphase, origins, directions, 0};
+	t = BENCHMARK_TIME(1, raycast_job(&batch, 0, QUERY_COUNT));
+	snprintf(name, sizeof name, "%d raycasts, 1 threads", QUERY_COUNT);
+	BENCHMARK_RESULT(name, "%f ms, %d hits", t * 1000, batch.hit_count);
+
+	batch.hit_count = 0;
+	t = BENCHMARK_TIME(1, job_parallel_for(QUERY_COUNT, 0, raycast_job, &batch));
+	snprintf(name, sizeof name, "%d raycasts, %d threads", QUERY_COUNT, jobs_thread_count());
+	BENCHMARK_RESULT(name, "%f ms, %d hits", t * 1000, batch.hit_count);
+
+	free(origins);
+	free(directions);
+	free(results);
+	broadphase_destroy(broadphase);
+}
+
+void bench_broadphase()
+{
+	positions = malloc(SPHERE_COUNT * sizeof *positions);
+	velocities = malloc(SPHERE_COUNT * sizeof *velocities);
+	radii = malloc(SPHERE_COUNT * sizeof *radii);
+
+	srand(1);
+	for (uint32_t i = 0; i < SPHERE_COUNT; i++)
+	{
+		positions[i] = benchmark_random_vec3(0, WORLD_WIDTH);
+		velocities[i] = benchmark_random_vec3(-1, 1);
+		radii[i] = benchmark_random(MIN_RADIUS, MAX_RADIUS);
+	}
+
+	printf("%d spheres in a %.0f unit cube\n", SPHERE_COUNT, WORLD_WIDTH);
+
+	// Without workers the sweep runs on the calling thread
+	bench_update(1);
+	jobs_init(0);
+	bench_verify();
+	bench_update(jobs_thread_count());
+	bench_queries();
+	jobs_terminate();
+
+	free(positions);
+	free(velocities);
+	free(radii);
+}
@@ -0,0 +1,82 @@
+#include "benchmark.h"
+#include "jobs.h"
+#include <math.h>
+#include <stdlib.h>
+
+#define WORK_COUNT (1 << 20)
+
+static float* work_data;
+
+static void empty_job(void* arg)
+{
+	(void)arg;
+}
+
+static void work_range(void* arg, uint32_t begin, uint32_t end)
+{
+	(void)arg;
+	for (uint32_t i = begin; i < end; i++)
+	{
+		work_data[i] = sqrtf(work_data[i] * 1.0001f + i);
+	}
+}
+
+static void submit_empty(uint32_t count)
+{
+	JobCounter counter = {0};
+	for (uint32_t i = 0; i < count; i++)
+		job_submit(empty_job, NULL, &counter);
+	job_wait(&counter);
+}
+
+static void bench_overhead()
+{
+	const uint32_t count = 1024;
+	float t = BENCHMARK_TIME(100, submit_empty(count));
+	BENCHMARK_RESULT("submit + wait, empty job", "%f ns/job", t / count * 1e9);
+
+	JobCounter counter = {0};
+	t = BENCHMARK_TIME(10000, job_submit(empty_job, NULL, &counter); job_wait(&counter));
+	BENCHMARK_RESULT("single job round trip", "%f ns", t * 1e9);
+
+	t = BENCHMARK_TIME(10000, job_parallel_for(jobs_thread_count(), 1, work_range, NULL));
+	BENCHMARK_RESULT("parallel_for, one item per thread", "%f ns", t * 1e9);
+}
+
+static void bench_scaling()
+{
+	float base = 0;
+	uint32_t max_threads = jobs_thread_count();
+
+	// Restart the job system with an increasing number of threads
+	jobs_terminate();
+	for (uint32_t threads = 1;; threads = threads * 2 < max_threads ? threads * 2 : max_threads)
+	{
+		// Without workers the jobs run inline on the calling thread
+		if (threads > 1)
+			jobs_init(threads - 1);
+
+		float t = BENCHMARK_TIME(20, job_parallel_for(WORK_COUNT, 0, work_range, NULL));
+		if (threads == 1)
+			base = t;
+
+		char name[64];
+		snprintf(name, sizeof name, "parallel_for %d items, %d threads", WORK_COUNT, threads);
+		BENCHMARK_RESULT(name, "%f ms, speedup %f", t * 1000, base / t);
+
+		jobs_terminate();
+		if (threads == max_threads)
+			break;
+	}
+}
+
+void bench_jobs()
+{
+	jobs_init(0);
+	work_data = calloc(WORK_COUNT, sizeof *work_data);
+
+	bench_overhead();
+	bench_scaling();
+
+	free(work_data);
+}
@@ -0,0 +1,104 @@
+#include "benchmark.h"
+#include "physics.h"
+#include "jobs.h"
+#include <stdlib.h>
+
+// Towers of boxes standing on a static ground, each tower is an island
+#define TOWER_ROWS	 20
+#define TOWER_HEIGHT 5
+#define TOWER_SPACING 3.0f
+#define BODY_COUNT	 (TOWER_ROWS * TOWER_ROWS * TOWER_HEIGHT + 1)
+// Towers whose top moved further than this have fallen
+#define FALLEN_DISTANCE 0.25f
+
+static Transform* transforms;
+static Rigidbody* rigidbodies;
+static BoxCollider* boxes;
+static SphereCollider* bounds;
+static PhysicsBody* bodies;
+
+static void create_towers()
+{
+	float ground_width = TOWER_ROWS * TOWER_SPACING;
+	transforms[0] = (Transform){.position = {0, -1, 0}, .rotation = quat_identity, .scale = vec3_one};
+	rigidbodies[0] = rigidbody_create(0, vec3_zero, 0, 0.5f);
+	boxes[0] = boxcollider_create((vec3){ground_width, 1, ground_width}, vec3_zero, &transforms[0]);
+	bounds[0] = spherecollider_create(ground_width * 1.5f, vec3_zero, &transforms[0]);
+
+	vec3 halfwidth = {0.5f, 0.5f, 0.5f};
+	for (uint32_t i = 1; i < BODY_COUNT; i++)
+	{
+		int tower = (i - 1) / TOWER_HEIGHT;
+		int level = (i - 1) % TOWER_HEIGHT;
+		// Start slightly apart and offset so the towers settle
+		vec3 position = {(tower % TOWER_ROWS - TOWER_ROWS / 2) * TOWER_SPACING + (level % 2) * 0.05f, 0.5f + level * 1.02f,
+						 (tower / TOWER_ROWS - TOWER_ROWS / 2) * TOWER_SPACING};
+		transforms[i] = (Transform){.position = position, .rotation = quat_identity, .scale = vec3_one};
+		rigidbodies[i] = rigidbody_create(1, rigidbody_inertia_box(1, halfwidth), 0, 0.5f);
+		boxes[i] = boxcollider_create(halfwidth, vec3_zero, &transforms[i]);
+		bounds[i] = spherecollider_create(vec3_mag(halfwidth), vec3_zero, &transforms[i]);
+	}
+
+	for (uint32_t i = 0; i < BODY_COUNT; i++)
+		bodies[i] = (PhysicsBody){&rigidbodies[i], &transforms[i], &boxes[i].base, &bounds[i]};
+}
+
+static void bench_towers(uint32_t threads)
+{
+	create_towers();
+	Physics* physics = physics_create();
+
+	char name[64];
+	float t = BENCHMARK_TIME(60, physics_step(physics, bodies, BODY_COUNT, PHYSICS_TIMESTEP));
+	uint32_t contact_count = 0;
+	(void)physics_get_contacts(physics, &contact_count);
+	snprintf(name, sizeof name, "settling step, %d threads", threads);
+	BENCHMARK_RESULT(name, "%f ms, %d contacts, %d islands", t * 1000, contact_count, physics_get_island_count(physics));
+
+	// Resting towers fall asleep and only cost the broadphase
+	for (uint32_t i = 0; i < 120; i++)
+		physics_step(physics, bodies, BODY_COUNT, PHYSICS_TIMESTEP);
+	t = BENCHMARK_TIME(60, physics_step(physics, bodies, BODY_COUNT, PHYSICS_TIMESTEP));
+	snprintf(name, sizeof name, "resting step, %d threads", threads);
+	BENCHMARK_RESULT(name, "%f ms", t * 1000);
+
+	uint32_t asleep = 0;
+	uint32_t fallen = 0;
+	for (uint32_t i = 1; i < BODY_COUNT; i++)
+	{
+		asleep += rigidbodies[i].asleep;
+		if (i % TOWER_HEIGHT == 0)
+		{
+			vec3 start = {transforms[i - TOWER_HEIGHT + 1].position.x, 0, transforms[i - TOWER_HEIGHT + 1].position.z};
+			vec3 top = {transforms[i].position.x, 0, transforms[i].position.z};
+			fallen += vec3_sqrdistance(start, top) > FALLEN_DISTANCE * FALLEN_DISTANCE;
+		}
+	}
+	snprintf(name, sizeof name, "after 4 s, %d threads", threads);
+	BENCHMARK_RESULT(name, "%d of %d asleep, %d towers fallen", asleep, BODY_COUNT - 1, fallen);
+
+	physics_destroy(physics);
+}
+
+void bench_physics()
+{
+	transforms = malloc(BODY_COUNT * sizeof *transforms);
+	rigidbodies = malloc(BODY_COUNT * sizeof *rigidbodies);
+	boxes = malloc(BODY_COUNT * sizeof *boxes);
+	bounds = malloc(BODY_COUNT * sizeof *bounds);
+	bodies = malloc(BODY_COUNT * sizeof *bodies);
+
+	printf("%d towers of %d boxes\n", TOWER_ROWS * TOWER_ROWS, TOWER_HEIGHT);
+
+	// Without workers the islands are solved on the calling thread
+	bench_towers(1);
+	jobs_init(0);
+	bench_towers(jobs_thread_count());
+	jobs_terminate();
+
+	free(transforms);
+	free(rigidbodies);
+	free(boxes);
+	free(bounds);
+	free(bodies);
+}
@@ -0,0 +1,124 @@
+#include "benchmark.h"
+#include "scene.h"
+#include "graphics/rendertree.h"
+#include "jobs.h"
+#include <stdlib.h>
+
+#define ENTITY_COUNT 20000
+// Entities are spread in a cube of this halfwidth inside the root of the scene
+#define WORLD_HALFWIDTH 250.0f
+// A group of entities moves in and out of a small region, which splits the nodes there when inside
+#define GROUP_COUNT	 (RENDER_TREE_LIM * 2)
+#define GROUP_WIDTH	 10.0f
+#define GROUP_PERIOD 20
+#define FRAME_COUNT	 600
+// The split limits compared, the limit has been tuned between these by hand
+static const uint32_t limits[] = {128, RENDER_TREE_LIM, 700};
+
+static Entity** entities;
+static vec3* group_positions;
+
+// Returns the highest id of the nodes from node
+static uint32_t tree_max_id(RenderTreeNode* node)
+{
+	uint32_t id = node->id;
+	for (uint32_t i = 0; node->children[0] && i < 8; i++)
+	{
+		uint32_t child = tree_max_id(node->children[i]);
+		id = child > id ? child : id;
+	}
+	return id;
+}
+
+// Counts the nodes from node and those created after the node with id
+static uint32_t tree_count(RenderTreeNode* node, uint32_t id, uint32_t* created)
+{
+	uint32_t count = 1;
+	*created += node->id > id;
+	for (uint32_t i = 0; node->children[0] && i < 8; i++)
+		count += tree_count(node->children[i], id, created);
+	return count;
+}
+
+// Returns the bytes used by the nodes from node and their entity lists
+static size_t tree_memory(RenderTreeNode* node)
+{
+	size_t size = sizeof *node + node->entity_capacity * sizeof *node->entities;
+	for (uint32_t i = 0; node->children[0] && i < 8; i++)
+		size += tree_memory(node->children[i]);
+	return size;
+}
+
+// Builds the tree with each split limit
+static void bench_limits(Scene* scene)
+{
+	RenderTreeNode* root = scene_get_rendertree(scene);
+	char name[64];
+	for (uint32_t i = 0; i < sizeof limits / sizeof *limits; i++)
+	{
+		rendertree_set_limit(limits[i]);
+		float t = BENCHMARK_TIME(1, rendertree_build(root, entities, ENTITY_COUNT));
+		uint32_t created = 0;
+		uint32_t node_count = tree_count(root, UINT32_MAX, &created);
+		snprintf(name, sizeof name, "build, limit %d", limits[i]);
+		BENCHMARK_RESULT(name, "%f ms, %d nodes, %.0f KB", t * 1000, node_count, tree_memory(root) / 1024.0f);
+
+		t = BENCHMARK_TIME(60, rendertree_update(root, 0));
+		snprintf(name, sizeof name, "update, limit %d", limits[i]);
+		BENCHMARK_RESULT(name, "%f ms", t * 1000);
+	}
+	rendertree_set_limit(RENDER_TREE_LIM);
+	rendertree_build(root, entities, ENTITY_COUNT);
+}
+
+// Updates the tree while the group moves in and out every GROUP_PERIOD frames
+// Counts the nodes created, each of which means a split or merge recreating nodes
+static void bench_oscillating(Scene* scene)
+{
+	RenderTreeNode* root = scene_get_rendertree(scene);
+	uint32_t created = 0;
+	uint32_t node_count = 0;
+	float time = 0;
+	for (uint32_t frame = 0; frame < FRAME_COUNT; frame++)
+	{
+		bool inside = (frame / GROUP_PERIOD) % 2 == 0;
+		for (uint32_t i = 0; i < GROUP_COUNT; i++)
+			entity_get_transform(entities[i])->position = inside ? group_positions[i] : benchmark_random_vec3(-WORLD_HALFWIDTH, WORLD_HALFWIDTH);
+
+		uint32_t last_id = tree_max_id(root);
+		time += BENCHMARK_TIME(1, rendertree_update(root, frame % 3));
+		node_count = tree_count(root, last_id, &created);
+	}
+
+	BENCHMARK_RESULT("oscillating update", "%f ms", time / FRAME_COUNT * 1000);
+	BENCHMARK_RESULT("oscillating nodes created", "%d in %d frames, %d nodes", created, FRAME_COUNT, node_count);
+}
+
+void bench_rendertree()
+{
+	entities = malloc(ENTITY_COUNT * sizeof *entities);
+	group_positions = malloc(GROUP_COUNT * sizeof *group_positions);
+	Transform* transforms = malloc(ENTITY_COUNT * sizeof *transforms);
+	for (uint32_t i = 0; i < ENTITY_COUNT; i++)
+		transforms[i] = (Transform){.position = benchmark_random_vec3(-WORLD_HALFWIDTH, WORLD_HALFWIDTH), .rotation = quat_identity, .scale = vec3_one};
+	for (uint32_t i = 0; i < GROUP_COUNT; i++)
+		group_positions[i] = benchmark_random_vec3(100, 100 + GROUP_WIDTH);
+
+	printf("%d entities, %d moving in and out of a region every %d frames\n", ENTITY_COUNT, GROUP_COUNT, GROUP_PERIOD);
+
+	jobs_init(0);
+	// The entities have no mesh and are only placed in the tree, nothing is rendered
+	Scene* scene = scene_create("benchmark");
+	entity_create_batch("entity", INVALID(Material), NULL, transforms, NULL, ENTITY_COUNT, entities);
+
+	bench_limits(scene);
+	bench_oscillating(scene);
+
+	scene_destroy_entities(scene);
+	scene_destroy(scene);
+	jobs_terminate();
+
+	free(transforms);
+	free(group_positions);
+	free(entities);
+}
@@ -0,0 +1,101 @@
+#include "benchmark.h"
+#include "scenefile.h"
+#include "jobs.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define ENTITY_COUNT 1000000
+// Consecutive entities share a name, as when spawned in batches
+#define BATCH_SIZE		1000
+#define WORLD_HALFWIDTH 250.0f
+// The XML export is only timed for part of the entities
+#define XML_ENTITY_COUNT 10000
+#define SCENE_PATH		 "benchmark.scene"
+#define XML_PATH		 "benchmark.xml"
+
+static void create_entities(uint32_t count, Entity** entities)
+{
+	Transform* transforms = malloc(BATCH_SIZE * sizeof *transforms);
+	Rigidbody* rigidbodies = malloc(BATCH_SIZE * sizeof *rigidbodies);
+	for (uint32_t begin = 0; begin < count; begin += BATCH_SIZE)
+	{
+		for (uint32_t i = 0; i < BATCH_SIZE; i++)
+		{
+			transforms[i] = (Transform){.position = benchmark_random_vec3(-WORLD_HALFWIDTH, WORLD_HALFWIDTH), .rotation = quat_identity, .scale = vec3_one};
+			rigidbodies[i] = rigidbody_create(1, vec3_one, 0.5f, 0.5f);
+			rigidbodies[i].velocity = benchmark_random_vec3(-1, 1);
+		}
+
+		char name[64];
+		snprintf(name, sizeof name, "batch %d", begin / BATCH_SIZE);
+		// The entities have no mesh, so no assets need to be loaded
+		entity_create_batch(name, INVALID(Material), NULL, transforms, rigidbodies, BATCH_SIZE, entities + begin);
+		for (uint32_t i = begin; i < begin + BATCH_SIZE; i++)
+			entity_set_color(entities[i], (vec4){benchmark_random(0, 1), benchmark_random(0, 1), benchmark_random(0, 1), 1});
+	}
+	free(transforms);
+	free(rigidbodies);
+}
+
+// Returns the number of entities whose data differs between the scenes
+static uint32_t compare_scenes(Scene* a, Scene* b)
+{
+	uint32_t count = scene_get_entity_count(a);
+	if (scene_get_entity_count(b) != count)
+		return count;
+
+	uint32_t differences = 0;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		Entity* ea = scene_get_entity(a, i);
+		Entity* eb = scene_get_entity(b, i);
+		const Transform* ta = entity_get_transform(ea);
+		const Transform* tb = entity_get_transform(eb);
+		vec4 ca = entity_get_color(ea);
+		vec4 cb = entity_get_color(eb);
+		differences += strcmp(entity_get_name(ea), entity_get_name(eb)) != 0 || memcmp(&ta->position, &tb->position, sizeof ta->position) != 0 ||
+					   memcmp(&entity_get_rigidbody(ea)->velocity, &entity_get_rigidbody(eb)->velocity, sizeof(vec3)) != 0 ||
+					   memcmp(&ca, &cb, sizeof ca) != 0;
+	}
+	return differences;
+}
+
+void bench_scenefile()
+{
+	Entity** entities = malloc(ENTITY_COUNT * sizeof *entities);
+	printf("%d entities in batches of %d\n", ENTITY_COUNT, BATCH_SIZE);
+
+	jobs_init(0);
+	Scene* previous = scene_get_current();
+	Scene* scene = scene_create("benchmark");
+	(void)scene_set_current(scene);
+	create_entities(ENTITY_COUNT, entities);
+
+	float t = BENCHMARK_TIME(1, scene_save(scene, SCENE_PATH));
+	BENCHMARK_RESULT("save", "%f ms", t * 1000);
+
+	Scene* loaded = scene_create("loaded");
+	t = BENCHMARK_TIME(1, scene_load(loaded, SCENE_PATH));
+	BENCHMARK_RESULT("load", "%f ms", t * 1000);
+	BENCHMARK_RESULT("loaded entities differing", "%d of %d", compare_scenes(scene, loaded), scene_get_entity_count(loaded));
+
+	scene_destroy_entities(loaded);
+	scene_destroy(loaded);
+	scene_destroy_entities(scene);
+
+	// The XML export of a smaller scene, for comparison
+	create_entities(XML_ENTITY_COUNT, entities);
+	t = BENCHMARK_TIME(1, scene_save(scene, SCENE_PATH));
+	BENCHMARK_RESULT("save, 10000 entities", "%f ms", t * 1000);
+	t = BENCHMARK_TIME(1, scene_export_xml(scene, XML_PATH));
+	BENCHMARK_RESULT("xml export, 10000 entities", "%f ms", t * 1000);
+
+	(void)scene_set_current(previous);
+	scene_destroy_entities(scene);
+	scene_destroy(scene);
+	jobs_terminate();
+
+	remove(SCENE_PATH);
+	remove(XML_PATH);
+	free(entities);
+}
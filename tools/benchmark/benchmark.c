@@ -0,0 +1,56 @@
+#include "benchmark.h"
+#include "log.h"
+#include <stdlib.h>
+#include <string.h>
+
+static struct
+{
+	const char* name;
+	BenchmarkFunc func;
+} suites[] = {
+	{"jobs", bench_jobs},
+	{"broadphase", bench_broadphase},
+	{"physics", bench_physics},
+	{"rendertree", bench_rendertree},
+	{"scenefile", bench_scenefile},
+};
+
+float benchmark_random(float min, float max)
+{
+	return min + rand() / (float)RAND_MAX * (max - min);
+}
+
+vec3 benchmark_random_vec3(float min, float max)
+{
+	float x = benchmark_random(min, max);
+	float y = benchmark_random(min, max);
+	float z = benchmark_random(min, max);
+	return (vec3){x, y, z};
+}
+
+// Runs the benchmark suites
+// Usage: benchmark [suite...]
+// Runs all suites if none are given
+int main(int argc, char** argv)
+{
+	log_init();
+
+	for (size_t i = 0; i < sizeof suites / sizeof *suites; i++)
+	{
+		int selected = argc < 2;
+		for (int j = 1; j < argc; j++)
+		{
+			if (strcmp(argv[j], suites[i].name) == 0)
+				selected = 1;
+		}
+
+		if (!selected)
+			continue;
+
+		printf("%s\n", suites[i].name);
+		suites[i].func();
+	}
+
+	log_terminate();
+	return 0;
+}
@@ -0,0 +1,36 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include "timer.h"
+#include "math/vec.h"
+#include <stdio.h>
+
+// A benchmark suite is a function that runs its cases and prints the results
+typedef void (*BenchmarkFunc)();
+
+// Runs func iterations times and returns the average time of an iteration in seconds
+#define BENCHMARK_TIME(iterations, func)                 \
+	({                                                   \
+		Timer _timer = timer_start(CT_WALL_TICKS);       \
+		for (uint32_t _i = 0; _i < (iterations); _i++) \
+		{                                                \
+			func;                                        \
+		}                                                \
+		timer_stop(&_timer) / (iterations);              \
+	})
+
+// Prints a result row
+#define BENCHMARK_RESULT(name, fmt, ...) printf("  %-40s " fmt "\n", name, ##__VA_ARGS__)
+
+// Returns a random number in [min, max] from rand
+float benchmark_random(float min, float max);
+// Returns a point with each coordinate random in [min, max]
+vec3 benchmark_random_vec3(float min, float max);
+
+void bench_jobs();
+void bench_broadphase();
+void bench_physics();
+void bench_rendertree();
+void bench_scenefile();
+
+#endif
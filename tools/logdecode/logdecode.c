@@ -0,0 +1,43 @@
+#include "log.h"
+#include <stdio.h>
+
+// Decodes a binary log file written with LOG_MODE_BINARY into text
+// Usage: logdecode <file.blog> [output]
+// Writes to stdout if no output is given
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		fprintf(stderr, "Usage: %s <file.blog> [output]\n", argv[0]);
+		return 1;
+	}
+
+	FILE* in = fopen(argv[1], "rb");
+	if (in == NULL)
+	{
+		fprintf(stderr, "Failed to open %s\n", argv[1]);
+		return 1;
+	}
+
+	FILE* out = stdout;
+	if (argc > 2)
+	{
+		out = fopen(argv[2], "w");
+		if (out == NULL)
+		{
+			fprintf(stderr, "Failed to open %s\n", argv[2]);
+			fclose(in);
+			return 1;
+		}
+	}
+
+	int result = log_decode(in, out);
+	if (result != 0)
+		fprintf(stderr, "%s is not a valid binary log or is truncated\n", argv[1]);
+
+	fclose(in);
+	if (out != stdout)
+		fclose(out);
+
+	return result != 0;
+}